@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "slam/types.h"
+#include "slam/utils_g2o.h"
+
+/*
+ * Time from a g2o file on disk to timesteps and ground truth associations in memory, for every file in a directory
+ * (data/g2o/3d_garage unless given), with readG2owithLmks, findFactors and convert_into_timesteps as the main
+ * used to, and with the single pass readG2oDataset.
+ */
+
+double median(std::vector<double> latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  return latencies[latencies.size() / 2];
+}
+
+size_t load_legacy(const std::string &g2o_file)
+{
+  gtsam::NonlinearFactorGraph::shared_ptr graph;
+  gtsam::Values::shared_ptr initial;
+  boost::tie(graph, initial) = gtsam::readG2owithLmks(g2o_file, true, "none");
+  std::vector<boost::shared_ptr<gtsam::PoseToPointFactor<gtsam::Pose2, gtsam::Point2>>> meas2d;
+  std::vector<boost::shared_ptr<gtsam::PoseToPointFactor<gtsam::Pose3, gtsam::Point3>>> meas3d;
+  std::vector<boost::shared_ptr<gtsam::BetweenFactor<gtsam::Pose2>>> odom2d;
+  std::vector<boost::shared_ptr<gtsam::BetweenFactor<gtsam::Pose3>>> odom3d;
+  gtsam::findFactors(odom2d, odom3d, meas2d, meas3d, graph);
+  std::vector<slam::Timestep3D> timesteps = convert_into_timesteps(odom3d, meas3d);
+  std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(meas3d, timesteps);
+  return timesteps.size() + meas_lmk_assos.size();
+}
+
+size_t load_dataset(const std::string &g2o_file)
+{
+  slam::G2oDataset3D dataset = slam::readG2oDataset<gtsam::Pose3, gtsam::Point3>(g2o_file);
+  std::vector<slam::Timestep3D> timesteps = dataset.timesteps();
+  std::map<uint64_t, gtsam::Key> meas_lmk_assos = dataset.measurementLandmarkAssociations();
+  return timesteps.size() + meas_lmk_assos.size();
+}
+
+template <class LOAD>
+std::vector<double> time_loading(LOAD load, const std::string &g2o_file, int repetitions, size_t &checksum)
+{
+  std::vector<double> latencies;
+  for (int r = 0; r < repetitions; r++)
+  {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    checksum = load(g2o_file);
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    latencies.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+  }
+  return latencies;
+}
+
+int main(int argc, char **argv)
+{
+  std::string dir = argc > 1 ? argv[1] : std::string(G2O_DATA_DIR) + "/3d_garage";
+  int repetitions = argc > 2 ? std::stoi(argv[2]) : 10;
+
+  std::vector<std::string> files;
+  for (const auto &entry : std::filesystem::directory_iterator(dir))
+  {
+    if (entry.path().extension() == ".g2o")
+    {
+      files.push_back(entry.path().string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  for (const std::string &file : files)
+  {
+    size_t legacy_checksum = 0;
+    size_t dataset_checksum = 0;
+    std::vector<double> legacy = time_loading(load_legacy, file, repetitions, legacy_checksum);
+    std::vector<double> dataset = time_loading(load_dataset, file, repetitions, dataset_checksum);
+    std::cout << std::filesystem::path(file).filename().string() << ":\n"
+              << "  readG2owithLmks + findFactors + convert_into_timesteps: median " << median(legacy) << " ms, max "
+              << *std::max_element(legacy.begin(), legacy.end()) << " ms\n"
+              << "  readG2oDataset: median " << median(dataset) << " ms, max "
+              << *std::max_element(dataset.begin(), dataset.end()) << " ms\n"
+              << "  speedup " << median(legacy) / median(dataset) << "x"
+              << (legacy_checksum == dataset_checksum ? "" : ", but the two disagree on the number of timesteps and measurements")
+              << "\n";
+  }
+}
@@ -0,0 +1,126 @@
+#include <Eigen/Core>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include "data_association/DataAssociation.h"
+#include "data_association/InnovationEngine.h"
+
+/*
+ * Pairs per second of individual compatibility, one pair at a time with CompatibilityKernel
+ * versus all pairs at once with InnovationEngine.
+ */
+
+template <class POSE, class POINT>
+struct Problem
+{
+  static constexpr int PoseDim = POSE::dimension;
+  static constexpr int PointDim = POINT::RowsAtCompileTime;
+  using Kernel = da::CompatibilityKernel<POSE, POINT>;
+
+  POSE x;
+  Eigen::Matrix<double, PoseDim, PoseDim> Pxx;
+  std::vector<POINT> z, l;
+  std::vector<typename Kernel::JointCovariance> P;
+  POINT noise_variance;
+};
+
+template <class POSE, class POINT>
+Problem<POSE, POINT> make_problem(const POSE &x, size_t num_pairs, std::mt19937 &rng)
+{
+  using P = Problem<POSE, POINT>;
+  std::uniform_real_distribution<double> uniform(-10.0, 10.0);
+
+  P problem;
+  problem.x = x;
+  problem.noise_variance = POINT::Constant(0.01);
+
+  Eigen::Matrix<double, P::PoseDim, P::PoseDim> A = Eigen::Matrix<double, P::PoseDim, P::PoseDim>::Random();
+  problem.Pxx = A * A.transpose() * 0.01 + Eigen::Matrix<double, P::PoseDim, P::PoseDim>::Identity() * 0.1;
+
+  for (size_t i = 0; i < num_pairs; i++)
+  {
+    POINT l;
+    for (int k = 0; k < P::PointDim; k++)
+    {
+      l(k) = uniform(rng);
+    }
+    problem.l.push_back(l);
+    problem.z.push_back(x.transformTo(l) + POINT::Constant(0.1));
+
+    typename P::Kernel::JointCovariance Pjoint = P::Kernel::JointCovariance::Identity() * 0.5;
+    Pjoint.template topLeftCorner<P::PoseDim, P::PoseDim>() = problem.Pxx;
+    problem.P.push_back(Pjoint);
+  }
+
+  return problem;
+}
+
+template <class POSE, class POINT>
+void benchmark(const std::string &name, const POSE &x, size_t num_pairs, int repetitions)
+{
+  using P = Problem<POSE, POINT>;
+  using Kernel = typename P::Kernel;
+
+  std::mt19937 rng(42);
+  P problem = make_problem<POSE, POINT>(x, num_pairs, rng);
+
+  double checksum_kernel = 0.0, checksum_engine = 0.0;
+
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  for (int r = 0; r < repetitions; r++)
+  {
+    typename Kernel::JacobianPose Hx;
+    typename Kernel::JacobianPoint Hl;
+    typename Kernel::Covariance R = problem.noise_variance.asDiagonal();
+    for (size_t i = 0; i < num_pairs; i++)
+    {
+      typename Kernel::Innovation e = Kernel::innovation(problem.x, problem.l[i], problem.z[i], Hx, Hl);
+      typename Kernel::Covariance S = Kernel::innovationCovariance(Hx, Hl, problem.P[i], R);
+      double log_det;
+      checksum_kernel += Kernel::nis(S, e, &log_det) + log_det;
+    }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double kernel_s = std::chrono::duration<double>(end - begin).count();
+
+  da::InnovationEngine<POSE, POINT> engine;
+  engine.reserve(num_pairs);
+  begin = std::chrono::steady_clock::now();
+  for (int r = 0; r < repetitions; r++)
+  {
+    engine.reset(problem.x, problem.Pxx);
+    for (size_t i = 0; i < num_pairs; i++)
+    {
+      engine.add(i, i, problem.z[i], problem.noise_variance, problem.l[i],
+                 problem.P[i].template topRightCorner<P::PoseDim, P::PointDim>(),
+                 problem.P[i].template bottomRightCorner<P::PointDim, P::PointDim>());
+    }
+    engine.evaluate();
+    checksum_engine += (engine.nis() + engine.logDet()).sum();
+  }
+  end = std::chrono::steady_clock::now();
+  double engine_s = std::chrono::duration<double>(end - begin).count();
+
+  double total_pairs = double(num_pairs) * repetitions;
+  std::cout << name << ", " << num_pairs << " pairs:\n"
+            << "  kernel: " << total_pairs / kernel_s << " pairs/s\n"
+            << "  engine: " << total_pairs / engine_s << " pairs/s\n"
+            << "  checksum difference: " << std::abs(checksum_kernel - checksum_engine) / std::abs(checksum_kernel) << "\n";
+}
+
+int main(int argc, char **argv)
+{
+  int repetitions = argc > 1 ? std::stoi(argv[1]) : 100;
+
+  for (size_t num_pairs : {100, 1'000, 10'000})
+  {
+    benchmark<gtsam::Pose2, gtsam::Point2>("2D", gtsam::Pose2(1.0, -2.0, 0.3), num_pairs, repetitions);
+    benchmark<gtsam::Pose3, gtsam::Point3>("3D", gtsam::Pose3(gtsam::Rot3::RzRyRx(0.1, -0.2, 0.3), gtsam::Point3(1.0, -2.0, 0.5)), num_pairs, repetitions);
+  }
+}
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "data_association/Murty.h"
+#include "data_association/SparseAssignment.h"
+
+/*
+ * Latency of finding the K best assignments with Murty's method, for a few scan sizes and K,
+ * on random problems with a few candidate landmarks per measurement, as after gating in MaximumLikelihood.
+ */
+
+da::SparseCostMatrix make_problem(int num_meas, int num_lmks, int candidates_per_meas, std::mt19937 &rng)
+{
+  std::uniform_real_distribution<double> uniform_cost(0.0, 15.0);
+  std::uniform_int_distribution<int> uniform_lmk(0, num_lmks - 1);
+
+  std::vector<da::SparseCostMatrix::Entry> entries;
+  for (int m = 0; m < num_meas; m++)
+  {
+    std::vector<int> lmks;
+    for (int c = 0; c < candidates_per_meas; c++)
+    {
+      lmks.push_back(uniform_lmk(rng));
+    }
+    std::sort(lmks.begin(), lmks.end());
+    lmks.erase(std::unique(lmks.begin(), lmks.end()), lmks.end());
+    for (int l : lmks)
+    {
+      entries.push_back({m, l, uniform_cost(rng)});
+    }
+  }
+  return da::SparseCostMatrix(num_meas, num_lmks, entries);
+}
+
+void benchmark(int num_meas, int num_lmks, int candidates_per_meas, int repetitions)
+{
+  const double unassigned_cost = 10.0;
+
+  std::mt19937 rng(42);
+  std::vector<da::SparseCostMatrix> problems;
+  for (int r = 0; r < repetitions; r++)
+  {
+    problems.push_back(make_problem(num_meas, num_lmks, candidates_per_meas, rng));
+  }
+
+  std::cout << num_meas << " measurements, " << num_lmks << " landmarks, " << candidates_per_meas << " candidates per measurement:\n";
+  for (int k : {1, 2, 5, 10, 20, 50, 100})
+  {
+    std::vector<double> latencies;
+    double checksum = 0.0;
+    for (const da::SparseCostMatrix &problem : problems)
+    {
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      std::vector<da::RankedAssignment> ranked = da::murty(problem, unassigned_cost, k);
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      latencies.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+      checksum += ranked.back().cost;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "  K = " << k << ": median " << latencies[latencies.size() / 2] << " µs, max " << latencies.back()
+              << " µs (checksum " << checksum << ")\n";
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int repetitions = argc > 1 ? std::stoi(argv[1]) : 20;
+
+  benchmark(10, 20, 3, repetitions);
+  benchmark(30, 60, 3, repetitions);
+  benchmark(100, 200, 3, repetitions);
+}
@@ -0,0 +1,463 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "slam/slam.h"
+#include "slam/timestep_source.h"
+#include "slam/types.h"
+#include "slam/utils_g2o.h"
+#include "data_association/DataAssociation.h"
+#include "data_association/ml/MaximumLikelihood.h"
+#include "data_association/gt/KnownDataAssociation.h"
+#include "data_association/jcbb/JCBB.h"
+
+/*
+ * Single hypothesis SLAM end to end over every g2o file under a directory (data/g2o unless given), with every
+ * association method and optimizer unless told which, optimizing after every timestep with measurements unless told
+ * which optimization policies to run with, writing per run
+ *   - the latency of each timestep, and its mean, p50, p90, p99 and max
+ *   - wall time of the run, including the final optimization
+ *   - peak resident set size during the run (Linux, from /proc/self/status)
+ *   - graph error of the final estimates
+ *   - association accuracy against the ground truth landmarks of the measurements
+ * to <output prefix>.json and <output prefix>.csv, rewritten after every run so a crash keeps the runs before it.
+ *
+ *   benchmark_slam [data dir] [output prefix] [association methods] [optimizers] [optimization policies]
+ *   benchmark_slam data/g2o/3d_garage garage MaximumLikelihood,JCBB ISAM2,FixedLag MeasurementSteps,EveryN
+ */
+
+using gtsam::symbol_shorthand::L;
+
+constexpr double IC_PROB = 0.99;
+constexpr double JC_PROB = 0.95;
+
+struct RunResult
+{
+  std::string dataset;
+  std::string association;
+  std::string optimizer;
+  std::string policy;
+  std::string status = "ok";
+  size_t timesteps = 0;
+  size_t measurements = 0;
+  size_t landmarks = 0;
+  std::vector<double> latencies; // Milliseconds, one per timestep processed
+  double wall_time = 0.0;        // Seconds
+  double peak_rss = std::numeric_limits<double>::quiet_NaN(); // MB
+  double final_error = std::numeric_limits<double>::quiet_NaN();
+  // Measurements associated with a landmark of their ground truth landmark, or making a new landmark when there is none
+  size_t correct = 0;
+  // Associated with a landmark of another ground truth landmark
+  size_t wrong = 0;
+  // Left unassociated although their ground truth landmark was mapped, duplicating it
+  size_t missed = 0;
+};
+
+/*
+ * Follows which ground truth landmark each landmark of the map was made from, naming new landmarks the way SLAM does,
+ * L(0), L(1), ... in the order of the unassociated measurements of the hypotheses.
+ */
+template <class POINT>
+class AssociationScore
+{
+private:
+  const std::map<uint64_t, gtsam::Key> &meas_lmk_assos_;
+  std::unordered_map<gtsam::Key, gtsam::Key> map_to_gt_;
+  std::unordered_map<gtsam::Key, gtsam::Key> gt_to_map_; // The latest landmark made of each ground truth landmark
+  uint64_t next_landmark_ = 0;
+
+public:
+  explicit AssociationScore(const std::map<uint64_t, gtsam::Key> &meas_lmk_assos) : meas_lmk_assos_(meas_lmk_assos) {}
+
+  // Scores the latest hypothesis, once added
+  void add(const da::hypothesis::Hypothesis &h, const slam::Measurements<POINT> &measurements,
+           const slam::KeyRegistry<POINT> &registry, RunResult &result)
+  {
+    std::vector<std::pair<gtsam::Key, gtsam::Key>> made;
+    for (const auto &a : h.associations())
+    {
+      const gtsam::Key gt = meas_lmk_assos_.at(measurements[a->measurement].idx);
+      auto mapped = gt_to_map_.find(gt);
+      // Landmarks marginalized out of a fixed-lag window can not be associated with anymore
+      const bool gt_mapped = mapped != gt_to_map_.end() && registry.hasLandmark(mapped->second);
+      if (a->associated())
+      {
+        auto it = map_to_gt_.find(*a->landmark);
+        if (it != map_to_gt_.end() && it->second == gt)
+        {
+          result.correct++;
+        }
+        else
+        {
+          result.wrong++;
+        }
+      }
+      else
+      {
+        if (gt_mapped)
+        {
+          result.missed++;
+        }
+        else
+        {
+          result.correct++;
+        }
+        made.push_back({L(next_landmark_++), gt});
+      }
+    }
+    // Only mapped once the whole timestep is added, as measurements of a timestep can not be associated with each other
+    for (const auto &[l, gt] : made)
+    {
+      map_to_gt_[l] = gt;
+      gt_to_map_[gt] = l;
+    }
+  }
+};
+
+// Clears the peak resident set size of the process, so the next peakRss is of what follows. False if not supported.
+bool resetPeakRss()
+{
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  return bool(clear_refs);
+}
+
+// Peak resident set size in MB since the process started or the last resetPeakRss, NaN if not known
+double peakRss()
+{
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.rfind("VmHWM:", 0) == 0)
+    {
+      return std::stod(line.substr(6)) / 1024.0;
+    }
+  }
+  return std::numeric_limits<double>::quiet_NaN();
+}
+
+template <class T>
+std::string toString(const T &value)
+{
+  std::ostringstream os;
+  os << value;
+  return os.str();
+}
+
+// Nearest rank, of sorted latencies
+double percentile(const std::vector<double> &sorted, double p)
+{
+  if (sorted.empty())
+  {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  size_t rank = std::max<size_t>(1, std::ceil(p * sorted.size()));
+  return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+template <class POSE, class POINT>
+std::shared_ptr<da::DataAssociation<slam::Measurement<POINT>>> makeDataAssociation(
+    da::AssociationMethod method, const std::map<uint64_t, gtsam::Key> &meas_lmk_assos)
+{
+  switch (method)
+  {
+  case da::AssociationMethod::MaximumLikelihood:
+    return std::make_shared<da::ml::MaximumLikelihood<POSE, POINT>>(std::sqrt(da::chi2inv(IC_PROB, POINT::RowsAtCompileTime)));
+  case da::AssociationMethod::KnownDataAssociation:
+    return std::make_shared<da::gt::KnownDataAssociation<POSE, POINT>>(meas_lmk_assos);
+  case da::AssociationMethod::JCBB:
+    return std::make_shared<da::jcbb::JCBB<POSE, POINT>>(IC_PROB, JC_PROB);
+  }
+  throw std::invalid_argument("Unknown association method");
+}
+
+template <class POSE, class POINT>
+gtsam::Vector posePriorNoise();
+
+template <>
+gtsam::Vector posePriorNoise<gtsam::Pose2, gtsam::Point2>()
+{
+  return gtsam::Vector3(1e-6, 1e-6, 1e-8).array().sqrt().matrix();
+}
+
+template <>
+gtsam::Vector posePriorNoise<gtsam::Pose3, gtsam::Point3>()
+{
+  return (gtsam::Vector(6) << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4).finished().array().sqrt().matrix();
+}
+
+template <class POSE, class POINT>
+void run(const std::shared_ptr<const slam::G2oDataset<POSE, POINT>> &dataset, da::AssociationMethod method,
+         slam::OptimizationMethod optimizer, slam::OptimizationPolicy optimization_policy, RunResult &result)
+{
+  const std::map<uint64_t, gtsam::Key> meas_lmk_assos = dataset->measurementLandmarkAssociations();
+  slam::G2oTimestepSource<POSE, POINT> timesteps(dataset);
+  AssociationScore<POINT> score(meas_lmk_assos);
+  result.latencies.reserve(timesteps.size());
+
+  if (!resetPeakRss())
+  {
+    std::cout << "  Could not reset the peak resident set size, it is of the whole process\n";
+  }
+  std::chrono::steady_clock::time_point run_begin = std::chrono::steady_clock::now();
+
+  slam::SLAM<POSE, POINT> slam_sys{};
+  slam_sys.initialize(posePriorNoise<POSE, POINT>(), makeDataAssociation<POSE, POINT>(method, meas_lmk_assos), optimizer);
+  slam::OptimizationPolicyParams policy;
+  policy.policy = optimization_policy;
+  slam_sys.setOptimizationPolicy(policy);
+
+  try
+  {
+    while (auto timestep = timesteps.next())
+    {
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      slam_sys.processTimestep(*timestep);
+      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+      result.latencies.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+      result.timesteps++;
+      result.measurements += timestep->measurements.size();
+      if (!timestep->measurements.empty())
+      {
+        score.add(slam_sys.latestHypothesis(), timestep->measurements, slam_sys.registry(), result);
+      }
+    }
+    slam_sys.optimizePending();
+    result.final_error = slam_sys.error();
+  }
+  catch (const std::exception &e)
+  {
+    result.status = std::string("failed: ") + e.what();
+  }
+
+  result.wall_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_begin).count();
+  result.peak_rss = peakRss();
+  result.landmarks = slam_sys.registry().numLandmarks();
+}
+
+std::string jsonNumber(double value)
+{
+  if (!std::isfinite(value))
+  {
+    return "null";
+  }
+  std::ostringstream os;
+  os << std::setprecision(10) << value;
+  return os.str();
+}
+
+std::string jsonString(const std::string &s)
+{
+  std::string escaped = "\"";
+  for (char c : s)
+  {
+    if (c == '"' || c == '\\')
+    {
+      escaped += '\\';
+      escaped += c;
+    }
+    else if (c == '\n')
+    {
+      escaped += "\\n";
+    }
+    else
+    {
+      escaped += c;
+    }
+  }
+  return escaped + "\"";
+}
+
+struct LatencySummary
+{
+  double mean, p50, p90, p99, max;
+};
+
+LatencySummary summarize(const std::vector<double> &latencies)
+{
+  std::vector<double> sorted = latencies;
+  std::sort(sorted.begin(), sorted.end());
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  return {sorted.empty() ? nan : std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size(),
+          percentile(sorted, 0.5), percentile(sorted, 0.9), percentile(sorted, 0.99), sorted.empty() ? nan : sorted.back()};
+}
+
+double accuracy(const RunResult &r)
+{
+  return r.measurements > 0 ? double(r.correct) / r.measurements : std::numeric_limits<double>::quiet_NaN();
+}
+
+void writeJson(const std::string &filename, const std::string &data_dir, const std::vector<RunResult> &results)
+{
+  std::ofstream os(filename);
+  os << "{\n  \"data_dir\": " << jsonString(data_dir) << ",\n  \"ic_prob\": " << IC_PROB << ",\n  \"jc_prob\": " << JC_PROB
+     << ",\n  \"runs\": [";
+  for (size_t i = 0; i < results.size(); i++)
+  {
+    const RunResult &r = results[i];
+    const LatencySummary latency = summarize(r.latencies);
+    os << (i == 0 ? "" : ",") << "\n    {\n"
+       << "      \"dataset\": " << jsonString(r.dataset) << ",\n"
+       << "      \"association\": " << jsonString(r.association) << ",\n"
+       << "      \"optimizer\": " << jsonString(r.optimizer) << ",\n"
+       << "      \"optimization_policy\": " << jsonString(r.policy) << ",\n"
+       << "      \"status\": " << jsonString(r.status) << ",\n"
+       << "      \"timesteps\": " << r.timesteps << ",\n"
+       << "      \"measurements\": " << r.measurements << ",\n"
+       << "      \"landmarks\": " << r.landmarks << ",\n"
+       << "      \"wall_time_s\": " << jsonNumber(r.wall_time) << ",\n"
+       << "      \"peak_rss_mb\": " << jsonNumber(r.peak_rss) << ",\n"
+       << "      \"final_error\": " << jsonNumber(r.final_error) << ",\n"
+       << "      \"association_accuracy\": " << jsonNumber(accuracy(r)) << ",\n"
+       << "      \"correct\": " << r.correct << ",\n"
+       << "      \"wrong\": " << r.wrong << ",\n"
+       << "      \"missed\": " << r.missed << ",\n"
+       << "      \"latency_ms\": {\"mean\": " << jsonNumber(latency.mean) << ", \"p50\": " << jsonNumber(latency.p50)
+       << ", \"p90\": " << jsonNumber(latency.p90) << ", \"p99\": " << jsonNumber(latency.p99) << ", \"max\": " << jsonNumber(latency.max) << "},\n"
+       << "      \"timestep_latencies_ms\": [";
+    for (size_t t = 0; t < r.latencies.size(); t++)
+    {
+      os << (t == 0 ? "" : ", ") << jsonNumber(r.latencies[t]);
+    }
+    os << "]\n    }";
+  }
+  os << "\n  ]\n}\n";
+}
+
+void writeCsv(const std::string &filename, const std::vector<RunResult> &results)
+{
+  std::ofstream os(filename);
+  os << "dataset,association,optimizer,optimization_policy,status,timesteps,measurements,landmarks,wall_time_s,peak_rss_mb,final_error,"
+        "association_accuracy,correct,wrong,missed,latency_mean_ms,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms\n";
+  os << std::setprecision(10);
+  for (const RunResult &r : results)
+  {
+    const LatencySummary latency = summarize(r.latencies);
+    // Statuses are the only field that may hold commas, from exception messages
+    std::string status = r.status;
+    std::replace(status.begin(), status.end(), ',', ';');
+    std::replace(status.begin(), status.end(), '\n', ' ');
+    os << r.dataset << "," << r.association << "," << r.optimizer << "," << r.policy << "," << status << "," << r.timesteps << "," << r.measurements << ","
+       << r.landmarks << "," << r.wall_time << "," << r.peak_rss << "," << r.final_error << "," << accuracy(r) << "," << r.correct << ","
+       << r.wrong << "," << r.missed << "," << latency.mean << "," << latency.p50 << "," << latency.p90 << "," << latency.p99 << ","
+       << latency.max << "\n";
+  }
+}
+
+// Comma separated names, each the name operator<< gives one of the values
+template <class T>
+std::vector<T> parseList(const std::string &list, const std::vector<T> &all)
+{
+  std::vector<T> chosen;
+  std::stringstream ss(list);
+  std::string name;
+  while (std::getline(ss, name, ','))
+  {
+    auto it = std::find_if(all.begin(), all.end(), [&](const T &value)
+                           { return toString(value) == name; });
+    if (it == all.end())
+    {
+      throw std::invalid_argument("Unknown name " + name);
+    }
+    chosen.push_back(*it);
+  }
+  return chosen;
+}
+
+int main(int argc, char **argv)
+{
+  const std::string data_dir = argc > 1 ? argv[1] : G2O_DATA_DIR;
+  const std::string output_prefix = argc > 2 ? argv[2] : "benchmark_slam";
+
+  const std::vector<da::AssociationMethod> all_methods{
+      da::AssociationMethod::MaximumLikelihood, da::AssociationMethod::KnownDataAssociation, da::AssociationMethod::JCBB};
+  const std::vector<slam::OptimizationMethod> all_optimizers{
+      slam::OptimizationMethod::GaussNewton, slam::OptimizationMethod::LevenbergMarquardt, slam::OptimizationMethod::ISAM2,
+      slam::OptimizationMethod::FixedLag};
+  const std::vector<da::AssociationMethod> methods = argc > 3 ? parseList(argv[3], all_methods) : all_methods;
+  const std::vector<slam::OptimizationMethod> optimizers = argc > 4 ? parseList(argv[4], all_optimizers) : all_optimizers;
+  const std::vector<slam::OptimizationPolicy> all_policies{
+      slam::OptimizationPolicy::Always, slam::OptimizationPolicy::MeasurementSteps, slam::OptimizationPolicy::EveryN,
+      slam::OptimizationPolicy::Keyframe, slam::OptimizationPolicy::ErrorIncrease};
+  const std::vector<slam::OptimizationPolicy> policies =
+      argc > 5 ? parseList(argv[5], all_policies) : std::vector<slam::OptimizationPolicy>{slam::OptimizationPolicy::MeasurementSteps};
+
+  std::vector<std::string> files;
+  for (const auto &entry : std::filesystem::recursive_directory_iterator(data_dir))
+  {
+    if (entry.is_regular_file() && entry.path().extension() == ".g2o")
+    {
+      files.push_back(entry.path().string());
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::vector<RunResult> results;
+  for (const std::string &file : files)
+  {
+    const std::string dataset_name = std::filesystem::relative(file, data_dir).string();
+    // Loaded once for all runs over it, before the peak resident set size is reset
+    std::shared_ptr<const slam::G2oDataset2D> dataset2d;
+    std::shared_ptr<const slam::G2oDataset3D> dataset3d;
+    if (slam::isG2o3D(file))
+    {
+      dataset3d = std::make_shared<const slam::G2oDataset3D>(slam::readG2oDataset<gtsam::Pose3, gtsam::Point3>(file));
+    }
+    else
+    {
+      dataset2d = std::make_shared<const slam::G2oDataset2D>(slam::readG2oDataset<gtsam::Pose2, gtsam::Point2>(file));
+    }
+
+    for (da::AssociationMethod method : methods)
+    {
+      for (slam::OptimizationMethod optimizer : optimizers)
+      {
+        for (slam::OptimizationPolicy policy : policies)
+        {
+          RunResult result;
+          result.dataset = dataset_name;
+          result.association = toString(method);
+          result.optimizer = toString(optimizer);
+          result.policy = toString(policy);
+          std::cout << dataset_name << ", " << method << ", " << optimizer << ", " << policy << std::endl;
+
+          if (dataset3d)
+          {
+            run(dataset3d, method, optimizer, policy, result);
+          }
+          else
+          {
+            run(dataset2d, method, optimizer, policy, result);
+          }
+
+          const LatencySummary latency = summarize(result.latencies);
+          std::cout << "  " << result.status << ": " << result.timesteps << " timesteps in " << result.wall_time << " s, p50 "
+                    << latency.p50 << " ms, p99 " << latency.p99 << " ms, peak RSS " << result.peak_rss << " MB, error "
+                    << result.final_error << ", association accuracy " << accuracy(result) << std::endl;
+
+          results.push_back(std::move(result));
+          writeJson(output_prefix + ".json", data_dir, results);
+          writeCsv(output_prefix + ".csv", results);
+        }
+      }
+    }
+  }
+}
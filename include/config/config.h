@@ -3,6 +3,8 @@
 #include <string>
 #include "data_association/DataAssociation.h"
 #include "slam/slam.h"
+#include "slam/multi_hypothesis_slam.h"
+#include "slam/async_slam.h"
 #include <gtsam/nonlinear/Marginals.h>
 
 namespace config {
@@ -23,13 +25,35 @@ struct Config {
     int factor_graph_window;
 
     da::AssociationMethod association_method;
+    int num_threads;
+    da::AssignmentSolver assignment_solver;
+
+    double jc_prob;
+    int jcbb_max_nodes;
+    double jcbb_time_budget;
 
     bool with_ground_truth;
     bool stop_at_association_timestep;
     bool draw_association_hypothesis;
 
+    int num_branches;
+    int hypotheses_per_branch;
+    slam::BranchScore branch_score;
+
+    bool async_pipeline;
+    slam::AssociationPolicy association_policy;
+    int max_staleness;
+
     slam::OptimizationMethod optimization_method;
+    double smoother_lag;
+    slam::OptimizationPolicyParams optimization_policy;
     gtsam::Marginals::Factorization marginals_factorization;
+
+    bool dataset_cache;
+
+    std::string checkpoint_file;
+    int checkpoint_every;
+    bool resume_from_checkpoint;
 };
 
 } // namespace config
\ No newline at end of file
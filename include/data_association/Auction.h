@@ -0,0 +1,52 @@
+#ifndef AUCTION_H
+#define AUCTION_H
+
+#include <cstdint>
+#include <vector>
+
+#include "data_association/SparseAssignment.h"
+#include "utils/thread_pool.h"
+
+namespace da
+{
+  struct AuctionParams
+  {
+    // Epsilon of the last scaling phase, the assignment is then within (num_rows + num_cols) * eps_final of optimal
+    double eps_final = 1e-6;
+    // Epsilon is divided by this between phases
+    double eps_scaling = 5.0;
+    // Bidding rounds over all phases before giving up
+    uint64_t max_rounds = 1'000'000;
+  };
+
+  struct AuctionResult
+  {
+    std::vector<int> assignment; // Same shape as hungarian(), column per row, -1 if unassigned
+    double primal;               // Cost of assignment, unassigned rows included
+    double dual;                 // Lower bound on the optimal cost
+    double gap;                  // primal - dual, a bound on how far from optimal assignment is
+    bool converged;              // All rows assigned before running out of rounds
+    uint64_t rounds;
+  };
+
+  /*
+   * Forward auction with epsilon-scaling for the same problem as sparse_assignment(), minimizing cost.
+   * Leaving a row unassigned at unassigned_cost is a private dummy column per row. The problem is made square, with a
+   * dummy row per column, as forward auction is only optimal when no column is left over.
+   *
+   * Bidding is Jacobi style: all unassigned rows bid against the same prices, then each column goes to its highest
+   * bidder. With a thread pool the bids are computed in parallel, and the result does not depend on the number of
+   * threads. Owners are kept per column, so outbidding is O(1).
+   *
+   * The dual is computed from the final prices, so gap is a guarantee on optimality, and not just the
+   * theoretical (num_rows + num_cols) * eps_final.
+   */
+  AuctionResult auction(
+      const SparseCostMatrix &costs,
+      double unassigned_cost,
+      const AuctionParams &params = AuctionParams(),
+      utils::ThreadPool *thread_pool = nullptr);
+
+} // namespace da
+
+#endif // AUCTION_H
@@ -0,0 +1,52 @@
+#ifndef CLUSTERING_H
+#define CLUSTERING_H
+
+#include <vector>
+
+#include "data_association/SparseAssignment.h"
+
+namespace da
+{
+  // Disjoint sets over 0, ..., size - 1, with path halving and union by size
+  class UnionFind
+  {
+  private:
+    std::vector<int> parent_;
+    std::vector<int> size_;
+
+  public:
+    explicit UnionFind(int size);
+
+    int find(int x);
+    // Returns false if a and b were already in the same set
+    bool unite(int a, int b);
+  };
+
+  /*
+   * Connected component of the bipartite graph given by the feasible entries of a cost matrix.
+   * Rows and columns are the global indices, in increasing order, and costs is indexed locally by their positions.
+   */
+  struct AssignmentCluster
+  {
+    std::vector<int> rows;
+    std::vector<int> cols;
+    SparseCostMatrix costs;
+  };
+
+  /*
+   * Splits the assignment problem into independent subproblems, as rows with no feasible column in common can not
+   * compete for anything. Every row ends up in exactly one cluster, rows without feasible entries in a cluster of
+   * their own with no columns. Clusters are ordered by their first row, so the result is deterministic.
+   */
+  std::vector<AssignmentCluster> cluster_assignment(const SparseCostMatrix &costs);
+
+  /*
+   * Optimal assignment of clusters with a single row or a single column, where there is no competition to resolve.
+   * Same result shape as sparse_assignment(), in local indices.
+   */
+  bool is_trivial(const AssignmentCluster &cluster);
+  std::vector<int> trivial_assignment(const AssignmentCluster &cluster, double unassigned_cost);
+
+} // namespace da
+
+#endif // CLUSTERING_H
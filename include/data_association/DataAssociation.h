@@ -12,7 +12,14 @@
 #include <functional>
 #include <memory>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 #include "slam/types.h"
+#include "slam/covariance_recovery.h"
+#include "slam/key_registry.h"
+#include "slam/checkpoint.h"
 
 namespace da
 {
@@ -20,10 +27,18 @@ namespace da
   {
     MaximumLikelihood = 0,
     KnownDataAssociation = 1,
+    JCBB = 2,
+  };
+
+  enum class AssignmentSolver : int
+  {
+    ShortestAugmentingPath = 0,
+    Auction = 1,
   };
 }
 
 std::ostream &operator<<(std::ostream &os, const da::AssociationMethod &asso_method);
+std::ostream &operator<<(std::ostream &os, const da::AssignmentSolver &assignment_solver);
 
 namespace da
 {
@@ -32,18 +47,121 @@ namespace da
   class DataAssociation
   {
   public:
+    using Point = decltype(MEASUREMENT::measurement);
+
+    // registry holds the poses and landmarks of estimates, so the latest pose and the landmarks are found without scanning it
     virtual hypothesis::Hypothesis associate(
         const gtsam::Values &estimates,
-        const gtsam::Marginals &marginals,
+        const slam::KeyRegistry<Point> &registry,
+        const slam::CovarianceRecovery &marginals,
         const gtsam::FastVector<MEASUREMENT> &measurements) = 0;
+    // Up to k hypotheses, best first. Methods that only find the best one return just that.
+    virtual std::vector<hypothesis::Hypothesis> associate_k_best(
+        const gtsam::Values &estimates,
+        const slam::KeyRegistry<Point> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<MEASUREMENT> &measurements,
+        int k)
+    {
+      return {associate(estimates, registry, marginals, measurements)};
+    }
+    // Called by SLAM after every optimization, for methods that keep state derived from the landmark estimates
+    virtual void landmarksUpdated(const slam::KeyRegistry<Point> &registry) {}
+    // Written to and read back from SLAM checkpoints, for methods with state not derived from the estimates
+    virtual void saveState(slam::CheckpointWriter &writer) const {}
+    virtual void loadState(slam::CheckpointReader &reader) {}
     virtual ~DataAssociation() {}
   };
 
-  template <class MEASUREMENT>
+  /*
+   * Individual compatibility of a single measurement/landmark pair, with all sizes known at compile time.
+   * Everything is kept on the stack, so it can be run for every pair in the gating loop without allocating.
+   * The measurement model is the same as gtsam::PoseToPointFactor, z = x.transformTo(l).
+   */
+  template <class POSE, class POINT>
+  struct CompatibilityKernel
+  {
+    static constexpr int PoseDim = POSE::dimension;
+    static constexpr int PointDim = POINT::RowsAtCompileTime;
+    static constexpr int JointDim = PoseDim + PointDim;
+
+    using JacobianPose = Eigen::Matrix<double, PointDim, PoseDim>;
+    using JacobianPoint = Eigen::Matrix<double, PointDim, PointDim>;
+    using Innovation = Eigen::Matrix<double, PointDim, 1>;
+    using Covariance = Eigen::Matrix<double, PointDim, PointDim>;
+    using JointCovariance = Eigen::Matrix<double, JointDim, JointDim>;
+
+    // Measurement noise covariance, meant to be computed once per measurement and reused for every landmark
+    static Covariance noiseCovariance(const gtsam::SharedNoiseModel &noise)
+    {
+      return noise->sigmas().array().square().matrix().asDiagonal();
+    }
+
+    static Innovation innovation(const POSE &x, const POINT &l, const POINT &z, JacobianPose &Hx, JacobianPoint &Hl)
+    {
+      return x.transformTo(l, Hx, Hl) - z;
+    }
+
+    // S = H P H^T + R, with H = [Hx, Hl] and P the joint covariance of [x; l]
+    static Covariance innovationCovariance(const JacobianPose &Hx, const JacobianPoint &Hl, const JointCovariance &P, const Covariance &R)
+    {
+      Eigen::Matrix<double, PointDim, JointDim> H;
+      H << Hx, Hl;
+      Covariance S = R;
+      S.noalias() += H * P * H.transpose();
+      return S;
+    }
+
+    /*
+     * Squared Mahalanobis distance innov^T S^-1 innov. S is factorized in place, so it holds its Cholesky factor afterwards.
+     * log_det is set to log|S| if given. Returns infinity if S is not positive definite.
+     */
+    static double nis(Covariance &S, const Innovation &innov, double *log_det = nullptr)
+    {
+      Eigen::LLT<Eigen::Ref<Covariance>> chol(S);
+      if (chol.info() != Eigen::Success)
+      {
+        if (log_det)
+        {
+          *log_det = std::numeric_limits<double>::infinity();
+        }
+        return std::numeric_limits<double>::infinity();
+      }
+
+      if (log_det)
+      {
+        *log_det = 2.0 * chol.matrixLLT().diagonal().array().log().sum();
+      }
+
+      Innovation y = chol.matrixL().solve(innov);
+      return y.squaredNorm();
+    }
+
+    // Joint covariance of [x; l] from anything indexable as joint_marginals(i, j)
+    template <class JOINT_MARGINAL>
+    static JointCovariance jointCovariance(const JOINT_MARGINAL &joint_marginals, gtsam::Key x_key, gtsam::Key l_key)
+    {
+      JointCovariance P;
+      P.template topLeftCorner<PoseDim, PoseDim>() = joint_marginals(x_key, x_key);
+      P.template topRightCorner<PoseDim, PointDim>() = joint_marginals(x_key, l_key);
+      P.template bottomLeftCorner<PointDim, PoseDim>() = P.template topRightCorner<PoseDim, PointDim>().transpose();
+      P.template bottomRightCorner<PointDim, PointDim>() = joint_marginals(l_key, l_key);
+      return P;
+    }
+
+    static JointCovariance jointCovariance(const slam::CovarianceRecovery &marginals, gtsam::Key x_key, gtsam::Key l_key)
+    {
+      // Already stored as [x; l], so a single copy from the cache
+      return marginals.jointCovariance(x_key, l_key);
+    }
+  };
+
+  // JOINT_MARGINAL is anything indexable as joint_marginals(i, j), i.e. gtsam::JointMarginal or slam::CovarianceRecovery
+  template <class MEASUREMENT, class JOINT_MARGINAL>
   double individual_compatability(
       const hypothesis::Association &a,
       gtsam::Key x_key,
-      const gtsam::JointMarginal &joint_marginals,
+      const JOINT_MARGINAL &joint_marginals,
       const gtsam::FastVector<MEASUREMENT> &measurements,
       std::optional<std::reference_wrapper<double>> log_norm_factor = {},
       std::optional<Eigen::Ref<Eigen::MatrixXd>> S_ = {})
@@ -87,65 +205,154 @@ namespace da
     return innov.transpose() * chol.solve(innov);
   }
 
-  template <class MEASUREMENT>
-  double joint_compatability(
-      const hypothesis::Hypothesis &h,
-      gtsam::Key x_key,
-      const gtsam::Marginals &marginals,
-      const gtsam::FastVector<MEASUREMENT> &measurements,
-      int state_dim,
-      int lmk_dim,
-      int meas_dim)
+  /*
+   * Joint compatibility of all associated pairs of a hypothesis, the NIS of the stacked innovations.
+   * Each measurement only depends on the pose and its own landmark, so H is never formed. The diagonal blocks of S are
+   * the individual innovation covariances from CompatibilityKernel, and the off-diagonal blocks are built from
+   * A_i = Hx_i Pxx + Hl_i Plx_i, shared by all blocks of row i. S and the per pair blocks are kept between calls and
+   * only ever grow, so once they are large enough for the biggest hypothesis nothing is allocated.
+   */
+  template <class POSE, class POINT>
+  class JointCompatibility
   {
-    gtsam::KeyVector joint_states;
-    joint_states.push_back(x_key);
-    int num_associated_meas_to_lmk = 0;
-    for (const auto &asso : h.associations())
+  public:
+    using Kernel = CompatibilityKernel<POSE, POINT>;
+    static constexpr int PoseDim = Kernel::PoseDim;
+    static constexpr int PointDim = Kernel::PointDim;
+
+    template <class MEASUREMENT>
+    double operator()(
+        const hypothesis::Hypothesis &h,
+        gtsam::Key x_key,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<MEASUREMENT> &measurements)
     {
-      if (asso->associated())
+      size_t n = 0;
+      for (const auto &a : h.associations())
       {
-        num_associated_meas_to_lmk++;
-        joint_states.push_back(*asso->landmark);
+        n += a->associated() ? 1 : 0;
+      }
+      if (n == 0)
+      {
+        return std::numeric_limits<double>::infinity();
       }
-    }
 
-    if (num_associated_meas_to_lmk == 0)
-    {
-      return std::numeric_limits<double>::infinity();
-    }
+      const int dim = n * PointDim;
+      if (pairs_.size() < n)
+      {
+        pairs_.resize(n);
+      }
+      if (S_.rows() < dim)
+      {
+        S_.resize(dim, dim);
+        innov_.resize(dim);
+      }
 
-    Eigen::MatrixXd Pjoint = marginals.jointMarginalCovariance(joint_states).fullMatrix();
+      const Eigen::Matrix<double, PoseDim, PoseDim> Pxx = marginals.marginalCovariance(x_key);
+      size_t i = 0;
+      for (const auto &a : h.associations())
+      {
+        if (!a->associated())
+        {
+          continue;
+        }
+        Pair &pair = pairs_[i];
+        pair.landmark = *a->landmark;
+        pair.Hx = a->Hx;
+        pair.Hl = a->Hl;
+        innov_.template segment<PointDim>(i * PointDim) = a->error;
+
+        const typename Kernel::JointCovariance P = Kernel::jointCovariance(marginals, x_key, pair.landmark);
+        pair.Pxl = P.template topRightCorner<PoseDim, PointDim>();
+        pair.A.noalias() = pair.Hx * Pxx + pair.Hl * pair.Pxl.transpose();
+        S_.template block<PointDim, PointDim>(i * PointDim, i * PointDim) =
+            Kernel::innovationCovariance(pair.Hx, pair.Hl, P, noiseCovariance(measurements[a->measurement].noise));
+        i++;
+      }
 
-    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(num_associated_meas_to_lmk * meas_dim, state_dim + num_associated_meas_to_lmk * lmk_dim);
-    Eigen::MatrixXd R = Eigen::MatrixXd::Zero(num_associated_meas_to_lmk * meas_dim, num_associated_meas_to_lmk * meas_dim);
+      for (size_t i = 0; i < n; i++)
+      {
+        const Pair &pi = pairs_[i];
+        for (size_t j = i + 1; j < n; j++)
+        {
+          const Pair &pj = pairs_[j];
+          typename Kernel::Covariance Plilj;
+          if (pi.landmark == pj.landmark)
+          {
+            Plilj = marginals.marginalCovariance(pi.landmark);
+          }
+          else
+          {
+            Plilj = marginals.jointCovariance(pi.landmark, pj.landmark).template topRightCorner<PointDim, PointDim>();
+          }
+          Eigen::Matrix<double, PointDim, PointDim> Bij;
+          Bij.noalias() = pi.Hx * pj.Pxl + pi.Hl * Plilj;
+
+          auto Sij = S_.template block<PointDim, PointDim>(i * PointDim, j * PointDim);
+          Sij.noalias() = pi.A * pj.Hx.transpose() + Bij * pj.Hl.transpose();
+          S_.template block<PointDim, PointDim>(j * PointDim, i * PointDim) = Sij.transpose();
+        }
+      }
 
-    Eigen::VectorXd innov(num_associated_meas_to_lmk * meas_dim);
-    int meas_idx = 0, lmk_idx = 0;
+      Eigen::Ref<Eigen::MatrixXd> S = S_.topLeftCorner(dim, dim);
+      Eigen::LLT<Eigen::Ref<Eigen::MatrixXd>> chol(S);
+      if (chol.info() != Eigen::Success)
+      {
+        return std::numeric_limits<double>::infinity();
+      }
+      auto y = innov_.head(dim);
+      chol.matrixL().solveInPlace(y);
+      return y.squaredNorm();
+    }
 
-    for (const auto &a : h.associations())
+  private:
+    struct Pair
     {
-      if (a->associated())
+      gtsam::Key landmark;
+      typename Kernel::JacobianPose Hx;
+      typename Kernel::JacobianPoint Hl;
+      Eigen::Matrix<double, PoseDim, PointDim> Pxl;
+      Eigen::Matrix<double, PointDim, PoseDim> A;
+    };
+
+    // sigmas() allocates, so R is computed once per noise model. The models are held so their addresses are not reused.
+    const typename Kernel::Covariance &noiseCovariance(const gtsam::SharedNoiseModel &noise)
+    {
+      for (const auto &entry : noise_cache_)
       {
-        innov.segment(meas_idx, meas_dim) = a->error;
-        H.block(meas_idx, 0, meas_dim, state_dim) = a->Hx;
-        H.block(meas_idx, state_dim + lmk_idx, meas_dim, lmk_dim) = a->Hl;
-
-        const auto &meas_noise = measurements[a->measurement].noise;
-
-        // Adding R might be done more cleverly
-        R.block(meas_idx, meas_idx, meas_dim, meas_dim) = meas_noise->sigmas().array().square().matrix().asDiagonal();
-
-        meas_idx += meas_dim;
-        lmk_idx += lmk_dim;
+        if (entry.first == noise)
+        {
+          return entry.second;
+        }
       }
+      if (noise_cache_.size() >= MAX_CACHED_NOISE_MODELS)
+      {
+        noise_cache_.clear();
+      }
+      noise_cache_.emplace_back(noise, Kernel::noiseCovariance(noise));
+      return noise_cache_.back().second;
     }
 
-    Eigen::MatrixXd Sjoint = H * Pjoint * H.transpose() + R;
+    static constexpr size_t MAX_CACHED_NOISE_MODELS = 64;
 
-    double nis = innov.transpose() * Sjoint.llt().solve(innov);
-    return nis;
-  }
+    std::vector<Pair, Eigen::aligned_allocator<Pair>> pairs_;
+    Eigen::MatrixXd S_;
+    Eigen::VectorXd innov_;
+    std::vector<std::pair<gtsam::SharedNoiseModel, typename Kernel::Covariance>,
+                Eigen::aligned_allocator<std::pair<gtsam::SharedNoiseModel, typename Kernel::Covariance>>>
+        noise_cache_;
+  };
+
+  // Pose and point of the given dimensions, for the overloads below that are called with dimensions only
+  template <unsigned int STATE_DIM>
+  using PoseOfDim = std::conditional_t<STATE_DIM == 3, gtsam::Pose2, gtsam::Pose3>;
+  template <unsigned int STATE_DIM>
+  using PointOfDim = std::conditional_t<STATE_DIM == 3, gtsam::Point2, gtsam::Point3>;
 
+  /*
+   * Joint compatibility with scratch kept per thread, for callers without a JointCompatibility of their own.
+   * Only the planar (3, 2, 2) and spatial (6, 3, 3) models exist.
+   */
   template <const unsigned int STATE_DIM,
             const unsigned int LANDMARK_DIM,
             const unsigned int MEASUREMENT_DIM,
@@ -153,90 +360,57 @@ namespace da
   double joint_compatability(
       const hypothesis::Hypothesis &h,
       gtsam::Key x_key,
-      const gtsam::Marginals &marginals,
+      const slam::CovarianceRecovery &marginals,
       const gtsam::FastVector<MEASUREMENT> &measurements)
   {
-    gtsam::KeyVector joint_states;
-    joint_states.push_back(x_key);
-    int num_associated_meas_to_lmk = 0;
-    for (const auto &asso : h.associations())
-    {
-      if (asso->associated())
-      {
-        num_associated_meas_to_lmk++;
-        joint_states.push_back(*asso->landmark);
-      }
-    }
+    static_assert((STATE_DIM == 3 && LANDMARK_DIM == 2 && MEASUREMENT_DIM == 2) ||
+                      (STATE_DIM == 6 && LANDMARK_DIM == 3 && MEASUREMENT_DIM == 3),
+                  "Joint compatibility is only defined for Pose2/Point2 and Pose3/Point3");
+    thread_local JointCompatibility<PoseOfDim<STATE_DIM>, PointOfDim<STATE_DIM>> joint_compatibility;
+    return joint_compatibility(h, x_key, marginals, measurements);
+  }
 
-    if (num_associated_meas_to_lmk == 0)
+  template <class MEASUREMENT>
+  double joint_compatability(
+      const hypothesis::Hypothesis &h,
+      gtsam::Key x_key,
+      const slam::CovarianceRecovery &marginals,
+      const gtsam::FastVector<MEASUREMENT> &measurements,
+      int state_dim,
+      int lmk_dim,
+      int meas_dim)
+  {
+    if (state_dim == 3 && lmk_dim == 2 && meas_dim == 2)
     {
-      return std::numeric_limits<double>::infinity();
+      return joint_compatability<3, 2, 2>(h, x_key, marginals, measurements);
     }
-
-    Eigen::MatrixXd Pjoint = marginals.jointMarginalCovariance(joint_states).fullMatrix();
-
-    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(num_associated_meas_to_lmk * MEASUREMENT_DIM, STATE_DIM + num_associated_meas_to_lmk * LANDMARK_DIM);
-    Eigen::MatrixXd R = Eigen::MatrixXd::Zero(num_associated_meas_to_lmk * MEASUREMENT_DIM, num_associated_meas_to_lmk * MEASUREMENT_DIM);
-
-    Eigen::VectorXd innov(num_associated_meas_to_lmk * MEASUREMENT_DIM);
-    int meas_idx = 0, lmk_idx = 0;
-
-    for (const auto &a : h.associations())
+    if (state_dim == 6 && lmk_dim == 3 && meas_dim == 3)
     {
-      if (a->associated())
-      {
-        innov.segment(meas_idx, MEASUREMENT_DIM) = a->error;
-        H.block(meas_idx, 0, MEASUREMENT_DIM, STATE_DIM) = a->Hx;
-        H.block(meas_idx, STATE_DIM + lmk_idx, MEASUREMENT_DIM, LANDMARK_DIM) = a->Hl;
-
-        const auto &meas_noise = measurements[a->measurement].noise;
-        // Adding R might be done more cleverly
-        R.block(meas_idx, meas_idx, MEASUREMENT_DIM, MEASUREMENT_DIM) = meas_noise->sigmas().array().square().matrix().asDiagonal();
-
-        meas_idx += MEASUREMENT_DIM;
-        lmk_idx += LANDMARK_DIM;
-      }
+      return joint_compatability<6, 3, 3>(h, x_key, marginals, measurements);
     }
-
-    Eigen::MatrixXd Sjoint = H * Pjoint * H.transpose() + R;
-
-    double nis = innov.transpose() * Sjoint.llt().solve(innov);
-    return nis;
+    throw std::invalid_argument("Joint compatibility is not defined for state dimension " + std::to_string(state_dim) +
+                                " and landmark dimension " + std::to_string(lmk_dim));
   }
 
-  template <class POSE, class POINT>
+  template <class POSE, class POINT, class JOINT_MARGINAL>
   std::pair<gtsam::Vector, gtsam::Matrix> innovation(
       gtsam::Key x_key,
       gtsam::Key lmk_key,
       const POSE &x,
       const POINT &l,
-      const gtsam::JointMarginal &joint_marginal,
+      const JOINT_MARGINAL &joint_marginal,
       const slam::Measurement<POINT> &measurement)
   {
-    gtsam::Matrix Hx, Hl;
-    gtsam::PoseToPointFactor<POSE, POINT> factor(x_key, lmk_key, measurement.measurement, measurement.noise);
-    gtsam::Vector innovation = factor.evaluateError(x, l, Hx, Hl);
-
-    int rows = Hx.rows();
-    int cols = Hx.cols() + Hl.cols();
-    Eigen::MatrixXd H(rows, cols);
-    H << Hx, Hl;
+    using Kernel = CompatibilityKernel<POSE, POINT>;
 
-    Eigen::MatrixXd Pxx = joint_marginal(x_key, x_key);
-    Eigen::MatrixXd Pll = joint_marginal(lmk_key, lmk_key);
-    Eigen::MatrixXd Pxl = joint_marginal(x_key, lmk_key);
-    const auto &Plx = Pxl.transpose();
-
-    rows = Pxx.rows() + Pll.rows();
-    cols = rows;
+    typename Kernel::JacobianPose Hx;
+    typename Kernel::JacobianPoint Hl;
+    typename Kernel::Innovation innovation = Kernel::innovation(x, l, measurement.measurement, Hx, Hl);
 
-    Eigen::MatrixXd P(rows, cols);
-    P << Pxx, Pxl,
-        Plx, Pll;
-
-    Eigen::MatrixXd R = measurement.noise->sigmas().array().square().matrix().asDiagonal();
-
-    Eigen::MatrixXd S = H * P * H.transpose() + R;
+    typename Kernel::Covariance S = Kernel::innovationCovariance(
+        Hx, Hl,
+        Kernel::jointCovariance(joint_marginal, x_key, lmk_key),
+        Kernel::noiseCovariance(measurement.noise));
 
     return {innovation, S};
   }
@@ -64,6 +64,8 @@ namespace da
         private:
             double nis_;
             gtsam::FastVector<Association::shared_ptr> assos_;
+            // Cost of the assignment the hypothesis came from, for methods ranking several
+            double cost_ = 0.0;
 
         public:
 
@@ -75,6 +77,8 @@ namespace da
             int num_measurements() const;
             void set_nis(double nis) { nis_ = nis; }
             double get_nis() const { return nis_; }
+            void set_cost(double cost) { cost_ = cost; }
+            double get_cost() const { return cost_; }
 
             gtsam::KeyVector associated_landmarks() const;
             // Needed for min heap
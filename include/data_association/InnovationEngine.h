@@ -0,0 +1,363 @@
+#ifndef INNOVATION_ENGINE_H
+#define INNOVATION_ENGINE_H
+
+#include <gtsam/base/Matrix.h>
+#include <gtsam/inference/Key.h>
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include <Eigen/Core>
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace da
+{
+  /*
+   * Batched individual compatibility of all gated measurement/landmark pairs against the same pose.
+   *
+   * Pairs are stored as structure of arrays, one contiguous array per scalar of each per-pair quantity.
+   * evaluate() then computes innovations, Jacobians, innovation covariances S = H P H^T + R and NIS for all pairs
+   * in passes over these arrays, which Eigen vectorizes. S is inverted in closed form, as it is only 2x2 or 3x3.
+   *
+   * The measurement model is the same as gtsam::PoseToPointFactor, z = x.transformTo(l), so Hl = R^T is shared
+   * by all pairs, and only Hx depends on the pair.
+   */
+  template <class POSE, class POINT>
+  class InnovationEngine
+  {
+  public:
+    static constexpr int PoseDim = POSE::dimension;
+    static constexpr int PointDim = POINT::RowsAtCompileTime;
+
+    static_assert(PointDim == 2 || PointDim == 3, "Closed form inverse only implemented for 2D and 3D measurements");
+
+    using PoseCovariance = Eigen::Matrix<double, PoseDim, PoseDim>;
+    using CrossCovariance = Eigen::Matrix<double, PoseDim, PointDim>;
+    using PointCovariance = Eigen::Matrix<double, PointDim, PointDim>;
+    using PointVector = Eigen::Matrix<double, PointDim, 1>;
+
+  private:
+    using Column = std::vector<double>;
+    using Array = Eigen::ArrayXd;
+    using ConstMap = Eigen::Map<const Eigen::ArrayXd>;
+
+    // Shared by all pairs
+    POSE x_;
+    PoseCovariance Pxx_;
+    PointCovariance Rt_; // Rotation from world to body, which is also Hl
+
+    // Per pair inputs
+    std::vector<int> measurement_;
+    std::vector<gtsam::Key> landmark_;
+    std::array<Column, PointDim> z_;
+    std::array<Column, PointDim> noise_variance_;
+    std::array<Column, PointDim> l_;
+    std::array<Column, PoseDim * PointDim> Pxl_; // Row major
+    std::array<Column, PointDim * PointDim> Pll_; // Row major
+
+    // Per pair outputs
+    std::array<Array, PointDim> innovation_;
+    std::array<Array, PointDim * PoseDim> Hx_; // Row major
+    std::array<Array, PointDim * PointDim> S_; // Row major
+    Array nis_;
+    Array log_det_;
+
+    static ConstMap map(const Column &c) { return ConstMap(c.data(), c.size()); }
+
+    // Always the scalar std::log, as Eigen's vectorized log may differ in the last bits. This way the result for a
+    // pair does not depend on where in the batch it ended up.
+    static double scalarLog(double v) { return std::log(v); }
+
+    // Body frame landmark q = R^T (l - t), and the Jacobian of it wrt. the pose
+    void predict(std::array<Array, PointDim> &q)
+    {
+      const size_t n = size();
+      const PointVector t = x_.translation();
+
+      std::array<Array, PointDim> d;
+      for (int k = 0; k < PointDim; k++)
+      {
+        d[k] = map(l_[k]) - t(k);
+      }
+      for (int a = 0; a < PointDim; a++)
+      {
+        q[a] = Array::Zero(n);
+        for (int k = 0; k < PointDim; k++)
+        {
+          q[a] += Rt_(a, k) * d[k];
+        }
+      }
+
+      for (auto &H : Hx_)
+      {
+        H.setZero(n);
+      }
+
+      if constexpr (PoseDim == 3)
+      {
+        // Pose2, tangent space [x, y, theta]: Hx = [-I, [qy; -qx]]
+        Hx_[0 * PoseDim + 0] = -1.0;
+        Hx_[1 * PoseDim + 1] = -1.0;
+        Hx_[0 * PoseDim + 2] = q[1];
+        Hx_[1 * PoseDim + 2] = -q[0];
+      }
+      else
+      {
+        // Pose3, tangent space [omega, v]: Hx = [skew(q), -I]
+        Hx_[0 * PoseDim + 1] = -q[2];
+        Hx_[0 * PoseDim + 2] = q[1];
+        Hx_[1 * PoseDim + 0] = q[2];
+        Hx_[1 * PoseDim + 2] = -q[0];
+        Hx_[2 * PoseDim + 0] = -q[1];
+        Hx_[2 * PoseDim + 1] = q[0];
+        Hx_[0 * PoseDim + 3] = -1.0;
+        Hx_[1 * PoseDim + 4] = -1.0;
+        Hx_[2 * PoseDim + 5] = -1.0;
+      }
+    }
+
+    /*
+     * S = Hx Pxx Hx^T + Hx Pxl Hl^T + (Hx Pxl Hl^T)^T + Hl Pll Hl^T + R.
+     * Pxx and Hl are the same for all pairs, so they enter as scalars.
+     */
+    void computeInnovationCovariance()
+    {
+      const size_t n = size();
+
+      // G = Hx Pxx + Hl Plx, i.e. the pose columns of H P
+      std::array<Array, PointDim * PoseDim> G;
+      for (int a = 0; a < PointDim; a++)
+      {
+        for (int m = 0; m < PoseDim; m++)
+        {
+          Array &g = G[a * PoseDim + m];
+          g = Array::Zero(n);
+          for (int k = 0; k < PoseDim; k++)
+          {
+            g += Pxx_(k, m) * Hx_[a * PoseDim + k];
+          }
+          for (int j = 0; j < PointDim; j++)
+          {
+            g += Rt_(a, j) * map(Pxl_[m * PointDim + j]);
+          }
+        }
+      }
+
+      // B = Hx Pxl + Hl Pll, i.e. the landmark columns of H P
+      std::array<Array, PointDim * PointDim> B;
+      for (int a = 0; a < PointDim; a++)
+      {
+        for (int m = 0; m < PointDim; m++)
+        {
+          Array &b = B[a * PointDim + m];
+          b = Array::Zero(n);
+          for (int k = 0; k < PoseDim; k++)
+          {
+            b += Hx_[a * PoseDim + k] * map(Pxl_[k * PointDim + m]);
+          }
+          for (int j = 0; j < PointDim; j++)
+          {
+            b += Rt_(a, j) * map(Pll_[j * PointDim + m]);
+          }
+        }
+      }
+
+      // S = G Hx^T + B Hl^T + R, only the upper triangle is computed
+      for (int a = 0; a < PointDim; a++)
+      {
+        for (int c = a; c < PointDim; c++)
+        {
+          Array &s = S_[a * PointDim + c];
+          s = Array::Zero(n);
+          for (int m = 0; m < PoseDim; m++)
+          {
+            s += G[a * PoseDim + m] * Hx_[c * PoseDim + m];
+          }
+          for (int m = 0; m < PointDim; m++)
+          {
+            s += Rt_(c, m) * B[a * PointDim + m];
+          }
+          if (a == c)
+          {
+            s += map(noise_variance_[a]);
+          }
+        }
+      }
+      for (int a = 0; a < PointDim; a++)
+      {
+        for (int c = 0; c < a; c++)
+        {
+          S_[a * PointDim + c] = S_[c * PointDim + a];
+        }
+      }
+    }
+
+    // Closed form inverse and log-determinant of S. Pairs where S is not positive definite get infinite NIS.
+    void mahalanobis()
+    {
+      const double inf = std::numeric_limits<double>::infinity();
+      const auto &e = innovation_;
+
+      if constexpr (PointDim == 2)
+      {
+        const Array &s00 = S_[0], &s01 = S_[1], &s11 = S_[3];
+        Array det = s00 * s11 - s01 * s01;
+        Array quad = s11 * e[0].square() - 2.0 * s01 * e[0] * e[1] + s00 * e[1].square();
+        auto valid = (det > 0.0) && (s00 > 0.0);
+        nis_ = valid.select(quad / det, inf);
+        log_det_ = valid.select(det.unaryExpr(&scalarLog), inf);
+      }
+      else
+      {
+        const Array &a = S_[0], &b = S_[1], &c = S_[2], &d = S_[4], &f = S_[5], &g = S_[8];
+        // Cofactors of the symmetric matrix [a b c; b d f; c f g]
+        Array C00 = d * g - f * f;
+        Array C01 = c * f - b * g;
+        Array C02 = b * f - c * d;
+        Array C11 = a * g - c * c;
+        Array C12 = b * c - a * f;
+        Array C22 = a * d - b * b;
+        Array det = a * C00 + b * C01 + c * C02;
+        Array quad = C00 * e[0].square() + C11 * e[1].square() + C22 * e[2].square() +
+                     2.0 * (C01 * e[0] * e[1] + C02 * e[0] * e[2] + C12 * e[1] * e[2]);
+        // Sylvester's criterion
+        auto valid = (det > 0.0) && (a > 0.0) && (C22 > 0.0);
+        nis_ = valid.select(quad / det, inf);
+        log_det_ = valid.select(det.unaryExpr(&scalarLog), inf);
+      }
+    }
+
+  public:
+    InnovationEngine() : Pxx_(PoseCovariance::Zero()), Rt_(PointCovariance::Identity()) {}
+
+    // Start a new batch against pose x with marginal covariance Pxx. Capacity is kept between batches.
+    void reset(const POSE &x, const PoseCovariance &Pxx)
+    {
+      x_ = x;
+      Pxx_ = Pxx;
+      Rt_ = x.rotation().matrix().transpose();
+
+      measurement_.clear();
+      landmark_.clear();
+      for (int i = 0; i < PointDim; i++)
+      {
+        z_[i].clear();
+        noise_variance_[i].clear();
+        l_[i].clear();
+      }
+      for (auto &c : Pxl_)
+      {
+        c.clear();
+      }
+      for (auto &c : Pll_)
+      {
+        c.clear();
+      }
+    }
+
+    void reserve(size_t n)
+    {
+      measurement_.reserve(n);
+      landmark_.reserve(n);
+      for (int i = 0; i < PointDim; i++)
+      {
+        z_[i].reserve(n);
+        noise_variance_[i].reserve(n);
+        l_[i].reserve(n);
+      }
+      for (auto &c : Pxl_)
+      {
+        c.reserve(n);
+      }
+      for (auto &c : Pll_)
+      {
+        c.reserve(n);
+      }
+    }
+
+    /*
+     * Add a gated pair. noise_variance is the diagonal of the measurement noise covariance,
+     * Pxl and Pll the cross covariance with the pose and marginal covariance of the landmark.
+     */
+    void add(
+        int measurement,
+        gtsam::Key landmark,
+        const POINT &z,
+        const PointVector &noise_variance,
+        const POINT &l,
+        const CrossCovariance &Pxl,
+        const PointCovariance &Pll)
+    {
+      measurement_.push_back(measurement);
+      landmark_.push_back(landmark);
+      for (int i = 0; i < PointDim; i++)
+      {
+        z_[i].push_back(z(i));
+        noise_variance_[i].push_back(noise_variance(i));
+        l_[i].push_back(l(i));
+      }
+      for (int k = 0; k < PoseDim; k++)
+      {
+        for (int j = 0; j < PointDim; j++)
+        {
+          Pxl_[k * PointDim + j].push_back(Pxl(k, j));
+        }
+      }
+      for (int k = 0; k < PointDim; k++)
+      {
+        for (int j = 0; j < PointDim; j++)
+        {
+          Pll_[k * PointDim + j].push_back(Pll(k, j));
+        }
+      }
+    }
+
+    void evaluate()
+    {
+      std::array<Array, PointDim> q;
+      predict(q);
+      for (int a = 0; a < PointDim; a++)
+      {
+        innovation_[a] = q[a] - map(z_[a]);
+      }
+      computeInnovationCovariance();
+      mahalanobis();
+    }
+
+    inline size_t size() const { return measurement_.size(); }
+    inline int measurement(size_t i) const { return measurement_[i]; }
+    inline gtsam::Key landmark(size_t i) const { return landmark_[i]; }
+
+    // Results, valid after evaluate()
+    inline double nis(size_t i) const { return nis_(i); }
+    inline double logDet(size_t i) const { return log_det_(i); }
+    inline const Eigen::ArrayXd &nis() const { return nis_; }
+    inline const Eigen::ArrayXd &logDet() const { return log_det_; }
+
+    PointVector innovation(size_t i) const
+    {
+      PointVector e;
+      for (int a = 0; a < PointDim; a++)
+      {
+        e(a) = innovation_[a](i);
+      }
+      return e;
+    }
+
+    PointCovariance innovationCovariance(size_t i) const
+    {
+      PointCovariance S;
+      for (int k = 0; k < PointDim * PointDim; k++)
+      {
+        S(k / PointDim, k % PointDim) = S_[k](i);
+      }
+      return S;
+    }
+  };
+
+} // namespace da
+
+#endif // INNOVATION_ENGINE_H
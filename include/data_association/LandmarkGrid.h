@@ -0,0 +1,288 @@
+#ifndef LANDMARK_GRID_H
+#define LANDMARK_GRID_H
+
+#include <gtsam/base/FastMap.h>
+#include <gtsam/inference/Key.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/Values.h>
+
+#include "slam/key_registry.h"
+#include "utils/profiler.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+namespace da
+{
+  /*
+   * Uniform hash grid over landmark means, for range gating without looping over the whole map.
+   *
+   * With cell size equal to the gating radius, a range query only touches the 3^D cells around the query point.
+   * Landmarks are only moved between buckets when they change cell, so keeping the grid in sync after an
+   * optimization is cheap even though every estimate may have moved slightly.
+   */
+  template <class POINT>
+  class LandmarkGrid
+  {
+  public:
+    static constexpr int Dim = POINT::RowsAtCompileTime;
+
+  private:
+    using Cell = std::array<int64_t, Dim>;
+
+    struct CellHash
+    {
+      size_t operator()(const Cell &c) const
+      {
+        // Large primes from Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+        static constexpr uint64_t primes[3] = {73856093ULL, 19349663ULL, 83492791ULL};
+        uint64_t h = 0;
+        for (int i = 0; i < Dim; i++)
+        {
+          h ^= static_cast<uint64_t>(c[i]) * primes[i];
+        }
+        return h;
+      }
+    };
+
+    struct Entry
+    {
+      POINT point;
+      Cell cell;
+      uint64_t generation;
+    };
+
+    double cell_size_;
+    uint64_t generation_;
+    gtsam::FastMap<gtsam::Key, Entry> entries_;
+    std::unordered_map<Cell, std::vector<gtsam::Key>, CellHash> cells_;
+
+    Cell cellOf(const POINT &p) const
+    {
+      Cell c;
+      for (int i = 0; i < Dim; i++)
+      {
+        c[i] = static_cast<int64_t>(std::floor(p(i) / cell_size_));
+      }
+      return c;
+    }
+
+    void removeFromCell(gtsam::Key key, const Cell &cell)
+    {
+      auto it = cells_.find(cell);
+      std::vector<gtsam::Key> &bucket = it->second;
+      // Swap and pop, order within a bucket does not matter
+      auto key_it = std::find(bucket.begin(), bucket.end(), key);
+      *key_it = bucket.back();
+      bucket.pop_back();
+      if (bucket.empty())
+      {
+        cells_.erase(it);
+      }
+    }
+
+  public:
+    // Throws std::invalid_argument unless cell_size is positive and finite, as cells are found by dividing by it
+    explicit LandmarkGrid(double cell_size) : cell_size_(cell_size), generation_(0)
+    {
+      if (!(cell_size > 0.0) || !std::isfinite(cell_size))
+      {
+        throw std::invalid_argument("Landmark grid cell size must be positive and finite, got " + std::to_string(cell_size));
+      }
+    }
+
+    inline size_t size() const { return entries_.size(); }
+    inline double cellSize() const { return cell_size_; }
+
+    // Insert a landmark, or move it if it is already in the grid
+    void update(gtsam::Key key, const POINT &point)
+    {
+      Cell cell = cellOf(point);
+      auto it = entries_.find(key);
+      if (it == entries_.end())
+      {
+        entries_.emplace(key, Entry{point, cell, generation_});
+        cells_[cell].push_back(key);
+        return;
+      }
+
+      Entry &entry = it->second;
+      if (entry.cell != cell)
+      {
+        removeFromCell(key, entry.cell);
+        cells_[cell].push_back(key);
+        entry.cell = cell;
+      }
+      entry.point = point;
+      entry.generation = generation_;
+    }
+
+    void erase(gtsam::Key key)
+    {
+      auto it = entries_.find(key);
+      if (it == entries_.end())
+      {
+        return;
+      }
+      removeFromCell(key, it->second.cell);
+      entries_.erase(it);
+    }
+
+    /*
+     * Sync the grid with the landmarks of keys.
+     * Landmarks no longer registered, e.g. marginalized out of a sliding window, are removed.
+     */
+    void update(const slam::KeyRegistry<POINT> &keys)
+    {
+      generation_++;
+      const gtsam::KeyVector &landmarks = keys.landmarks();
+      const std::vector<POINT> &points = keys.landmarkPoints();
+      for (size_t i = 0; i < landmarks.size(); i++)
+      {
+        update(landmarks[i], points[i]);
+      }
+
+      std::vector<gtsam::Key> stale;
+      for (const auto &[key, entry] : entries_)
+      {
+        if (entry.generation != generation_)
+        {
+          stale.push_back(key);
+        }
+      }
+      for (const gtsam::Key key : stale)
+      {
+        erase(key);
+      }
+    }
+
+    // Appends all landmarks within radius of point to keys. Keys are not deduplicated across calls.
+    void query(const POINT &point, double radius, std::vector<gtsam::Key> &keys) const
+    {
+      Cell lo = cellOf(point - POINT::Constant(radius));
+      Cell hi = cellOf(point + POINT::Constant(radius));
+      Cell c = lo;
+      double radius_sq = radius * radius;
+
+      // Odometer style iteration over all cells between lo and hi
+      while (true)
+      {
+        auto it = cells_.find(c);
+        if (it != cells_.end())
+        {
+          for (const gtsam::Key key : it->second)
+          {
+            if ((entries_.at(key).point - point).squaredNorm() <= radius_sq)
+            {
+              keys.push_back(key);
+            }
+          }
+        }
+
+        int i = 0;
+        for (; i < Dim; i++)
+        {
+          if (c[i] < hi[i])
+          {
+            c[i]++;
+            break;
+          }
+          c[i] = lo[i];
+        }
+        if (i == Dim)
+        {
+          break;
+        }
+      }
+    }
+  };
+
+  /*
+   * Range gating of data association: the landmarks within range_threshold of any measurement, put in world frame
+   * by the pose it was taken from. Looked up in a LandmarkGrid when the threshold is positive and finite, by a loop
+   * over the landmarks when it is zero or below, and without a finite threshold every landmark passes.
+   */
+  template <class POINT>
+  class RangeGate
+  {
+  private:
+    double range_threshold_;
+    std::optional<LandmarkGrid<POINT>> grid_;
+
+  public:
+    explicit RangeGate(double range_threshold) : range_threshold_(range_threshold)
+    {
+      if (range_threshold_ > 0.0 && std::isfinite(range_threshold_))
+      {
+        grid_.emplace(range_threshold_);
+      }
+    }
+
+    inline double rangeThreshold() const { return range_threshold_; }
+
+    // Sync with the landmark estimates after an optimization
+    void update(const slam::KeyRegistry<POINT> &registry)
+    {
+      if (grid_)
+      {
+        grid_->update(registry);
+      }
+    }
+
+    // Sorted and without duplicates when looked up in the grid, in registry order otherwise
+    template <class POSE, class MEASUREMENTS>
+    gtsam::KeyVector gatedLandmarks(const slam::KeyRegistry<POINT> &registry, const POSE &x_pose, const MEASUREMENTS &measurements)
+    {
+      PROFILE_ZONE("da::gatedLandmarks");
+      if (!std::isfinite(range_threshold_))
+      {
+        return registry.landmarks();
+      }
+
+      gtsam::KeyVector keys;
+      if (!grid_)
+      {
+        // Only landmarks exactly where a measurement is, if any
+        const std::vector<POINT> &points = registry.landmarkPoints();
+        for (size_t i = 0; i < points.size(); i++)
+        {
+          for (const auto &measurement : measurements)
+          {
+            if ((x_pose * measurement.measurement - points[i]).norm() <= range_threshold_)
+            {
+              keys.push_back(registry.landmarks()[i]);
+              break;
+            }
+          }
+        }
+        return keys;
+      }
+
+      // Out of sync if we have not been told about the last optimization, e.g. when used outside of SLAM
+      if (grid_->size() != registry.numLandmarks())
+      {
+        grid_->update(registry);
+      }
+
+      for (const auto &measurement : measurements)
+      {
+        grid_->query(x_pose * measurement.measurement, range_threshold_, keys);
+      }
+
+      // Same landmark may be in range of several measurements
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+      return keys;
+    }
+  };
+
+} // namespace da
+
+#endif // LANDMARK_GRID_H
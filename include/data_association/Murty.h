@@ -0,0 +1,35 @@
+#ifndef MURTY_H
+#define MURTY_H
+
+#include <vector>
+
+#include "data_association/SparseAssignment.h"
+
+namespace da
+{
+  struct RankedAssignment
+  {
+    std::vector<int> assignment; // Same shape as sparse_assignment(), column per row, -1 if unassigned
+    double cost;                 // Unassigned rows included
+  };
+
+  /*
+   * The k lowest cost assignments of the same problem as sparse_assignment(), best first, by Murty's method
+   * ("An algorithm for ranking all the assignments in order of increasing cost", 1968).
+   *
+   * Each solution partitions the rest of its subproblem into one child per row, where the child fixes the rows before
+   * it to the parent solution and forbids the parent choice for the row itself. Partial solutions are reused:
+   * - Fixed rows are taken from the parent as is, so only the free rows of a child are ever solved.
+   * - Of the free rows, only the ones connected to the forbidden choice through shared candidates are solved again,
+   *   the others keep the parent solution.
+   * - A child can not be cheaper than its parent, so it is queued with the parent cost and only solved once it
+   *   reaches the front of the queue. Children that never get there are never solved.
+   *
+   * Fewer than k are returned if the problem does not have that many distinct assignments.
+   * Ties are broken by the order subproblems were created in, so the result is deterministic.
+   */
+  std::vector<RankedAssignment> murty(const SparseCostMatrix &costs, double unassigned_cost, int k);
+
+} // namespace da
+
+#endif // MURTY_H
@@ -0,0 +1,67 @@
+#ifndef SPARSE_ASSIGNMENT_H
+#define SPARSE_ASSIGNMENT_H
+
+#include <optional>
+#include <vector>
+
+namespace da
+{
+  /*
+   * Rectangular cost matrix in compressed sparse row format, rows being measurements and columns landmarks.
+   * Entries that are not stored are infeasible, i.e. infinite cost.
+   */
+  class SparseCostMatrix
+  {
+  public:
+    struct Entry
+    {
+      int row;
+      int col;
+      double cost;
+    };
+
+  private:
+    int rows_;
+    int cols_;
+    std::vector<int> row_begin_; // rows_ + 1 long, entries of row r are [row_begin_[r], row_begin_[r + 1])
+    std::vector<int> col_;
+    std::vector<double> cost_;
+
+  public:
+    SparseCostMatrix() : rows_(0), cols_(0), row_begin_(1, 0) {}
+
+    // Entries may come in any order, non-finite costs are dropped
+    SparseCostMatrix(int rows, int cols, const std::vector<Entry> &entries);
+
+    inline int rows() const { return rows_; }
+    inline int cols() const { return cols_; }
+    inline int nonZeros() const { return col_.size(); }
+
+    inline int rowBegin(int row) const { return row_begin_[row]; }
+    inline int rowEnd(int row) const { return row_begin_[row + 1]; }
+    inline int col(int idx) const { return col_[idx]; }
+    inline double cost(int idx) const { return cost_[idx]; }
+  };
+
+  /*
+   * Minimum cost assignment of rows to columns, using shortest augmenting paths with Dijkstra on the sparse
+   * entries, in the style of Jonker-Volgenant (see also Crouse, "On implementing 2D rectangular assignment
+   * algorithms", 2016).
+   *
+   * Every row may also be left unassigned at unassigned_cost, which is handled as a private dummy column per row,
+   * so a solution always exists. Same result shape as hungarian(): one column index per row, -1 if unassigned.
+   */
+  std::vector<int> sparse_assignment(const SparseCostMatrix &costs, double unassigned_cost);
+
+  /*
+   * As above, with a cost per row for leaving it unassigned. Rows with infinite unassigned cost must be assigned,
+   * and std::nullopt is returned if that is not possible.
+   */
+  std::optional<std::vector<int>> sparse_assignment(const SparseCostMatrix &costs, const std::vector<double> &unassigned_costs);
+
+  // Total cost of an assignment in the shape returned by sparse_assignment()
+  double assignment_cost(const SparseCostMatrix &costs, const std::vector<int> &assignment, double unassigned_cost);
+
+} // namespace da
+
+#endif // SPARSE_ASSIGNMENT_H
@@ -36,8 +36,12 @@ namespace da
       KnownDataAssociation(const std::map<uint64_t, gtsam::Key>& meas_lmk_assos);
       virtual hypothesis::Hypothesis associate(
           const gtsam::Values &estimates,
-          const gtsam::Marginals &marginals,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
           const gtsam::FastVector<slam::Measurement<POINT>> &measurements) override;
+      // The landmarks already mapped, the ground truth associations come from the constructor
+      virtual void saveState(slam::CheckpointWriter &writer) const override;
+      virtual void loadState(slam::CheckpointReader &reader) override;
 
     };
 
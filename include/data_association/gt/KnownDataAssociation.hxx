@@ -31,13 +31,12 @@ namespace da
     template <class POSE, class POINT>
     Hypothesis KnownDataAssociation<POSE, POINT>::associate(
         const gtsam::Values &estimates,
-        const gtsam::Marginals &marginals,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
         const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
     {
-      // gtsam::KeyList landmark_keys = estimates.filter(gtsam::Symbol::ChrTest('l')).keys();
-      auto poses = estimates.filter(gtsam::Symbol::ChrTest('x'));
-      int last_pose = poses.size() - 1; // Assuming first pose is 0
-      gtsam::Key x_key = X(last_pose);
+      // Not necessarily X(poses - 1), as old poses may be marginalized out
+      gtsam::Key x_key = registry.latestPose();
       POSE x_pose = estimates.at<POSE>(x_key);
       // size_t num_measurements = measurements.size();
       // size_t num_landmarks = landmark_keys.size();
@@ -60,14 +59,14 @@ namespace da
         gtsam::Key lmk_gt = meas_lmk_assos_[measurement.idx];
         const auto lmk_mapping_it = gt_lmk2map_lmk_.find(lmk_gt);
 
-        // If we find the mapping, associate to it
-        if (lmk_mapping_it != gt_lmk2map_lmk_.end())
+        // If we find the mapping, associate to it. Landmarks marginalized out of a sliding window can't be associated with anymore
+        if (lmk_mapping_it != gt_lmk2map_lmk_.end() && registry.hasLandmark(lmk_mapping_it->second))
         {
 // #ifdef LOGGING
 //           std::cout << "Found ground truth landmark " << gtsam::Symbol(lmk_gt);
 // #endif // LOGGING
           gtsam::Key l = lmk_mapping_it->second;
-          POINT lmk = estimates.at<POINT>(l);
+          POINT lmk = registry.landmarkPoint(l);
           const auto &meas = measurement.measurement;
           const auto &noise = measurement.noise;
 
@@ -76,7 +75,7 @@ namespace da
           Association::shared_ptr a = std::make_shared<Association>(meas_idx, l, Hx, Hl, error);
           h.extend(a);
         }
-        // We have not seen this landmark before - add to mapping 
+        // We have not seen this landmark before (or it is no longer estimated) - add to mapping 
         else {
           // TODO: Not sure if keeping track of landmark count internally is a good way of doing this, but ohwell
           gt_lmk2map_lmk_[lmk_gt] = L(curr_landmark_count_);
@@ -102,5 +101,30 @@ namespace da
       return h;
     }
 
+    template <class POSE, class POINT>
+    void KnownDataAssociation<POSE, POINT>::saveState(slam::CheckpointWriter &writer) const
+    {
+      writer.write<uint64_t>(curr_landmark_count_);
+      writer.write<uint64_t>(gt_lmk2map_lmk_.size());
+      for (const auto &[lmk_gt, lmk_map] : gt_lmk2map_lmk_)
+      {
+        writer.write<uint64_t>(lmk_gt);
+        writer.write<uint64_t>(lmk_map);
+      }
+    }
+
+    template <class POSE, class POINT>
+    void KnownDataAssociation<POSE, POINT>::loadState(slam::CheckpointReader &reader)
+    {
+      curr_landmark_count_ = reader.read<uint64_t>();
+      uint64_t num_mapped = reader.read<uint64_t>();
+      gt_lmk2map_lmk_.clear();
+      for (uint64_t i = 0; i < num_mapped; i++)
+      {
+        gtsam::Key lmk_gt = reader.read<uint64_t>();
+        gt_lmk2map_lmk_[lmk_gt] = reader.read<uint64_t>();
+      }
+    }
+
   } // namespace gt
 } // namespace da
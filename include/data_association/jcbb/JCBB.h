@@ -0,0 +1,136 @@
+#ifndef JCBB_H
+#define JCBB_H
+
+#include <vector>
+#include <limits>
+#include <chrono>
+#include <optional>
+#include <Eigen/Core>
+
+#include "slam/types.h"
+#include "slam/measurement_batch.h"
+
+#include <gtsam/base/FastVector.h>
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include "data_association/Hypothesis.h"
+#include "data_association/DataAssociation.h"
+#include "data_association/LandmarkGrid.h"
+#include "data_association/InnovationEngine.h"
+
+namespace da
+{
+  namespace jcbb
+  {
+    using hypothesis::Association;
+    using hypothesis::Hypothesis;
+
+    /*
+     * Joint Compatibility Branch and Bound (Neira and Tardós, 2001).
+     *
+     * Measurements are assigned one at a time, depth first, to individually compatible landmarks not yet used,
+     * or left unassociated. A branch is kept only while the joint NIS of all associations in it is below the
+     * chi2 threshold for its dimension, and leaving a measurement unassociated is only tried while the branch
+     * can still beat the best hypothesis so far in number of associations.
+     *
+     * The Cholesky factor of the joint innovation covariance is shared along the current branch. Adding an
+     * association appends one block row to it, which only needs the cross covariances with the associations
+     * already made, so Sjoint is never formed or refactorized.
+     *
+     * The search stops after max_nodes nodes or time_budget, returning the best hypothesis found so far.
+     * The first branch tried is the greedy one, so this is never worse than greedy nearest neighbour.
+     */
+    template <class POSE, class POINT>
+    class JCBB : public DataAssociation<slam::Measurement<POINT>>
+    {
+    public:
+      static constexpr int PoseDim = POSE::dimension;
+      static constexpr int PointDim = POINT::RowsAtCompileTime;
+
+    private:
+      using Kernel = CompatibilityKernel<POSE, POINT>;
+      using Engine = InnovationEngine<POSE, POINT>;
+
+      struct Candidate
+      {
+        int measurement;
+        gtsam::Key landmark;
+        int landmark_idx; // Index into the gated landmarks, for marking them used
+        double nis;
+
+        typename Kernel::Innovation innovation;
+        typename Kernel::JacobianPose Hx;
+        typename Kernel::JacobianPoint Hl;
+        typename Kernel::Covariance S; // Individual innovation covariance, including R
+        Eigen::Matrix<double, PoseDim, PointDim> Pxl;
+        Eigen::Matrix<double, PointDim, PoseDim> A; // Hx Pxx + Hl Plx, shared by all cross blocks of this candidate
+      };
+
+      double ic_threshold_;
+      double jc_prob_;
+      RangeGate<POINT> range_gate_;
+      uint64_t max_nodes_;
+      std::chrono::duration<double> time_budget_;
+      Engine innovation_engine_;
+      // Kept between calls so noise models are only converted the first time seen
+      slam::MeasurementBatch<POINT> batch_;
+
+      // chi2inv(jc_prob, k * PointDim) for k associations, extended as needed
+      std::vector<double> jc_thresholds_;
+
+      // Search state of the current call to associate()
+      std::vector<Candidate> candidates_;
+      std::vector<std::vector<int>> meas_candidates_; // Candidate indices per measurement, best NIS first
+      std::vector<int> order_;                        // Measurements with candidates, in the order they are branched on
+      std::vector<char> landmark_used_;
+      std::vector<int> branch_;                       // Candidates of the associations of the current branch
+      Eigen::MatrixXd L_;                             // Cholesky factor of Sjoint of the current branch
+      Eigen::VectorXd y_;                             // L^-1 innovation of the current branch
+      Eigen::MatrixXd S_row_;                         // Scratch for the block row being appended
+
+      std::vector<int> best_;
+      double best_nis_;
+      uint64_t nodes_;
+      bool out_of_budget_;
+      std::chrono::steady_clock::time_point deadline_;
+
+      double jcThreshold(int num_associations);
+
+      // Appends candidate c as association number k to the factor, returning false if Sjoint is not positive definite
+      bool extend(int k, const Candidate &c, const slam::CovarianceRecovery &marginals, double nis, double &extended_nis);
+
+      void search(size_t depth, double nis, const slam::CovarianceRecovery &marginals);
+
+      bool budgetExhausted();
+
+    public:
+      JCBB(
+          double ic_prob,
+          double jc_prob,
+          double range_threshold = std::numeric_limits<double>::infinity(),
+          uint64_t max_nodes = 100'000,
+          double time_budget = std::numeric_limits<double>::infinity());
+
+      virtual hypothesis::Hypothesis associate(
+          const gtsam::Values &estimates,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
+          const gtsam::FastVector<slam::Measurement<POINT>> &measurements) override;
+
+      virtual void landmarksUpdated(const slam::KeyRegistry<POINT> &registry) override;
+
+      // Nodes visited by the last call to associate(), and if it was cut short by the budget
+      inline uint64_t nodesVisited() const { return nodes_; }
+      inline bool outOfBudget() const { return out_of_budget_; }
+    };
+
+    using JCBB2D = JCBB<gtsam::Pose2, gtsam::Point2>;
+    using JCBB3D = JCBB<gtsam::Pose3, gtsam::Point3>;
+
+  } // namespace jcbb
+} // namespace da
+
+#include "data_association/jcbb/JCBB.hxx"
+
+#endif // JCBB_H
@@ -0,0 +1,299 @@
+#include <gtsam/inference/Symbol.h>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+#include <Eigen/Cholesky>
+
+#include <chrono>
+
+#include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
+
+namespace da
+{
+
+  namespace jcbb
+  {
+
+    template <class POSE, class POINT>
+    JCBB<POSE, POINT>::JCBB(double ic_prob, double jc_prob, double range_threshold, uint64_t max_nodes, double time_budget)
+        : ic_threshold_(chi2inv(ic_prob, PointDim)),
+          jc_prob_(jc_prob),
+          range_gate_(range_threshold),
+          max_nodes_(max_nodes),
+          time_budget_(time_budget),
+          best_nis_(std::numeric_limits<double>::infinity()),
+          nodes_(0),
+          out_of_budget_(false)
+    {
+    }
+
+    template <class POSE, class POINT>
+    void JCBB<POSE, POINT>::landmarksUpdated(const slam::KeyRegistry<POINT> &registry)
+    {
+      range_gate_.update(registry);
+    }
+
+    template <class POSE, class POINT>
+    double JCBB<POSE, POINT>::jcThreshold(int num_associations)
+    {
+      while (static_cast<int>(jc_thresholds_.size()) <= num_associations)
+      {
+        int k = jc_thresholds_.size();
+        jc_thresholds_.push_back(k == 0 ? 0.0 : chi2inv(jc_prob_, k * PointDim));
+      }
+      return jc_thresholds_[num_associations];
+    }
+
+    template <class POSE, class POINT>
+    bool JCBB<POSE, POINT>::budgetExhausted()
+    {
+      // Reading the clock is not free, so it is only done every so often
+      if (nodes_ >= max_nodes_ || ((nodes_ & 0xff) == 0 && std::chrono::steady_clock::now() >= deadline_))
+      {
+        out_of_budget_ = true;
+      }
+      return out_of_budget_;
+    }
+
+    template <class POSE, class POINT>
+    bool JCBB<POSE, POINT>::extend(int k, const Candidate &c, const slam::CovarianceRecovery &marginals, double nis, double &extended_nis)
+    {
+      constexpr int d = PointDim;
+      const int n = k * d;
+
+      // Block row k of Sjoint. With measurement i on landmark l_i,
+      // S_ik = Hx_i Pxx Hx_k^T + Hl_i Plx_i Hx_k^T + Hx_i Pxl_k Hl_k^T + Hl_i Pl_il_k Hl_k^T = A_i Hx_k^T + (Hx_i Pxl_k + Hl_i Pl_il_k) Hl_k^T
+      auto S_row = S_row_.topLeftCorner(d, n);
+      for (int i = 0; i < k; i++)
+      {
+        const Candidate &a = candidates_[branch_[i]];
+        const Eigen::Matrix<double, PointDim, PointDim> Plilk = marginals(a.landmark, c.landmark);
+        Eigen::Matrix<double, PointDim, PointDim> B = a.Hx * c.Pxl + a.Hl * Plilk;
+        Eigen::Matrix<double, PointDim, PointDim> Sik = a.A * c.Hx.transpose() + B * c.Hl.transpose();
+        S_row.template middleCols<d>(i * d) = Sik.transpose();
+      }
+
+      // [L11 0; L21 L22] with L21 = S_ki L11^-T and L22 L22^T = S_kk - L21 L21^T
+      auto L11 = L_.topLeftCorner(n, n);
+      auto L21 = L_.block(n, 0, d, n);
+      L21.transpose() = L11.template triangularView<Eigen::Lower>().solve(S_row.transpose());
+
+      Eigen::Matrix<double, PointDim, PointDim> schur = c.S;
+      schur.noalias() -= L21 * L21.transpose();
+      Eigen::LLT<Eigen::Matrix<double, PointDim, PointDim>> chol(schur);
+      if (chol.info() != Eigen::Success)
+      {
+        return false;
+      }
+      L_.block(n, n, d, d) = chol.matrixL();
+
+      // y_k = L22^-1 (innov_k - L21 y), and the joint NIS is |y|^2
+      Eigen::Matrix<double, PointDim, 1> r = c.innovation;
+      r.noalias() -= L21 * y_.head(n);
+      auto y_k = y_.template segment<d>(n);
+      y_k = chol.matrixL().solve(r);
+
+      extended_nis = nis + y_k.squaredNorm();
+      return true;
+    }
+
+    template <class POSE, class POINT>
+    void JCBB<POSE, POINT>::search(size_t depth, double nis, const slam::CovarianceRecovery &marginals)
+    {
+      nodes_++;
+      if (budgetExhausted())
+      {
+        return;
+      }
+
+      const int k = branch_.size();
+
+      if (depth == order_.size())
+      {
+        if (k > static_cast<int>(best_.size()) || (k == static_cast<int>(best_.size()) && nis < best_nis_))
+        {
+          best_ = branch_;
+          best_nis_ = nis;
+        }
+        return;
+      }
+
+      for (int c : meas_candidates_[order_[depth]])
+      {
+        const Candidate &candidate = candidates_[c];
+        if (landmark_used_[candidate.landmark_idx])
+        {
+          continue;
+        }
+
+        double extended_nis;
+        if (!extend(k, candidate, marginals, nis, extended_nis) || extended_nis >= jcThreshold(k + 1))
+        {
+          continue;
+        }
+
+        landmark_used_[candidate.landmark_idx] = true;
+        branch_.push_back(c);
+        search(depth + 1, extended_nis, marginals);
+        branch_.pop_back();
+        landmark_used_[candidate.landmark_idx] = false;
+
+        if (out_of_budget_)
+        {
+          return;
+        }
+      }
+
+      // Leave the measurement unassociated, if there are enough measurements left to beat the best
+      const size_t remaining = order_.size() - depth - 1;
+      if (k + remaining > best_.size())
+      {
+        search(depth + 1, nis, marginals);
+      }
+    }
+
+    template <class POSE, class POINT>
+    Hypothesis JCBB<POSE, POINT>::associate(
+        const gtsam::Values &estimates,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
+    {
+      PROFILE_ZONE("jcbb::associate");
+
+      // Not necessarily X(poses - 1), as old poses may be marginalized out
+      gtsam::Key x_key = registry.latestPose();
+      POSE x_pose = estimates.at<POSE>(x_key);
+      size_t num_measurements = measurements.size();
+
+      nodes_ = 0;
+      out_of_budget_ = false;
+
+      hypothesis::Hypothesis h = hypothesis::Hypothesis::empty_hypothesis();
+
+      gtsam::KeyVector keys = range_gate_.gatedLandmarks(registry, x_pose, measurements);
+      if (keys.empty())
+      {
+        h.fill_with_unassociated_measurements(num_measurements);
+        return h;
+      }
+
+      // Individual compatibility of all gated pairs
+      const typename Engine::PoseCovariance Pxx = marginals.marginalCovariance(x_key);
+      std::vector<typename Engine::CrossCovariance> Pxl(keys.size());
+      innovation_engine_.reset(x_pose, Pxx);
+      innovation_engine_.reserve(num_measurements * keys.size());
+      batch_.assign(measurements);
+      for (size_t i = 0; i < keys.size(); i++)
+      {
+        const gtsam::Matrix &P = marginals.jointCovariance(x_key, keys[i]);
+        Pxl[i] = P.topRightCorner<PoseDim, PointDim>();
+        const typename Engine::PointCovariance Pll = P.bottomRightCorner<PointDim, PointDim>();
+        const POINT lmk = registry.landmarkPoint(keys[i]);
+        for (size_t meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+        {
+          innovation_engine_.add(meas_idx, keys[i], batch_.point(meas_idx), batch_.noise(meas_idx).variances, lmk, Pxl[i], Pll);
+        }
+      }
+      innovation_engine_.evaluate();
+
+      candidates_.clear();
+      meas_candidates_.assign(num_measurements, {});
+      for (size_t pair = 0; pair < innovation_engine_.size(); pair++)
+      {
+        if (innovation_engine_.nis(pair) >= ic_threshold_)
+        {
+          continue;
+        }
+
+        // Pairs were added landmark by landmark
+        const int lmk_idx = pair / num_measurements;
+        const int meas_idx = innovation_engine_.measurement(pair);
+
+        Candidate c;
+        c.measurement = meas_idx;
+        c.landmark = keys[lmk_idx];
+        c.landmark_idx = lmk_idx;
+        c.nis = innovation_engine_.nis(pair);
+        c.innovation = Kernel::innovation(x_pose, registry.landmarkPoint(c.landmark), measurements[meas_idx].measurement, c.Hx, c.Hl);
+        c.S = innovation_engine_.innovationCovariance(pair);
+        c.Pxl = Pxl[lmk_idx];
+        c.A.noalias() = c.Hx * Pxx + c.Hl * c.Pxl.transpose();
+
+        meas_candidates_[meas_idx].push_back(candidates_.size());
+        candidates_.push_back(c);
+      }
+
+      // Most likely landmark first, so the first branch is the greedy one
+      order_.clear();
+      for (size_t meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+      {
+        auto &cands = meas_candidates_[meas_idx];
+        std::sort(cands.begin(), cands.end(), [this](int a, int b)
+                  { return candidates_[a].nis < candidates_[b].nis; });
+        if (!cands.empty())
+        {
+          order_.push_back(meas_idx);
+        }
+      }
+      // Measurements with few candidates first, as they constrain the rest the most
+      std::stable_sort(order_.begin(), order_.end(), [this](int a, int b)
+                       { return meas_candidates_[a].size() < meas_candidates_[b].size(); });
+
+      const int max_dim = order_.size() * PointDim;
+      L_.resize(max_dim, max_dim);
+      y_.resize(max_dim);
+      S_row_.resize(PointDim, max_dim);
+      landmark_used_.assign(keys.size(), false);
+      branch_.clear();
+      best_.clear();
+      best_nis_ = std::numeric_limits<double>::infinity();
+      deadline_ = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                         std::min(time_budget_, std::chrono::duration<double>(std::chrono::hours(24))));
+
+      {
+        PROFILE_ZONE("jcbb::search");
+        search(0, 0.0, marginals);
+      }
+
+#ifdef LOGGING
+      if (out_of_budget_)
+      {
+        std::cout << "JCBB ran out of budget after " << nodes_ << " nodes, using best hypothesis so far\n";
+      }
+#endif
+
+      for (int c : best_)
+      {
+        const Candidate &candidate = candidates_[c];
+        Association::shared_ptr a = std::make_shared<Association>(
+            candidate.measurement, candidate.landmark, gtsam::Matrix(candidate.Hx), gtsam::Matrix(candidate.Hl), gtsam::Vector(candidate.innovation));
+        h.extend(a);
+      }
+      h.fill_with_unassociated_measurements(num_measurements);
+      h.set_nis(best_.empty() ? std::numeric_limits<double>::infinity() : best_nis_);
+
+#ifdef LOGGING
+      std::cout << "\n\nJCBB made associations:\n";
+      for (const auto &asso : h.associations())
+      {
+        if (asso->associated())
+        {
+          std::cout << "Measurement z" << measurements[asso->measurement].idx << " associated with landmark " << gtsam::Symbol(*asso->landmark) << "\n";
+        }
+        else
+        {
+          std::cout << "Measurement z" << measurements[asso->measurement].idx << " unassociated\n";
+        }
+      }
+      std::cout << "\n";
+#endif // LOGGING
+
+      return h;
+    }
+
+  } // namespace jcbb
+} // namespace da
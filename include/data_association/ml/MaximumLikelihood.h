@@ -8,12 +8,20 @@
 #include <iostream>
 
 #include "slam/types.h"
+#include "slam/measurement_batch.h"
 
 #include <gtsam/base/FastVector.h>
 #include <gtsam/geometry/Pose3.h>
 
 #include "data_association/Hypothesis.h"
 #include "data_association/DataAssociation.h"
+#include "data_association/LandmarkGrid.h"
+#include "data_association/InnovationEngine.h"
+#include "data_association/SparseAssignment.h"
+#include "data_association/Auction.h"
+#include "data_association/Clustering.h"
+#include "data_association/Murty.h"
+#include "utils/thread_pool.h"
 
 namespace da
 {
@@ -27,20 +35,95 @@ namespace da
     {
 
     private:
+      using Kernel = CompatibilityKernel<POSE, POINT>;
+
       double mh_threshold_;
       double sigmas_;
-      double range_threshold_;
+      RangeGate<POINT> range_gate_;
+      AssignmentSolver assignment_solver_;
+
+      // Leaving a measurement unassigned costs the same as the dummy measurements of the dense formulation
+      static constexpr double unassigned_cost_ = 10'000;
+
+      using Engine = InnovationEngine<POSE, POINT>;
+
+      struct Candidate
+      {
+        gtsam::Key landmark;
+        int measurement;
+        double mle_cost;
+      };
+
+      // Gating is only done in parallel with more than one thread
+      std::unique_ptr<utils::ThreadPool> thread_pool_;
+
+      // One per chunk of measurements, kept between calls so their buffers are reused
+      std::vector<Engine> innovation_engines_;
+
+      // Measurements being associated, kept between calls so noise models are only converted the first time seen
+      slam::MeasurementBatch<POINT> batch_;
+
+      // Scratch of the joint NIS of a hypothesis, reused between calls
+      mutable JointCompatibility<POSE, POINT> joint_compatibility_;
+
+      // Individually compatible pairs against the latest pose, as a cost matrix with a column per candidate landmark
+      struct AssignmentProblem
+      {
+        gtsam::Key x_key;
+        POSE x_pose;
+        SparseCostMatrix costs;
+        std::vector<gtsam::Key> col_to_lmk;
+      };
+
+      AssignmentProblem assignmentProblem(
+          const gtsam::Values &estimates,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
+          const gtsam::FastVector<slam::Measurement<POINT>> &measurements);
+
+      // Hypothesis of an assignment to problem, with the cost of the assignment
+      hypothesis::Hypothesis makeHypothesis(
+          const AssignmentProblem &problem,
+          const std::vector<int> &associated_measurements,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
+          const gtsam::FastVector<slam::Measurement<POINT>> &measurements) const;
+
+      // Solves one cluster with the configured solver, using thread_pool within the solver if not null
+      std::vector<int> solveAssignment(const SparseCostMatrix &costs, utils::ThreadPool *thread_pool) const;
+
+      // Writes a solution in the local indices of cluster into assignment, in global indices
+      static void scatterAssignment(
+          const AssignmentCluster &cluster,
+          const std::vector<int> &local_assignment,
+          std::vector<int> &assignment);
 
     public:
-      MaximumLikelihood(double sigmas, double range_threshold = std::numeric_limits<double>::infinity());
+      MaximumLikelihood(
+          double sigmas,
+          double range_threshold = std::numeric_limits<double>::infinity(),
+          int num_threads = 1,
+          AssignmentSolver assignment_solver = AssignmentSolver::ShortestAugmentingPath);
       virtual hypothesis::Hypothesis associate(
           const gtsam::Values &estimates,
-          const gtsam::Marginals &marginals,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
           const gtsam::FastVector<slam::Measurement<POINT>> &measurements) override;
 
+      // Ranked by assignment cost, with Murty's method on the same cost matrix as associate()
+      virtual std::vector<hypothesis::Hypothesis> associate_k_best(
+          const gtsam::Values &estimates,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
+          const gtsam::FastVector<slam::Measurement<POINT>> &measurements,
+          int k) override;
+
+      virtual void landmarksUpdated(const slam::KeyRegistry<POINT> &registry) override;
+
     hypothesis::Hypothesis associate_bad(
           const gtsam::Values &estimates,
-          const gtsam::Marginals &marginals,
+          const slam::KeyRegistry<POINT> &registry,
+          const slam::CovarianceRecovery &marginals,
           const gtsam::FastVector<slam::Measurement<POINT>> &measurements);
     };
 
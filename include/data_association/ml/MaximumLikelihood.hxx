@@ -9,9 +9,8 @@
 #include <slam/types.h>
 #include <limits>
 
-#include <chrono>
-
 #include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
 
 
 namespace da
@@ -23,78 +22,84 @@ namespace da
     using gtsam::symbol_shorthand::X;
 
     template <class POSE, class POINT>
-    MaximumLikelihood<POSE, POINT>::MaximumLikelihood(double sigmas, double range_threshold)
+    MaximumLikelihood<POSE, POINT>::MaximumLikelihood(double sigmas, double range_threshold, int num_threads, AssignmentSolver assignment_solver)
         : mh_threshold_(sigmas * sigmas),
-          range_threshold_(range_threshold),
-          sigmas_(sigmas)
+          range_gate_(range_threshold),
+          sigmas_(sigmas),
+          assignment_solver_(assignment_solver)
     {
+      if (num_threads > 1)
+      {
+        thread_pool_ = std::make_unique<utils::ThreadPool>(num_threads);
+      }
     }
 
     template <class POSE, class POINT>
-    Hypothesis MaximumLikelihood<POSE, POINT>::associate(
-        const gtsam::Values &estimates,
-        const gtsam::Marginals &marginals,
-        const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
+    void MaximumLikelihood<POSE, POINT>::landmarksUpdated(const slam::KeyRegistry<POINT> &registry)
     {
+      range_gate_.update(registry);
+    }
 
-#ifdef PROFILING
-      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    template <class POSE, class POINT>
+    std::vector<int> MaximumLikelihood<POSE, POINT>::solveAssignment(const SparseCostMatrix &costs, utils::ThreadPool *thread_pool) const
+    {
+      PROFILE_ZONE("ml::solveAssignment");
+      if (assignment_solver_ == AssignmentSolver::Auction)
+      {
+        AuctionResult auction_result = auction(costs, unassigned_cost_, AuctionParams(), thread_pool);
+        if (auction_result.converged)
+        {
+          return std::move(auction_result.assignment);
+        }
+#ifdef LOGGING
+        std::cout << "Auction did not converge after " << auction_result.rounds << " rounds, with gap " << auction_result.gap
+                  << ", falling back to shortest augmenting path\n";
 #endif
+      }
+      return sparse_assignment(costs, unassigned_cost_);
+    }
 
-      gtsam::KeyList landmark_keys = estimates.filter(gtsam::Symbol::ChrTest('l')).keys();
-      auto poses = estimates.filter(gtsam::Symbol::ChrTest('x'));
-      int last_pose = poses.size() - 1; // Assuming first pose is 0
-      gtsam::Key x_key = X(last_pose);
-      POSE x_pose = estimates.at<POSE>(x_key);
-      size_t num_measurements = measurements.size();
-      size_t num_landmarks = landmark_keys.size();
-
-      // Make hypothesis to return later
-      hypothesis::Hypothesis h = hypothesis::Hypothesis::empty_hypothesis();
-
-      // If no landmarks, return immediately
-      if (num_landmarks == 0)
+    template <class POSE, class POINT>
+    void MaximumLikelihood<POSE, POINT>::scatterAssignment(
+        const AssignmentCluster &cluster,
+        const std::vector<int> &local_assignment,
+        std::vector<int> &assignment)
+    {
+      for (size_t r = 0; r < cluster.rows.size(); r++)
       {
-        h.fill_with_unassociated_measurements(num_measurements);
-        return h;
+        assignment[cluster.rows[r]] = local_assignment[r] == -1 ? -1 : cluster.cols[local_assignment[r]];
       }
+    }
 
-#ifdef PROFILING
-      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-      std::cout << "Initialization of div variables took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
+    template <class POSE, class POINT>
+    typename MaximumLikelihood<POSE, POINT>::AssignmentProblem MaximumLikelihood<POSE, POINT>::assignmentProblem(
+        const gtsam::Values &estimates,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
+    {
+      PROFILE_ZONE("ml::assignmentProblem");
 
-      begin = std::chrono::steady_clock::now();
-#endif
+      // Not necessarily X(poses - 1), as old poses may be marginalized out
+      gtsam::Key x_key = registry.latestPose();
+      POSE x_pose = estimates.at<POSE>(x_key);
+      size_t num_measurements = measurements.size();
+      size_t num_landmarks = registry.numLandmarks();
 
-      gtsam::Matrix Hx, Hl;
-      gtsam::KeyVector keys;
-      keys.push_back(x_key);
+      // Without any feasible pairs every measurement is left unassigned
+      AssignmentProblem problem;
+      problem.x_key = x_key;
+      problem.x_pose = x_pose;
+      problem.costs = SparseCostMatrix(num_measurements, 0, {});
 
-      for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+      // If no landmarks, return immediately
+      if (num_landmarks == 0)
       {
-        const auto &meas = measurements[meas_idx].measurement;
-        POINT meas_world = x_pose * meas;
-        const auto &noise = measurements[meas_idx].noise;
-
-        for (int lmk_idx = 0; lmk_idx < num_landmarks; lmk_idx++)
-        {
-          gtsam::Key l = L(lmk_idx);
-          POINT lmk = estimates.at<POINT>(l);
-          if ((meas_world - lmk).norm() <= range_threshold_)
-          {
-            // Key not already in vector
-            if (std::find(keys.begin(), keys.end(), l) == keys.end())
-            {
-              keys.push_back(l);
-            }
-          }
-        }
+        return problem;
       }
 
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Building key vector took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-#endif
+      gtsam::KeyVector keys = range_gate_.gatedLandmarks(registry, x_pose, measurements);
+      keys.insert(keys.begin(), x_key);
 
       // If no landmarks are close enough, terminate
       if (keys.size() == 1)
@@ -102,162 +107,166 @@ namespace da
 #ifdef LOGGING
         std::cout << "No landmarks close enough to measurements, terminating!\n";
 #endif
-        h.fill_with_unassociated_measurements(num_measurements);
-        return h;
+        return problem;
       }
 
-#ifdef PROFILING
-      begin = std::chrono::steady_clock::now();
-#endif
-
-      gtsam::JointMarginal joint_marginals = marginals.jointMarginalCovariance(keys);
-
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Making joint marginals took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-
-      begin = std::chrono::steady_clock::now();
-#endif
-
       // Map of landmarks that are individually compatible with at least one measurement, with NIS
       gtsam::FastMap<gtsam::Key, std::vector<std::pair<int, double>>> lmk_meas_asso_candidates;
 
-      for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+      batch_.assign(measurements);
+
+      // The covariance recovery caches are not thread safe, so everything needed from it is fetched up front
+      const typename Engine::PoseCovariance Pxx = marginals.marginalCovariance(x_key);
+      std::vector<POINT> lmks;
+      std::vector<typename Engine::CrossCovariance> Pxl;
+      std::vector<typename Engine::PointCovariance> Pll;
+      lmks.reserve(keys.size() - 1);
+      Pxl.reserve(keys.size() - 1);
+      Pll.reserve(keys.size() - 1);
+      for (int i = 1; i < keys.size(); i++)
       {
-        const auto &meas = measurements[meas_idx].measurement;
-        POINT meas_world = x_pose * meas;
-        const auto &noise = measurements[meas_idx].noise;
+        lmks.push_back(registry.landmarkPoint(keys[i]));
+        const gtsam::Matrix &P = marginals.jointCovariance(x_key, keys[i]);
+        Pxl.push_back(P.topRightCorner<Engine::PoseDim, Engine::PointDim>());
+        Pll.push_back(P.bottomRightCorner<Engine::PointDim, Engine::PointDim>());
+      }
 
-        // Start iteration at second element as the first one is state
-        for (int i = 1; i < keys.size(); i++)
+      // Measurements are split into contiguous chunks, each gated in a batch of its own with its own buffers
+      const size_t num_chunks = thread_pool_ ? std::min(thread_pool_->size(), num_measurements) : 1;
+      std::vector<std::vector<Candidate>> chunk_candidates(num_chunks);
+
+      auto gate_chunk = [&](size_t chunk)
+      {
+        PROFILE_ZONE("ml::gate chunk");
+        const size_t meas_begin = chunk * num_measurements / num_chunks;
+        const size_t meas_end = (chunk + 1) * num_measurements / num_chunks;
+
+        Engine &engine = innovation_engines_[chunk];
+        engine.reset(x_pose, Pxx);
+        engine.reserve((meas_end - meas_begin) * lmks.size());
+
+        for (size_t meas_idx = meas_begin; meas_idx < meas_end; meas_idx++)
         {
-          gtsam::Key l = keys[i];
-          POINT lmk = estimates.at<POINT>(l);
-          gtsam::PoseToPointFactor<POSE, POINT> factor(x_key, l, meas, noise);
-          gtsam::Vector error = factor.evaluateError(x_pose, lmk, Hx, Hl);
-          hypothesis::Association a(meas_idx, l, Hx, Hl, error);
-          double log_norm_factor;
-          double mh_dist = individual_compatability(a, x_key, joint_marginals, measurements, log_norm_factor);
+          const POINT meas = batch_.point(meas_idx);
+          const POINT &noise_variance = batch_.noise(meas_idx).variances;
 
-          double mle_cost = mh_dist + log_norm_factor;
+          // Start iteration at second element as the first one is state
+          for (int i = 1; i < keys.size(); i++)
+          {
+            engine.add(meas_idx, keys[i], meas, noise_variance, lmks[i - 1], Pxl[i - 1], Pll[i - 1]);
+          }
+        }
+
+        engine.evaluate();
+
+        for (size_t pair = 0; pair < engine.size(); pair++)
+        {
+          double mh_dist = engine.nis(pair);
+          double mle_cost = mh_dist + engine.logDet(pair);
 
           // Individually compatible?
           if (mh_dist < mh_threshold_)
           {
-            lmk_meas_asso_candidates[l].push_back({meas_idx, mle_cost});
+            chunk_candidates[chunk].push_back({engine.landmark(pair), engine.measurement(pair), mle_cost});
           }
         }
-      }
+      };
 
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Computing individual compatibility took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-
-      begin = std::chrono::steady_clock::now();
-#endif
-
-      size_t num_assoed_lmks = lmk_meas_asso_candidates.size();
+      if (innovation_engines_.size() < num_chunks)
+      {
+        innovation_engines_.resize(num_chunks);
+      }
 
-      // We found landmarks that can be associated, set up for auction algorithm
-      if (num_assoed_lmks > 0)
+      if (num_chunks == 1)
+      {
+        gate_chunk(0);
+      }
+      else
       {
-        // Build cost matrix
-        gtsam::Matrix cost_matrix = gtsam::Matrix::Constant(
-            num_measurements,
-            num_assoed_lmks + num_measurements,
-            std::numeric_limits<double>::infinity());
+        thread_pool_->parallel_for(num_chunks, gate_chunk);
+      }
 
-        // Fill bottom diagonal with "dummy measurements" meaning they are unassigned.
-        cost_matrix.rightCols(num_measurements).diagonal().array() = 10'000;
+      // Chunks are in measurement order, so merging them in order gives exactly the candidates of the serial path
+      for (const auto &candidates : chunk_candidates)
+      {
+        for (const Candidate &c : candidates)
+        {
+          lmk_meas_asso_candidates[c.landmark].push_back({c.measurement, c.mle_cost});
+        }
+      }
 
-        // To keep track of what column in the cost matrix corresponds to what actual landmark
-        std::vector<gtsam::Key> cost_mat_col_to_lmk;
+      size_t num_assoed_lmks = lmk_meas_asso_candidates.size();
 
-        // Fill cost matrix based on valid associations
-        int lmk_idx = 0;
-        double lowest_mle_cost = std::numeric_limits<double>::infinity();
+      // Build sparse cost matrix, only individually compatible pairs are feasible
+      std::vector<SparseCostMatrix::Entry> cost_entries;
 
-        for (const auto &[lmk, meas_candidates] : lmk_meas_asso_candidates)
+      int lmk_idx = 0;
+      for (const auto &[lmk, meas_candidates] : lmk_meas_asso_candidates)
+      {
+        problem.col_to_lmk.push_back(lmk);
+        for (const auto &[meas_idx, mle_cost] : meas_candidates)
         {
-          cost_mat_col_to_lmk.push_back(lmk);
-          for (const auto &[meas_idx, mle_cost] : meas_candidates)
-          {
-            cost_matrix(meas_idx, lmk_idx) = mle_cost;
-            if (mle_cost < lowest_mle_cost)
-            {
-              lowest_mle_cost = mle_cost;
-            }
-          }
-          lmk_idx++;
+          cost_entries.push_back({meas_idx, lmk_idx, mle_cost});
         }
+        lmk_idx++;
+      }
 
-#ifdef PROFILING
-        end = std::chrono::steady_clock::now();
-        std::cout << "Building cost matrix took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-#endif
-
-        cost_matrix.array() -= lowest_mle_cost; // We subtract lowest to ensure all costs are nonnegative
-
-#ifdef PROFILING
-        begin = std::chrono::steady_clock::now();
-#endif
+      problem.costs = SparseCostMatrix(num_measurements, num_assoed_lmks, cost_entries);
 
-        std::vector<int> associated_measurements = hungarian(cost_matrix);
+      return problem;
+    }
 
-#ifdef PROFILING
-        end = std::chrono::steady_clock::now();
-        std::cout << "Hungarian algorithm took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-#endif
+    template <class POSE, class POINT>
+    Hypothesis MaximumLikelihood<POSE, POINT>::makeHypothesis(
+        const AssignmentProblem &problem,
+        const std::vector<int> &associated_measurements,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<slam::Measurement<POINT>> &measurements) const
+    {
+      const size_t num_measurements = measurements.size();
+      hypothesis::Hypothesis h = hypothesis::Hypothesis::empty_hypothesis();
+      gtsam::Matrix Hx, Hl;
 
 #ifdef LOGGING
-        for (int m = 0; m < associated_measurements.size(); m++)
+      for (int m = 0; m < associated_measurements.size(); m++)
+      {
+        std::cout << "Measurement " << m << " associated with ";
+        if (associated_measurements[m] != -1)
         {
-          std::cout << "Measurement " << m << " associated with ";
-          if (associated_measurements[m] < num_assoed_lmks)
-          {
-            std::cout << " landmark " << associated_measurements[m];
-          }
-          else
-          {
-            std::cout << "no landmark";
-          }
-          std::cout << "\n";
+          std::cout << " landmark " << associated_measurements[m];
         }
+        else
+        {
+          std::cout << "no landmark";
+        }
+        std::cout << "\n";
+      }
 #endif
 
-#ifdef PROFILING
-        begin = std::chrono::steady_clock::now();
-#endif
-
-        for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+      for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
+      {
+        int lmk_idx = associated_measurements[meas_idx];
+        if (lmk_idx == -1)
         {
-          int lmk_idx = associated_measurements[meas_idx];
-          if (lmk_idx == -1 || lmk_idx >= num_assoed_lmks)
-          {
-            continue; // Measurement associated with dummy landmark, so skip
-          }
-          gtsam::Key l = cost_mat_col_to_lmk[lmk_idx];
-          POINT lmk = estimates.at<POINT>(l);
-
-          const auto &meas = measurements[meas_idx].measurement;
-          const auto &noise = measurements[meas_idx].noise;
+          continue; // Measurement left unassigned, so skip
+        }
+        gtsam::Key l = problem.col_to_lmk[lmk_idx];
+        POINT lmk = registry.landmarkPoint(l);
 
-          gtsam::PoseToPointFactor<POSE, POINT> factor(x_key, l, meas, noise);
-          gtsam::Vector error = factor.evaluateError(x_pose, lmk, Hx, Hl);
-          Association::shared_ptr a = std::make_shared<Association>(meas_idx, l, Hx, Hl, error);
-          // auto [nis, log_norm_factor] = individual_compatability(*a, x_key, joint_marginals, measurements);
+        const auto &meas = measurements[meas_idx].measurement;
+        const auto &noise = measurements[meas_idx].noise;
 
-          h.extend(a);
-        }
+        gtsam::PoseToPointFactor<POSE, POINT> factor(problem.x_key, l, meas, noise);
+        gtsam::Vector error = factor.evaluateError(problem.x_pose, lmk, Hx, Hl);
+        Association::shared_ptr a = std::make_shared<Association>(meas_idx, l, Hx, Hl, error);
 
-#ifdef PROFILING
-        end = std::chrono::steady_clock::now();
-        std::cout << "Building hypothesis from auction solution took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-#endif
+        h.extend(a);
       }
 
       // Regardless of if no or only some measurements were made, fill hypothesis with remaining unassociated measurements and return
       h.fill_with_unassociated_measurements(num_measurements);
+      h.set_cost(assignment_cost(problem.costs, associated_measurements, unassigned_cost_));
 
 #ifdef LOGGING
       std::cout << "\n\nMaximum likelihood made associations:\n";
@@ -277,30 +286,100 @@ namespace da
 
 #ifdef HYPOTHESIS_QUALITY
       std::cout << "Computing joint NIS\n";
-      double nis = joint_compatability<POSE::dimension, POINT::RowsAtCompileTime, POINT::RowsAtCompileTime>(h, x_key, marginals, measurements);
+      double nis = joint_compatibility_(h, problem.x_key, marginals, measurements);
       h.set_nis(nis);
 #endif
       return h;
     }
 
     template <class POSE, class POINT>
-    Hypothesis MaximumLikelihood<POSE, POINT>::associate_bad(
+    Hypothesis MaximumLikelihood<POSE, POINT>::associate(
         const gtsam::Values &estimates,
-        const gtsam::Marginals &marginals,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
         const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
     {
+      PROFILE_ZONE("ml::associate");
+      const size_t num_measurements = measurements.size();
+      AssignmentProblem problem = assignmentProblem(estimates, registry, marginals, measurements);
 
-#ifdef PROFILING
-      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
-#endif
+      // Measurements only compete with the ones sharing candidate landmarks, so each cluster is solved on its own
+      std::vector<AssignmentCluster> clusters = cluster_assignment(problem.costs);
+      std::vector<int> associated_measurements(num_measurements, -1);
+
+      std::vector<size_t> nontrivial_clusters;
+      for (size_t c = 0; c < clusters.size(); c++)
+      {
+        if (is_trivial(clusters[c]))
+        {
+          std::vector<int> local = trivial_assignment(clusters[c], unassigned_cost_);
+          scatterAssignment(clusters[c], local, associated_measurements);
+        }
+        else
+        {
+          nontrivial_clusters.push_back(c);
+        }
+      }
+
+      // Clusters are spread over the threads if there are several, otherwise the threads are left to the solver.
+      // Never both, as a solver waiting on the pool from within the pool could deadlock it.
+      if (thread_pool_ && nontrivial_clusters.size() > 1)
+      {
+        std::vector<std::vector<int>> local(nontrivial_clusters.size());
+        thread_pool_->parallel_for(nontrivial_clusters.size(), [&](size_t k)
+                                   { local[k] = solveAssignment(clusters[nontrivial_clusters[k]].costs, nullptr); });
+        for (size_t k = 0; k < nontrivial_clusters.size(); k++)
+        {
+          scatterAssignment(clusters[nontrivial_clusters[k]], local[k], associated_measurements);
+        }
+      }
+      else
+      {
+        for (size_t c : nontrivial_clusters)
+        {
+          scatterAssignment(clusters[c], solveAssignment(clusters[c].costs, thread_pool_.get()), associated_measurements);
+        }
+      }
+
+      return makeHypothesis(problem, associated_measurements, registry, marginals, measurements);
+    }
+
+    template <class POSE, class POINT>
+    std::vector<Hypothesis> MaximumLikelihood<POSE, POINT>::associate_k_best(
+        const gtsam::Values &estimates,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<slam::Measurement<POINT>> &measurements,
+        int k)
+    {
+      PROFILE_ZONE("ml::associate_k_best");
+      AssignmentProblem problem = assignmentProblem(estimates, registry, marginals, measurements);
+
+      std::vector<RankedAssignment> ranked = murty(problem.costs, unassigned_cost_, k);
+
+      std::vector<Hypothesis> hypotheses;
+      hypotheses.reserve(ranked.size());
+      for (const RankedAssignment &r : ranked)
+      {
+        hypotheses.push_back(makeHypothesis(problem, r.assignment, registry, marginals, measurements));
+      }
+      return hypotheses;
+    }
+
+    template <class POSE, class POINT>
+    Hypothesis MaximumLikelihood<POSE, POINT>::associate_bad(
+        const gtsam::Values &estimates,
+        const slam::KeyRegistry<POINT> &registry,
+        const slam::CovarianceRecovery &marginals,
+        const gtsam::FastVector<slam::Measurement<POINT>> &measurements)
+    {
+      PROFILE_ZONE("ml::associate_bad");
 
-      gtsam::KeyList landmark_keys = estimates.filter(gtsam::Symbol::ChrTest('l')).keys();
-      auto poses = estimates.filter(gtsam::Symbol::ChrTest('x'));
-      int last_pose = poses.size() - 1; // Assuming first pose is 0
-      gtsam::Key x_key = X(last_pose);
+      // Not necessarily X(poses - 1), as old poses may be marginalized out
+      gtsam::Key x_key = registry.latestPose();
       POSE x_pose = estimates.at<POSE>(x_key);
       size_t num_measurements = measurements.size();
-      size_t num_landmarks = landmark_keys.size();
+      size_t num_landmarks = registry.numLandmarks();
 
       // Make hypothesis to return later
       hypothesis::Hypothesis h = hypothesis::Hypothesis::empty_hypothesis();
@@ -312,42 +391,9 @@ namespace da
         return h;
       }
 
-#ifdef PROFILING
-      std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-      std::cout << "Initialization of div variables took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-
-      begin = std::chrono::steady_clock::now();
-#endif
-
       gtsam::Matrix Hx, Hl;
-      gtsam::KeyVector keys;
-      keys.push_back(x_key);
-
-      for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
-      {
-        const auto &meas = measurements[meas_idx].measurement;
-        POINT meas_world = x_pose * meas;
-        const auto &noise = measurements[meas_idx].noise;
-
-        for (int lmk_idx = 0; lmk_idx < num_landmarks; lmk_idx++)
-        {
-          gtsam::Key l = L(lmk_idx);
-          POINT lmk = estimates.at<POINT>(l);
-          if ((meas_world - lmk).norm() <= range_threshold_)
-          {
-            // Key not already in vector
-            if (std::find(keys.begin(), keys.end(), l) == keys.end())
-            {
-              keys.push_back(l);
-            }
-          }
-        }
-      }
-
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Building key vector took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-#endif
+      gtsam::KeyVector keys = range_gate_.gatedLandmarks(registry, x_pose, measurements);
+      keys.insert(keys.begin(), x_key);
 
       // If no landmarks are close enough, terminate
       if (keys.size() == 1)
@@ -358,27 +404,17 @@ namespace da
         return h;
       }
 
-#ifdef PROFILING
-      begin = std::chrono::steady_clock::now();
-#endif
-
-      gtsam::JointMarginal joint_marginals = marginals.jointMarginalCovariance(keys);
-
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Making joint marginals took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-
-      begin = std::chrono::steady_clock::now();
-#endif
-
       // Map of landmarks that are individually compatible with at least one measurement, with NIS
       gtsam::FastMap<gtsam::Key, std::vector<std::pair<int, double>>> lmk_meas_asso_candidates;
 
+      typename Kernel::JacobianPose Hx_fixed;
+      typename Kernel::JacobianPoint Hl_fixed;
+
+      batch_.assign(measurements);
       for (int meas_idx = 0; meas_idx < num_measurements; meas_idx++)
       {
-        const auto &meas = measurements[meas_idx].measurement;
-        POINT meas_world = x_pose * meas;
-        const auto &noise = measurements[meas_idx].noise;
+        const POINT meas = batch_.point(meas_idx);
+        const typename Kernel::Covariance R = batch_.noise(meas_idx).variances.asDiagonal();
 
         double lowest_mle_cost = std::numeric_limits<double>::infinity();
 
@@ -388,13 +424,11 @@ namespace da
         for (int i = 1; i < keys.size(); i++)
         {
           gtsam::Key l = keys[i];
-          POINT lmk = estimates.at<POINT>(l);
-          gtsam::PoseToPointFactor<POSE, POINT> factor(x_key, l, meas, noise);
-          gtsam::Vector error = factor.evaluateError(x_pose, lmk, Hx, Hl);
-          hypothesis::Association a(meas_idx, l, Hx, Hl, error);
+          const POINT &lmk = registry.landmarkPoint(l);
+          typename Kernel::Innovation error = Kernel::innovation(x_pose, lmk, meas, Hx_fixed, Hl_fixed);
+          typename Kernel::Covariance S = Kernel::innovationCovariance(Hx_fixed, Hl_fixed, Kernel::jointCovariance(marginals, x_key, l), R);
           double log_norm_factor;
-          Eigen::Matrix2d S;
-          double mh_dist = individual_compatability(a, x_key, joint_marginals, measurements, log_norm_factor, S);
+          double mh_dist = Kernel::nis(S, error, &log_norm_factor);
 
           double mle_cost = mh_dist + log_norm_factor;
 
@@ -414,13 +448,6 @@ namespace da
         }
       }
 
-#ifdef PROFILING
-      end = std::chrono::steady_clock::now();
-      std::cout << "Computing individual compatibility took " << std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << "[µs]" << std::endl;
-
-      begin = std::chrono::steady_clock::now();
-#endif
-
       size_t num_assoed_lmks = lmk_meas_asso_candidates.size();
 
       // We found landmarks that can be associated, set up for auction algorithm
@@ -434,7 +461,7 @@ namespace da
                                     { return p1.second < p2.second; });
           // Pretty redundant to do full recomputation here, but oh well
           int meas_idx = p->first;
-          POINT lmk = estimates.at<POINT>(l);
+          POINT lmk = registry.landmarkPoint(l);
 
           const auto &meas = measurements[meas_idx].measurement;
           const auto &noise = measurements[meas_idx].noise;
@@ -451,7 +478,7 @@ namespace da
 
 #ifdef HYPOTHESIS_QUALITY
       std::cout << "Computing joint NIS\n";
-      double nis = joint_compatability<POSE::dimension, POINT::RowsAtCompileTime, POINT::RowsAtCompileTime>(h, x_key, marginals, measurements);
+      double nis = joint_compatibility_(h, x_key, marginals, measurements);
       h.set_nis(nis);
 #endif
 
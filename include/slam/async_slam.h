@@ -0,0 +1,237 @@
+#ifndef ASYNC_SLAM_H
+#define ASYNC_SLAM_H
+
+#include <gtsam/nonlinear/Marginals.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "slam/types.h"
+#include "slam/slam.h"
+#include "slam/key_registry.h"
+#include "slam/covariance_recovery.h"
+#include "utils/bounded_queue.h"
+#include "data_association/Hypothesis.h"
+#include "data_association/DataAssociation.h"
+
+namespace slam
+{
+    // Which estimate the front end may associate a timestep against
+    enum class AssociationPolicy
+    {
+        // The estimate after every earlier timestep, same result as SLAM but nothing overlaps
+        WaitForLatest = 0,
+        // Whatever the back end last finished, as long as it misses at most max_staleness earlier timesteps
+        LatestAvailable = 1,
+    };
+} // slam
+
+inline std::ostream& operator<<(std::ostream& os, const slam::AssociationPolicy& policy) {
+  switch (policy) {
+    case slam::AssociationPolicy::WaitForLatest: {
+      os << "WaitForLatest";
+      break;
+    }
+    case slam::AssociationPolicy::LatestAvailable: {
+      os << "LatestAvailable";
+      break;
+    }
+  }
+  return os;
+}
+
+namespace slam
+{
+    /*
+     * SLAM with association and optimization pipelined on two threads, connected by bounded queues.
+     *
+     * The front end dead-reckons each timestep from the latest estimate published by the back end, recovers
+     * covariances and associates. The back end adds the odometry and the hypothesis to SLAM and optimizes, then
+     * publishes the result. With AssociationPolicy::LatestAvailable timestep t+1 is associated while timestep t is
+     * still being optimized. Landmarks first seen in the timesteps missing from that estimate can not be
+     * associated with, so they may be initialized twice.
+     *
+     * The back end publishes a snapshot after every timestep. It shares the estimates, registry and graph of the back end
+     * rather than copying them, so publishing is O(1), and one the front end never picks up is simply replaced by the next.
+     * SLAM copies one of them before changing it only while the front end still holds it, at most once per timestep,
+     * which costs no more than the optimization recomputing the estimates and refreshing the registry does anyway.
+     * With the ISAM2 back end the front end keeps a replica of the Bayes tree, replaying the updates pushed to the back
+     * end up to the snapshot it associates against, so the tree is never copied. Otherwise covariances are recovered in
+     * batch from the shared graph, which is only the window with fixed-lag smoothing. Poses dead-reckoned past the
+     * snapshot get their covariances propagated through the odometry, and only then are its estimates and registry copied.
+     * A fixed-lag back end may marginalize a landmark before a stale hypothesis reaches it, so it always waits for
+     * the latest estimate.
+     */
+    template <class POSE, class POINT>
+    class AsyncSLAM
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct TimestepResult
+        {
+            int step;
+            da::hypothesis::Hypothesis hypothesis;
+            // Timesteps included in the estimate the hypothesis was made against
+            size_t associated_against;
+            // Seconds spent in the front end and back end, and from processTimestep until done
+            double association_time;
+            double optimization_time;
+            double latency;
+        };
+
+        struct Stats
+        {
+            size_t timesteps = 0;
+            double association_time = 0.0; // Total busy time of the front end
+            double optimization_time = 0.0; // Total busy time of the back end
+            double wall_time = 0.0; // From the first processTimestep to the last timestep done
+            double mean_latency = 0.0;
+            double max_latency = 0.0;
+
+            inline double throughput() const { return wall_time > 0.0 ? timesteps / wall_time : 0.0; }
+            // Time the two threads were busy at once, positive only if the pipeline overlapped
+            inline double overlap() const { return association_time + optimization_time - wall_time; }
+        };
+
+    private:
+        // Back end state published to the front end after every timestep, never changed once published
+        struct Snapshot
+        {
+            size_t timesteps;
+            size_t latest_pose; // Index of the last pose key
+            std::shared_ptr<const gtsam::Values> estimates;
+            std::shared_ptr<const KeyRegistry<POINT>> registry;
+            // Batch and fixed-lag back ends only
+            std::shared_ptr<const gtsam::NonlinearFactorGraph> graph;
+            // ISAM2 back end only, number of updates of its Bayes tree so far
+            size_t bayes_tree_updates = 0;
+        };
+
+        struct BayesTreeUpdate
+        {
+            gtsam::NonlinearFactorGraph factors; // The factors themselves are shared with the back end
+            gtsam::Values values;
+            gtsam::ISAM2UpdateParams params;
+        };
+
+        struct Job
+        {
+            Timestep<POSE, POINT> timestep;
+            std::promise<TimestepResult> promise;
+            Clock::time_point submitted;
+        };
+
+        struct Associated
+        {
+            Job job;
+            da::hypothesis::Hypothesis hypothesis;
+            size_t associated_against;
+            double association_time;
+        };
+
+        AssociationPolicy policy_;
+        size_t max_staleness_;
+        gtsam::Marginals::Factorization marginals_factorization_;
+
+        // Only touched by the front end thread
+        std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association_;
+        std::shared_ptr<const Snapshot> landmarks_snapshot_; // Last estimate passed to landmarksUpdated
+        // Odometry by the index of the pose it leads to, for the poses the published estimate may lack
+        std::deque<std::pair<size_t, Odometry<POSE>>> pending_odometry_;
+        // Snapshot associated against, with covariances cached for as long as it stays the latest. The estimates and
+        // registry are only copied once poses are dead-reckoned past it, up to working_pose_.
+        std::shared_ptr<const Snapshot> working_snapshot_;
+        CovarianceRecovery marginals_;
+        std::optional<gtsam::Values> working_estimates_;
+        std::optional<KeyRegistry<POINT>> working_registry_;
+        size_t working_pose_;
+        size_t front_pose_;
+        size_t front_timesteps_;
+        // Replica of the Bayes tree of the ISAM2 back end, with the number of updates replayed on it so far
+        std::unique_ptr<gtsam::ISAM2> bayes_tree_;
+        size_t bayes_tree_updates_replayed_;
+
+        // Only touched by the back end thread while timesteps are in flight
+        SLAM<POSE, POINT> slam_;
+        size_t back_timesteps_;
+        size_t bayes_tree_updates_pushed_;
+
+        utils::BoundedQueue<Job> input_;
+        utils::BoundedQueue<Associated> associated_;
+
+        std::mutex snapshot_mutex_;
+        std::condition_variable snapshot_cv_;
+        std::shared_ptr<const Snapshot> snapshot_;
+        // Pushed by the back end as it updates, dropped by the front end as it replays them
+        std::deque<BayesTreeUpdate> bayes_tree_updates_;
+        // Set if any timestep failed, every later one fails with the same exception
+        std::exception_ptr failure_;
+
+        mutable std::mutex stats_mutex_;
+        Stats stats_;
+        std::optional<Clock::time_point> first_submitted_;
+
+        std::thread front_end_;
+        std::thread back_end_;
+
+        void runFrontEnd();
+        void runBackEnd();
+        void publish();
+        void fail(std::exception_ptr failure);
+        std::exception_ptr failure();
+        std::shared_ptr<const Snapshot> waitForSnapshot(size_t timesteps);
+        void replayBayesTreeUpdates(size_t updates);
+
+    public:
+        // Timesteps that may wait in each of the two queues before processTimestep blocks
+        explicit AsyncSLAM(size_t queue_capacity = 4);
+        ~AsyncSLAM();
+
+        AsyncSLAM(const AsyncSLAM &) = delete;
+        AsyncSLAM &operator=(const AsyncSLAM &) = delete;
+
+        // Starts the threads, the rest is the same as SLAM::initialize
+        void initialize(
+            const gtsam::Vector &pose_prior_noise,
+            std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
+            AssociationPolicy policy = AssociationPolicy::LatestAvailable,
+            size_t max_staleness = 1,
+            OptimizationMethod optimizaton_method = OptimizationMethod::GaussNewton,
+            gtsam::Marginals::Factorization marginals_factorization = gtsam::Marginals::CHOLESKY,
+            double smoother_lag = 20.0
+        );
+
+        // Queues the timestep, blocking while the pipeline is full. Timesteps are processed in the order given.
+        std::future<TimestepResult> processTimestep(const Timestep<POSE, POINT>& timestep);
+
+        Stats stats() const;
+
+        // Latest map of the back end, safe to call at any time
+        inline std::shared_ptr<const MapSnapshot<POSE, POINT>> mapSnapshot() const { return slam_.mapSnapshot(); }
+
+        // The back end itself, only safe to use once the futures of every queued timestep are ready
+        inline const SLAM<POSE, POINT>& backEnd() const { return slam_; }
+        inline const gtsam::Values& currentEstimates() const { return slam_.currentEstimates(); }
+        inline const gtsam::NonlinearFactorGraph& getGraph() const { return slam_.getGraph(); }
+        inline double error() const { return slam_.error(); }
+    };
+
+    using AsyncSLAM3D = AsyncSLAM<gtsam::Pose3, gtsam::Point3>;
+    using AsyncSLAM2D = AsyncSLAM<gtsam::Pose2, gtsam::Point2>;
+
+} // namespace slam
+
+#include "slam/async_slam.hxx"
+
+#endif // ASYNC_SLAM_H
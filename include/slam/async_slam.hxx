@@ -0,0 +1,349 @@
+#include "slam/async_slam.h"
+#include "slam/types.h"
+#include "slam/covariance_recovery.h"
+#include "data_association/Hypothesis.h"
+#include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
+
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/linear/NoiseModel.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+namespace slam
+{
+
+  template <class POSE, class POINT>
+  AsyncSLAM<POSE, POINT>::AsyncSLAM(size_t queue_capacity)
+      : policy_(AssociationPolicy::LatestAvailable),
+        max_staleness_(1),
+        marginals_factorization_(gtsam::Marginals::CHOLESKY),
+        working_pose_(0),
+        front_pose_(0),
+        front_timesteps_(0),
+        bayes_tree_updates_replayed_(0),
+        back_timesteps_(0),
+        bayes_tree_updates_pushed_(0),
+        input_(queue_capacity),
+        associated_(queue_capacity)
+  {
+  }
+
+  template <class POSE, class POINT>
+  AsyncSLAM<POSE, POINT>::~AsyncSLAM()
+  {
+    // Everything queued is still processed, the front end closes the queue to the back end when done
+    input_.close();
+    if (front_end_.joinable())
+    {
+      front_end_.join();
+    }
+    associated_.close();
+    if (back_end_.joinable())
+    {
+      back_end_.join();
+    }
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::initialize(
+      const gtsam::Vector &pose_prior_noise,
+      std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
+      AssociationPolicy policy,
+      size_t max_staleness,
+      OptimizationMethod optimizaton_method,
+      gtsam::Marginals::Factorization marginals_factorization,
+      double smoother_lag)
+  {
+    // The back end never associates itself, so it gets no data association to keep updated
+    slam_.initialize(pose_prior_noise, nullptr, optimizaton_method, marginals_factorization, smoother_lag);
+    data_association_ = data_association;
+    marginals_factorization_ = marginals_factorization;
+    marginals_.setFactorization(marginals_factorization_);
+    policy_ = policy;
+    max_staleness_ = max_staleness;
+
+    if (policy_ == AssociationPolicy::LatestAvailable && optimizaton_method == OptimizationMethod::FixedLag)
+    {
+      std::cout << "Fixed-lag smoothing can not associate against stale estimates, using " << AssociationPolicy::WaitForLatest << "\n";
+      policy_ = AssociationPolicy::WaitForLatest;
+    }
+
+    if (optimizaton_method == OptimizationMethod::ISAM2)
+    {
+      // Called on the back end thread, as it updates
+      bayes_tree_ = std::make_unique<gtsam::ISAM2>(slam_.bayesTree()->params());
+      slam_.setBayesTreeListener([this](const gtsam::NonlinearFactorGraph &factors, const gtsam::Values &values, const gtsam::ISAM2UpdateParams &params)
+                                 {
+                                   {
+                                     std::lock_guard<std::mutex> lock(snapshot_mutex_);
+                                     bayes_tree_updates_.push_back({factors, values, params});
+                                   }
+                                   bayes_tree_updates_pushed_++; });
+    }
+
+    publish();
+
+    front_end_ = std::thread(&AsyncSLAM::runFrontEnd, this);
+    back_end_ = std::thread(&AsyncSLAM::runBackEnd, this);
+  }
+
+  template <class POSE, class POINT>
+  std::future<typename AsyncSLAM<POSE, POINT>::TimestepResult> AsyncSLAM<POSE, POINT>::processTimestep(const Timestep<POSE, POINT> &timestep)
+  {
+    Job job{timestep, std::promise<TimestepResult>(), Clock::now()};
+    std::future<TimestepResult> result = job.promise.get_future();
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+      if (!first_submitted_)
+      {
+        first_submitted_ = job.submitted;
+      }
+    }
+    input_.push(std::move(job));
+    return result;
+  }
+
+  template <class POSE, class POINT>
+  typename AsyncSLAM<POSE, POINT>::Stats AsyncSLAM<POSE, POINT>::stats() const
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::publish()
+  {
+    PROFILE_ZONE("async::publish");
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->timesteps = back_timesteps_;
+    snapshot->latest_pose = gtsam::Symbol(slam_.latestPoseKey()).index();
+    snapshot->estimates = slam_.activeEstimatesSnapshot();
+    snapshot->registry = slam_.registrySnapshot();
+    // The back end optimizes after every timestep, so the Bayes tree holds every variable of the estimates
+    if (bayes_tree_)
+    {
+      snapshot->bayes_tree_updates = bayes_tree_updates_pushed_;
+    }
+    else
+    {
+      snapshot->graph = slam_.graphSnapshot();
+    }
+    {
+      std::lock_guard<std::mutex> lock(snapshot_mutex_);
+      snapshot_ = std::move(snapshot);
+    }
+    snapshot_cv_.notify_all();
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::fail(std::exception_ptr failure)
+  {
+    {
+      std::lock_guard<std::mutex> lock(snapshot_mutex_);
+      if (!failure_)
+      {
+        failure_ = failure;
+      }
+    }
+    snapshot_cv_.notify_all();
+  }
+
+  template <class POSE, class POINT>
+  std::exception_ptr AsyncSLAM<POSE, POINT>::failure()
+  {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return failure_;
+  }
+
+  template <class POSE, class POINT>
+  std::shared_ptr<const typename AsyncSLAM<POSE, POINT>::Snapshot> AsyncSLAM<POSE, POINT>::waitForSnapshot(size_t timesteps)
+  {
+    std::unique_lock<std::mutex> lock(snapshot_mutex_);
+    snapshot_cv_.wait(lock, [this, timesteps]
+                      { return failure_ || snapshot_->timesteps >= timesteps; });
+    if (failure_)
+    {
+      return nullptr;
+    }
+    return snapshot_;
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::replayBayesTreeUpdates(size_t updates)
+  {
+    PROFILE_ZONE("async::replayBayesTreeUpdates");
+    // The same updates in the same order as the back end, so the replica ends up with the same tree
+    while (bayes_tree_updates_replayed_ < updates)
+    {
+      BayesTreeUpdate update;
+      {
+        std::lock_guard<std::mutex> lock(snapshot_mutex_);
+        update = std::move(bayes_tree_updates_.front());
+        bayes_tree_updates_.pop_front();
+      }
+      bayes_tree_->update(update.factors, update.values, update.params);
+      bayes_tree_updates_replayed_++;
+    }
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::runFrontEnd()
+  {
+    while (std::optional<Job> job = input_.pop())
+    {
+      const Timestep<POSE, POINT> &timestep = job->timestep;
+      size_t index = front_timesteps_++;
+      // Same pose numbering as SLAM, which only adds a pose for timesteps after the first
+      if (timestep.step > 0)
+      {
+        front_pose_++;
+        pending_odometry_.push_back({front_pose_, timestep.odom});
+      }
+
+      size_t required = index;
+      if (policy_ == AssociationPolicy::LatestAvailable)
+      {
+        required = index > max_staleness_ ? index - max_staleness_ : 0;
+      }
+      std::shared_ptr<const Snapshot> snapshot = waitForSnapshot(required);
+      if (!snapshot)
+      {
+        job->promise.set_exception(failure());
+        continue;
+      }
+
+      Clock::time_point begin = Clock::now();
+
+      // Poses the back end has estimated need no odometry anymore
+      while (!pending_odometry_.empty() && pending_odometry_.front().first <= snapshot->latest_pose)
+      {
+        pending_odometry_.pop_front();
+      }
+
+      da::hypothesis::Hypothesis h = da::hypothesis::Hypothesis::empty_hypothesis();
+      try
+      {
+        if (timestep.measurements.size() > 0)
+        {
+          PROFILE_ZONE("async::associate");
+          if (snapshot != working_snapshot_)
+          {
+            working_snapshot_ = snapshot;
+            if (bayes_tree_)
+            {
+              replayBayesTreeUpdates(snapshot->bayes_tree_updates);
+              marginals_.update(*bayes_tree_, snapshot->timesteps);
+            }
+            else
+            {
+              marginals_.update(*snapshot->graph, *snapshot->estimates, snapshot->timesteps);
+            }
+            working_estimates_.reset();
+            working_registry_.reset();
+            working_pose_ = snapshot->latest_pose;
+          }
+
+          // Dead-reckon from the last estimated pose, with the odometry the back end has not added yet.
+          // The pose only depends on the one before through the odometry, so its covariance is propagated exactly.
+          for (const auto &[pose, odom] : pending_odometry_)
+          {
+            if (pose <= working_pose_)
+            {
+              continue;
+            }
+            auto gaussian = boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(odom.noise);
+            if (!gaussian)
+            {
+              throw std::invalid_argument("Odometry noise must be Gaussian to dead-reckon covariances");
+            }
+            if (!working_estimates_)
+            {
+              working_estimates_ = *snapshot->estimates;
+              working_registry_ = *snapshot->registry;
+            }
+            gtsam::Matrix H;
+            POSE predicted = working_estimates_->at<POSE>(X(pose - 1)).compose(odom.odom, H);
+            working_estimates_->insert(X(pose), predicted);
+            working_registry_->addPose(X(pose));
+            marginals_.addPrediction(X(pose), X(pose - 1), H, gaussian->covariance());
+            working_pose_ = pose;
+          }
+
+          if (snapshot != landmarks_snapshot_)
+          {
+            data_association_->landmarksUpdated(*snapshot->registry);
+            landmarks_snapshot_ = snapshot;
+          }
+          const gtsam::Values &estimates = working_estimates_ ? *working_estimates_ : *snapshot->estimates;
+          const KeyRegistry<POINT> &registry = working_registry_ ? *working_registry_ : *snapshot->registry;
+          h = data_association_->associate(estimates, registry, marginals_, timestep.measurements);
+        }
+      }
+      catch (...)
+      {
+        fail(std::current_exception());
+        job->promise.set_exception(std::current_exception());
+        continue;
+      }
+
+      double association_time = std::chrono::duration<double>(Clock::now() - begin).count();
+      associated_.push(Associated{std::move(*job), std::move(h), snapshot->timesteps, association_time});
+    }
+    associated_.close();
+  }
+
+  template <class POSE, class POINT>
+  void AsyncSLAM<POSE, POINT>::runBackEnd()
+  {
+    while (std::optional<Associated> item = associated_.pop())
+    {
+      Job &job = item->job;
+      if (std::exception_ptr failed = failure())
+      {
+        job.promise.set_exception(failed);
+        continue;
+      }
+
+      Clock::time_point begin = Clock::now();
+      try
+      {
+        PROFILE_ZONE("async::update");
+        slam_.addOdometry(job.timestep);
+        slam_.addHypothesis(job.timestep, item->hypothesis);
+        back_timesteps_++;
+        publish();
+      }
+      catch (...)
+      {
+        fail(std::current_exception());
+        job.promise.set_exception(std::current_exception());
+        continue;
+      }
+      Clock::time_point end = Clock::now();
+
+      TimestepResult result{
+          job.timestep.step,
+          std::move(item->hypothesis),
+          item->associated_against,
+          item->association_time,
+          std::chrono::duration<double>(end - begin).count(),
+          std::chrono::duration<double>(end - job.submitted).count()};
+
+      {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.timesteps++;
+        stats_.association_time += result.association_time;
+        stats_.optimization_time += result.optimization_time;
+        stats_.wall_time = std::chrono::duration<double>(end - *first_submitted_).count();
+        stats_.mean_latency += (result.latency - stats_.mean_latency) / stats_.timesteps;
+        stats_.max_latency = std::max(stats_.max_latency, result.latency);
+      }
+
+      job.promise.set_value(std::move(result));
+    }
+  }
+
+} // namespace slam
@@ -0,0 +1,115 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/nonlinear/NonlinearFactor.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace slam
+{
+  // Every checkpoint starts with these, a file of another format version is refused
+  constexpr uint64_t CHECKPOINT_MAGIC = 0x54504b434d414c53; // "SLAMCKPT"
+  constexpr uint32_t CHECKPOINT_FORMAT_VERSION = 3;
+
+  /*
+   * Builds a checkpoint in memory, as plain values in host byte order.
+   *
+   * Only the factor types SLAM creates can be written: priors and odometry on poses, and pose to point
+   * measurements, with diagonal, constrained or Gaussian noise but not robust noise. Graphs of the fixed lag smoother
+   * can be written too, with their empty slots and the linear marginals of variables that left the window. Likewise
+   * only 2D and 3D poses and points can be written as values. Anything else throws std::runtime_error.
+   */
+  class CheckpointWriter
+  {
+  private:
+    std::vector<char> buffer_;
+
+  public:
+    template <class T>
+    void write(const T &value)
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written directly");
+      writeBytes(&value, sizeof(T));
+    }
+
+    void writeBytes(const void *data, size_t size)
+    {
+      const char *bytes = static_cast<const char *>(data);
+      buffer_.insert(buffer_.end(), bytes, bytes + size);
+    }
+
+    void writeMatrix(const gtsam::Matrix &m);
+    void writePose(const gtsam::Pose2 &pose);
+    void writePose(const gtsam::Pose3 &pose);
+    void writeNoise(const gtsam::SharedNoiseModel &noise);
+    void writeFactor(const gtsam::NonlinearFactor::shared_ptr &factor);
+    void writeGraph(const gtsam::NonlinearFactorGraph &graph);
+    void writeValues(const gtsam::Values &values);
+
+    inline const char *data() const { return buffer_.data(); }
+    inline size_t size() const { return buffer_.size(); }
+
+    // Written to a temporary file first and then renamed, so an earlier checkpoint survives a crash while saving
+    void save(const std::string &filename) const;
+  };
+
+  /*
+   * Reads a checkpoint straight from a memory mapped file, in the order it was written.
+   * Reading past the end throws std::runtime_error, so a truncated file is never silently accepted.
+   */
+  class CheckpointReader
+  {
+  private:
+    const char *data_;
+    size_t size_;
+    size_t offset_;
+
+    const char *take(size_t size);
+
+  public:
+    explicit CheckpointReader(const std::string &filename);
+    ~CheckpointReader();
+
+    CheckpointReader(const CheckpointReader &) = delete;
+    CheckpointReader &operator=(const CheckpointReader &) = delete;
+
+    template <class T>
+    T read()
+    {
+      static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read directly");
+      T value;
+      std::memcpy(&value, take(sizeof(T)), sizeof(T));
+      return value;
+    }
+
+    gtsam::Matrix readMatrix();
+    /*
+     * Number of entries that follow, each encoded in at least min_size bytes. Throws std::runtime_error if there
+     * is not room left for that many, so a corrupt count never sizes an allocation.
+     */
+    uint64_t readCount(size_t min_size);
+    void readPose(gtsam::Pose2 &pose);
+    void readPose(gtsam::Pose3 &pose);
+    gtsam::SharedNoiseModel readNoise();
+    gtsam::NonlinearFactor::shared_ptr readFactor();
+    gtsam::NonlinearFactorGraph readGraph();
+    gtsam::Values readValues();
+
+    // Past encodings of known size, without decoding them
+    inline void skip(size_t size) { take(size); }
+    inline size_t offset() const { return offset_; }
+    inline size_t remaining() const { return size_ - offset_; }
+  };
+
+} // namespace slam
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,87 @@
+#ifndef COVARIANCE_RECOVERY_H
+#define COVARIANCE_RECOVERY_H
+
+#include <gtsam/nonlinear/ISAM2.h>
+#include <gtsam/nonlinear/Marginals.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+#include <gtsam/base/FastMap.h>
+
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace slam
+{
+    /*
+     * Recovers marginal covariances for data association, computing only the blocks that are asked for.
+     *
+     * With an incremental backend the blocks are read from the iSAM2 Bayes tree directly. Otherwise the graph is
+     * factorized once, on the first query after an update, instead of on every timestep.
+     * Results are cached until update() is called with a new version, i.e. until the factorization changes.
+     *
+     * Variables the graph or Bayes tree does not have yet can be predicted from one it does, e.g. poses dead-reckoned
+     * from the latest estimated one. Their covariances are propagated through the prediction instead of refactorizing.
+     */
+    class CovarianceRecovery
+    {
+    private:
+        gtsam::Marginals::Factorization factorization_;
+        std::optional<uint64_t> version_;
+
+        // Batch, graph and estimates are owned by the caller
+        const gtsam::NonlinearFactorGraph *graph_;
+        const gtsam::Values *estimates_;
+        mutable std::optional<gtsam::Marginals> marginals_;
+
+        // Incremental, owned by the caller
+        const gtsam::ISAM2 *isam_;
+
+        // to = f(from) + noise, with H the Jacobian of f and Q the covariance of the noise
+        struct Prediction
+        {
+            gtsam::Key from;
+            gtsam::Matrix H;
+            gtsam::Matrix Q;
+            size_t order; // Predictions are only ever made from earlier ones
+        };
+        gtsam::FastMap<gtsam::Key, Prediction> predictions_;
+
+        mutable gtsam::FastMap<gtsam::Key, gtsam::Matrix> marginal_cache_;
+        mutable std::map<std::pair<gtsam::Key, gtsam::Key>, gtsam::Matrix> joint_cache_;
+
+        void clear();
+        const gtsam::Marginals &marginals() const;
+        // Block (a, b) of the joint covariance, a != b, reducing predicted variables to the ones they came from
+        gtsam::Matrix crossCovariance(gtsam::Key a, gtsam::Key b) const;
+
+    public:
+        CovarianceRecovery(gtsam::Marginals::Factorization factorization = gtsam::Marginals::CHOLESKY);
+
+        // Graph and estimates must outlive all queries made before the next update
+        void update(const gtsam::NonlinearFactorGraph &graph, const gtsam::Values &estimates, uint64_t version);
+        // The Bayes tree of isam is used directly, so isam must outlive all queries made before the next update
+        void update(const gtsam::ISAM2 &isam, uint64_t version);
+
+        // Cleared by the next update with a new version. from must be known to the graph or Bayes tree, or predicted.
+        void addPrediction(gtsam::Key to, gtsam::Key from, const gtsam::Matrix &H, const gtsam::Matrix &Q);
+        inline bool isPredicted(gtsam::Key key) const { return predictions_.count(key) > 0; }
+
+        inline std::optional<uint64_t> version() const { return version_; }
+        void setFactorization(gtsam::Marginals::Factorization factorization);
+
+        const gtsam::Matrix &marginalCovariance(gtsam::Key key) const;
+
+        // Joint covariance of [a; b], with the block of a first
+        const gtsam::Matrix &jointCovariance(gtsam::Key a, gtsam::Key b) const;
+
+        // Block (i, j) of the joint covariance, same semantics as gtsam::JointMarginal
+        gtsam::Matrix operator()(gtsam::Key i, gtsam::Key j) const;
+
+        // Dense joint covariance of all keys, assembled from the pairwise blocks
+        gtsam::Matrix jointMarginalCovariance(const gtsam::KeyVector &keys) const;
+    };
+
+} // namespace slam
+
+#endif // COVARIANCE_RECOVERY_H
@@ -0,0 +1,35 @@
+#ifndef CRASH_DUMP_H
+#define CRASH_DUMP_H
+
+#include <gtsam/inference/Key.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Values.h>
+
+#include <cstdint>
+#include <string>
+
+namespace slam
+{
+  constexpr uint64_t CRASH_DUMP_MAGIC = 0x504d55444d414c53; // "SLAMDUMP"
+
+  /*
+   * Factor graph and estimates an optimization or covariance recovery failed on, with where it happened.
+   * Dumped to disk on request, and read back to replay the failure offline.
+   */
+  struct CrashDump
+  {
+    int step = -1; // Timestep being processed
+    gtsam::Key nearby_variable = 0;
+    std::string when;
+    gtsam::NonlinearFactorGraph graph;
+    gtsam::Values values;
+  };
+
+  // Same encoding as checkpoints, so the same factor and value types can be dumped
+  void saveCrashDump(const std::string &filename, int step, gtsam::Key nearby_variable, const std::string &when,
+                     const gtsam::NonlinearFactorGraph &graph, const gtsam::Values &values);
+  CrashDump loadCrashDump(const std::string &filename);
+
+} // namespace slam
+
+#endif // CRASH_DUMP_H
@@ -0,0 +1,57 @@
+#ifndef FACTOR_CHAIN_H
+#define FACTOR_CHAIN_H
+
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+
+#include <memory>
+#include <unordered_set>
+
+namespace slam
+{
+    /*
+     * Factor graph that shares its history with its copies, for keeping many branches of the same map.
+     *
+     * Factors are appended to a pending segment owned by this chain alone. seal() makes the pending factors an
+     * immutable segment linked to the previous ones, after which copies of the chain share every sealed segment and
+     * only copy what they add themselves. The factors themselves are shared pointers and are never copied.
+     */
+    class FactorChain
+    {
+    private:
+        struct Segment
+        {
+            std::shared_ptr<const Segment> parent;
+            gtsam::NonlinearFactorGraph factors;
+            size_t size; // Factors in this segment and all before it
+        };
+
+        std::shared_ptr<const Segment> head_;
+        gtsam::NonlinearFactorGraph pending_;
+
+    public:
+        FactorChain() = default;
+        FactorChain(const FactorChain &) = default;
+        FactorChain(FactorChain &&) = default;
+        FactorChain &operator=(const FactorChain &) = default;
+        FactorChain &operator=(FactorChain &&) = default;
+        ~FactorChain();
+
+        template <class FACTOR>
+        void add(const FACTOR &factor) { pending_.add(factor); }
+
+        // Makes the pending factors shared with copies made from now on
+        void seal();
+
+        size_t size() const;
+
+        // All factors in the order they were added
+        gtsam::NonlinearFactorGraph graph() const;
+
+        // Adds every sealed segment of this chain to segments, so that storage shared between chains can be counted once.
+        // Returns the number of factors in segments not already there, pending factors included.
+        size_t collectSegments(std::unordered_set<const void *> &segments) const;
+    };
+
+} // namespace slam
+
+#endif // FACTOR_CHAIN_H
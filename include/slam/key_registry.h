@@ -0,0 +1,131 @@
+#ifndef KEY_REGISTRY_H
+#define KEY_REGISTRY_H
+
+#include <gtsam/base/FastMap.h>
+#include <gtsam/inference/Key.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/Values.h>
+
+#include <cassert>
+#include <optional>
+#include <vector>
+
+namespace slam
+{
+  /*
+   * Pose and landmark keys of a set of estimates, in the order they were added, with the landmark estimates cached
+   * alongside. Lets data association find the latest pose and loop over landmarks without scanning gtsam::Values.
+   *
+   * Pose estimates are not cached: association reads the latest pose once per timestep, but every landmark estimate
+   * once per measurement, so only the latter is worth keeping in sync. This also keeps the registry independent of
+   * the pose type.
+   *
+   * Kept by SLAM as it adds variables, and refreshed from the estimates after every optimization.
+   */
+  template <class POINT>
+  class KeyRegistry
+  {
+  private:
+    gtsam::KeyVector poses_;
+    gtsam::KeyVector landmarks_;
+    std::vector<POINT> points_; // Estimate of landmarks_[i]
+    gtsam::FastMap<gtsam::Key, size_t> landmark_index_;
+
+    void reindexLandmarks()
+    {
+      landmark_index_.clear();
+      for (size_t i = 0; i < landmarks_.size(); i++)
+      {
+        landmark_index_[landmarks_[i]] = i;
+      }
+    }
+
+  public:
+    KeyRegistry() = default;
+
+    // For estimates not built up through a registry, scans them once for poses (symbol 'x') and landmarks (symbol 'l')
+    static KeyRegistry fromValues(const gtsam::Values &estimates)
+    {
+      KeyRegistry registry;
+      for (const gtsam::Key x : estimates.filter(gtsam::Symbol::ChrTest('x')).keys())
+      {
+        registry.addPose(x);
+      }
+      for (const gtsam::Key l : estimates.filter(gtsam::Symbol::ChrTest('l')).keys())
+      {
+        registry.addLandmark(l, estimates.at<POINT>(l));
+      }
+      return registry;
+    }
+
+    // Poses must be added in order, the last one added is the latest
+    void addPose(gtsam::Key key) { poses_.push_back(key); }
+
+    void addLandmark(gtsam::Key key, const POINT &point)
+    {
+      landmark_index_[key] = landmarks_.size();
+      landmarks_.push_back(key);
+      points_.push_back(point);
+    }
+
+    /*
+     * Refresh the cached landmark estimates after an optimization.
+     * Variables no longer in estimates, e.g. marginalized out of a sliding window, are dropped.
+     */
+    void update(const gtsam::Values &estimates)
+    {
+      size_t kept = 0;
+      for (size_t i = 0; i < landmarks_.size(); i++)
+      {
+        if (!estimates.exists(landmarks_[i]))
+        {
+          continue;
+        }
+        landmarks_[kept] = landmarks_[i];
+        points_[kept] = estimates.at<POINT>(landmarks_[i]);
+        kept++;
+      }
+      if (kept < landmarks_.size())
+      {
+        landmarks_.resize(kept);
+        points_.resize(kept);
+        reindexLandmarks();
+      }
+
+      // Poses only leave from the front of a window
+      size_t first = 0;
+      while (first + 1 < poses_.size() && !estimates.exists(poses_[first]))
+      {
+        first++;
+      }
+      poses_.erase(poses_.begin(), poses_.begin() + first);
+    }
+
+    inline gtsam::Key latestPose() const
+    {
+      assert(!poses_.empty());
+      return poses_.back();
+    }
+    inline const gtsam::KeyVector &poses() const { return poses_; }
+
+    inline size_t numLandmarks() const { return landmarks_.size(); }
+    inline const gtsam::KeyVector &landmarks() const { return landmarks_; }
+    inline const std::vector<POINT> &landmarkPoints() const { return points_; }
+
+    std::optional<size_t> landmarkIndex(gtsam::Key key) const
+    {
+      auto it = landmark_index_.find(key);
+      if (it == landmark_index_.end())
+      {
+        return std::nullopt;
+      }
+      return it->second;
+    }
+    inline bool hasLandmark(gtsam::Key key) const { return landmark_index_.count(key) > 0; }
+    // The key must be a registered landmark
+    inline const POINT &landmarkPoint(gtsam::Key key) const { return points_[landmark_index_.at(key)]; }
+  };
+
+} // namespace slam
+
+#endif // KEY_REGISTRY_H
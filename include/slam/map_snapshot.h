@@ -0,0 +1,27 @@
+#ifndef MAP_SNAPSHOT_H
+#define MAP_SNAPSHOT_H
+
+#include <cstdint>
+#include <vector>
+
+namespace slam
+{
+  /*
+   * Trajectory and landmark estimates after one optimization, as contiguous arrays.
+   * trajectory[i] is the estimate of X(i) and landmarks[j] the estimate of L(j).
+   *
+   * Published as a shared_ptr to const and never modified afterwards, so any thread may read it for as long
+   * as it holds on to it, while SLAM carries on.
+   */
+  template <class POSE, class POINT>
+  struct MapSnapshot
+  {
+    // Number of optimizations done before it was taken, newer snapshots have larger versions
+    uint64_t version = 0;
+    std::vector<POSE> trajectory;
+    std::vector<POINT> landmarks;
+  };
+
+} // namespace slam
+
+#endif // MAP_SNAPSHOT_H
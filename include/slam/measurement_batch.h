@@ -0,0 +1,187 @@
+#ifndef MEASUREMENT_BATCH_H
+#define MEASUREMENT_BATCH_H
+
+#include <gtsam/linear/NoiseModel.h>
+
+#include <Eigen/Core>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "slam/types.h"
+
+namespace slam
+{
+  // A measurement noise model, with what association needs of it computed once
+  template <int DIM>
+  struct InternedNoise
+  {
+    using Matrix = Eigen::Matrix<double, DIM, DIM>;
+    using Vector = Eigen::Matrix<double, DIM, 1>;
+
+    gtsam::SharedNoiseModel model;
+    Matrix information; // What models are told apart by
+    Vector variances;   // Squared sigmas, the diagonal gating adds to the innovation covariance
+  };
+
+  /*
+   * Distinct noise models, told apart by their information matrix, each held once and referred to by index.
+   * Datasets are simulated with a handful of noise levels, so the table stays small however many edges use them.
+   */
+  template <int DIM>
+  class NoiseTable
+  {
+  public:
+    using Matrix = typename InternedNoise<DIM>::Matrix;
+
+  private:
+    std::vector<InternedNoise<DIM>> noise_;
+    std::unordered_multimap<uint64_t, uint32_t> by_hash_;
+    // Consecutive measurements mostly share a model, which is then found without looking at its information.
+    // Held on to, so the pointer can not be reused for another model.
+    gtsam::SharedNoiseModel last_;
+    uint32_t last_index_ = 0;
+
+    static uint64_t hash(const Matrix &information)
+    {
+      // 64 bit FNV-1a of the entries, with -0.0 as 0.0 since the two compare equal
+      uint64_t h = 0xcbf29ce484222325;
+      for (int i = 0; i < DIM * DIM; i++)
+      {
+        const double value = information.data()[i] == 0.0 ? 0.0 : information.data()[i];
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int b = 0; b < 64; b += 8)
+        {
+          h ^= (bits >> b) & 0xff;
+          h *= 0x100000001b3;
+        }
+      }
+      return h;
+    }
+
+    uint32_t insert(const Matrix &information, gtsam::SharedNoiseModel model)
+    {
+      const uint64_t h = hash(information);
+      auto [begin, end] = by_hash_.equal_range(h);
+      for (auto it = begin; it != end; ++it)
+      {
+        if (noise_[it->second].information == information)
+        {
+          return it->second;
+        }
+      }
+
+      InternedNoise<DIM> noise;
+      noise.model = model ? model : gtsam::noiseModel::Gaussian::Information(information, true);
+      noise.information = information;
+      noise.variances = noise.model->sigmas().array().square();
+      noise_.push_back(std::move(noise));
+      by_hash_.emplace(h, noise_.size() - 1);
+      return noise_.size() - 1;
+    }
+
+  public:
+    // Throws std::invalid_argument unless the noise is Gaussian and of dimension DIM
+    uint32_t intern(const gtsam::SharedNoiseModel &noise)
+    {
+      if (noise && noise == last_)
+      {
+        return last_index_;
+      }
+      auto gaussian = boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(noise);
+      if (!gaussian || gaussian->dim() != DIM)
+      {
+        throw std::invalid_argument("Only Gaussian noise of dimension " + std::to_string(DIM) + " can be interned");
+      }
+      last_index_ = insert(gaussian->information(), noise);
+      last_ = noise;
+      return last_index_;
+    }
+
+    // Makes a Gaussian noise model of the information matrix, unless there already is one
+    uint32_t internInformation(const Matrix &information)
+    {
+      return insert(information, nullptr);
+    }
+
+    inline const InternedNoise<DIM> &operator[](uint32_t index) const { return noise_[index]; }
+    inline const gtsam::SharedNoiseModel &model(uint32_t index) const { return noise_[index].model; }
+    inline size_t size() const { return noise_.size(); }
+  };
+
+  /*
+   * The measurements of a timestep as structure of arrays: one contiguous array per coordinate of the measured
+   * points, their ids, and the index of their noise model in a table kept across assign(), so each distinct noise
+   * model is only converted the first time it is seen. For the gating loops, which then stream over contiguous data.
+   */
+  template <class POINT>
+  class MeasurementBatch
+  {
+  public:
+    static constexpr int Dim = POINT::RowsAtCompileTime;
+
+  private:
+    std::array<std::vector<double>, Dim> coordinates_;
+    std::vector<uint64_t> ids_;
+    std::vector<uint32_t> noise_;
+    NoiseTable<Dim> noise_table_;
+
+  public:
+    MeasurementBatch() = default;
+    explicit MeasurementBatch(const Measurements<POINT> &measurements) { assign(measurements); }
+
+    // Replaces the measurements, keeping the noise table and the capacity of the arrays
+    void assign(const Measurements<POINT> &measurements)
+    {
+      for (auto &coordinate : coordinates_)
+      {
+        coordinate.resize(measurements.size());
+      }
+      ids_.resize(measurements.size());
+      noise_.resize(measurements.size());
+      for (size_t i = 0; i < measurements.size(); i++)
+      {
+        const Measurement<POINT> &measurement = measurements[i];
+        for (int d = 0; d < Dim; d++)
+        {
+          coordinates_[d][i] = measurement.measurement(d);
+        }
+        ids_[i] = measurement.idx;
+        noise_[i] = noise_table_.intern(measurement.noise);
+      }
+    }
+
+    inline size_t size() const { return ids_.size(); }
+    inline bool empty() const { return ids_.empty(); }
+
+    inline POINT point(size_t i) const
+    {
+      POINT p;
+      for (int d = 0; d < Dim; d++)
+      {
+        p(d) = coordinates_[d][i];
+      }
+      return p;
+    }
+    // Coordinate d of every measurement
+    inline const std::vector<double> &coordinate(int d) const { return coordinates_[d]; }
+    inline uint64_t id(size_t i) const { return ids_[i]; }
+    inline uint32_t noiseIndex(size_t i) const { return noise_[i]; }
+    inline const InternedNoise<Dim> &noise(size_t i) const { return noise_table_[noise_[i]]; }
+    inline const NoiseTable<Dim> &noiseTable() const { return noise_table_; }
+
+    inline Measurement<POINT> measurement(size_t i) const { return {point(i), ids_[i], noise(i).model}; }
+  };
+
+  using MeasurementBatch2D = MeasurementBatch<gtsam::Point2>;
+  using MeasurementBatch3D = MeasurementBatch<gtsam::Point3>;
+
+} // namespace slam
+
+#endif // MEASUREMENT_BATCH_H
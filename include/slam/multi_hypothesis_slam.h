@@ -0,0 +1,136 @@
+#ifndef MULTI_HYPOTHESIS_SLAM_H
+#define MULTI_HYPOTHESIS_SLAM_H
+
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/nonlinear/Marginals.h>
+#include <gtsam/nonlinear/Values.h>
+#include <gtsam/inference/Symbol.h>
+#include <vector>
+#include <memory>
+#include <iostream>
+
+#include "slam/types.h"
+#include "slam/slam.h"
+#include "slam/factor_chain.h"
+#include "slam/key_registry.h"
+#include "data_association/Hypothesis.h"
+#include "data_association/DataAssociation.h"
+#include "utils/copy_on_write.h"
+
+namespace slam
+{
+    // What branches are ranked and pruned by, accumulated over all timesteps. Lower is better for both.
+    enum class BranchScore
+    {
+        // Assignment cost of the hypotheses, which for ML is the negative log-likelihood up to a constant
+        NegativeLogLikelihood = 0,
+        // Joint NIS of the associated measurements, with a fixed penalty for each unassociated one
+        NIS = 1,
+    };
+} // slam
+
+inline std::ostream& operator<<(std::ostream& os, const slam::BranchScore& branch_score) {
+  switch (branch_score) {
+    case slam::BranchScore::NegativeLogLikelihood: {
+      os << "NegativeLogLikelihood";
+      break;
+    }
+    case slam::BranchScore::NIS: {
+      os << "NIS";
+      break;
+    }
+  }
+  return os;
+}
+
+namespace slam
+{
+    /*
+     * SLAM keeping several concurrent maps, one per association hypothesis.
+     *
+     * Every timestep each branch asks the data association for its k best hypotheses, and the best children over
+     * all branches are kept. Children share the factor graph of their parent through FactorChain, so the factors
+     * stored grow with the factors where branches differ, not with the number of branches times the graph size.
+     * Estimates are still kept per branch, as every branch is optimized on its own.
+     *
+     * Only the batch optimizers are supported, an incremental backend can not be shared between branches.
+     */
+    template <class POSE, class POINT>
+    class MultiHypothesisSLAM
+    {
+    public:
+        struct Branch
+        {
+            FactorChain graph;
+            utils::CopyOnWrite<gtsam::Values> estimates; // Shared between children until one of them changes it
+            KeyRegistry<POINT> registry; // Poses and landmarks of estimates
+            unsigned long int latest_landmark_key = 0;
+            double score = 0.0;
+            da::hypothesis::Hypothesis latest_hypothesis = da::hypothesis::Hypothesis::empty_hypothesis();
+        };
+
+    private:
+        // Best first
+        std::vector<Branch> branches_;
+
+        gtsam::noiseModel::Diagonal::shared_ptr pose_prior_noise_;
+        std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association_;
+
+        int max_branches_;
+        int hypotheses_per_branch_;
+        BranchScore branch_score_;
+        double unassociated_nis_;
+
+        unsigned long int latest_pose_key_;
+
+        OptimizationMethod optimization_method_;
+        gtsam::Marginals::Factorization marginals_factorization_;
+
+        // Scratch of the joint NIS of a hypothesis, reused for every hypothesis scored
+        mutable da::JointCompatibility<POSE, POINT> joint_compatibility_;
+
+        void optimize(Branch &branch, int step) const;
+
+        double score(const da::hypothesis::Hypothesis &h, const CovarianceRecovery &marginals, const Measurements<POINT> &measurements) const;
+        void addHypothesis(Branch &branch, const da::hypothesis::Hypothesis &h, const Measurements<POINT> &measurements) const;
+
+    public:
+        MultiHypothesisSLAM();
+
+        void processTimestep(const Timestep<POSE, POINT>& timestep);
+        void initialize(
+            const gtsam::Vector &pose_prior_noise,
+            std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
+            int max_branches,
+            int hypotheses_per_branch,
+            BranchScore branch_score,
+            double unassociated_nis, // Only used with BranchScore::NIS, typically the gate of individual compatibility
+            OptimizationMethod optimizaton_method = OptimizationMethod::GaussNewton,
+            gtsam::Marginals::Factorization marginals_factorization = gtsam::Marginals::CHOLESKY
+        );
+
+        inline const std::vector<Branch>& branches() const { return branches_; }
+        inline const Branch& bestBranch() const { return branches_.front(); }
+
+        // Factors stored over all branches, counting shared factors once
+        size_t storedFactors() const;
+
+        // Same as SLAM, for the best branch
+        inline const gtsam::Values& currentEstimates() const { return *bestBranch().estimates; }
+        gtsam::FastVector<POSE> getTrajectory() const;
+        gtsam::FastVector<POINT> getLandmarkPoints() const;
+        inline gtsam::NonlinearFactorGraph getGraph() const { return bestBranch().graph.graph(); }
+        inline double error() const { return getGraph().error(currentEstimates()); }
+        inline const da::hypothesis::Hypothesis& latestHypothesis() const { return bestBranch().latest_hypothesis; }
+        inline gtsam::Key latestPoseKey() const { return X(latest_pose_key_); }
+        inline POSE latestPose() const { return currentEstimates().template at<POSE>(latestPoseKey()); }
+    };
+
+    using MultiHypothesisSLAM3D = MultiHypothesisSLAM<gtsam::Pose3, gtsam::Point3>;
+    using MultiHypothesisSLAM2D = MultiHypothesisSLAM<gtsam::Pose2, gtsam::Point2>;
+
+} // namespace slam
+
+#include "slam/multi_hypothesis_slam.hxx"
+
+#endif // MULTI_HYPOTHESIS_SLAM_H
@@ -0,0 +1,300 @@
+#include "slam/multi_hypothesis_slam.h"
+#include "slam/types.h"
+#include "data_association/Hypothesis.h"
+#include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
+
+#include <gtsam/nonlinear/PriorFactor.h>
+#include <gtsam/nonlinear/LevenbergMarquardtOptimizer.h>
+#include <gtsam/nonlinear/GaussNewtonOptimizer.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam_unstable/slam/PoseToPointFactor.h>
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_set>
+
+namespace slam
+{
+
+  template <class POSE, class POINT>
+  MultiHypothesisSLAM<POSE, POINT>::MultiHypothesisSLAM()
+      : max_branches_(1),
+        hypotheses_per_branch_(1),
+        branch_score_(BranchScore::NegativeLogLikelihood),
+        unassociated_nis_(0.0),
+        latest_pose_key_(0),
+        optimization_method_(OptimizationMethod::GaussNewton),
+        marginals_factorization_(gtsam::Marginals::CHOLESKY)
+  {
+  }
+
+  template <class POSE, class POINT>
+  void MultiHypothesisSLAM<POSE, POINT>::initialize(
+      const gtsam::Vector &pose_prior_noise,
+      std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
+      int max_branches,
+      int hypotheses_per_branch,
+      BranchScore branch_score,
+      double unassociated_nis,
+      OptimizationMethod optimizaton_method,
+      gtsam::Marginals::Factorization marginals_factorization)
+  {
+    pose_prior_noise_ = gtsam::noiseModel::Diagonal::Sigmas(pose_prior_noise);
+    data_association_ = data_association;
+    max_branches_ = std::max(max_branches, 1);
+    hypotheses_per_branch_ = std::max(hypotheses_per_branch, 1);
+    branch_score_ = branch_score;
+    unassociated_nis_ = unassociated_nis;
+    marginals_factorization_ = marginals_factorization;
+
+    switch (optimizaton_method)
+    {
+    case OptimizationMethod::GaussNewton:
+    case OptimizationMethod::LevenbergMarquardt:
+    {
+      optimization_method_ = optimizaton_method;
+      break;
+    }
+    default:
+    {
+      std::cout << "Multi-hypothesis SLAM can not use " << optimizaton_method << ", using GaussNewton\n";
+      optimization_method_ = OptimizationMethod::GaussNewton;
+      break;
+    }
+    }
+
+    // Single root branch with the prior on the first pose
+    Branch root;
+    root.graph.add(gtsam::PriorFactor<POSE>(X(latest_pose_key_), POSE(), pose_prior_noise_));
+    root.estimates.write().insert(X(latest_pose_key_), POSE());
+    root.registry.addPose(X(latest_pose_key_));
+    branches_.clear();
+    branches_.push_back(std::move(root));
+  }
+
+  template <class POSE, class POINT>
+  gtsam::FastVector<POSE> MultiHypothesisSLAM<POSE, POINT>::getTrajectory() const
+  {
+    const gtsam::Values &estimates = currentEstimates();
+    gtsam::FastVector<POSE> trajectory;
+    for (int i = 0; i < latest_pose_key_; i++)
+    {
+      trajectory.push_back(estimates.at<POSE>(X(i)));
+    }
+    return trajectory;
+  }
+
+  template <class POSE, class POINT>
+  gtsam::FastVector<POINT> MultiHypothesisSLAM<POSE, POINT>::getLandmarkPoints() const
+  {
+    const gtsam::Values &estimates = currentEstimates();
+    gtsam::FastVector<POINT> landmarks;
+    for (int i = 0; i < bestBranch().latest_landmark_key; i++)
+    {
+      landmarks.push_back(estimates.at<POINT>(L(i)));
+    }
+    return landmarks;
+  }
+
+  template <class POSE, class POINT>
+  size_t MultiHypothesisSLAM<POSE, POINT>::storedFactors() const
+  {
+    std::unordered_set<const void *> segments;
+    size_t factors = 0;
+    for (const Branch &branch : branches_)
+    {
+      factors += branch.graph.collectSegments(segments);
+    }
+    return factors;
+  }
+
+  template <class POSE, class POINT>
+  void MultiHypothesisSLAM<POSE, POINT>::processTimestep(const Timestep<POSE, POINT> &timestep)
+  {
+    PROFILE_ZONE("mh::processTimestep");
+    if (timestep.step > 0)
+    {
+      for (Branch &branch : branches_)
+      {
+        POSE latest_pose = branch.estimates->template at<POSE>(X(latest_pose_key_));
+        branch.graph.add(gtsam::BetweenFactor<POSE>(X(latest_pose_key_), X(latest_pose_key_ + 1), timestep.odom.odom, timestep.odom.noise));
+        branch.estimates.write().insert(X(latest_pose_key_ + 1), latest_pose * timestep.odom.odom);
+        branch.registry.addPose(X(latest_pose_key_ + 1));
+      }
+      latest_pose_key_++;
+    }
+
+    for (Branch &branch : branches_)
+    {
+      optimize(branch, timestep.step);
+    }
+
+    // We have no measurements to associate, so no branching either
+    if (timestep.measurements.size() == 0)
+    {
+      for (Branch &branch : branches_)
+      {
+        branch.latest_hypothesis = da::hypothesis::Hypothesis::empty_hypothesis();
+      }
+
+#ifdef LOGGING
+      std::cout << "No measurements to associate, so returning now...\n";
+#endif
+
+      return;
+    }
+
+    struct Child
+    {
+      size_t parent;
+      da::hypothesis::Hypothesis h;
+      double score;
+    };
+    std::vector<Child> children;
+
+    for (size_t b = 0; b < branches_.size(); b++)
+    {
+      Branch &branch = branches_[b];
+
+      // Everything up to now is shared by the children of this branch
+      branch.graph.seal();
+      gtsam::NonlinearFactorGraph graph = branch.graph.graph();
+
+      CovarianceRecovery marginals(marginals_factorization_);
+      marginals.update(graph, *branch.estimates, 0);
+      data_association_->landmarksUpdated(branch.registry);
+
+      try
+      {
+        std::vector<da::hypothesis::Hypothesis> hypotheses = data_association_->associate_k_best(
+            *branch.estimates, branch.registry, marginals, timestep.measurements, hypotheses_per_branch_);
+        for (const auto &h : hypotheses)
+        {
+          children.push_back({b, h, branch.score + score(h, marginals, timestep.measurements)});
+        }
+      }
+      catch (gtsam::IndeterminantLinearSystemException &indetErr)
+      {
+        throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, std::make_shared<const gtsam::NonlinearFactorGraph>(std::move(graph)),
+                                                                branch.estimates.snapshot(), timestep.step, "Error when computing marginals!");
+      }
+    }
+
+    // Only if the data association gave nothing at all, then the measurements are dropped
+    if (children.empty())
+    {
+      return;
+    }
+
+    // Pruned before any child is made. Children share the estimates of their parent until they add landmarks
+    std::stable_sort(children.begin(), children.end(), [](const Child &a, const Child &b)
+                     { return a.score < b.score; });
+    if (children.size() > static_cast<size_t>(max_branches_))
+    {
+      children.resize(max_branches_);
+    }
+
+#ifdef LOGGING
+    std::cout << "Keeping " << children.size() << " branches, best score " << children.front().score << "\n";
+#endif
+
+    std::vector<Branch> next;
+    next.reserve(children.size());
+    for (const Child &child : children)
+    {
+      Branch branch = branches_[child.parent];
+      branch.score = child.score;
+      branch.latest_hypothesis = child.h;
+      addHypothesis(branch, child.h, timestep.measurements);
+      optimize(branch, timestep.step);
+      next.push_back(std::move(branch));
+    }
+    branches_ = std::move(next);
+  }
+
+  template <class POSE, class POINT>
+  double MultiHypothesisSLAM<POSE, POINT>::score(
+      const da::hypothesis::Hypothesis &h,
+      const CovarianceRecovery &marginals,
+      const Measurements<POINT> &measurements) const
+  {
+    switch (branch_score_)
+    {
+    case BranchScore::NegativeLogLikelihood:
+    {
+      return h.get_cost();
+    }
+    case BranchScore::NIS:
+    {
+      int unassociated = h.num_measurements() - h.num_associations();
+      double nis = unassociated * unassociated_nis_;
+      if (h.num_associations() > 0)
+      {
+        nis += joint_compatibility_(h, X(latest_pose_key_), marginals, measurements);
+      }
+      return nis;
+    }
+    }
+    return 0.0;
+  }
+
+  template <class POSE, class POINT>
+  void MultiHypothesisSLAM<POSE, POINT>::addHypothesis(
+      Branch &branch,
+      const da::hypothesis::Hypothesis &h,
+      const Measurements<POINT> &measurements) const
+  {
+    POSE T_wb = branch.estimates->template at<POSE>(X(latest_pose_key_));
+    for (const auto &a : h.associations())
+    {
+      POINT meas = measurements[a->measurement].measurement;
+      const auto &meas_noise = measurements[a->measurement].noise;
+      if (a->associated())
+      {
+        branch.graph.add(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), *a->landmark, meas, meas_noise));
+      }
+      else
+      {
+        branch.graph.add(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), L(branch.latest_landmark_key), meas, meas_noise));
+        branch.estimates.write().insert(L(branch.latest_landmark_key), T_wb * meas);
+        branch.registry.addLandmark(L(branch.latest_landmark_key), T_wb * meas);
+        branch.latest_landmark_key++;
+      }
+    }
+  }
+
+  template <class POSE, class POINT>
+  void MultiHypothesisSLAM<POSE, POINT>::optimize(Branch &branch, int step) const
+  {
+    PROFILE_ZONE("mh::optimize");
+    gtsam::NonlinearFactorGraph graph = branch.graph.graph();
+    try
+    {
+      switch (optimization_method_)
+      {
+      case OptimizationMethod::LevenbergMarquardt:
+      {
+        gtsam::LevenbergMarquardtParams params;
+        gtsam::LevenbergMarquardtOptimizer optimizer(graph, *branch.estimates, params);
+        branch.estimates = optimizer.optimize();
+        break;
+      }
+      default:
+      {
+        gtsam::GaussNewtonParams params;
+        gtsam::GaussNewtonOptimizer optimizer(graph, *branch.estimates, params);
+        branch.estimates = optimizer.optimize();
+        break;
+      }
+      }
+    }
+    catch (gtsam::IndeterminantLinearSystemException &indetErr)
+    {
+      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, std::make_shared<const gtsam::NonlinearFactorGraph>(std::move(graph)),
+                                                              branch.estimates.snapshot(), step, "Error when optimizing branch!");
+    }
+    branch.registry.update(*branch.estimates);
+  }
+
+} // namespace slam
@@ -12,10 +12,17 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <string>
+#include <functional>
 
 #include "slam/types.h"
+#include "slam/checkpoint.h"
+#include "slam/covariance_recovery.h"
+#include "slam/key_registry.h"
+#include "slam/map_snapshot.h"
 #include "data_association/Hypothesis.h"
 #include "data_association/DataAssociation.h"
+#include "utils/copy_on_write.h"
 
 
 namespace slam
@@ -23,6 +30,8 @@ namespace slam
     enum class OptimizationMethod {
         GaussNewton = 0,
         LevenbergMarquardt = 1,
+        ISAM2 = 2,
+        FixedLag = 3,
     };
 } // slam
 
@@ -36,6 +45,65 @@ inline std::ostream& operator<<(std::ostream& os, const slam::OptimizationMethod
       os << "LevenbergMarquardt";
       break;
     }
+    case slam::OptimizationMethod::ISAM2: {
+      os << "ISAM2";
+      break;
+    }
+    case slam::OptimizationMethod::FixedLag: {
+      os << "FixedLag";
+      break;
+    }
+  }
+  return os;
+}
+
+namespace slam
+{
+    // When SLAM optimizes. Odometry-only steps never need it unless Always, as the composed pose is already optimal.
+    enum class OptimizationPolicy {
+        // After every odometry and every set of measurements
+        Always = 0,
+        // After every timestep with measurements
+        MeasurementSteps = 1,
+        // After measurements, once every_n poses have been added since the last optimization
+        EveryN = 2,
+        // After measurements, once the robot has moved keyframe_distance or turned keyframe_angle since the last optimization
+        Keyframe = 3,
+        // After measurements, once they raise the graph error by more than error_increase
+        ErrorIncrease = 4,
+    };
+
+    struct OptimizationPolicyParams {
+        OptimizationPolicy policy = OptimizationPolicy::Always;
+        int every_n = 5;
+        double keyframe_distance = 1.0;
+        double keyframe_angle = 0.5; // Radians
+        double error_increase = 1.0;
+    };
+} // slam
+
+inline std::ostream& operator<<(std::ostream& os, const slam::OptimizationPolicy& optimization_policy) {
+  switch (optimization_policy) {
+    case slam::OptimizationPolicy::Always: {
+      os << "Always";
+      break;
+    }
+    case slam::OptimizationPolicy::MeasurementSteps: {
+      os << "MeasurementSteps";
+      break;
+    }
+    case slam::OptimizationPolicy::EveryN: {
+      os << "EveryN";
+      break;
+    }
+    case slam::OptimizationPolicy::Keyframe: {
+      os << "Keyframe";
+      break;
+    }
+    case slam::OptimizationPolicy::ErrorIncrease: {
+      os << "ErrorIncrease";
+      break;
+    }
   }
   return os;
 }
@@ -48,9 +116,29 @@ namespace slam
     template <class POSE, class POINT>
     class SLAM
     {
+    public:
+        // What was pushed to the Bayes tree of the ISAM2 back end in one update
+        using BayesTreeListener = std::function<void(const gtsam::NonlinearFactorGraph &, const gtsam::Values &, const gtsam::ISAM2UpdateParams &)>;
+
     private:
-        gtsam::NonlinearFactorGraph graph_;
-        gtsam::Values estimates_;
+        // Shared with the exceptions thrown on failure and with snapshot readers rather than copied for them, and only
+        // copied by a change made while one of them is still held
+        utils::CopyOnWrite<gtsam::NonlinearFactorGraph> graph_;
+        utils::CopyOnWrite<gtsam::Values> estimates_;
+
+        // Factors and values added since last call to optimize(), only pushed to incremental backends
+        gtsam::NonlinearFactorGraph new_factors_;
+        gtsam::Values new_values_;
+        std::unique_ptr<gtsam::ISAM2> isam_;
+        BayesTreeListener bayes_tree_listener_;
+
+        // Sliding window, timestamps are timestep indices, so the lag is measured in poses
+        std::unique_ptr<gtsam::IncrementalFixedLagSmoother> smoother_;
+        gtsam::FixedLagSmoother::KeyTimestampMap new_timestamps_;
+        utils::CopyOnWrite<gtsam::Values> window_estimates_;
+        double latest_timestamp_;
+        // graph_ becomes the factors of the window, without the null slots the smoother leaves for marginalized ones
+        void updateWindowGraph();
 
         gtsam::noiseModel::Diagonal::shared_ptr pose_prior_noise_;
         gtsam::noiseModel::Diagonal::shared_ptr lmk_prior_noise_;
@@ -62,10 +150,19 @@ namespace slam
 
         unsigned long int latest_pose_key_;
         unsigned long int latest_landmark_key_;
+        // Step of the last timestep processed, -1 before the first
+        int latest_step_;
+        // Poses and landmarks of activeEstimates(), handed to the data association
+        utils::CopyOnWrite<KeyRegistry<POINT>> registry_;
 
         void incrementLatestPoseKey() { latest_pose_key_++; }
         void incrementLatestLandmarkKey() { latest_landmark_key_++; }
 
+        template <class FACTOR>
+        void addFactor(const FACTOR &factor);
+        template <class VALUE>
+        void addEstimate(gtsam::Key key, const VALUE &value);
+
         void addOdom(const Odometry<POSE> &odom);
         gtsam::FastVector<POINT> predictLandmarks() const;
         void log_timestep(const Timestep<POSE, POINT>& timestep, const da::hypothesis::Hypothesis& h);
@@ -74,25 +171,91 @@ namespace slam
         gtsam::Marginals::Factorization marginals_factorization_;
         void optimize();
 
+        OptimizationPolicyParams optimization_policy_;
+        size_t num_optimizations_;
+        // Where the last optimization left off, for the lazy policies
+        unsigned long int last_optimized_pose_key_;
+        // Error of the factors pushed since the last optimization, when they were pushed, for ErrorIncrease
+        double pushed_error_;
+        bool shouldOptimize() const;
+
+        // Incremental backends only. Pushes the pending factors into the Bayes tree so covariances can be recovered,
+        // without recalculating the estimates or counting as an optimization.
+        size_t num_pushes_;
+        bool pushed_since_optimization_;
+        void pushPending();
+
+        // Bumped whenever the graph, values or linearization changes, so cached covariances can be reused otherwise
+        uint64_t graph_version_;
+        CovarianceRecovery covariance_recovery_;
+        void updateCovarianceRecovery();
+
+        // Only ever replaced, with std::atomic_store, so readers on other threads need no lock
+        std::shared_ptr<const MapSnapshot<POSE, POINT>> map_;
+        void publishMap();
+
     public:
         SLAM();
 
         // inline const gtsam::Values currentEstimates() const { return estimates_; }
-        inline const gtsam::Values& currentEstimates() const { return estimates_; }
+        // Every variable added so far. With fixed-lag smoothing this includes those marginalized out of the window, at
+        // their last estimate, so it grows with the run as the trajectory and map do. Only the window is bounded.
+        inline const gtsam::Values& currentEstimates() const { return *estimates_; }
+        // Estimates still being optimized, which is only the smoother window when using fixed-lag smoothing
+        inline const gtsam::Values& activeEstimates() const { return smoother_ ? *window_estimates_ : *estimates_; }
+        inline const KeyRegistry<POINT>& registry() const { return *registry_; }
+        // The same, shared rather than copied. SLAM copies them before changing them for as long as they are held.
+        inline std::shared_ptr<const gtsam::Values> activeEstimatesSnapshot() const { return smoother_ ? window_estimates_.snapshot() : estimates_.snapshot(); }
+        inline std::shared_ptr<const KeyRegistry<POINT>> registrySnapshot() const { return registry_.snapshot(); }
+        inline std::shared_ptr<const gtsam::NonlinearFactorGraph> graphSnapshot() const { return graph_.snapshot(); }
+        // Bayes tree of the incremental backends, holding every variable pushed or optimized so far. Null for batch.
+        inline const gtsam::ISAM2* bayesTree() const { return isam_ ? isam_.get() : smoother_ ? &smoother_->getISAM2() : nullptr; }
+        // Called after every update of the ISAM2 back end, in order, so a replica of its Bayes tree can be kept by
+        // replaying them on an ISAM2 with the same params. Not called by the other back ends, nor when loading a checkpoint.
+        inline void setBayesTreeListener(BayesTreeListener listener) { bayes_tree_listener_ = std::move(listener); }
         void processTimestep(const Timestep<POSE, POINT>& timestep);
+        // The two halves of processTimestep around association, for associating elsewhere (see AsyncSLAM).
+        // addHypothesis expects the hypothesis of the same timestep, made against the estimates at the time.
+        void addOdometry(const Timestep<POSE, POINT>& timestep);
+        void addHypothesis(const Timestep<POSE, POINT>& timestep, const da::hypothesis::Hypothesis& h);
+        // data_association may be null if associating is done outside, with addOdometry and addHypothesis
         void initialize(
             const gtsam::Vector &pose_prior_noise,
             std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
             OptimizationMethod optimizaton_method = OptimizationMethod::GaussNewton,
-            gtsam::Marginals::Factorization marginals_factorization = gtsam::Marginals::CHOLESKY
+            gtsam::Marginals::Factorization marginals_factorization = gtsam::Marginals::CHOLESKY,
+            double smoother_lag = 20.0
         );
+        // Defaults to optimizing always. Estimates may lag behind the graph between optimizations, see optimizePending
+        void setOptimizationPolicy(const OptimizationPolicyParams &params);
+        inline const OptimizationPolicyParams& optimizationPolicy() const { return optimization_policy_; }
+        // Optimizes if anything was added since the last optimization, for when the final estimates are needed
+        void optimizePending();
+        inline size_t numOptimizations() const { return num_optimizations_; }
+        // Times pending factors were pushed to the Bayes tree to recover covariances between optimizations
+        inline size_t numPushes() const { return num_pushes_; }
+        inline int latestStep() const { return latest_step_; }
+
+        // Graph, estimates, counters and data association state, everything needed to carry on after latestStep().
+        // Save between timesteps. Fixed-lag smoothing can not be checkpointed, as its marginal factors are not kept.
+        void saveCheckpoint(const std::string &filename) const;
+        // Call after initialize(), with the same optimization method and a data association constructed the same way.
+        // Batch methods carry on as if never stopped. The iSAM2 Bayes tree is rebuilt by eliminating the whole graph
+        // at its saved linearization point, which costs one batch solve. The rebuilt tree solves for the update
+        // exactly, where the uninterrupted one only updates what moved more than the wildfire threshold, so the two
+        // runs agree to within that threshold rather than exactly.
+        void loadCheckpoint(const std::string &filename);
+        // Estimates as of the last optimization. Safe to call from any thread, and cheap enough to call every frame.
+        inline std::shared_ptr<const MapSnapshot<POSE, POINT>> mapSnapshot() const { return std::atomic_load(&map_); }
         gtsam::FastVector<POSE> getTrajectory() const;
         gtsam::FastVector<POINT> getLandmarkPoints() const;
-        inline const gtsam::NonlinearFactorGraph& getGraph() const { return graph_; }
+        // With fixed-lag smoothing only the factors of the window, where the marginals of what was marginalized out
+        // are gtsam::LinearContainerFactors over the oldest variables in the window, rather than every factor added
+        inline const gtsam::NonlinearFactorGraph& getGraph() const { return *graph_; }
         inline double error() const { return getGraph().error(currentEstimates()); }
         inline const da::hypothesis::Hypothesis& latestHypothesis() const { return latest_hypothesis_; }
         inline gtsam::Key latestPoseKey() const { return X(latest_pose_key_); }
-        inline POSE latestPose() const { return estimates_.at<POSE>(latestPoseKey()); }
+        inline POSE latestPose() const { return estimates_->at<POSE>(latestPoseKey()); }
 
         inline const gtsam::NonlinearFactorGraph& hypothesisGraph() const { return hypothesis_graph_; }
         inline const gtsam::Values& hypothesisEstimates() const { return hypothesis_values_; }
@@ -2,6 +2,7 @@
 #include "slam/types.h"
 #include "data_association/Hypothesis.h"
 #include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
 
 #include <gtsam/geometry/Pose3.h>
 #include <gtsam/slam/BetweenFactor.h>
@@ -20,14 +21,24 @@
 #include <chrono>
 #include <fstream>
 #include <set>
+#include <sstream>
+#include <stdexcept>
 
 namespace slam
 {
 
   template <class POSE, class POINT>
   SLAM<POSE, POINT>::SLAM()
-      : latest_pose_key_(0),
-        latest_landmark_key_(0)
+      : latest_timestamp_(0.0),
+        latest_pose_key_(0),
+        latest_landmark_key_(0),
+        latest_step_(-1),
+        num_optimizations_(0),
+        last_optimized_pose_key_(0),
+        pushed_error_(0.0),
+        num_pushes_(0),
+        pushed_since_optimization_(false),
+        graph_version_(0)
   {
   }
 
@@ -36,23 +47,104 @@ namespace slam
       const gtsam::Vector &pose_prior_noise,
       std::shared_ptr<da::DataAssociation<Measurement<POINT>>> data_association,
       OptimizationMethod optimizaton_method,
-      gtsam::Marginals::Factorization marginals_factorization)
+      gtsam::Marginals::Factorization marginals_factorization,
+      double smoother_lag)
   {
     pose_prior_noise_ = gtsam::noiseModel::Diagonal::Sigmas(pose_prior_noise);
     data_association_ = data_association;
 
     optimization_method_ = optimizaton_method;
     marginals_factorization_ = marginals_factorization;
+    covariance_recovery_.setFactorization(marginals_factorization_);
+
+    gtsam::ISAM2Params isam_params;
+    isam_params.relinearizeThreshold = 0.01;
+    isam_params.relinearizeSkip = 1;
+
+    switch (optimization_method_)
+    {
+    case OptimizationMethod::ISAM2:
+    {
+      isam_ = std::make_unique<gtsam::ISAM2>(isam_params);
+      break;
+    }
+    case OptimizationMethod::FixedLag:
+    {
+      smoother_ = std::make_unique<gtsam::IncrementalFixedLagSmoother>(smoother_lag, isam_params);
+      break;
+    }
+    default:
+      break;
+    }
 
     // Add prior on first pose
-    graph_.add(gtsam::PriorFactor<POSE>(X(latest_pose_key_), POSE(), pose_prior_noise_));
-    estimates_.insert(X(latest_pose_key_), POSE());
+    addFactor(gtsam::PriorFactor<POSE>(X(latest_pose_key_), POSE(), pose_prior_noise_));
+    addEstimate(X(latest_pose_key_), POSE());
+    registry_.write().addPose(X(latest_pose_key_));
+    publishMap();
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::setOptimizationPolicy(const OptimizationPolicyParams &params)
+  {
+    optimization_policy_ = params;
+    if (optimization_policy_.policy == OptimizationPolicy::EveryN && optimization_policy_.every_n < 1)
+    {
+      std::cout << "Invalid number of poses between optimizations, got " << optimization_policy_.every_n << ", using 1\n";
+      optimization_policy_.every_n = 1;
+    }
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::optimizePending()
+  {
+    if (pushed_since_optimization_ || new_factors_.size() > 0 || new_values_.size() > 0)
+    {
+      optimize();
+    }
+  }
+
+  template <class POSE, class POINT>
+  template <class FACTOR>
+  void SLAM<POSE, POINT>::addFactor(const FACTOR &factor)
+  {
+    graph_.write().add(factor);
+    new_factors_.add(factor);
+    graph_version_++;
+  }
+
+  template <class POSE, class POINT>
+  template <class VALUE>
+  void SLAM<POSE, POINT>::addEstimate(gtsam::Key key, const VALUE &value)
+  {
+    estimates_.write().insert(key, value);
+    new_values_.insert(key, value);
+    new_timestamps_[key] = latest_timestamp_;
+    graph_version_++;
+    if (smoother_)
+    {
+      window_estimates_.write().insert(key, value);
+    }
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::updateWindowGraph()
+  {
+    gtsam::NonlinearFactorGraph window_graph;
+    for (const auto &factor : smoother_->getFactors())
+    {
+      if (factor)
+      {
+        window_graph.push_back(factor);
+      }
+    }
+    graph_ = std::move(window_graph);
   }
 
   template <class POSE, class POINT>
   gtsam::FastVector<POSE> SLAM<POSE, POINT>::getTrajectory() const
   {
-    gtsam::Values estimates = currentEstimates();
+    const gtsam::Values &estimates = currentEstimates();
     gtsam::FastVector<POSE> trajectory;
     for (int i = 0; i < latest_pose_key_; i++)
     {
@@ -64,7 +156,7 @@ namespace slam
   template <class POSE, class POINT>
   gtsam::FastVector<POINT> SLAM<POSE, POINT>::getLandmarkPoints() const
   {
-    gtsam::Values estimates = currentEstimates();
+    const gtsam::Values &estimates = currentEstimates();
     gtsam::FastVector<POINT> landmarks;
     for (int i = 0; i < latest_landmark_key_; i++)
     {
@@ -76,10 +168,8 @@ namespace slam
   template <class POSE, class POINT>
   void SLAM<POSE, POINT>::processTimestep(const Timestep<POSE, POINT> &timestep)
   {
-    if (timestep.step > 0)
-    {
-      addOdom(timestep.odom);
-    }
+    PROFILE_ZONE("slam::processTimestep");
+    addOdometry(timestep);
 
     da::hypothesis::Hypothesis h = da::hypothesis::Hypothesis::empty_hypothesis();
 
@@ -95,32 +185,58 @@ namespace slam
       return;
     }
 
+    updateCovarianceRecovery();
+
     const gtsam::NonlinearFactorGraph &full_graph = getGraph();
-    const gtsam::Values &estimates = currentEstimates();
+    const gtsam::Values &estimates = activeEstimates();
 
     hypothesis_graph_ = full_graph;
     hypothesis_values_ = estimates;
 
-    gtsam::Marginals marginals;
+    // Covariances are recovered lazily while associating, so this is where factorization may fail
     try
     {
-      marginals = gtsam::Marginals(full_graph, estimates, marginals_factorization_);
+      h = data_association_->associate(estimates, *registry_, covariance_recovery_, timestep.measurements);
     }
     catch (gtsam::IndeterminantLinearSystemException &indetErr)
     {
-      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, graph_, estimates_, "Error when computing marginals!");
+      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, graph_.snapshot(), estimates_.snapshot(), timestep.step, "Error when computing marginals!");
+    }
+
+    addHypothesis(timestep, h);
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::addOdometry(const Timestep<POSE, POINT> &timestep)
+  {
+    latest_timestamp_ = timestep.step;
+    latest_step_ = timestep.step;
+
+    if (timestep.step > 0)
+    {
+      addOdom(timestep.odom);
     }
+  }
 
-    h = data_association_->associate(estimates, marginals, timestep.measurements);
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::addHypothesis(const Timestep<POSE, POINT> &timestep, const da::hypothesis::Hypothesis &h)
+  {
     latest_hypothesis_ = h;
 
+    if (timestep.measurements.size() == 0)
+    {
+      return;
+    }
+
     const auto &assos = h.associations();
 
 #ifdef LOGGING
     std::cout << "There are " << assos.size() << " associations\n";
 #endif
 
+    const gtsam::Values &estimates = activeEstimates();
     POSE T_wb = estimates.at<POSE>(X(latest_pose_key_));
+    unsigned long int first_new_landmark_key = latest_landmark_key_;
     int associated_measurements = 0;
     bool new_loop_closure = false;
     for (int i = 0; i < assos.size(); i++)
@@ -135,7 +251,9 @@ namespace slam
         std::cout << "Measurement z" << a->measurement << " associated with landmark " << gtsam::Symbol(*a->landmark) << "\n";
 #endif
         new_loop_closure = true;
-        graph_.add(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), *a->landmark, meas, meas_noise));
+        addFactor(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), *a->landmark, meas, meas_noise));
+        // Keep reobserved landmarks inside the smoother window
+        new_timestamps_[*a->landmark] = latest_timestamp_;
         associated_measurements++;
       }
       else
@@ -143,8 +261,9 @@ namespace slam
 #ifdef LOGGING
         std::cout << "Measurement z" << a->measurement << " unassociated, initialize landmark l" << latest_landmark_key_ << "\n";
 #endif
-        graph_.add(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), L(latest_landmark_key_), meas, meas_noise));
-        estimates_.insert(L(latest_landmark_key_), meas_world);
+        addFactor(gtsam::PoseToPointFactor<POSE, POINT>(X(latest_pose_key_), L(latest_landmark_key_), meas, meas_noise));
+        addEstimate(L(latest_landmark_key_), meas_world);
+        registry_.write().addLandmark(L(latest_landmark_key_), meas_world);
         incrementLatestLandmarkKey();
       }
     }
@@ -153,43 +272,328 @@ namespace slam
     std::cout << "Associated " << associated_measurements << " / " << timestep.measurements.size() << " measurements in timestep " << timestep.step << "\n";
 #endif
 
-    optimize();
+    if (shouldOptimize())
+    {
+      optimize();
+    }
+    else if (data_association_ && latest_landmark_key_ > first_new_landmark_key)
+    {
+      // New landmarks must still be associable, even if nothing was moved
+      data_association_->landmarksUpdated(*registry_);
+    }
+  }
+
+  template <class POSE, class POINT>
+  bool SLAM<POSE, POINT>::shouldOptimize() const
+  {
+    switch (optimization_policy_.policy)
+    {
+    case OptimizationPolicy::Always:
+    case OptimizationPolicy::MeasurementSteps:
+    {
+      return true;
+    }
+    case OptimizationPolicy::EveryN:
+    {
+      return latest_pose_key_ - last_optimized_pose_key_ >= static_cast<unsigned long int>(optimization_policy_.every_n);
+    }
+    case OptimizationPolicy::Keyframe:
+    {
+      // The last optimized pose may have left the smoother window, but its estimate is kept in estimates_
+      POSE delta = estimates_->at<POSE>(X(last_optimized_pose_key_)).between(estimates_->at<POSE>(X(latest_pose_key_)));
+      return delta.translation().norm() > optimization_policy_.keyframe_distance ||
+             POSE::Rotation::Logmap(delta.rotation()).norm() > optimization_policy_.keyframe_angle;
+    }
+    case OptimizationPolicy::ErrorIncrease:
+    {
+      // Estimates of earlier variables have not moved since the last optimization, so only the new factors add error
+      return pushed_error_ + new_factors_.error(*estimates_) > optimization_policy_.error_increase;
+    }
+    }
+    return true;
   }
 
   template <class POSE, class POINT>
   void SLAM<POSE, POINT>::addOdom(const Odometry<POSE> &odom)
   {
     POSE latest_pose = latestPose();
-    graph_.add(gtsam::BetweenFactor<POSE>(X(latest_pose_key_), X(latest_pose_key_ + 1), odom.odom, odom.noise));
+    addFactor(gtsam::BetweenFactor<POSE>(X(latest_pose_key_), X(latest_pose_key_ + 1), odom.odom, odom.noise));
     POSE this_pose = latest_pose * odom.odom;
-    estimates_.insert(X(latest_pose_key_ + 1), this_pose);
+    addEstimate(X(latest_pose_key_ + 1), this_pose);
+    registry_.write().addPose(X(latest_pose_key_ + 1));
 
-    optimize();
+    // The composed pose satisfies its only factor exactly, so optimizing now can not move anything
+    if (optimization_policy_.policy == OptimizationPolicy::Always)
+    {
+      optimize();
+    }
 
     incrementLatestPoseKey();
   }
 
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::publishMap()
+  {
+    auto map = std::make_shared<MapSnapshot<POSE, POINT>>();
+    map->version = num_optimizations_;
+    map->trajectory.reserve(latest_pose_key_ + 1);
+    map->landmarks.reserve(latest_landmark_key_);
+    // Values are ordered by key, so each kind of variable comes in index order, in one pass without lookups
+    for (const auto &key_value : *estimates_)
+    {
+      switch (gtsam::Symbol(key_value.key).chr())
+      {
+      case 'x':
+      {
+        map->trajectory.push_back(key_value.value.template cast<POSE>());
+        break;
+      }
+      case 'l':
+      {
+        map->landmarks.push_back(key_value.value.template cast<POINT>());
+        break;
+      }
+      default:
+        break;
+      }
+    }
+    std::atomic_store(&map_, std::shared_ptr<const MapSnapshot<POSE, POINT>>(std::move(map)));
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::saveCheckpoint(const std::string &filename) const
+  {
+    if (smoother_)
+    {
+      throw std::runtime_error("Fixed-lag smoothing can not be checkpointed");
+    }
+
+    CheckpointWriter writer;
+    writer.write(CHECKPOINT_MAGIC);
+    writer.write(CHECKPOINT_FORMAT_VERSION);
+    writer.write<uint32_t>(POSE::dimension);
+    writer.write<uint32_t>(static_cast<uint32_t>(optimization_method_));
+
+    writer.write<uint64_t>(latest_pose_key_);
+    writer.write<uint64_t>(latest_landmark_key_);
+    writer.write<int64_t>(latest_step_);
+    writer.write(latest_timestamp_);
+    writer.write<uint64_t>(graph_version_);
+    writer.write<uint64_t>(num_optimizations_);
+    writer.write<uint64_t>(last_optimized_pose_key_);
+    writer.write(pushed_error_);
+    writer.write<uint8_t>(pushed_since_optimization_);
+
+    writer.writeGraph(*graph_);
+
+    writer.writeValues(*estimates_);
+
+    // Added since the last optimization, always the newest factors of the graph
+    writer.write<uint64_t>(new_factors_.size());
+    writer.write<uint64_t>(new_values_.size());
+    for (const gtsam::Key key : new_values_.keys())
+    {
+      writer.write<uint64_t>(key);
+    }
+
+    // Where the Bayes tree is linearized, which lags behind the estimates until variables move far enough
+    if (isam_)
+    {
+      writer.writeValues(isam_->getLinearizationPoint());
+    }
+
+    if (data_association_)
+    {
+      data_association_->saveState(writer);
+    }
+
+    writer.save(filename);
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::loadCheckpoint(const std::string &filename)
+  {
+    if (smoother_)
+    {
+      throw std::runtime_error("Fixed-lag smoothing can not be checkpointed");
+    }
+
+    CheckpointReader reader(filename);
+    if (reader.read<uint64_t>() != CHECKPOINT_MAGIC || reader.read<uint32_t>() != CHECKPOINT_FORMAT_VERSION)
+    {
+      throw std::runtime_error(filename + " is not a checkpoint of this version");
+    }
+    if (reader.read<uint32_t>() != POSE::dimension)
+    {
+      throw std::runtime_error(filename + " is a checkpoint of another pose type");
+    }
+    auto method = static_cast<OptimizationMethod>(reader.read<uint32_t>());
+    if (method != optimization_method_)
+    {
+      std::stringstream ss;
+      ss << filename << " was saved with " << method << ", not " << optimization_method_;
+      throw std::runtime_error(ss.str());
+    }
+
+    latest_pose_key_ = reader.read<uint64_t>();
+    latest_landmark_key_ = reader.read<uint64_t>();
+    latest_step_ = reader.read<int64_t>();
+    latest_timestamp_ = reader.read<double>();
+    // Bumped past the saved version, so nothing cached before the load is reused
+    graph_version_ = reader.read<uint64_t>() + 1;
+    num_optimizations_ = reader.read<uint64_t>();
+    last_optimized_pose_key_ = reader.read<uint64_t>();
+    pushed_error_ = reader.read<double>();
+    pushed_since_optimization_ = reader.read<uint8_t>() != 0;
+
+    graph_ = reader.readGraph();
+
+    estimates_ = reader.readValues();
+    uint64_t num_new_factors = reader.read<uint64_t>();
+    uint64_t num_new_values = reader.read<uint64_t>();
+    if (num_new_factors > graph_->size())
+    {
+      throw std::runtime_error(filename + " is corrupt, more new factors than factors");
+    }
+    new_factors_.resize(0);
+    for (size_t i = graph_->size() - num_new_factors; i < graph_->size(); i++)
+    {
+      new_factors_.push_back((*graph_)[i]);
+    }
+    new_values_.clear();
+    for (uint64_t i = 0; i < num_new_values; i++)
+    {
+      gtsam::Key key = reader.read<uint64_t>();
+      new_values_.insert(key, estimates_->at(key));
+    }
+
+    if (isam_)
+    {
+      // Everything pushed before the checkpoint goes into a fresh Bayes tree, at the same linearization point, so it
+      // holds the same linear system. Eliminating it is a batch solve over the whole graph, once.
+      gtsam::NonlinearFactorGraph pushed_factors;
+      for (size_t i = 0; i < graph_->size() - num_new_factors; i++)
+      {
+        pushed_factors.push_back((*graph_)[i]);
+      }
+      gtsam::Values linearization_point = reader.readValues();
+      isam_ = std::make_unique<gtsam::ISAM2>(isam_->params());
+      isam_->update(pushed_factors, linearization_point);
+    }
+
+    if (data_association_)
+    {
+      data_association_->loadState(reader);
+    }
+
+    latest_hypothesis_ = da::hypothesis::Hypothesis::empty_hypothesis();
+    hypothesis_graph_ = gtsam::NonlinearFactorGraph();
+    hypothesis_values_.clear();
+
+    registry_ = KeyRegistry<POINT>::fromValues(activeEstimates());
+    if (data_association_)
+    {
+      data_association_->landmarksUpdated(*registry_);
+    }
+    publishMap();
+  }
+
   template <class POSE, class POINT>
   gtsam::FastVector<POINT> SLAM<POSE, POINT>::predictLandmarks() const
   {
-    const gtsam::Values estimates = currentEstimates();
-    gtsam::KeyList landmark_keys = estimates.filter(gtsam::Symbol::ChrTest('l')).keys();
-    if (landmark_keys.size() == 0)
+    const std::vector<POINT> &points = registry_->landmarkPoints();
+    return gtsam::FastVector<POINT>(points.begin(), points.end());
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::updateCovarianceRecovery()
+  {
+    PROFILE_ZONE("slam::updateCovarianceRecovery");
+    // The Bayes tree can only be queried for variables that have been pushed to it
+    if ((isam_ || smoother_) && (new_factors_.size() > 0 || new_values_.size() > 0))
+    {
+      pushPending();
+    }
+
+    if (isam_)
+    {
+      covariance_recovery_.update(*isam_, graph_version_);
+    }
+    else if (smoother_)
     {
-      return {};
+      covariance_recovery_.update(smoother_->getISAM2(), graph_version_);
     }
-    gtsam::FastVector<POINT> predicted_measurements;
-    for (const auto &lmk : landmark_keys)
+    else
+    {
+      covariance_recovery_.update(getGraph(), activeEstimates(), graph_version_);
+    }
+  }
+
+  template <class POSE, class POINT>
+  void SLAM<POSE, POINT>::pushPending()
+  {
+    PROFILE_ZONE("slam::pushPending");
+    if (optimization_policy_.policy == OptimizationPolicy::ErrorIncrease)
     {
-      predicted_measurements.push_back(estimates.at<POINT>(lmk));
+      pushed_error_ += new_factors_.error(*estimates_);
     }
 
-    return predicted_measurements;
+    try
+    {
+      if (isam_)
+      {
+        // Held at their linearization point, relinearizing is left to the next optimization
+        gtsam::ISAM2UpdateParams params;
+        params.noRelinKeys = gtsam::FastList<gtsam::Key>();
+        for (const auto &key_value : isam_->getLinearizationPoint())
+        {
+          params.noRelinKeys->push_back(key_value.key);
+        }
+        isam_->update(new_factors_, new_values_, params);
+        if (bayes_tree_listener_)
+        {
+          bayes_tree_listener_(new_factors_, new_values_, params);
+        }
+      }
+      else
+      {
+        // The smoother relinearizes as it sees fit, and moves its window, so whatever it marginalized out is
+        // dropped from the window estimates. The rest keep their estimates until the next optimization.
+        smoother_->update(new_factors_, new_values_, new_timestamps_);
+        updateWindowGraph();
+        const gtsam::Values &window = smoother_->getLinearizationPoint();
+        for (const gtsam::Key key : window_estimates_->keys())
+        {
+          if (!window.exists(key))
+          {
+            window_estimates_.write().erase(key);
+          }
+        }
+        const size_t num_landmarks = registry_->numLandmarks();
+        registry_.write().update(*window_estimates_);
+        if (data_association_ && registry_->numLandmarks() != num_landmarks)
+        {
+          data_association_->landmarksUpdated(*registry_);
+        }
+      }
+    }
+    catch (gtsam::IndeterminantLinearSystemException &indetErr)
+    {
+      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, graph_.snapshot(), estimates_.snapshot(), latest_step_, "Error when computing marginals!");
+    }
+
+    new_factors_.resize(0);
+    new_values_.clear();
+    new_timestamps_.clear();
+    graph_version_++;
+    num_pushes_++;
+    pushed_since_optimization_ = true;
   }
 
   template <class POSE, class POINT>
   void SLAM<POSE, POINT>::optimize()
   {
+    PROFILE_ZONE("slam::optimize");
     try
     {
       switch (optimization_method_)
@@ -197,22 +601,60 @@ namespace slam
       case OptimizationMethod::GaussNewton:
       {
         gtsam::GaussNewtonParams params;
-        gtsam::GaussNewtonOptimizer optimizer(graph_, estimates_, params);
+        gtsam::GaussNewtonOptimizer optimizer(*graph_, *estimates_, params);
         estimates_ = optimizer.optimize();
         break;
       }
       case OptimizationMethod::LevenbergMarquardt:
       {
         gtsam::LevenbergMarquardtParams params;
-        gtsam::LevenbergMarquardtOptimizer optimizer(graph_, estimates_, params);
+        gtsam::LevenbergMarquardtOptimizer optimizer(*graph_, *estimates_, params);
         estimates_ = optimizer.optimize();
         break;
       }
+      case OptimizationMethod::ISAM2:
+      {
+        // Only the factors and values added since last time are pushed, the rest is already in the Bayes tree
+        isam_->update(new_factors_, new_values_);
+        if (bayes_tree_listener_)
+        {
+          bayes_tree_listener_(new_factors_, new_values_, gtsam::ISAM2UpdateParams());
+        }
+        estimates_ = isam_->calculateEstimate();
+        break;
+      }
+      case OptimizationMethod::FixedLag:
+      {
+        // Variables older than the lag are marginalized out. Their last estimate is kept in estimates_,
+        // while graph_ only holds the factors (and marginal factors) of the current window.
+        smoother_->update(new_factors_, new_values_, new_timestamps_);
+        window_estimates_ = smoother_->calculateEstimate();
+        estimates_.write().update(*window_estimates_);
+        updateWindowGraph();
+        break;
+      }
       }
     }
     catch (gtsam::IndeterminantLinearSystemException &indetErr)
     {
-      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, graph_, estimates_, "Error after adding odom!");
+      throw IndeterminantLinearSystemExceptionWithGraphValues(indetErr, graph_.snapshot(), estimates_.snapshot(), latest_step_, "Error after adding odom!");
+    }
+
+    new_factors_.resize(0);
+    new_values_.clear();
+    new_timestamps_.clear();
+    graph_version_++;
+    registry_.write().update(activeEstimates());
+
+    num_optimizations_++;
+    last_optimized_pose_key_ = latest_pose_key_;
+    pushed_error_ = 0.0;
+    pushed_since_optimization_ = false;
+    publishMap();
+
+    if (data_association_)
+    {
+      data_association_->landmarksUpdated(*registry_);
     }
   }
 
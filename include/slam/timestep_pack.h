@@ -0,0 +1,252 @@
+#ifndef TIMESTEP_PACK_H
+#define TIMESTEP_PACK_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "slam/checkpoint.h"
+#include "slam/utils_g2o.h"
+
+namespace slam
+{
+  // Every pack starts with these, a pack of another format version is rebuilt
+  constexpr uint64_t TIMESTEP_PACK_MAGIC = 0x4b4341504d414c53; // "SLAMPACK"
+  constexpr uint32_t TIMESTEP_PACK_FORMAT_VERSION = 2;
+  // Shortest encoding of a noise model, its type and the dimensions of its matrix, to bound counts read from a pack
+  constexpr size_t TIMESTEP_PACK_MIN_NOISE_SIZE = sizeof(uint8_t) + 2 * sizeof(uint64_t);
+
+  /*
+   * 64 bit hash of the contents of a file, to tell whether a pack was built from it. Reads the mapped file a word at
+   * a time, each mixed in with a multiply and a shift, so hashing keeps up with reading the file rather than taking
+   * a multiply per byte as FNV-1a would.
+   */
+  inline uint64_t hashFile(const std::string &filename)
+  {
+    g2o::MappedFile file(filename);
+    const size_t size = file.end() - file.begin();
+    uint64_t hash = 0xcbf29ce484222325 ^ size;
+    auto mix = [&hash](uint64_t word)
+    {
+      hash = (hash ^ word) * 0x9e3779b97f4a7c15;
+      hash ^= hash >> 32;
+    };
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+      uint64_t word;
+      std::memcpy(&word, file.begin() + i, sizeof(word));
+      mix(word);
+    }
+    if (i < size)
+    {
+      uint64_t word = 0;
+      std::memcpy(&word, file.begin() + i, size - i);
+      mix(word);
+    }
+
+    // Final avalanche of MurmurHash3, so every bit of the last word reaches every bit of the hash
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccd;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb93fe53a85ad;
+    hash ^= hash >> 33;
+    return hash;
+  }
+
+  /*
+   * Writes a dataset as a timestep pack: a header with the dimensions and the hash of the g2o file it was read from,
+   * every distinct noise model once, then odometry, measurements with their ground truth landmarks, and vertices.
+   * Edges refer to their noise model by index, so the dataset loaded back shares one noise model per distinct one.
+   */
+  template <class POSE, class POINT>
+  void saveTimestepPack(const std::string &filename, const G2oDataset<POSE, POINT> &dataset, uint64_t source_hash)
+  {
+    // Noise models are told apart by their encoding
+    std::unordered_map<std::string, uint32_t> noise_index;
+    CheckpointWriter noise_table;
+    auto intern = [&](const gtsam::SharedNoiseModel &noise)
+    {
+      CheckpointWriter encoded;
+      encoded.writeNoise(noise);
+      auto [it, inserted] = noise_index.emplace(std::string(encoded.data(), encoded.size()), noise_index.size());
+      if (inserted)
+      {
+        noise_table.writeBytes(encoded.data(), encoded.size());
+      }
+      return it->second;
+    };
+
+    CheckpointWriter edges;
+    edges.write<uint64_t>(dataset.odometry.size());
+    for (const auto &edge : dataset.odometry)
+    {
+      edges.write<uint64_t>(edge.from);
+      edges.write<uint64_t>(edge.to);
+      edges.writePose(edge.measured);
+      edges.write<uint32_t>(intern(edge.noise));
+    }
+    edges.write<uint64_t>(dataset.measurements.size());
+    for (const auto &edge : dataset.measurements)
+    {
+      edges.write<uint64_t>(edge.pose);
+      edges.write<uint64_t>(edge.landmark);
+      edges.writeBytes(edge.measured.data(), sizeof(double) * POINT::RowsAtCompileTime);
+      edges.write<uint32_t>(intern(edge.noise));
+    }
+    edges.writeValues(dataset.initial);
+
+    CheckpointWriter writer;
+    writer.write(TIMESTEP_PACK_MAGIC);
+    writer.write(TIMESTEP_PACK_FORMAT_VERSION);
+    writer.write<uint32_t>(POSE::dimension);
+    writer.write<uint32_t>(POINT::RowsAtCompileTime);
+    writer.write(source_hash);
+    writer.write<uint64_t>(noise_index.size());
+    writer.writeBytes(noise_table.data(), noise_table.size());
+    writer.writeBytes(edges.data(), edges.size());
+    writer.save(filename);
+  }
+
+  /*
+   * The dataset in a timestep pack, read from a memory mapping.
+   * Empty if there is no pack, or if it is of another format version, dimension or source file.
+   * Throws std::runtime_error if it is corrupt.
+   */
+  template <class POSE, class POINT>
+  std::optional<G2oDataset<POSE, POINT>> loadTimestepPack(const std::string &filename, uint64_t source_hash)
+  {
+    if (!std::ifstream(filename).good())
+    {
+      return std::nullopt;
+    }
+
+    CheckpointReader reader(filename);
+    if (reader.read<uint64_t>() != TIMESTEP_PACK_MAGIC || reader.read<uint32_t>() != TIMESTEP_PACK_FORMAT_VERSION ||
+        reader.read<uint32_t>() != POSE::dimension || reader.read<uint32_t>() != POINT::RowsAtCompileTime ||
+        reader.read<uint64_t>() != source_hash)
+    {
+      return std::nullopt;
+    }
+
+    // Counts are checked against what is left of the file before anything is sized by them
+    std::vector<gtsam::SharedNoiseModel> noise_table(reader.readCount(TIMESTEP_PACK_MIN_NOISE_SIZE));
+    for (auto &noise : noise_table)
+    {
+      noise = reader.readNoise();
+    }
+    auto noise = [&](uint32_t index)
+    {
+      if (index >= noise_table.size())
+      {
+        throw std::runtime_error(filename + " refers to a noise model it does not have");
+      }
+      return noise_table[index];
+    };
+
+    G2oDataset<POSE, POINT> dataset;
+    // Poses take up more than nothing, so this is a lower bound
+    dataset.odometry.resize(reader.readCount(2 * sizeof(uint64_t) + sizeof(uint32_t)));
+    for (auto &edge : dataset.odometry)
+    {
+      edge.from = reader.read<uint64_t>();
+      edge.to = reader.read<uint64_t>();
+      reader.readPose(edge.measured);
+      edge.noise = noise(reader.read<uint32_t>());
+    }
+    dataset.measurements.resize(reader.readCount(2 * sizeof(uint64_t) + POINT::RowsAtCompileTime * sizeof(double) + sizeof(uint32_t)));
+    for (auto &edge : dataset.measurements)
+    {
+      edge.pose = reader.read<uint64_t>();
+      edge.landmark = reader.read<uint64_t>();
+      for (int i = 0; i < POINT::RowsAtCompileTime; i++)
+      {
+        edge.measured(i) = reader.read<double>();
+      }
+      edge.noise = noise(reader.read<uint32_t>());
+    }
+    dataset.initial = reader.readValues();
+    return dataset;
+  }
+
+  /*
+   * readG2oDataset, through a timestep pack: the pack is used if it was built from the file as it is now, and is
+   * otherwise (re)built from the file for the next run.
+   */
+  template <class POSE, class POINT>
+  G2oDataset<POSE, POINT> readG2oDatasetCached(const std::string &g2oFile, const std::string &pack_file)
+  {
+    const uint64_t source_hash = hashFile(g2oFile);
+    try
+    {
+      if (std::optional<G2oDataset<POSE, POINT>> dataset = loadTimestepPack<POSE, POINT>(pack_file, source_hash))
+      {
+        return std::move(*dataset);
+      }
+    }
+    catch (const std::runtime_error &err)
+    {
+      std::cout << "Rebuilding corrupt timestep pack " << pack_file << ": " << err.what() << "\n";
+    }
+
+    G2oDataset<POSE, POINT> dataset = readG2oDataset<POSE, POINT>(g2oFile);
+    try
+    {
+      saveTimestepPack(pack_file, dataset, source_hash);
+    }
+    catch (const std::runtime_error &err)
+    {
+      // Only a cache, the run goes on without it
+      std::cout << "Could not write timestep pack " << pack_file << ": " << err.what() << "\n";
+    }
+    return dataset;
+  }
+
+  // Whether there is a pack of this format version and dimension built from the file of source_hash, from its header
+  template <class POSE, class POINT>
+  bool isTimestepPackOf(const std::string &filename, uint64_t source_hash)
+  {
+    if (!std::ifstream(filename).good())
+    {
+      return false;
+    }
+    try
+    {
+      CheckpointReader reader(filename);
+      return reader.read<uint64_t>() == TIMESTEP_PACK_MAGIC && reader.read<uint32_t>() == TIMESTEP_PACK_FORMAT_VERSION &&
+             reader.read<uint32_t>() == POSE::dimension && reader.read<uint32_t>() == POINT::RowsAtCompileTime &&
+             reader.read<uint64_t>() == source_hash;
+    }
+    catch (const std::runtime_error &)
+    {
+      // Too short for a header
+      return false;
+    }
+  }
+
+  /*
+   * Makes sure pack_file is a timestep pack of g2oFile as it is now, parsing the file to (re)build it if not, and
+   * returns the hash to open it with. Unlike readG2oDatasetCached the dataset is only in memory while building.
+   * Throws std::runtime_error if the pack can not be written.
+   */
+  template <class POSE, class POINT>
+  uint64_t buildTimestepPack(const std::string &g2oFile, const std::string &pack_file)
+  {
+    const uint64_t source_hash = hashFile(g2oFile);
+    if (!isTimestepPackOf<POSE, POINT>(pack_file, source_hash))
+    {
+      saveTimestepPack(pack_file, readG2oDataset<POSE, POINT>(g2oFile), source_hash);
+    }
+    return source_hash;
+  }
+
+} // namespace slam
+
+#endif // TIMESTEP_PACK_H
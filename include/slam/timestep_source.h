@@ -0,0 +1,399 @@
+#ifndef TIMESTEP_SOURCE_H
+#define TIMESTEP_SOURCE_H
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "slam/checkpoint.h"
+#include "slam/timestep_pack.h"
+#include "slam/types.h"
+#include "slam/utils_g2o.h"
+#include "utils/bounded_queue.h"
+
+namespace slam
+{
+  /*
+   * Timesteps of a run, pulled one at a time in order of step, so only the timesteps being processed need to be
+   * held in memory rather than all of them up front.
+   */
+  template <class POSE, class POINT>
+  class TimestepSource
+  {
+  public:
+    virtual ~TimestepSource() = default;
+
+    // Empty once every timestep has been given
+    virtual std::optional<Timestep<POSE, POINT>> next() = 0;
+    // Number of timesteps in total, including those already given
+    virtual size_t size() const = 0;
+  };
+
+  // Timesteps already in memory, as convert_into_timesteps or G2oDataset::timesteps gives them
+  template <class POSE, class POINT>
+  class MemoryTimestepSource : public TimestepSource<POSE, POINT>
+  {
+  private:
+    std::vector<Timestep<POSE, POINT>> timesteps_;
+    size_t next_;
+
+  public:
+    explicit MemoryTimestepSource(std::vector<Timestep<POSE, POINT>> timesteps) : timesteps_(std::move(timesteps)), next_(0) {}
+
+    std::optional<Timestep<POSE, POINT>> next() override
+    {
+      if (next_ == timesteps_.size())
+      {
+        return std::nullopt;
+      }
+      return timesteps_[next_++];
+    }
+
+    size_t size() const override { return timesteps_.size(); }
+  };
+
+  /*
+   * Timesteps of a g2o file, built one at a time from the edges of the dataset, the same as G2oDataset::timesteps
+   * would. The dataset may be shared with whoever also needs its odometry or vertices.
+   */
+  template <class POSE, class POINT>
+  class G2oTimestepSource : public TimestepSource<POSE, POINT>
+  {
+  private:
+    std::shared_ptr<const G2oDataset<POSE, POINT>> dataset_;
+    size_t next_step_;
+    size_t next_measurement_;
+
+  public:
+    explicit G2oTimestepSource(std::shared_ptr<const G2oDataset<POSE, POINT>> dataset)
+        : dataset_(std::move(dataset)), next_step_(0), next_measurement_(0) {}
+    explicit G2oTimestepSource(const std::string &g2o_file)
+        : G2oTimestepSource(std::make_shared<const G2oDataset<POSE, POINT>>(readG2oDataset<POSE, POINT>(g2o_file))) {}
+
+    std::optional<Timestep<POSE, POINT>> next() override
+    {
+      if (next_step_ == size())
+      {
+        return std::nullopt;
+      }
+      Timestep<POSE, POINT> timestep;
+      timestep.step = next_step_;
+      if (next_step_ > 0)
+      {
+        const auto &odometry = dataset_->odometry[next_step_ - 1];
+        timestep.odom.odom = odometry.measured;
+        timestep.odom.noise = odometry.noise;
+      }
+      const auto &measurements = dataset_->measurements;
+      while (next_measurement_ < measurements.size() && gtsam::symbolIndex(measurements[next_measurement_].pose) == next_step_)
+      {
+        const auto &edge = measurements[next_measurement_];
+        timestep.measurements.push_back({edge.measured, next_measurement_, edge.noise});
+        next_measurement_++;
+      }
+      next_step_++;
+      return timestep;
+    }
+
+    // There will always be one more robot pose than odometry edges since they're all between
+    size_t size() const override { return dataset_->odometry.size() + 1; }
+  };
+
+  /*
+   * Timesteps of a timestep pack, decoded one at a time from the memory mapped pack, so neither the edges nor the
+   * timesteps are ever all in memory. Only the noise models are decoded up front, and shared by the timesteps.
+   * Throws std::runtime_error if the pack is of another format version or dimension, was built from another g2o
+   * file, or is corrupt.
+   */
+  template <class POSE, class POINT>
+  class TimestepPackSource : public TimestepSource<POSE, POINT>
+  {
+  private:
+    std::string filename_;
+    std::vector<gtsam::SharedNoiseModel> noise_table_;
+    // Two mappings of the pack, positioned at the next odometry and the next measurement
+    CheckpointReader odometry_reader_;
+    CheckpointReader measurement_reader_;
+    size_t num_odometry_;
+    size_t num_measurements_;
+    size_t odometry_offset_;
+    size_t measurements_offset_;
+    size_t next_step_;
+    // Measurements read so far, the last one pending if it belongs to a later timestep
+    size_t next_measurement_;
+    using MeasurementEdge = typename G2oDataset<POSE, POINT>::MeasurementEdge;
+    std::optional<MeasurementEdge> pending_;
+
+    // Encoded size of one odometry edge
+    static size_t odometryEdgeSize()
+    {
+      CheckpointWriter pose;
+      pose.writePose(POSE());
+      return 2 * sizeof(uint64_t) + pose.size() + sizeof(uint32_t);
+    }
+
+    // Encoded size of one measurement edge
+    static size_t measurementEdgeSize() { return 2 * sizeof(uint64_t) + POINT::RowsAtCompileTime * sizeof(double) + sizeof(uint32_t); }
+
+    const gtsam::SharedNoiseModel &noise(uint32_t index) const
+    {
+      if (index >= noise_table_.size())
+      {
+        throw std::runtime_error(filename_ + " refers to a noise model it does not have");
+      }
+      return noise_table_[index];
+    }
+
+    MeasurementEdge readMeasurementEdge(CheckpointReader &reader) const
+    {
+      MeasurementEdge edge;
+      edge.pose = reader.read<uint64_t>();
+      edge.landmark = reader.read<uint64_t>();
+      for (int i = 0; i < POINT::RowsAtCompileTime; i++)
+      {
+        edge.measured(i) = reader.read<double>();
+      }
+      edge.noise = noise(reader.read<uint32_t>());
+      return edge;
+    }
+
+  public:
+    TimestepPackSource(const std::string &filename, uint64_t source_hash)
+        : filename_(filename),
+          odometry_reader_(filename),
+          measurement_reader_(filename),
+          next_step_(0),
+          next_measurement_(0)
+    {
+      CheckpointReader &reader = odometry_reader_;
+      if (reader.read<uint64_t>() != TIMESTEP_PACK_MAGIC || reader.read<uint32_t>() != TIMESTEP_PACK_FORMAT_VERSION ||
+          reader.read<uint32_t>() != POSE::dimension || reader.read<uint32_t>() != POINT::RowsAtCompileTime)
+      {
+        throw std::runtime_error(filename + " is not a timestep pack of this format version and dimension");
+      }
+      if (reader.read<uint64_t>() != source_hash)
+      {
+        throw std::runtime_error(filename + " was built from another g2o file");
+      }
+
+      // Counts are checked against what is left of the file before anything is sized or skipped by them
+      noise_table_.resize(reader.readCount(TIMESTEP_PACK_MIN_NOISE_SIZE));
+      for (auto &noise : noise_table_)
+      {
+        noise = reader.readNoise();
+      }
+
+      // Measurements follow the odometry, whose edges are all the same size
+      num_odometry_ = reader.readCount(odometryEdgeSize());
+      odometry_offset_ = reader.offset();
+      measurement_reader_.skip(odometry_offset_ + num_odometry_ * odometryEdgeSize());
+      num_measurements_ = measurement_reader_.readCount(measurementEdgeSize());
+      measurements_offset_ = measurement_reader_.offset();
+    }
+
+    std::optional<Timestep<POSE, POINT>> next() override
+    {
+      if (next_step_ == size())
+      {
+        return std::nullopt;
+      }
+      Timestep<POSE, POINT> timestep;
+      timestep.step = next_step_;
+      if (next_step_ > 0)
+      {
+        odometry_reader_.skip(2 * sizeof(uint64_t));
+        odometry_reader_.readPose(timestep.odom.odom);
+        timestep.odom.noise = noise(odometry_reader_.read<uint32_t>());
+      }
+
+      // The first measurement of a later pose is only known to be one once read, and is held on to until then
+      while (pending_ || next_measurement_ < num_measurements_)
+      {
+        if (!pending_)
+        {
+          pending_ = readMeasurementEdge(measurement_reader_);
+          next_measurement_++;
+        }
+        if (gtsam::symbolIndex(pending_->pose) != next_step_)
+        {
+          break;
+        }
+        timestep.measurements.push_back({pending_->measured, next_measurement_ - 1, pending_->noise});
+        pending_.reset();
+      }
+      next_step_++;
+      return timestep;
+    }
+
+    size_t size() const override { return num_odometry_ + 1; }
+
+    // Ground truth landmark of every measurement, by measurement idx, read through the pack once more
+    std::map<uint64_t, gtsam::Key> measurementLandmarkAssociations() const
+    {
+      CheckpointReader reader(filename_);
+      reader.skip(measurements_offset_);
+      std::map<uint64_t, gtsam::Key> meas_lmk_assos;
+      for (size_t i = 0; i < num_measurements_; i++)
+      {
+        meas_lmk_assos.emplace_hint(meas_lmk_assos.end(), i, readMeasurementEdge(reader).landmark);
+      }
+      return meas_lmk_assos;
+    }
+
+    // The odometry as between factors, as G2oDataset::odometryGraph gives it, read through the pack once more
+    gtsam::NonlinearFactorGraph odometryGraph() const
+    {
+      CheckpointReader reader(filename_);
+      reader.skip(odometry_offset_);
+      gtsam::NonlinearFactorGraph graph;
+      graph.reserve(num_odometry_);
+      for (size_t i = 0; i < num_odometry_; i++)
+      {
+        const gtsam::Key from = reader.read<uint64_t>();
+        const gtsam::Key to = reader.read<uint64_t>();
+        POSE measured;
+        reader.readPose(measured);
+        graph.emplace_shared<gtsam::BetweenFactor<POSE>>(from, to, measured, noise(reader.read<uint32_t>()));
+      }
+      return graph;
+    }
+
+    // The vertices of the g2o file, read through the pack once more
+    gtsam::Values initialEstimates() const
+    {
+      CheckpointReader reader(filename_);
+      reader.skip(measurements_offset_ + num_measurements_ * measurementEdgeSize());
+      return reader.readValues();
+    }
+  };
+
+  /*
+   * Pulls timesteps from another source on a thread of its own, at most read_ahead timesteps ahead of next(), so
+   * reading and decoding overlaps with processing. Exceptions thrown by the source are rethrown by next(), after
+   * the timesteps read before them.
+   */
+  template <class POSE, class POINT>
+  class ReadAheadTimestepSource : public TimestepSource<POSE, POINT>
+  {
+  private:
+    std::unique_ptr<TimestepSource<POSE, POINT>> source_;
+    const size_t size_;
+    utils::BoundedQueue<Timestep<POSE, POINT>> queue_;
+    std::exception_ptr error_;
+    std::thread reader_;
+
+  public:
+    ReadAheadTimestepSource(std::unique_ptr<TimestepSource<POSE, POINT>> source, size_t read_ahead)
+        : source_(std::move(source)), size_(source_->size()), queue_(read_ahead)
+    {
+      reader_ = std::thread([this]
+                            {
+        try
+        {
+          // push fails once closed by the destructor
+          while (std::optional<Timestep<POSE, POINT>> timestep = source_->next())
+          {
+            if (!queue_.push(std::move(*timestep)))
+            {
+              break;
+            }
+          }
+        }
+        catch (...)
+        {
+          error_ = std::current_exception();
+        }
+        queue_.close(); });
+    }
+
+    ~ReadAheadTimestepSource()
+    {
+      queue_.close();
+      reader_.join();
+    }
+
+    ReadAheadTimestepSource(const ReadAheadTimestepSource &) = delete;
+    ReadAheadTimestepSource &operator=(const ReadAheadTimestepSource &) = delete;
+
+    std::optional<Timestep<POSE, POINT>> next() override
+    {
+      std::optional<Timestep<POSE, POINT>> timestep = queue_.pop();
+      // Only empty once the reader has closed the queue, after setting any error
+      if (!timestep && error_)
+      {
+        std::rethrow_exception(error_);
+      }
+      return timestep;
+    }
+
+    size_t size() const override { return size_; }
+  };
+
+  /*
+   * The g2o file a run reads. With a timestep pack, timesteps are decoded from the pack read_ahead at a time on a
+   * thread of their own, and only the odometry graph and initial estimates are read whole, when asked for. Without
+   * one, or if the pack can not be written, the file is parsed into a dataset once and timesteps built from that.
+   */
+  template <class POSE, class POINT>
+  class G2oInput
+  {
+  private:
+    std::string pack_file_;
+    uint64_t pack_hash_;
+    size_t read_ahead_;
+    std::shared_ptr<const G2oDataset<POSE, POINT>> dataset_;
+
+    TimestepPackSource<POSE, POINT> pack() const { return TimestepPackSource<POSE, POINT>(pack_file_, pack_hash_); }
+
+  public:
+    G2oInput(const std::string &g2o_file, bool use_pack, size_t read_ahead = 64) : pack_hash_(0), read_ahead_(read_ahead)
+    {
+      if (use_pack)
+      {
+        try
+        {
+          pack_hash_ = buildTimestepPack<POSE, POINT>(g2o_file, g2o_file + ".pack");
+          pack_file_ = g2o_file + ".pack";
+          return;
+        }
+        catch (const std::runtime_error &err)
+        {
+          std::cout << "Could not write timestep pack " << g2o_file << ".pack: " << err.what() << "\n";
+        }
+      }
+      dataset_ = std::make_shared<const G2oDataset<POSE, POINT>>(readG2oDataset<POSE, POINT>(g2o_file));
+    }
+
+    // Every call starts from the first timestep
+    std::unique_ptr<TimestepSource<POSE, POINT>> timesteps() const
+    {
+      if (dataset_)
+      {
+        return std::make_unique<G2oTimestepSource<POSE, POINT>>(dataset_);
+      }
+      return std::make_unique<ReadAheadTimestepSource<POSE, POINT>>(
+          std::make_unique<TimestepPackSource<POSE, POINT>>(pack_file_, pack_hash_), read_ahead_);
+    }
+
+    gtsam::NonlinearFactorGraph odometryGraph() const { return dataset_ ? dataset_->odometryGraph() : pack().odometryGraph(); }
+    gtsam::Values initialEstimates() const { return dataset_ ? dataset_->initial : pack().initialEstimates(); }
+    std::map<uint64_t, gtsam::Key> measurementLandmarkAssociations() const
+    {
+      return dataset_ ? dataset_->measurementLandmarkAssociations() : pack().measurementLandmarkAssociations();
+    }
+  };
+
+  using TimestepSource2D = TimestepSource<gtsam::Pose2, gtsam::Point2>;
+  using TimestepSource3D = TimestepSource<gtsam::Pose3, gtsam::Point3>;
+
+} // namespace slam
+
+#endif // TIMESTEP_SOURCE_H
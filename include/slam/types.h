@@ -11,7 +11,12 @@
 #include <gtsam_unstable/slam/PoseToPointFactor.h>
 #include <gtsam/nonlinear/ISAM2.h>
 
+#include <exception>
+#include <iostream>
 #include <memory>
+#include <string>
+
+#include "slam/crash_dump.h"
 
 
 namespace slam {
@@ -59,17 +64,37 @@ struct IndeterminantLinearSystemExceptionWithISAM : public gtsam::IndeterminantL
 };
 
 
+/*
+ * Thrown when optimization or covariance recovery runs into an indeterminant system, with snapshots of the graph and
+ * estimates it failed on. They are shared with the system that throws rather than copied, so throwing is O(1), and the
+ * system keeps its own to be inspected or checkpointed after. Should it change them while the exception is still held,
+ * that change copies them first (see utils::CopyOnWrite), so the snapshots stay as they were when thrown.
+ */
 struct IndeterminantLinearSystemExceptionWithGraphValues : public gtsam::IndeterminantLinearSystemException {
-    gtsam::NonlinearFactorGraph graph;
-    gtsam::Values values;
+    std::shared_ptr<const gtsam::NonlinearFactorGraph> graph;
+    std::shared_ptr<const gtsam::Values> values;
+    int step; // Timestep being processed
     std::string when;
-    IndeterminantLinearSystemExceptionWithGraphValues(const gtsam::IndeterminantLinearSystemException& err, const gtsam::NonlinearFactorGraph& graph_,
-    const gtsam::Values& values_, const char* when_) noexcept :
+    IndeterminantLinearSystemExceptionWithGraphValues(const gtsam::IndeterminantLinearSystemException& err, std::shared_ptr<const gtsam::NonlinearFactorGraph> graph_,
+    std::shared_ptr<const gtsam::Values> values_, int step_, const char* when_) noexcept :
     gtsam::IndeterminantLinearSystemException(err.nearbyVariable()),
-    graph(graph_),
-    values(values_),
+    graph(std::move(graph_)),
+    values(std::move(values_)),
+    step(step_),
      when(when_)
       {}
+
+    // Nothing is written unless asked for, read it back with loadCrashDump to replay the failure.
+    // Called from catch handlers, so a dump that can not be written is reported and false returned rather than thrown.
+    bool dump(const std::string& filename) const noexcept {
+        try {
+            saveCrashDump(filename, step, nearbyVariable(), when, *graph, *values);
+            return true;
+        } catch (const std::exception& err) {
+            std::cerr << "Could not write crash dump " << filename << ": " << err.what() << std::endl;
+            return false;
+        }
+    }
 };
 
 
@@ -32,7 +32,20 @@
 #include <fstream>
 #include <boost/filesystem/path.hpp>
 #include <ctime>
-
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "slam/measurement_batch.h"
 #include "slam/types.h"
 
 using gtsam::symbol_shorthand::L;  // gtsam/slam/dataset.cpp
@@ -403,3 +416,434 @@ std::map<uint64_t, gtsam::Key> measurement_landmarks_associations(
     return meas_lmk_assos;
 }
 
+
+
+namespace slam
+{
+
+/*
+ * Odometry, landmark measurements and vertices of a g2o file, as read by readG2oDataset.
+ * Poses are keyed by their vertex id and landmarks by L(id), the same keys readG2owithLmks gives.
+ */
+template <class POSE, class POINT>
+struct G2oDataset
+{
+    struct OdometryEdge
+    {
+        gtsam::Key from;
+        gtsam::Key to;
+        POSE measured;
+        gtsam::SharedNoiseModel noise;
+    };
+
+    struct MeasurementEdge
+    {
+        gtsam::Key pose;
+        gtsam::Key landmark;
+        POINT measured;
+        gtsam::SharedNoiseModel noise;
+    };
+
+    std::vector<OdometryEdge> odometry;        // Ordered by pose
+    std::vector<MeasurementEdge> measurements; // Ordered by pose, in file order for the same pose
+    gtsam::Values initial;
+
+    // One timestep per pose, the idx of a measurement is its index in measurements
+    std::vector<Timestep<POSE, POINT>> timesteps() const
+    {
+        std::vector<Timestep<POSE, POINT>> timesteps;
+        // There will always be one more robot pose than odometry edges since they're all between
+        timesteps.resize(odometry.size() + 1);
+        size_t curr_measurement = 0;
+        for (size_t t = 0; t < timesteps.size(); t++)
+        {
+            Timestep<POSE, POINT> &timestep = timesteps[t];
+            timestep.step = t;
+            if (t > 0)
+            {
+                timestep.odom.odom = odometry[t - 1].measured;
+                timestep.odom.noise = odometry[t - 1].noise;
+            }
+            while (curr_measurement < measurements.size() && gtsam::symbolIndex(measurements[curr_measurement].pose) == t)
+            {
+                const MeasurementEdge &edge = measurements[curr_measurement];
+                timestep.measurements.push_back({edge.measured, curr_measurement, edge.noise});
+                curr_measurement++;
+            }
+        }
+        return timesteps;
+    }
+
+    // Ground truth landmark of every measurement, by measurement idx
+    std::map<uint64_t, gtsam::Key> measurementLandmarkAssociations() const
+    {
+        std::map<uint64_t, gtsam::Key> meas_lmk_assos;
+        for (size_t i = 0; i < measurements.size(); i++)
+        {
+            meas_lmk_assos.emplace_hint(meas_lmk_assos.end(), i, measurements[i].landmark);
+        }
+        return meas_lmk_assos;
+    }
+
+    // The odometry as between factors, the graph gtsam::readG2o gives for writing results with writeG2o
+    gtsam::NonlinearFactorGraph odometryGraph() const
+    {
+        gtsam::NonlinearFactorGraph graph;
+        graph.reserve(odometry.size());
+        for (const OdometryEdge &edge : odometry)
+        {
+            graph.emplace_shared<gtsam::BetweenFactor<POSE>>(edge.from, edge.to, edge.measured, edge.noise);
+        }
+        return graph;
+    }
+};
+
+using G2oDataset2D = G2oDataset<gtsam::Pose2, gtsam::Point2>;
+using G2oDataset3D = G2oDataset<gtsam::Pose3, gtsam::Point3>;
+
+namespace g2o
+{
+    // Read only view of a whole file, memory mapped
+    class MappedFile
+    {
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+
+    public:
+        explicit MappedFile(const std::string &filename)
+        {
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::invalid_argument("cannot find file " + filename);
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                throw std::runtime_error("cannot stat file " + filename);
+            }
+            size_ = st.st_size;
+            if (size_ > 0)
+            {
+                void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("cannot map file " + filename);
+                }
+                data_ = static_cast<const char *>(data);
+                ::madvise(data, size_, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+        ~MappedFile()
+        {
+            if (data_)
+            {
+                ::munmap(const_cast<char *>(data_), size_);
+            }
+        }
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        inline const char *begin() const { return data_; }
+        inline const char *end() const { return data_ + size_; }
+    };
+
+    /*
+     * Splits a g2o file into records, and records into whitespace separated fields, without copying it.
+     * Numbers are never read past the end of their line.
+     */
+    class Tokenizer
+    {
+    private:
+        const char *p_;
+        const char *end_;
+        size_t line_ = 0;
+
+        static inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+        void skipBlanks()
+        {
+            while (p_ < end_ && isBlank(*p_))
+            {
+                p_++;
+            }
+        }
+
+        // The next field of this line, copied NUL terminated into buf for strtod and friends
+        void field(char (&buf)[64])
+        {
+            skipBlanks();
+            const char *start = p_;
+            while (p_ < end_ && !isBlank(*p_) && *p_ != '\n')
+            {
+                p_++;
+            }
+            size_t len = p_ - start;
+            if (len == 0 || len >= sizeof(buf))
+            {
+                throw std::runtime_error("g2o line " + std::to_string(line_) + " has a missing or malformed field");
+            }
+            std::memcpy(buf, start, len);
+            buf[len] = '\0';
+        }
+
+    public:
+        Tokenizer(const char *begin, const char *end) : p_(begin), end_(end) {}
+
+        // Moves to the start of the next non-empty line and returns its tag, false at the end of the file
+        bool nextRecord(const char *&tag, size_t &tag_len)
+        {
+            while (p_ < end_)
+            {
+                skipBlanks();
+                if (p_ < end_ && *p_ == '\n')
+                {
+                    p_++;
+                    line_++;
+                    continue;
+                }
+                tag = p_;
+                while (p_ < end_ && !isBlank(*p_) && *p_ != '\n')
+                {
+                    p_++;
+                }
+                tag_len = p_ - tag;
+                line_++;
+                return tag_len > 0;
+            }
+            return false;
+        }
+
+        // Ignores the rest of the current line
+        void skipLine()
+        {
+            const char *newline = static_cast<const char *>(std::memchr(p_, '\n', end_ - p_));
+            p_ = newline ? newline + 1 : end_;
+        }
+
+        double number()
+        {
+            char buf[64];
+            field(buf);
+            char *parsed;
+            double value = std::strtod(buf, &parsed);
+            if (*parsed != '\0')
+            {
+                throw std::runtime_error("g2o line " + std::to_string(line_) + " has a malformed number " + buf);
+            }
+            return value;
+        }
+
+        uint64_t id()
+        {
+            char buf[64];
+            field(buf);
+            char *parsed;
+            uint64_t value = std::strtoull(buf, &parsed, 10);
+            if (*parsed != '\0')
+            {
+                throw std::runtime_error("g2o line " + std::to_string(line_) + " has a malformed id " + buf);
+            }
+            return value;
+        }
+
+        // Upper triangle of a symmetric information matrix, row by row
+        template <int N>
+        Eigen::Matrix<double, N, N> information()
+        {
+            Eigen::Matrix<double, N, N> info;
+            for (int i = 0; i < N; i++)
+            {
+                for (int j = i; j < N; j++)
+                {
+                    info(i, j) = info(j, i) = number();
+                }
+            }
+            return info;
+        }
+    };
+
+    inline bool isTag(const char *tag, size_t tag_len, const char *expected)
+    {
+        return tag_len == std::strlen(expected) && std::memcmp(tag, expected, tag_len) == 0;
+    }
+
+    // Returns false for records of other types, which are skipped
+    inline bool parseRecord(Tokenizer &tokens, const char *tag, size_t tag_len, G2oDataset2D &dataset,
+                            NoiseTable<3> &odometry_noise, NoiseTable<2> &measurement_noise)
+    {
+        if (isTag(tag, tag_len, "EDGE_SE2"))
+        {
+            G2oDataset2D::OdometryEdge edge;
+            edge.from = tokens.id();
+            edge.to = tokens.id();
+            double x = tokens.number();
+            double y = tokens.number();
+            double theta = tokens.number();
+            edge.measured = gtsam::Pose2(x, y, theta);
+            edge.noise = odometry_noise.model(odometry_noise.internInformation(tokens.information<3>()));
+            dataset.odometry.push_back(std::move(edge));
+        }
+        else if (isTag(tag, tag_len, "EDGE_SE2_XY"))
+        {
+            G2oDataset2D::MeasurementEdge edge;
+            edge.pose = tokens.id();
+            edge.landmark = L(tokens.id());
+            double x = tokens.number();
+            double y = tokens.number();
+            edge.measured = gtsam::Point2(x, y);
+            edge.noise = measurement_noise.model(measurement_noise.internInformation(tokens.information<2>()));
+            dataset.measurements.push_back(std::move(edge));
+        }
+        else if (isTag(tag, tag_len, "VERTEX_SE2"))
+        {
+            gtsam::Key key = tokens.id();
+            double x = tokens.number();
+            double y = tokens.number();
+            double theta = tokens.number();
+            dataset.initial.insert(key, gtsam::Pose2(x, y, theta));
+        }
+        else if (isTag(tag, tag_len, "VERTEX_XY"))
+        {
+            gtsam::Key key = L(tokens.id());
+            double x = tokens.number();
+            double y = tokens.number();
+            dataset.initial.insert(key, gtsam::Point2(x, y));
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+
+    inline gtsam::Pose3 pose3(Tokenizer &tokens)
+    {
+        double x = tokens.number();
+        double y = tokens.number();
+        double z = tokens.number();
+        double qx = tokens.number();
+        double qy = tokens.number();
+        double qz = tokens.number();
+        double qw = tokens.number();
+        return gtsam::Pose3(gtsam::NormalizedRot3(qw, qx, qy, qz), gtsam::Point3(x, y, z));
+    }
+
+    inline bool parseRecord(Tokenizer &tokens, const char *tag, size_t tag_len, G2oDataset3D &dataset,
+                            NoiseTable<6> &odometry_noise, NoiseTable<3> &measurement_noise)
+    {
+        if (isTag(tag, tag_len, "EDGE_SE3:QUAT"))
+        {
+            G2oDataset3D::OdometryEdge edge;
+            edge.from = tokens.id();
+            edge.to = tokens.id();
+            edge.measured = pose3(tokens);
+            // g2o orders the tangent space translation first, gtsam rotation first
+            gtsam::Matrix6 info = tokens.information<6>();
+            gtsam::Matrix6 info_gtsam;
+            info_gtsam << info.block<3, 3>(3, 3), info.block<3, 3>(3, 0),
+                info.block<3, 3>(0, 3), info.block<3, 3>(0, 0);
+            edge.noise = odometry_noise.model(odometry_noise.internInformation(info_gtsam));
+            dataset.odometry.push_back(std::move(edge));
+        }
+        else if (isTag(tag, tag_len, "EDGE_SE3_XYZ"))
+        {
+            G2oDataset3D::MeasurementEdge edge;
+            edge.pose = tokens.id();
+            edge.landmark = L(tokens.id());
+            double x = tokens.number();
+            double y = tokens.number();
+            double z = tokens.number();
+            edge.measured = gtsam::Point3(x, y, z);
+            edge.noise = measurement_noise.model(measurement_noise.internInformation(tokens.information<3>()));
+            dataset.measurements.push_back(std::move(edge));
+        }
+        else if (isTag(tag, tag_len, "VERTEX_SE3:QUAT"))
+        {
+            gtsam::Key key = tokens.id();
+            dataset.initial.insert(key, pose3(tokens));
+        }
+        else if (isTag(tag, tag_len, "VERTEX_TRACKXYZ"))
+        {
+            gtsam::Key key = L(tokens.id());
+            double x = tokens.number();
+            double y = tokens.number();
+            double z = tokens.number();
+            dataset.initial.insert(key, gtsam::Point3(x, y, z));
+        }
+        else
+        {
+            return false;
+        }
+        return true;
+    }
+} // namespace g2o
+
+/*
+ * Reads a g2o file in a single pass over a memory mapping, straight into typed odometry and measurement arrays.
+ * Replaces readG2owithLmks, findFactors and convert_into_timesteps, which parse the file twice and build a factor
+ * graph only to take it apart again. Records of the other dimension, and of other types, are skipped.
+ */
+template <class POSE, class POINT>
+G2oDataset<POSE, POINT> readG2oDataset(const std::string &g2oFile)
+{
+    G2oDataset<POSE, POINT> dataset;
+    g2o::MappedFile file(g2oFile);
+    g2o::Tokenizer tokens(file.begin(), file.end());
+    // Edges with the same information matrix share one noise model, rather than one each
+    NoiseTable<POSE::dimension> odometry_noise;
+    NoiseTable<POINT::RowsAtCompileTime> measurement_noise;
+    const char *tag;
+    size_t tag_len;
+    while (tokens.nextRecord(tag, tag_len))
+    {
+        g2o::parseRecord(tokens, tag, tag_len, dataset, odometry_noise, measurement_noise);
+        tokens.skipLine();
+    }
+
+    // Usually already in order, in which case this is a single pass
+    std::stable_sort(dataset.odometry.begin(), dataset.odometry.end(),
+                     [](const auto &lhs, const auto &rhs)
+                     { return gtsam::symbolIndex(lhs.from) < gtsam::symbolIndex(rhs.from); });
+    std::stable_sort(dataset.measurements.begin(), dataset.measurements.end(),
+                     [](const auto &lhs, const auto &rhs)
+                     { return gtsam::symbolIndex(lhs.pose) < gtsam::symbolIndex(rhs.pose); });
+    return dataset;
+}
+
+/*
+ * Whether a g2o file is of 3D poses and points, from the first pose or point record readG2oDataset knows, so other
+ * records and comments before it don't matter. Throws std::runtime_error if it has neither 2D nor 3D records.
+ */
+inline bool isG2o3D(const std::string &g2oFile)
+{
+    g2o::MappedFile file(g2oFile);
+    g2o::Tokenizer tokens(file.begin(), file.end());
+    const char *tag;
+    size_t tag_len;
+    while (tokens.nextRecord(tag, tag_len))
+    {
+        for (const char *tag_3d : {"VERTEX_SE3:QUAT", "VERTEX_TRACKXYZ", "EDGE_SE3:QUAT", "EDGE_SE3_XYZ"})
+        {
+            if (g2o::isTag(tag, tag_len, tag_3d))
+            {
+                return true;
+            }
+        }
+        for (const char *tag_2d : {"VERTEX_SE2", "VERTEX_XY", "EDGE_SE2", "EDGE_SE2_XY"})
+        {
+            if (g2o::isTag(tag, tag_len, tag_2d))
+            {
+                return false;
+            }
+        }
+        tokens.skipLine();
+    }
+    throw std::runtime_error(g2oFile + " has no 2D or 3D poses or points");
+}
+
+} // namespace slam
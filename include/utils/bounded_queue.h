@@ -0,0 +1,87 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace utils
+{
+  /*
+   * FIFO queue between threads, holding at most capacity items.
+   * push blocks while the queue is full and pop while it is empty, which is what throttles a fast producer.
+   */
+  template <class T>
+  class BoundedQueue
+  {
+  private:
+    const size_t capacity_;
+    std::deque<T> items_;
+    std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    bool closed_;
+
+  public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    // Returns false, dropping item, if the queue has been closed
+    bool push(T item)
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this]
+                       { return closed_ || items_.size() < capacity_; });
+        if (closed_)
+        {
+          return false;
+        }
+        items_.push_back(std::move(item));
+      }
+      not_empty_.notify_one();
+      return true;
+    }
+
+    // Empty only once the queue is closed and everything pushed before has been popped
+    std::optional<T> pop()
+    {
+      std::optional<T> item;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]
+                        { return closed_ || !items_.empty(); });
+        if (items_.empty())
+        {
+          return std::nullopt;
+        }
+        item.emplace(std::move(items_.front()));
+        items_.pop_front();
+      }
+      not_full_.notify_one();
+      return item;
+    }
+
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+      }
+      not_full_.notify_all();
+      not_empty_.notify_all();
+    }
+
+    size_t size()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return items_.size();
+    }
+  };
+
+} // namespace utils
+
+#endif // BOUNDED_QUEUE_H
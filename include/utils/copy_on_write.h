@@ -0,0 +1,47 @@
+#ifndef COPY_ON_WRITE_H
+#define COPY_ON_WRITE_H
+
+#include <memory>
+#include <utility>
+
+namespace utils
+{
+  /*
+   * Value shared with copies of the holder and with snapshots taken of it, which all see it as it was when taken.
+   * Taking a snapshot or copying is O(1). write() copies the value first only while anything else still shares it,
+   * and assigning a new value never copies, so an owner that replaces the value on every update copies nothing.
+   * Snapshots may be released from any thread, but the holder itself is only meant to be used from one.
+   */
+  template <class T>
+  class CopyOnWrite
+  {
+  private:
+    std::shared_ptr<T> value_;
+
+  public:
+    CopyOnWrite() : value_(std::make_shared<T>()) {}
+    explicit CopyOnWrite(T value) : value_(std::make_shared<T>(std::move(value))) {}
+
+    CopyOnWrite &operator=(T value)
+    {
+      value_ = std::make_shared<T>(std::move(value));
+      return *this;
+    }
+
+    const T &operator*() const { return *value_; }
+    const T *operator->() const { return value_.get(); }
+
+    std::shared_ptr<const T> snapshot() const { return value_; }
+
+    T &write()
+    {
+      if (value_.use_count() > 1)
+      {
+        value_ = std::make_shared<T>(*value_);
+      }
+      return *value_;
+    }
+  };
+} // namespace utils
+
+#endif // COPY_ON_WRITE_H
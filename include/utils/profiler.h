@@ -0,0 +1,88 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace utils
+{
+  /*
+   * Scoped timing of hot code paths, enabled with the PROFILING option.
+   *
+   *   {
+   *     PROFILE_ZONE("ml::gating");
+   *     ...
+   *   }
+   *
+   * times the rest of the scope. Each thread records into buffers of its own, so recording takes no lock: the end of
+   * a zone adds its duration to a log-linear histogram of the zone, and the zone itself to a ring buffer holding the
+   * latest RING_CAPACITY zones of the thread. Zone names are string literals, registered once per zone on first use.
+   *
+   * summary() gives count, total, p50, p99 and max of every zone, the percentiles from the histograms to within 1/8, and
+   * writeChromeTrace() the zones still in the ring buffers as a Chrome trace (chrome://tracing or Perfetto).
+   * Without PROFILING, PROFILE_ZONE compiles to nothing.
+   */
+  namespace profiler
+  {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t MAX_ZONES = 256;
+    constexpr size_t RING_CAPACITY = 1 << 14;
+
+    // Id of the zone called name, the same for every call with the same name. Throws past MAX_ZONES zones.
+    uint32_t registerZone(const char *name);
+    // Records a zone on the calling thread
+    void record(uint32_t zone, Clock::time_point begin, Clock::time_point end);
+
+    class Zone
+    {
+    private:
+      const uint32_t zone_;
+      const Clock::time_point begin_;
+
+    public:
+      explicit Zone(uint32_t zone) : zone_(zone), begin_(Clock::now()) {}
+      ~Zone() { record(zone_, begin_, Clock::now()); }
+
+      Zone(const Zone &) = delete;
+      Zone &operator=(const Zone &) = delete;
+    };
+
+    // Milliseconds, other than count
+    struct ZoneStats
+    {
+      std::string name;
+      uint64_t count;
+      double total;
+      double p50;
+      double p99;
+      double max;
+    };
+
+    // Every zone recorded at least once since the last reset(), over all threads, by name
+    std::vector<ZoneStats> summary();
+    void printSummary(std::ostream &os = std::cout);
+    // Throws std::runtime_error if the file can not be written
+    void writeChromeTrace(const std::string &filename);
+    // Forgets everything recorded so far. Only while no zones are open on other threads.
+    void reset();
+
+  } // namespace profiler
+} // namespace utils
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILING
+#define PROFILE_ZONE(name)                                                                                            \
+  static const uint32_t PROFILE_CONCAT(profile_zone_id_, __LINE__) = ::utils::profiler::registerZone("" name ""); \
+  const ::utils::profiler::Zone PROFILE_CONCAT(profile_zone_, __LINE__)(PROFILE_CONCAT(profile_zone_id_, __LINE__))
+#else
+// Still only takes string literals, so names stay valid with PROFILING off
+#define PROFILE_ZONE(name) static_assert(sizeof("" name "") > 1, "Profiler zones need a name")
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,118 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace utils
+{
+  /*
+   * Fixed size pool of worker threads, running submitted tasks in FIFO order.
+   * Exceptions thrown by a task are passed on through its future.
+   */
+  class ThreadPool
+  {
+  private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_;
+
+    void work()
+    {
+      while (true)
+      {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          cv_.wait(lock, [this]
+                   { return stopping_ || !tasks_.empty(); });
+          if (stopping_ && tasks_.empty())
+          {
+            return;
+          }
+          task = std::move(tasks_.front());
+          tasks_.pop();
+        }
+        task();
+      }
+    }
+
+  public:
+    explicit ThreadPool(size_t num_threads) : stopping_(false)
+    {
+      for (size_t i = 0; i < num_threads; i++)
+      {
+        workers_.emplace_back(&ThreadPool::work, this);
+      }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Finishes all queued tasks before returning
+    ~ThreadPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+      }
+      cv_.notify_all();
+      for (std::thread &worker : workers_)
+      {
+        worker.join();
+      }
+    }
+
+    inline size_t size() const { return workers_.size(); }
+
+    template <class F>
+    std::future<std::invoke_result_t<F>> submit(F &&f)
+    {
+      using R = std::invoke_result_t<F>;
+      // std::function needs copyable callables, hence the shared_ptr
+      auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+      std::future<R> result = task->get_future();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace([task]
+                       { (*task)(); });
+      }
+      cv_.notify_one();
+      return result;
+    }
+
+    // Runs f(0), ..., f(n - 1) on the pool and blocks until all are done, rethrowing the first exception
+    template <class F>
+    void parallel_for(size_t n, F &&f)
+    {
+      std::vector<std::future<void>> futures;
+      futures.reserve(n);
+      for (size_t i = 0; i < n; i++)
+      {
+        futures.push_back(submit([&f, i]
+                                 { f(i); }));
+      }
+      // Wait for all before rethrowing, as the tasks reference f
+      for (auto &future : futures)
+      {
+        future.wait();
+      }
+      for (auto &future : futures)
+      {
+        future.get();
+      }
+    }
+  };
+
+} // namespace utils
+
+#endif // THREAD_POOL_H
@@ -1,6 +1,7 @@
 #include "config/config.h"
 #include <opencv2/core.hpp>
 #include <iostream>
+#include <limits>
 
 // Stolen from https://stackoverflow.com/questions/62303440/opencv-yaml-parser-does-not-recognize-true-false-values
 namespace cv
@@ -51,6 +52,7 @@ namespace config
         {
         case 0:
         case 1:
+        case 2:
         {
             association_method = static_cast<da::AssociationMethod>(asso_method);
             break;
@@ -63,14 +65,110 @@ namespace config
         }
         }
 
+        int solver;
+        yaml["assignment_solver"] >> solver;
+        switch (solver)
+        {
+        case 0:
+        case 1:
+        {
+            assignment_solver = static_cast<da::AssignmentSolver>(solver);
+            break;
+        }
+        default:
+        {
+            std::cout << "Unknown assignment solver passed in, got " << solver << ", using shortest augmenting path\n";
+            assignment_solver = da::AssignmentSolver::ShortestAugmentingPath;
+            break;
+        }
+        }
+
+        yaml["num_threads"] >> num_threads;
+        if (num_threads < 1)
+        {
+            std::cout << "Invalid number of threads, got " << num_threads << ", using 1\n";
+            num_threads = 1;
+        }
+
+        yaml["jc_prob"] >> jc_prob;
+        yaml["jcbb_max_nodes"] >> jcbb_max_nodes;
+        yaml["jcbb_time_budget"] >> jcbb_time_budget;
+        // Non-positive budgets mean no budget
+        if (jcbb_max_nodes <= 0)
+        {
+            jcbb_max_nodes = std::numeric_limits<int>::max();
+        }
+        if (jcbb_time_budget <= 0.0)
+        {
+            jcbb_time_budget = std::numeric_limits<double>::infinity();
+        }
+
         yaml["with_ground_truth"] >> with_ground_truth;
 
+        yaml["num_branches"] >> num_branches;
+        yaml["hypotheses_per_branch"] >> hypotheses_per_branch;
+        if (num_branches < 1)
+        {
+            std::cout << "Invalid number of branches, got " << num_branches << ", using 1\n";
+            num_branches = 1;
+        }
+        if (hypotheses_per_branch < 1)
+        {
+            std::cout << "Invalid number of hypotheses per branch, got " << hypotheses_per_branch << ", using 1\n";
+            hypotheses_per_branch = 1;
+        }
+
+        int score;
+        yaml["branch_score"] >> score;
+        switch (score)
+        {
+        case 0:
+        case 1:
+        {
+            branch_score = static_cast<slam::BranchScore>(score);
+            break;
+        }
+        default:
+        {
+            std::cout << "Unknown branch score passed in, got " << score << ", using negative log-likelihood\n";
+            branch_score = slam::BranchScore::NegativeLogLikelihood;
+            break;
+        }
+        }
+
+        yaml["async_pipeline"] >> async_pipeline;
+        int policy;
+        yaml["association_policy"] >> policy;
+        switch (policy)
+        {
+        case 0:
+        case 1:
+        {
+            association_policy = static_cast<slam::AssociationPolicy>(policy);
+            break;
+        }
+        default:
+        {
+            std::cout << "Unknown association policy passed in, got " << policy << ", waiting for the latest estimate\n";
+            association_policy = slam::AssociationPolicy::WaitForLatest;
+            break;
+        }
+        }
+        yaml["max_staleness"] >> max_staleness;
+        if (max_staleness < 0)
+        {
+            std::cout << "Invalid staleness, got " << max_staleness << ", using 0\n";
+            max_staleness = 0;
+        }
+
         int optim;
         yaml["optimization_method"] >> optim;
         switch (optim)
         {
         case 0:
         case 1:
+        case 2:
+        case 3:
         {
             optimization_method = static_cast<slam::OptimizationMethod>(optim);
             break;
@@ -83,6 +181,33 @@ namespace config
         }
         }
 
+        yaml["smoother_lag"] >> smoother_lag;
+
+        int policy_value;
+        yaml["optimization_policy"] >> policy_value;
+        switch (policy_value)
+        {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        {
+            optimization_policy.policy = static_cast<slam::OptimizationPolicy>(policy_value);
+            break;
+        }
+        default:
+        {
+            std::cout << "Unknown optimization policy passed in, got " << policy_value << ", optimizing always\n";
+            optimization_policy.policy = slam::OptimizationPolicy::Always;
+            break;
+        }
+        }
+        yaml["optimize_every_n"] >> optimization_policy.every_n;
+        yaml["keyframe_distance"] >> optimization_policy.keyframe_distance;
+        yaml["keyframe_angle"] >> optimization_policy.keyframe_angle;
+        yaml["error_increase_threshold"] >> optimization_policy.error_increase;
+
         int fact;
         yaml["marginals_factorization"] >> fact;
         switch (fact)
@@ -104,6 +229,12 @@ namespace config
         }
         }
 
+        yaml["dataset_cache"] >> dataset_cache;
+
+        yaml["checkpoint_file"] >> checkpoint_file;
+        yaml["checkpoint_every"] >> checkpoint_every;
+        yaml["resume_from_checkpoint"] >> resume_from_checkpoint;
+
         yaml["stop_at_association_timestep"] >> stop_at_association_timestep;
         yaml["draw_association_hypothesis"] >> draw_association_hypothesis;
     }
@@ -0,0 +1,271 @@
+#include "data_association/Auction.h"
+#include "utils/profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace da
+{
+  namespace
+  {
+    struct Bid
+    {
+      int col;
+      double price;
+      double cost;
+    };
+
+    // Below this many bidders in a round, bids are not worth spreading over threads
+    constexpr size_t min_bidders_per_thread = 32;
+
+    // Lower bound on the optimal cost from any nonnegative prices, by Lagrangian relaxation of the column constraints
+    double lagrangian_dual(const SparseCostMatrix &costs, const std::vector<double> &prices)
+    {
+      double dual = 0.0;
+      for (int i = 0; i < costs.rows(); i++)
+      {
+        double row_min = std::numeric_limits<double>::infinity();
+        for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+        {
+          row_min = std::min(row_min, costs.cost(idx) + prices[costs.col(idx)]);
+        }
+        dual += row_min;
+      }
+      for (double p : prices)
+      {
+        dual -= p;
+      }
+      return dual;
+    }
+
+    /*
+     * Square problem with the same optimum, as forward auction with epsilon-scaling is only optimal when every column
+     * ends up assigned. Rows are the measurements followed by one dummy row per landmark, and columns the landmarks
+     * followed by one dummy column per measurement:
+     *
+     *   [ C    diag(unassigned_cost) ]
+     *   [ I    C^T pattern, zero     ]
+     *
+     * A landmark that is not used is taken by its own dummy row. A landmark used by measurement i frees the dummy
+     * column of i, which its dummy row can take as (i, landmark) is in C. All extra entries are zero, so costs match.
+     */
+    SparseCostMatrix make_square(const SparseCostMatrix &costs, double unassigned_cost)
+    {
+      const int n = costs.rows();
+      const int m = costs.cols();
+
+      std::vector<SparseCostMatrix::Entry> entries;
+      entries.reserve(2 * costs.nonZeros() + n + m);
+      for (int i = 0; i < n; i++)
+      {
+        for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+        {
+          entries.push_back({i, costs.col(idx), costs.cost(idx)});
+          entries.push_back({n + costs.col(idx), m + i, 0.0});
+        }
+        entries.push_back({i, m + i, unassigned_cost});
+      }
+      for (int k = 0; k < m; k++)
+      {
+        entries.push_back({n + k, k, 0.0});
+      }
+
+      return SparseCostMatrix(n + m, m + n, entries);
+    }
+  } // namespace
+
+  AuctionResult auction(
+      const SparseCostMatrix &costs,
+      double unassigned_cost,
+      const AuctionParams &params,
+      utils::ThreadPool *thread_pool)
+  {
+    PROFILE_ZONE("da::auction");
+    const SparseCostMatrix square = make_square(costs, unassigned_cost);
+    const int num_rows = square.rows();
+    const int num_cols = square.cols();
+    const double inf = std::numeric_limits<double>::infinity();
+
+    std::vector<double> prices(num_cols, 0.0);
+    std::vector<int> owner(num_cols, -1);
+    std::vector<int> col4row(num_rows, -1);
+    std::vector<double> row_cost(num_rows, 0.0);
+
+    // Rows bid for maximum benefit, i.e. minimum cost. Every row has at least one entry by construction.
+    auto make_bid = [&](int i, double eps) -> Bid
+    {
+      int best_col = -1;
+      double best_cost = 0.0;
+      double best_value = -inf;
+      double second_value = -inf;
+
+      for (int idx = square.rowBegin(i); idx < square.rowEnd(i); idx++)
+      {
+        int j = square.col(idx);
+        double value = -square.cost(idx) - prices[j];
+        if (value > best_value)
+        {
+          second_value = best_value;
+          best_value = value;
+          best_col = j;
+          best_cost = square.cost(idx);
+        }
+        else if (value > second_value)
+        {
+          second_value = value;
+        }
+      }
+
+      // Only one column to choose from, so there is nothing to outbid but eps
+      if (second_value == -inf)
+      {
+        second_value = best_value;
+      }
+
+      return {best_col, prices[best_col] + (best_value - second_value) + eps, best_cost};
+    };
+
+    double max_abs_cost = 0.0;
+    for (int idx = 0; idx < square.nonZeros(); idx++)
+    {
+      max_abs_cost = std::max(max_abs_cost, std::abs(square.cost(idx)));
+    }
+    double eps = std::max(params.eps_final, max_abs_cost / 2.0);
+
+    std::vector<int> unassigned, next_unassigned;
+    std::vector<Bid> bids;
+    // Index of the highest bid so far per column in the current round
+    std::vector<int> col_winner(num_cols, -1);
+    std::vector<int> bid_cols;
+
+    uint64_t rounds = 0;
+    bool out_of_rounds = false;
+
+    while (true)
+    {
+      // New phase, prices are kept but assignments start over
+      std::fill(owner.begin(), owner.end(), -1);
+      std::fill(col4row.begin(), col4row.end(), -1);
+      unassigned.resize(num_rows);
+      for (int i = 0; i < num_rows; i++)
+      {
+        unassigned[i] = i;
+      }
+
+      while (!unassigned.empty())
+      {
+        if (rounds >= params.max_rounds)
+        {
+          out_of_rounds = true;
+          break;
+        }
+        rounds++;
+
+        // Bidding, every row only reads the prices, so rows can bid in parallel
+        bids.resize(unassigned.size());
+        size_t num_chunks = 1;
+        if (thread_pool)
+        {
+          num_chunks = std::min(thread_pool->size(), unassigned.size() / min_bidders_per_thread);
+        }
+        if (num_chunks > 1)
+        {
+          thread_pool->parallel_for(num_chunks, [&](size_t chunk)
+                                    {
+            size_t begin = chunk * unassigned.size() / num_chunks;
+            size_t end = (chunk + 1) * unassigned.size() / num_chunks;
+            for (size_t k = begin; k < end; k++)
+            {
+              bids[k] = make_bid(unassigned[k], eps);
+            } });
+        }
+        else
+        {
+          for (size_t k = 0; k < unassigned.size(); k++)
+          {
+            bids[k] = make_bid(unassigned[k], eps);
+          }
+        }
+
+        // Assignment, highest bid per column wins, ties go to the first bidder
+        for (size_t k = 0; k < bids.size(); k++)
+        {
+          int j = bids[k].col;
+          if (col_winner[j] == -1)
+          {
+            col_winner[j] = k;
+            bid_cols.push_back(j);
+          }
+          else if (bids[k].price > bids[col_winner[j]].price)
+          {
+            col_winner[j] = k;
+          }
+        }
+
+        next_unassigned.clear();
+        for (size_t k = 0; k < bids.size(); k++)
+        {
+          if (col_winner[bids[k].col] != static_cast<int>(k))
+          {
+            next_unassigned.push_back(unassigned[k]);
+          }
+        }
+        for (int j : bid_cols)
+        {
+          const Bid &bid = bids[col_winner[j]];
+          int i = unassigned[col_winner[j]];
+
+          if (owner[j] != -1)
+          {
+            col4row[owner[j]] = -1;
+            next_unassigned.push_back(owner[j]);
+          }
+          owner[j] = i;
+          col4row[i] = j;
+          row_cost[i] = bid.cost;
+          prices[j] = bid.price;
+          col_winner[j] = -1;
+        }
+        bid_cols.clear();
+
+        std::swap(unassigned, next_unassigned);
+      }
+
+      if (out_of_rounds || eps <= params.eps_final)
+      {
+        break;
+      }
+      eps = std::max(params.eps_final, eps / params.eps_scaling);
+    }
+
+    AuctionResult result;
+    result.rounds = rounds;
+    result.converged = !out_of_rounds;
+
+    // Measurements without a column when running out of rounds are left unassigned, which is always feasible
+    const int num_meas = costs.rows();
+    const int num_lmks = costs.cols();
+    result.assignment.resize(num_meas);
+    result.primal = 0.0;
+    for (int i = 0; i < num_meas; i++)
+    {
+      if (col4row[i] == -1 || col4row[i] >= num_lmks)
+      {
+        result.assignment[i] = -1;
+        result.primal += unassigned_cost;
+      }
+      else
+      {
+        result.assignment[i] = col4row[i];
+        result.primal += row_cost[i];
+      }
+    }
+
+    result.dual = lagrangian_dual(square, prices);
+    result.gap = std::max(0.0, result.primal - result.dual);
+
+    return result;
+  }
+
+} // namespace da
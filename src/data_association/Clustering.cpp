@@ -0,0 +1,136 @@
+#include "data_association/Clustering.h"
+#include "utils/profiler.h"
+
+#include <numeric>
+#include <utility>
+
+namespace da
+{
+  UnionFind::UnionFind(int size) : parent_(size), size_(size, 1)
+  {
+    std::iota(parent_.begin(), parent_.end(), 0);
+  }
+
+  int UnionFind::find(int x)
+  {
+    while (parent_[x] != x)
+    {
+      parent_[x] = parent_[parent_[x]];
+      x = parent_[x];
+    }
+    return x;
+  }
+
+  bool UnionFind::unite(int a, int b)
+  {
+    a = find(a);
+    b = find(b);
+    if (a == b)
+    {
+      return false;
+    }
+    if (size_[a] < size_[b])
+    {
+      std::swap(a, b);
+    }
+    parent_[b] = a;
+    size_[a] += size_[b];
+    return true;
+  }
+
+  std::vector<AssignmentCluster> cluster_assignment(const SparseCostMatrix &costs)
+  {
+    PROFILE_ZONE("da::cluster_assignment");
+    const int num_rows = costs.rows();
+    const int num_cols = costs.cols();
+
+    // Rows are the nodes [0, num_rows), columns the nodes [num_rows, num_rows + num_cols)
+    UnionFind sets(num_rows + num_cols);
+    for (int i = 0; i < num_rows; i++)
+    {
+      for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+      {
+        sets.unite(i, num_rows + costs.col(idx));
+      }
+    }
+
+    // Every cluster has at least one row, as columns are only in the matrix through entries of some row
+    std::vector<AssignmentCluster> clusters;
+    std::vector<int> cluster_of_root(num_rows + num_cols, -1);
+    for (int i = 0; i < num_rows; i++)
+    {
+      int root = sets.find(i);
+      if (cluster_of_root[root] == -1)
+      {
+        cluster_of_root[root] = clusters.size();
+        clusters.emplace_back();
+      }
+      clusters[cluster_of_root[root]].rows.push_back(i);
+    }
+
+    // Local index of every column within its cluster
+    std::vector<int> local_col(num_cols, -1);
+    for (int j = 0; j < num_cols; j++)
+    {
+      int c = cluster_of_root[sets.find(num_rows + j)];
+      if (c != -1)
+      {
+        local_col[j] = clusters[c].cols.size();
+        clusters[c].cols.push_back(j);
+      }
+    }
+
+    std::vector<SparseCostMatrix::Entry> entries;
+    for (AssignmentCluster &cluster : clusters)
+    {
+      entries.clear();
+      for (size_t r = 0; r < cluster.rows.size(); r++)
+      {
+        int i = cluster.rows[r];
+        for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+        {
+          entries.push_back({static_cast<int>(r), local_col[costs.col(idx)], costs.cost(idx)});
+        }
+      }
+      cluster.costs = SparseCostMatrix(cluster.rows.size(), cluster.cols.size(), entries);
+    }
+
+    return clusters;
+  }
+
+  bool is_trivial(const AssignmentCluster &cluster)
+  {
+    return cluster.rows.size() == 1 || cluster.cols.size() <= 1;
+  }
+
+  std::vector<int> trivial_assignment(const AssignmentCluster &cluster, double unassigned_cost)
+  {
+    const SparseCostMatrix &costs = cluster.costs;
+    std::vector<int> assignment(costs.rows(), -1);
+
+    // Either one row picking its cheapest column, or rows competing for one column, where the row gaining the most
+    // over being unassigned takes it. Both come down to the cheapest entry, if it beats being unassigned.
+    int best_row = -1;
+    int best_col = -1;
+    double best_cost = unassigned_cost;
+    for (int i = 0; i < costs.rows(); i++)
+    {
+      for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+      {
+        if (costs.cost(idx) < best_cost)
+        {
+          best_row = i;
+          best_col = costs.col(idx);
+          best_cost = costs.cost(idx);
+        }
+      }
+    }
+
+    if (best_row != -1)
+    {
+      assignment[best_row] = best_col;
+    }
+    return assignment;
+  }
+
+} // namespace da
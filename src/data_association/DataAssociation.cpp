@@ -1,6 +1,7 @@
 #include <Eigen/Core>
 #include <vector>
 #include "data_association/DataAssociation.h"
+#include "utils/profiler.h"
 
 // Basically all Hungarian algorithm code was taken from https://github.com/mcximing/hungarian-algorithm-cpp
 
@@ -15,6 +16,25 @@ std::ostream& operator<<(std::ostream& os, const da::AssociationMethod& asso_met
       os << "KnownDataAssociation";
       break;
     }
+    case da::AssociationMethod::JCBB: {
+      os << "JCBB";
+      break;
+    }
+  }
+
+  return os;
+}
+
+std::ostream& operator<<(std::ostream& os, const da::AssignmentSolver& assignment_solver) {
+  switch (assignment_solver) {
+    case da::AssignmentSolver::ShortestAugmentingPath: {
+      os << "ShortestAugmentingPath";
+      break;
+    }
+    case da::AssignmentSolver::Auction: {
+      os << "Auction";
+      break;
+    }
   }
 
   return os;
@@ -30,10 +50,13 @@ namespace da {
   }
 
   std::vector<int> auction(const Eigen::MatrixXd& problem, double eps, uint64_t max_iterations) {
+    PROFILE_ZONE("da::auction (dense)");
     int m = problem.rows();
     int n = problem.cols();
 
+#ifdef LOGGING
     std::cout << "Starting auction with problem size (" << m << ", " << n << ")\n";
+#endif
 
     std::deque<int> unassigned_queue;
     std::vector<int> assigned_landmarks;
@@ -44,6 +67,9 @@ namespace da {
       assigned_landmarks.push_back(-1);
     }
 
+    // Who currently holds each item, so outbidding does not need a search
+    std::vector<int> owner(m, -1);
+
     // Use Eigen vector for convenience below
     Eigen::VectorXd prices(m);
     for (int i = 0; i < m; i++) {
@@ -62,14 +88,14 @@ namespace da {
       Eigen::MatrixXd::Index i_star;
       double val_max = (problem.col(l_star) - prices).maxCoeff(&i_star);
 
-      auto prev_owner = std::find(assigned_landmarks.begin(), assigned_landmarks.end(), i_star);
+      int prev_owner = owner[i_star];
       assigned_landmarks[l_star] = i_star;
+      owner[i_star] = l_star;
 
-      if (prev_owner != assigned_landmarks.end()) {
+      if (prev_owner != -1) {
         // The item has a previous owner
-        *prev_owner = -1;
-        int pos = std::distance(assigned_landmarks.begin(), prev_owner);
-        unassigned_queue.push_back(pos);
+        assigned_landmarks[prev_owner] = -1;
+        unassigned_queue.push_back(prev_owner);
       }
 
       double y = problem(i_star, l_star) - val_max;
@@ -77,6 +103,7 @@ namespace da {
       curr_iter++;
     }
 
+#ifdef LOGGING
     if (curr_iter >= max_iterations) {
       std::cout << "\x1B[31m" << "Auction terminated early!\n" << "\033[0m";
     } else {
@@ -87,6 +114,7 @@ namespace da {
     for (int i = 0; i < assigned_landmarks.size(); i++) {
       std::cout << "Landmark " << i << " with measurement " << assigned_landmarks[i] << "\n";
     }
+#endif
 
     return assigned_landmarks;
   }
@@ -105,6 +133,7 @@ void step5(int *assignment, double *distMatrix, bool *starMatrix, bool *newStarM
 
 std::vector<int> hungarian(const Eigen::MatrixXd &cost_matrix)
 {
+  PROFILE_ZONE("da::hungarian");
 	unsigned int nRows = cost_matrix.rows();
 	unsigned int nCols = cost_matrix.cols();
 
@@ -0,0 +1,362 @@
+#include "data_association/Murty.h"
+#include "utils/profiler.h"
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <utility>
+
+namespace da
+{
+  namespace
+  {
+    // Marks a row as free in Subproblem::fixed
+    constexpr int free_row = -2;
+
+    struct Subproblem
+    {
+      // Column of every fixed row, -1 for fixed as unassigned, free_row for the rows left to solve
+      std::vector<int> fixed;
+      // Row and column pairs that may not be used, column -1 meaning the row may not be left unassigned
+      std::vector<std::pair<int, int>> forbidden;
+      // Solution of the parent and the row whose choice in it is forbidden here, not set for the root
+      std::shared_ptr<const std::vector<int>> parent_assignment;
+      double parent_cost;
+      int changed_row;
+      // Full solution and its cost, once solved
+      std::vector<int> assignment;
+      double cost;
+    };
+
+    struct QueueItem
+    {
+      double cost; // Exact if solved, otherwise a lower bound
+      bool solved;
+      uint64_t order;
+      int subproblem;
+
+      // Solved before unsolved on equal cost, as an unsolved subproblem can only get more expensive
+      bool operator>(const QueueItem &rhs) const
+      {
+        if (cost != rhs.cost)
+        {
+          return cost > rhs.cost;
+        }
+        if (solved != rhs.solved)
+        {
+          return !solved;
+        }
+        return order > rhs.order;
+      }
+    };
+
+    class Solver
+    {
+    private:
+      const SparseCostMatrix &costs_;
+      const double unassigned_cost_;
+
+      // Rows with an entry in each column, in compressed form like the rows of costs_
+      std::vector<int> col_begin_;
+      std::vector<int> col_rows_;
+
+      // Scratch, sized once
+      std::vector<char> col_used_;
+      std::vector<char> row_seen_;
+      std::vector<char> col_seen_;
+
+    public:
+      Solver(const SparseCostMatrix &costs, double unassigned_cost)
+          : costs_(costs),
+            unassigned_cost_(unassigned_cost),
+            col_begin_(costs.cols() + 1, 0),
+            col_used_(costs.cols(), false),
+            row_seen_(costs.rows(), false),
+            col_seen_(costs.cols(), false)
+      {
+        for (int idx = 0; idx < costs.nonZeros(); idx++)
+        {
+          col_begin_[costs.col(idx) + 1]++;
+        }
+        for (int j = 0; j < costs.cols(); j++)
+        {
+          col_begin_[j + 1] += col_begin_[j];
+        }
+        col_rows_.resize(costs.nonZeros());
+        std::vector<int> next(col_begin_.begin(), col_begin_.end() - 1);
+        for (int i = 0; i < costs.rows(); i++)
+        {
+          for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+          {
+            col_rows_[next[costs.col(idx)]++] = i;
+          }
+        }
+      }
+
+      /*
+       * Solves the free rows of s, given the fixed ones. Returns false if the constraints can not be met.
+       *
+       * A child differs from its parent by fixing rows to the parent solution and by one more forbidden choice, for
+       * changed_row. Every part of the free rows not connected to changed_row, or to the column it gives up, keeps its
+       * parent solution, as it would have been a better parent solution otherwise. So only the connected rows are
+       * solved again.
+       */
+      bool solve(Subproblem &s)
+      {
+        const int num_rows = costs_.rows();
+
+        std::vector<std::vector<int>> forbidden_cols(num_rows);
+        std::vector<char> must_assign(num_rows, false);
+        for (const auto &[i, j] : s.forbidden)
+        {
+          if (j == -1)
+          {
+            must_assign[i] = true;
+          }
+          else
+          {
+            forbidden_cols[i].push_back(j);
+          }
+        }
+        for (int i = 0; i < num_rows; i++)
+        {
+          if (s.fixed[i] >= 0)
+          {
+            col_used_[s.fixed[i]] = true;
+          }
+        }
+
+        auto usable = [&](int i, int j)
+        {
+          if (col_used_[j])
+          {
+            return false;
+          }
+          for (int f : forbidden_cols[i])
+          {
+            if (f == j)
+            {
+              return false;
+            }
+          }
+          return true;
+        };
+
+        // Rows to solve, all free rows for the root, otherwise the ones connected to changed_row
+        std::vector<int> rows;
+        std::vector<int> cols;
+        if (!s.parent_assignment)
+        {
+          for (int i = 0; i < num_rows; i++)
+          {
+            if (s.fixed[i] == free_row)
+            {
+              rows.push_back(i);
+            }
+          }
+        }
+        else
+        {
+          auto add_col = [&](int j)
+          {
+            col_seen_[j] = true;
+            cols.push_back(j);
+            for (int cidx = col_begin_[j]; cidx < col_begin_[j + 1]; cidx++)
+            {
+              int k = col_rows_[cidx];
+              if (!row_seen_[k] && s.fixed[k] == free_row && usable(k, j))
+              {
+                row_seen_[k] = true;
+                rows.push_back(k);
+              }
+            }
+          };
+
+          rows.push_back(s.changed_row);
+          row_seen_[s.changed_row] = true;
+          // The column changed_row gives up is free for the others, so the rows that can take it are solved too
+          int released = (*s.parent_assignment)[s.changed_row];
+          if (released >= 0)
+          {
+            add_col(released);
+          }
+          for (size_t r = 0; r < rows.size(); r++)
+          {
+            int i = rows[r];
+            for (int idx = costs_.rowBegin(i); idx < costs_.rowEnd(i); idx++)
+            {
+              int j = costs_.col(idx);
+              if (!col_seen_[j] && usable(i, j))
+              {
+                add_col(j);
+              }
+            }
+          }
+        }
+
+        // Columns keep their global indices, only the entries that can not be used are left out
+        std::vector<SparseCostMatrix::Entry> entries;
+        std::vector<double> unassigned_costs(rows.size(), unassigned_cost_);
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+          int i = rows[r];
+          if (must_assign[i])
+          {
+            unassigned_costs[r] = std::numeric_limits<double>::infinity();
+          }
+          for (int idx = costs_.rowBegin(i); idx < costs_.rowEnd(i); idx++)
+          {
+            if (usable(i, costs_.col(idx)))
+            {
+              entries.push_back({static_cast<int>(r), costs_.col(idx), costs_.cost(idx)});
+            }
+          }
+        }
+        SparseCostMatrix reduced(rows.size(), costs_.cols(), entries);
+        std::optional<std::vector<int>> local = sparse_assignment(reduced, unassigned_costs);
+
+        // Leave the scratch clean for the next subproblem
+        for (int i = 0; i < num_rows; i++)
+        {
+          if (s.fixed[i] >= 0)
+          {
+            col_used_[s.fixed[i]] = false;
+          }
+        }
+        for (int i : rows)
+        {
+          row_seen_[i] = false;
+        }
+        for (int j : cols)
+        {
+          col_seen_[j] = false;
+        }
+
+        if (!local)
+        {
+          return false;
+        }
+
+        if (!s.parent_assignment)
+        {
+          s.assignment = s.fixed;
+          for (size_t r = 0; r < rows.size(); r++)
+          {
+            s.assignment[rows[r]] = (*local)[r];
+          }
+          s.cost = assignment_cost(costs_, s.assignment, unassigned_cost_);
+          return true;
+        }
+
+        // Only the solved rows change from the parent, and the cost with them. The old costs are looked up in the
+        // full matrix, as the parent choice of changed_row is not in the reduced one.
+        auto row_cost = [&](int i, int j)
+        {
+          if (j == -1)
+          {
+            return unassigned_cost_;
+          }
+          for (int idx = costs_.rowBegin(i); idx < costs_.rowEnd(i); idx++)
+          {
+            if (costs_.col(idx) == j)
+            {
+              return costs_.cost(idx);
+            }
+          }
+          return 0.0;
+        };
+        s.assignment = *s.parent_assignment;
+        s.cost = s.parent_cost;
+        for (size_t r = 0; r < rows.size(); r++)
+        {
+          s.cost += row_cost(rows[r], (*local)[r]) - row_cost(rows[r], s.assignment[rows[r]]);
+          s.assignment[rows[r]] = (*local)[r];
+        }
+        return true;
+      }
+    };
+  } // namespace
+
+  std::vector<RankedAssignment> murty(const SparseCostMatrix &costs, double unassigned_cost, int k)
+  {
+    PROFILE_ZONE("da::murty");
+    std::vector<RankedAssignment> ranked;
+    if (k <= 0)
+    {
+      return ranked;
+    }
+
+    std::vector<Subproblem> subproblems;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    uint64_t order = 0;
+
+    Solver solver(costs, unassigned_cost);
+
+    Subproblem root;
+    root.fixed.assign(costs.rows(), free_row);
+    solver.solve(root);
+    subproblems.push_back(std::move(root));
+    queue.push({subproblems[0].cost, true, order++, 0});
+
+    while (!queue.empty() && static_cast<int>(ranked.size()) < k)
+    {
+      QueueItem item = queue.top();
+      queue.pop();
+
+      if (!item.solved)
+      {
+        Subproblem &s = subproblems[item.subproblem];
+        if (solver.solve(s))
+        {
+          queue.push({s.cost, true, item.order, item.subproblem});
+        }
+        else
+        {
+          // Infeasible, nothing to keep
+          s = Subproblem();
+        }
+        continue;
+      }
+
+      // Taken out, as subproblems may be reallocated when adding the children
+      Subproblem parent = std::move(subproblems[item.subproblem]);
+      subproblems[item.subproblem] = Subproblem();
+
+      auto parent_assignment = std::make_shared<const std::vector<int>>(std::move(parent.assignment));
+      ranked.push_back({*parent_assignment, parent.cost});
+      if (static_cast<int>(ranked.size()) == k)
+      {
+        break;
+      }
+
+      // Partition on the free rows, in order. Child t fixes the free rows before row t to this solution and
+      // forbids the choice made for row t.
+      std::vector<int> child_fixed = parent.fixed;
+      for (int i = 0; i < costs.rows(); i++)
+      {
+        if (parent.fixed[i] != free_row)
+        {
+          continue;
+        }
+
+        Subproblem child;
+        child.fixed = child_fixed;
+        child.forbidden = parent.forbidden;
+        child.forbidden.push_back({i, (*parent_assignment)[i]});
+        child.parent_assignment = parent_assignment;
+        child.parent_cost = parent.cost;
+        child.changed_row = i;
+        subproblems.push_back(std::move(child));
+        queue.push({parent.cost, false, order++, static_cast<int>(subproblems.size()) - 1});
+
+        child_fixed[i] = (*parent_assignment)[i];
+      }
+    }
+
+    return ranked;
+  }
+
+} // namespace da
@@ -0,0 +1,214 @@
+#include "data_association/SparseAssignment.h"
+#include "utils/profiler.h"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <utility>
+
+namespace da
+{
+  SparseCostMatrix::SparseCostMatrix(int rows, int cols, const std::vector<Entry> &entries)
+      : rows_(rows), cols_(cols), row_begin_(rows + 1, 0)
+  {
+    // Counting sort by row, keeping the order of entries within a row
+    for (const Entry &e : entries)
+    {
+      if (std::isfinite(e.cost))
+      {
+        row_begin_[e.row + 1]++;
+      }
+    }
+    for (int r = 0; r < rows_; r++)
+    {
+      row_begin_[r + 1] += row_begin_[r];
+    }
+
+    col_.resize(row_begin_[rows_]);
+    cost_.resize(row_begin_[rows_]);
+    std::vector<int> next(row_begin_.begin(), row_begin_.end() - 1);
+    for (const Entry &e : entries)
+    {
+      if (std::isfinite(e.cost))
+      {
+        int idx = next[e.row]++;
+        col_[idx] = e.col;
+        cost_[idx] = e.cost;
+      }
+    }
+  }
+
+  std::vector<int> sparse_assignment(const SparseCostMatrix &costs, double unassigned_cost)
+  {
+    // Always feasible, as every row can be left unassigned
+    return *sparse_assignment(costs, std::vector<double>(costs.rows(), unassigned_cost));
+  }
+
+  std::optional<std::vector<int>> sparse_assignment(const SparseCostMatrix &costs, const std::vector<double> &unassigned_costs)
+  {
+    PROFILE_ZONE("da::sparse_assignment");
+    const int num_rows = costs.rows();
+    const int num_real_cols = costs.cols();
+    // Column num_real_cols + r is the dummy column of row r
+    const int num_cols = num_real_cols + num_rows;
+    const double inf = std::numeric_limits<double>::infinity();
+
+    std::vector<double> u(num_rows, 0.0), v(num_cols, 0.0);
+    std::vector<int> col4row(num_rows, -1), row4col(num_cols, -1);
+
+    // Dijkstra state, only the touched entries are reset between augmentations
+    std::vector<double> shortest(num_cols, inf);
+    std::vector<int> path(num_cols, -1);
+    std::vector<char> col_done(num_cols, false);
+    std::vector<int> touched_cols;
+    std::vector<int> visited_rows;
+
+    using QueueItem = std::pair<double, int>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+
+    for (int cur_row = 0; cur_row < num_rows; cur_row++)
+    {
+      double min_val = 0.0;
+      int i = cur_row;
+      int sink = -1;
+
+      auto relax = [&](int j, double c)
+      {
+        if (col_done[j])
+        {
+          return;
+        }
+        double r = min_val + c - u[i] - v[j];
+        if (r < shortest[j])
+        {
+          if (shortest[j] == inf)
+          {
+            touched_cols.push_back(j);
+          }
+          shortest[j] = r;
+          path[j] = i;
+          queue.push({r, j});
+        }
+      };
+
+      while (sink == -1)
+      {
+        visited_rows.push_back(i);
+
+        for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+        {
+          relax(costs.col(idx), costs.cost(idx));
+        }
+        if (std::isfinite(unassigned_costs[i]))
+        {
+          relax(num_real_cols + i, unassigned_costs[i]);
+        }
+
+        // Closest column not yet done, skipping stale queue entries
+        int j = -1;
+        while (!queue.empty())
+        {
+          auto [d, col] = queue.top();
+          queue.pop();
+          if (!col_done[col] && d == shortest[col])
+          {
+            j = col;
+            break;
+          }
+        }
+
+        // Nothing left to reach, so cur_row can not be assigned without unassigning another row that must be
+        if (j == -1)
+        {
+          return std::nullopt;
+        }
+
+        min_val = shortest[j];
+        col_done[j] = true;
+
+        if (row4col[j] == -1)
+        {
+          sink = j;
+        }
+        else
+        {
+          i = row4col[j];
+        }
+      }
+
+      // Update duals
+      u[cur_row] += min_val;
+      for (int r : visited_rows)
+      {
+        if (r != cur_row)
+        {
+          u[r] += min_val - shortest[col4row[r]];
+        }
+      }
+      for (int j : touched_cols)
+      {
+        if (col_done[j])
+        {
+          v[j] -= min_val - shortest[j];
+        }
+      }
+
+      // Augment along the path back to cur_row
+      int j = sink;
+      while (true)
+      {
+        int r = path[j];
+        row4col[j] = r;
+        std::swap(col4row[r], j);
+        if (r == cur_row)
+        {
+          break;
+        }
+      }
+
+      for (int j : touched_cols)
+      {
+        shortest[j] = inf;
+        path[j] = -1;
+        col_done[j] = false;
+      }
+      touched_cols.clear();
+      visited_rows.clear();
+      queue = decltype(queue)();
+    }
+
+    // Dummy columns mean unassigned
+    for (int &col : col4row)
+    {
+      if (col >= num_real_cols)
+      {
+        col = -1;
+      }
+    }
+    return col4row;
+  }
+
+  double assignment_cost(const SparseCostMatrix &costs, const std::vector<int> &assignment, double unassigned_cost)
+  {
+    double cost = 0.0;
+    for (int i = 0; i < costs.rows(); i++)
+    {
+      if (assignment[i] == -1)
+      {
+        cost += unassigned_cost;
+        continue;
+      }
+      for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+      {
+        if (costs.col(idx) == assignment[i])
+        {
+          cost += costs.cost(idx);
+        }
+      }
+    }
+    return cost;
+  }
+
+} // namespace da
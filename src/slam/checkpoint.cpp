@@ -0,0 +1,521 @@
+#include "slam/checkpoint.h"
+
+#include <gtsam/base/GenericValue.h>
+#include <gtsam/linear/HessianFactor.h>
+#include <gtsam/nonlinear/LinearContainerFactor.h>
+#include <gtsam/nonlinear/PriorFactor.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam_unstable/slam/PoseToPointFactor.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace slam
+{
+  namespace
+  {
+    enum class FactorType : uint8_t
+    {
+      Prior2D = 0,
+      Prior3D = 1,
+      Between2D = 2,
+      Between3D = 3,
+      PoseToPoint2D = 4,
+      PoseToPoint3D = 5,
+      Empty = 6,
+      LinearContainer = 7,
+    };
+
+    enum class NoiseType : uint8_t
+    {
+      Diagonal = 0,
+      Gaussian = 1,
+      Constrained = 2,
+    };
+
+    enum class ValueType : uint8_t
+    {
+      Pose2 = 0,
+      Pose3 = 1,
+      Point2 = 2,
+      Point3 = 3,
+    };
+
+    void writeValueData(CheckpointWriter &writer, const gtsam::Pose2 &pose) { writer.writePose(pose); }
+    void writeValueData(CheckpointWriter &writer, const gtsam::Pose3 &pose) { writer.writePose(pose); }
+    void writeValueData(CheckpointWriter &writer, const gtsam::Point2 &point) { writer.writeMatrix(point); }
+    void writeValueData(CheckpointWriter &writer, const gtsam::Point3 &point) { writer.writeMatrix(point); }
+
+    template <class T>
+    bool writeValue(CheckpointWriter &writer, const gtsam::Value &value, ValueType type)
+    {
+      auto generic = dynamic_cast<const gtsam::GenericValue<T> *>(&value);
+      if (!generic)
+      {
+        return false;
+      }
+      writer.write(type);
+      writeValueData(writer, generic->value());
+      return true;
+    }
+
+    template <class POSE>
+    bool writePrior(CheckpointWriter &writer, const gtsam::NonlinearFactor::shared_ptr &factor, FactorType type)
+    {
+      auto prior = boost::dynamic_pointer_cast<gtsam::PriorFactor<POSE>>(factor);
+      if (!prior)
+      {
+        return false;
+      }
+      writer.write(type);
+      writer.write<uint64_t>(prior->keys()[0]);
+      writer.writePose(prior->prior());
+      writer.writeNoise(prior->noiseModel());
+      return true;
+    }
+
+    template <class POSE>
+    bool writeBetween(CheckpointWriter &writer, const gtsam::NonlinearFactor::shared_ptr &factor, FactorType type)
+    {
+      auto between = boost::dynamic_pointer_cast<gtsam::BetweenFactor<POSE>>(factor);
+      if (!between)
+      {
+        return false;
+      }
+      writer.write(type);
+      writer.write<uint64_t>(between->keys()[0]);
+      writer.write<uint64_t>(between->keys()[1]);
+      writer.writePose(between->measured());
+      writer.writeNoise(between->noiseModel());
+      return true;
+    }
+
+    template <class POSE, class POINT>
+    bool writePoseToPoint(CheckpointWriter &writer, const gtsam::NonlinearFactor::shared_ptr &factor, FactorType type)
+    {
+      auto meas = boost::dynamic_pointer_cast<gtsam::PoseToPointFactor<POSE, POINT>>(factor);
+      if (!meas)
+      {
+        return false;
+      }
+      writer.write(type);
+      writer.write<uint64_t>(meas->keys()[0]);
+      writer.write<uint64_t>(meas->keys()[1]);
+      writer.writeMatrix(meas->measured());
+      writer.writeNoise(meas->noiseModel());
+      return true;
+    }
+
+    // Marginals the fixed lag smoother keeps of what left its window, as their augmented information about the
+    // linearization point. Whether they were Jacobian or Hessian before, they come back as Hessian with the same error.
+    bool writeLinearContainer(CheckpointWriter &writer, const gtsam::NonlinearFactor::shared_ptr &factor)
+    {
+      auto container = boost::dynamic_pointer_cast<gtsam::LinearContainerFactor>(factor);
+      if (!container)
+      {
+        return false;
+      }
+      const gtsam::GaussianFactor::shared_ptr &linear = container->factor();
+      writer.write(FactorType::LinearContainer);
+      writer.write<uint64_t>(linear->size());
+      for (auto it = linear->begin(); it != linear->end(); ++it)
+      {
+        writer.write<uint64_t>(*it);
+        writer.write<uint64_t>(linear->getDim(it));
+      }
+      writer.writeMatrix(linear->augmentedInformation());
+      const boost::optional<gtsam::Values> &linearization_point = container->linearizationPoint();
+      writer.write<uint8_t>(linearization_point ? 1 : 0);
+      if (linearization_point)
+      {
+        writer.writeValues(*linearization_point);
+      }
+      return true;
+    }
+
+    template <class POINT>
+    POINT readPoint(CheckpointReader &reader)
+    {
+      gtsam::Matrix m = reader.readMatrix();
+      if (m.rows() != POINT::RowsAtCompileTime || m.cols() != 1)
+      {
+        throw std::runtime_error("Checkpoint has a point of the wrong dimension");
+      }
+      return POINT(m);
+    }
+  } // namespace
+
+  void CheckpointWriter::writeMatrix(const gtsam::Matrix &m)
+  {
+    write<uint64_t>(m.rows());
+    write<uint64_t>(m.cols());
+    // Eigen stores column major, read back the same way
+    writeBytes(m.data(), sizeof(double) * m.size());
+  }
+
+  void CheckpointWriter::writePose(const gtsam::Pose2 &pose)
+  {
+    write(pose.x());
+    write(pose.y());
+    write(pose.theta());
+  }
+
+  void CheckpointWriter::writePose(const gtsam::Pose3 &pose)
+  {
+    writeMatrix(pose.rotation().matrix());
+    writeMatrix(pose.translation());
+  }
+
+  void CheckpointWriter::writeNoise(const gtsam::SharedNoiseModel &noise)
+  {
+    // Constrained noise is diagonal too, but its zero sigmas only mean something together with mu
+    if (auto constrained = boost::dynamic_pointer_cast<gtsam::noiseModel::Constrained>(noise))
+    {
+      write(NoiseType::Constrained);
+      writeMatrix(constrained->sigmas());
+      writeMatrix(constrained->mu());
+    }
+    // Isotropic and unit noise are diagonal too, and come back as the smallest of the three
+    else if (auto diagonal = boost::dynamic_pointer_cast<gtsam::noiseModel::Diagonal>(noise))
+    {
+      write(NoiseType::Diagonal);
+      writeMatrix(diagonal->sigmas());
+    }
+    else if (auto gaussian = boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(noise))
+    {
+      write(NoiseType::Gaussian);
+      writeMatrix(gaussian->R());
+    }
+    else if (boost::dynamic_pointer_cast<gtsam::noiseModel::Robust>(noise))
+    {
+      throw std::runtime_error("Robust noise models can not be checkpointed");
+    }
+    else
+    {
+      throw std::runtime_error("Only diagonal, constrained and Gaussian noise models can be checkpointed");
+    }
+  }
+
+  void CheckpointWriter::writeFactor(const gtsam::NonlinearFactor::shared_ptr &factor)
+  {
+    // Slots of removed factors, kept so factor indices read back the same
+    if (!factor)
+    {
+      write(FactorType::Empty);
+      return;
+    }
+    bool written = writePrior<gtsam::Pose2>(*this, factor, FactorType::Prior2D) ||
+                   writePrior<gtsam::Pose3>(*this, factor, FactorType::Prior3D) ||
+                   writeBetween<gtsam::Pose2>(*this, factor, FactorType::Between2D) ||
+                   writeBetween<gtsam::Pose3>(*this, factor, FactorType::Between3D) ||
+                   writePoseToPoint<gtsam::Pose2, gtsam::Point2>(*this, factor, FactorType::PoseToPoint2D) ||
+                   writePoseToPoint<gtsam::Pose3, gtsam::Point3>(*this, factor, FactorType::PoseToPoint3D) ||
+                   writeLinearContainer(*this, factor);
+    if (!written)
+    {
+      throw std::runtime_error("Factor type can not be checkpointed");
+    }
+  }
+
+  void CheckpointWriter::writeGraph(const gtsam::NonlinearFactorGraph &graph)
+  {
+    write<uint64_t>(graph.size());
+    for (const auto &factor : graph)
+    {
+      writeFactor(factor);
+    }
+  }
+
+  void CheckpointWriter::writeValues(const gtsam::Values &values)
+  {
+    write<uint64_t>(values.size());
+    for (const auto &key_value : values)
+    {
+      write<uint64_t>(key_value.key);
+      bool written = writeValue<gtsam::Pose2>(*this, key_value.value, ValueType::Pose2) ||
+                     writeValue<gtsam::Pose3>(*this, key_value.value, ValueType::Pose3) ||
+                     writeValue<gtsam::Point2>(*this, key_value.value, ValueType::Point2) ||
+                     writeValue<gtsam::Point3>(*this, key_value.value, ValueType::Point3);
+      if (!written)
+      {
+        throw std::runtime_error("Value type can not be checkpointed");
+      }
+    }
+  }
+
+  void CheckpointWriter::save(const std::string &filename) const
+  {
+    const std::string tmp = filename + ".tmp";
+    {
+      std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+      os.write(buffer_.data(), buffer_.size());
+      if (!os)
+      {
+        throw std::runtime_error("Could not write checkpoint " + tmp);
+      }
+    }
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+      throw std::runtime_error("Could not move checkpoint into place at " + filename);
+    }
+  }
+
+  CheckpointReader::CheckpointReader(const std::string &filename)
+      : data_(nullptr), size_(0), offset_(0)
+  {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      throw std::runtime_error("Could not open checkpoint " + filename);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+      ::close(fd);
+      throw std::runtime_error("Empty or unreadable checkpoint " + filename);
+    }
+    size_ = st.st_size;
+    void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (data == MAP_FAILED)
+    {
+      throw std::runtime_error("Could not map checkpoint " + filename);
+    }
+    data_ = static_cast<const char *>(data);
+  }
+
+  CheckpointReader::~CheckpointReader()
+  {
+    if (data_)
+    {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  const char *CheckpointReader::take(size_t size)
+  {
+    if (size > size_ - offset_)
+    {
+      throw std::runtime_error("Checkpoint is truncated");
+    }
+    const char *p = data_ + offset_;
+    offset_ += size;
+    return p;
+  }
+
+  gtsam::Matrix CheckpointReader::readMatrix()
+  {
+    uint64_t rows = read<uint64_t>();
+    uint64_t cols = read<uint64_t>();
+    if (cols != 0 && rows > remaining() / sizeof(double) / cols)
+    {
+      throw std::runtime_error("Checkpoint is truncated");
+    }
+    gtsam::Matrix m(rows, cols);
+    std::memcpy(m.data(), take(sizeof(double) * m.size()), sizeof(double) * m.size());
+    return m;
+  }
+
+  uint64_t CheckpointReader::readCount(size_t min_size)
+  {
+    uint64_t count = read<uint64_t>();
+    if (count > remaining() / min_size)
+    {
+      throw std::runtime_error("Checkpoint is truncated");
+    }
+    return count;
+  }
+
+  void CheckpointReader::readPose(gtsam::Pose2 &pose)
+  {
+    double x = read<double>();
+    double y = read<double>();
+    double theta = read<double>();
+    pose = gtsam::Pose2(x, y, theta);
+  }
+
+  void CheckpointReader::readPose(gtsam::Pose3 &pose)
+  {
+    gtsam::Matrix R = readMatrix();
+    gtsam::Point3 t = readPoint<gtsam::Point3>(*this);
+    if (R.rows() != 3 || R.cols() != 3)
+    {
+      throw std::runtime_error("Checkpoint has a rotation of the wrong dimension");
+    }
+    pose = gtsam::Pose3(gtsam::Rot3(gtsam::Matrix3(R)), t);
+  }
+
+  gtsam::SharedNoiseModel CheckpointReader::readNoise()
+  {
+    NoiseType type = read<NoiseType>();
+    gtsam::Matrix m = readMatrix();
+    switch (type)
+    {
+    case NoiseType::Diagonal:
+    {
+      return gtsam::noiseModel::Diagonal::Sigmas(m);
+    }
+    case NoiseType::Gaussian:
+    {
+      return gtsam::noiseModel::Gaussian::SqrtInformation(m);
+    }
+    case NoiseType::Constrained:
+    {
+      gtsam::Matrix mu = readMatrix();
+      if (mu.rows() != m.rows() || mu.cols() != 1 || m.cols() != 1)
+      {
+        throw std::runtime_error("Checkpoint has a constrained noise model of mismatched dimensions");
+      }
+      return gtsam::noiseModel::Constrained::MixedSigmas(gtsam::Vector(mu), gtsam::Vector(m));
+    }
+    }
+    throw std::runtime_error("Checkpoint has an unknown noise model");
+  }
+
+  gtsam::NonlinearFactor::shared_ptr CheckpointReader::readFactor()
+  {
+    FactorType type = read<FactorType>();
+    switch (type)
+    {
+    case FactorType::Prior2D:
+    case FactorType::Prior3D:
+    {
+      gtsam::Key key = read<uint64_t>();
+      if (type == FactorType::Prior2D)
+      {
+        gtsam::Pose2 prior;
+        readPose(prior);
+        return boost::make_shared<gtsam::PriorFactor<gtsam::Pose2>>(key, prior, readNoise());
+      }
+      gtsam::Pose3 prior;
+      readPose(prior);
+      return boost::make_shared<gtsam::PriorFactor<gtsam::Pose3>>(key, prior, readNoise());
+    }
+    case FactorType::Between2D:
+    case FactorType::Between3D:
+    {
+      gtsam::Key key1 = read<uint64_t>();
+      gtsam::Key key2 = read<uint64_t>();
+      if (type == FactorType::Between2D)
+      {
+        gtsam::Pose2 measured;
+        readPose(measured);
+        return boost::make_shared<gtsam::BetweenFactor<gtsam::Pose2>>(key1, key2, measured, readNoise());
+      }
+      gtsam::Pose3 measured;
+      readPose(measured);
+      return boost::make_shared<gtsam::BetweenFactor<gtsam::Pose3>>(key1, key2, measured, readNoise());
+    }
+    case FactorType::PoseToPoint2D:
+    {
+      gtsam::Key key1 = read<uint64_t>();
+      gtsam::Key key2 = read<uint64_t>();
+      gtsam::Point2 measured = readPoint<gtsam::Point2>(*this);
+      return boost::make_shared<gtsam::PoseToPointFactor<gtsam::Pose2, gtsam::Point2>>(key1, key2, measured, readNoise());
+    }
+    case FactorType::PoseToPoint3D:
+    {
+      gtsam::Key key1 = read<uint64_t>();
+      gtsam::Key key2 = read<uint64_t>();
+      gtsam::Point3 measured = readPoint<gtsam::Point3>(*this);
+      return boost::make_shared<gtsam::PoseToPointFactor<gtsam::Pose3, gtsam::Point3>>(key1, key2, measured, readNoise());
+    }
+    case FactorType::Empty:
+    {
+      return nullptr;
+    }
+    case FactorType::LinearContainer:
+    {
+      uint64_t num_keys = read<uint64_t>();
+      if (num_keys > remaining() / (2 * sizeof(uint64_t)))
+      {
+        throw std::runtime_error("Checkpoint is truncated");
+      }
+      gtsam::KeyVector keys;
+      std::vector<size_t> dims;
+      size_t total_dim = 0;
+      for (uint64_t i = 0; i < num_keys; i++)
+      {
+        keys.push_back(read<uint64_t>());
+        dims.push_back(read<uint64_t>());
+        total_dim += dims.back();
+      }
+      gtsam::Matrix information = readMatrix();
+      if (information.rows() != static_cast<gtsam::DenseIndex>(total_dim + 1) || information.cols() != information.rows())
+      {
+        throw std::runtime_error("Checkpoint has a linear factor of the wrong dimension");
+      }
+      gtsam::HessianFactor hessian(keys, gtsam::SymmetricBlockMatrix(dims, information, true));
+      if (read<uint8_t>())
+      {
+        return boost::make_shared<gtsam::LinearContainerFactor>(hessian, readValues());
+      }
+      return boost::make_shared<gtsam::LinearContainerFactor>(hessian);
+    }
+    }
+    throw std::runtime_error("Checkpoint has an unknown factor type");
+  }
+
+  gtsam::NonlinearFactorGraph CheckpointReader::readGraph()
+  {
+    // An empty slot is the shortest factor, its type alone
+    uint64_t num_factors = readCount(sizeof(FactorType));
+    gtsam::NonlinearFactorGraph graph;
+    graph.reserve(num_factors);
+    for (uint64_t i = 0; i < num_factors; i++)
+    {
+      graph.push_back(readFactor());
+    }
+    return graph;
+  }
+
+  gtsam::Values CheckpointReader::readValues()
+  {
+    uint64_t num_values = read<uint64_t>();
+    gtsam::Values values;
+    for (uint64_t i = 0; i < num_values; i++)
+    {
+      gtsam::Key key = read<uint64_t>();
+      ValueType type = read<ValueType>();
+      switch (type)
+      {
+      case ValueType::Pose2:
+      {
+        gtsam::Pose2 pose;
+        readPose(pose);
+        values.insert(key, pose);
+        break;
+      }
+      case ValueType::Pose3:
+      {
+        gtsam::Pose3 pose;
+        readPose(pose);
+        values.insert(key, pose);
+        break;
+      }
+      case ValueType::Point2:
+      {
+        values.insert(key, readPoint<gtsam::Point2>(*this));
+        break;
+      }
+      case ValueType::Point3:
+      {
+        values.insert(key, readPoint<gtsam::Point3>(*this));
+        break;
+      }
+      default:
+      {
+        throw std::runtime_error("Checkpoint has an unknown value type");
+      }
+      }
+    }
+    return values;
+  }
+
+} // namespace slam
@@ -0,0 +1,208 @@
+#include "slam/covariance_recovery.h"
+
+#include <gtsam/linear/GaussianFactorGraph.h>
+#include <gtsam/inference/Ordering.h>
+
+namespace slam
+{
+    CovarianceRecovery::CovarianceRecovery(gtsam::Marginals::Factorization factorization)
+        : factorization_(factorization),
+          graph_(nullptr),
+          estimates_(nullptr),
+          isam_(nullptr)
+    {
+    }
+
+    void CovarianceRecovery::clear()
+    {
+        graph_ = nullptr;
+        estimates_ = nullptr;
+        isam_ = nullptr;
+        marginals_.reset();
+        predictions_.clear();
+        marginal_cache_.clear();
+        joint_cache_.clear();
+    }
+
+    void CovarianceRecovery::setFactorization(gtsam::Marginals::Factorization factorization)
+    {
+        factorization_ = factorization;
+    }
+
+    void CovarianceRecovery::update(const gtsam::NonlinearFactorGraph &graph, const gtsam::Values &estimates, uint64_t version)
+    {
+        // Factorization unchanged, keep what we have computed so far
+        if (version_ && *version_ == version && graph_ == &graph)
+        {
+            return;
+        }
+        clear();
+        graph_ = &graph;
+        estimates_ = &estimates;
+        version_ = version;
+    }
+
+    void CovarianceRecovery::update(const gtsam::ISAM2 &isam, uint64_t version)
+    {
+        if (version_ && *version_ == version && isam_ == &isam)
+        {
+            return;
+        }
+        clear();
+        isam_ = &isam;
+        version_ = version;
+    }
+
+    void CovarianceRecovery::addPrediction(gtsam::Key to, gtsam::Key from, const gtsam::Matrix &H, const gtsam::Matrix &Q)
+    {
+        predictions_[to] = Prediction{from, H, Q, predictions_.size()};
+        marginal_cache_.erase(to);
+        for (auto it = joint_cache_.begin(); it != joint_cache_.end();)
+        {
+            it = it->first.first == to || it->first.second == to ? joint_cache_.erase(it) : std::next(it);
+        }
+    }
+
+    const gtsam::Marginals &CovarianceRecovery::marginals() const
+    {
+        // Lazily factorize, so timesteps where nothing is gated never pay for it
+        if (!marginals_)
+        {
+            marginals_.emplace(*graph_, *estimates_, factorization_);
+        }
+        return *marginals_;
+    }
+
+    const gtsam::Matrix &CovarianceRecovery::marginalCovariance(gtsam::Key key) const
+    {
+        auto it = marginal_cache_.find(key);
+        if (it != marginal_cache_.end())
+        {
+            return it->second;
+        }
+
+        gtsam::Matrix P;
+        auto prediction = predictions_.find(key);
+        if (prediction != predictions_.end())
+        {
+            const Prediction &p = prediction->second;
+            P = p.H * marginalCovariance(p.from) * p.H.transpose() + p.Q;
+        }
+        else
+        {
+            P = isam_ ? isam_->marginalCovariance(key) : marginals().marginalCovariance(key);
+        }
+        return marginal_cache_.emplace(key, std::move(P)).first->second;
+    }
+
+    gtsam::Matrix CovarianceRecovery::crossCovariance(gtsam::Key a, gtsam::Key b) const
+    {
+        if (a == b)
+        {
+            return marginalCovariance(a);
+        }
+        auto pa = predictions_.find(a);
+        auto pb = predictions_.find(b);
+        // Reduce whichever was predicted last, until both are known to the graph or Bayes tree
+        if (pb != predictions_.end() && (pa == predictions_.end() || pb->second.order > pa->second.order))
+        {
+            return crossCovariance(a, pb->second.from) * pb->second.H.transpose();
+        }
+        if (pa != predictions_.end())
+        {
+            return pa->second.H * crossCovariance(pa->second.from, b);
+        }
+        const gtsam::Matrix &P = jointCovariance(a, b);
+        int dim_a = marginalCovariance(a).rows();
+        return P.topRightCorner(dim_a, P.cols() - dim_a);
+    }
+
+    const gtsam::Matrix &CovarianceRecovery::jointCovariance(gtsam::Key a, gtsam::Key b) const
+    {
+        auto it = joint_cache_.find({a, b});
+        if (it != joint_cache_.end())
+        {
+            return it->second;
+        }
+
+        gtsam::Matrix P;
+        int dim_a;
+        if (predictions_.count(a) > 0 || predictions_.count(b) > 0)
+        {
+            const gtsam::Matrix &Paa = marginalCovariance(a);
+            const gtsam::Matrix &Pbb = marginalCovariance(b);
+            gtsam::Matrix Pab = crossCovariance(a, b);
+            P.resize(Paa.rows() + Pbb.rows(), Paa.cols() + Pbb.cols());
+            P << Paa, Pab,
+                Pab.transpose(), Pbb;
+            dim_a = Paa.rows();
+        }
+        else if (isam_)
+        {
+            // Joint of two variables from the Bayes tree, through the shortcuts of the cliques
+            gtsam::GaussianFactorGraph::shared_ptr joint_graph = isam_->joint(a, b);
+            gtsam::Ordering ordering;
+            ordering.push_back(a);
+            ordering.push_back(b);
+            P = joint_graph->hessian(ordering).first.inverse();
+            dim_a = isam_->getLinearizationPoint().at(a).dim();
+        }
+        else
+        {
+            // JointMarginal is ordered by key, so pick out the blocks to get a first
+            gtsam::KeyVector keys;
+            keys.push_back(a);
+            keys.push_back(b);
+            gtsam::JointMarginal joint = marginals().jointMarginalCovariance(keys);
+            gtsam::Matrix Paa = joint(a, a);
+            gtsam::Matrix Pab = joint(a, b);
+            gtsam::Matrix Pbb = joint(b, b);
+            P.resize(Paa.rows() + Pbb.rows(), Paa.cols() + Pbb.cols());
+            P << Paa, Pab,
+                Pab.transpose(), Pbb;
+            dim_a = Paa.rows();
+        }
+
+        // Marginals of a and b come for free
+        marginal_cache_.emplace(a, P.topLeftCorner(dim_a, dim_a));
+        marginal_cache_.emplace(b, P.bottomRightCorner(P.rows() - dim_a, P.rows() - dim_a));
+
+        return joint_cache_.emplace(std::make_pair(a, b), std::move(P)).first->second;
+    }
+
+    gtsam::Matrix CovarianceRecovery::operator()(gtsam::Key i, gtsam::Key j) const
+    {
+        if (i == j)
+        {
+            return marginalCovariance(i);
+        }
+
+        return crossCovariance(i, j);
+    }
+
+    gtsam::Matrix CovarianceRecovery::jointMarginalCovariance(const gtsam::KeyVector &keys) const
+    {
+        std::vector<int> offsets;
+        int dim = 0;
+        for (const gtsam::Key k : keys)
+        {
+            offsets.push_back(dim);
+            dim += marginalCovariance(k).rows();
+        }
+
+        gtsam::Matrix P(dim, dim);
+        for (int i = 0; i < keys.size(); i++)
+        {
+            const gtsam::Matrix &Pii = marginalCovariance(keys[i]);
+            P.block(offsets[i], offsets[i], Pii.rows(), Pii.cols()) = Pii;
+            for (int j = i + 1; j < keys.size(); j++)
+            {
+                gtsam::Matrix Pij = (*this)(keys[i], keys[j]);
+                P.block(offsets[i], offsets[j], Pij.rows(), Pij.cols()) = Pij;
+                P.block(offsets[j], offsets[i], Pij.cols(), Pij.rows()) = Pij.transpose();
+            }
+        }
+        return P;
+    }
+
+} // namespace slam
@@ -0,0 +1,49 @@
+#include "slam/crash_dump.h"
+#include "slam/checkpoint.h"
+
+#include <stdexcept>
+
+namespace slam
+{
+  void saveCrashDump(const std::string &filename, int step, gtsam::Key nearby_variable, const std::string &when,
+                     const gtsam::NonlinearFactorGraph &graph, const gtsam::Values &values)
+  {
+    CheckpointWriter writer;
+    writer.write(CRASH_DUMP_MAGIC);
+    writer.write(CHECKPOINT_FORMAT_VERSION);
+    writer.write<int64_t>(step);
+    writer.write<uint64_t>(nearby_variable);
+    writer.write<uint64_t>(when.size());
+    writer.writeBytes(when.data(), when.size());
+    writer.writeGraph(graph);
+    writer.writeValues(values);
+    writer.save(filename);
+  }
+
+  CrashDump loadCrashDump(const std::string &filename)
+  {
+    CheckpointReader reader(filename);
+    if (reader.read<uint64_t>() != CRASH_DUMP_MAGIC || reader.read<uint32_t>() != CHECKPOINT_FORMAT_VERSION)
+    {
+      throw std::runtime_error(filename + " is not a crash dump of this version");
+    }
+
+    CrashDump dump;
+    dump.step = reader.read<int64_t>();
+    dump.nearby_variable = reader.read<uint64_t>();
+    uint64_t when_size = reader.read<uint64_t>();
+    if (when_size > reader.remaining())
+    {
+      throw std::runtime_error(filename + " is truncated");
+    }
+    dump.when.resize(when_size);
+    for (char &c : dump.when)
+    {
+      c = reader.read<char>();
+    }
+    dump.graph = reader.readGraph();
+    dump.values = reader.readValues();
+    return dump;
+  }
+
+} // namespace slam
@@ -0,0 +1,75 @@
+#include "slam/factor_chain.h"
+
+#include <vector>
+
+namespace slam
+{
+    FactorChain::~FactorChain()
+    {
+        // Release segments one at a time, as a long chain would otherwise be destroyed recursively
+        std::shared_ptr<const Segment> segment = std::move(head_);
+        while (segment && segment.use_count() == 1)
+        {
+            segment = segment->parent;
+        }
+    }
+
+    void FactorChain::seal()
+    {
+        if (pending_.size() == 0)
+        {
+            return;
+        }
+        auto segment = std::make_shared<Segment>();
+        segment->parent = head_;
+        segment->size = size();
+        segment->factors = std::move(pending_);
+        head_ = std::move(segment);
+        pending_ = gtsam::NonlinearFactorGraph();
+    }
+
+    size_t FactorChain::size() const
+    {
+        return (head_ ? head_->size : 0) + pending_.size();
+    }
+
+    gtsam::NonlinearFactorGraph FactorChain::graph() const
+    {
+        std::vector<const Segment *> segments;
+        for (const Segment *s = head_.get(); s; s = s->parent.get())
+        {
+            segments.push_back(s);
+        }
+
+        gtsam::NonlinearFactorGraph graph;
+        graph.reserve(size());
+        for (auto it = segments.rbegin(); it != segments.rend(); ++it)
+        {
+            for (const auto &factor : (*it)->factors)
+            {
+                graph.push_back(factor);
+            }
+        }
+        for (const auto &factor : pending_)
+        {
+            graph.push_back(factor);
+        }
+        return graph;
+    }
+
+    size_t FactorChain::collectSegments(std::unordered_set<const void *> &segments) const
+    {
+        size_t added = pending_.size();
+        for (const Segment *s = head_.get(); s; s = s->parent.get())
+        {
+            // The rest of the chain is already counted if this segment is
+            if (!segments.insert(s).second)
+            {
+                break;
+            }
+            added += s->factors.size();
+        }
+        return added;
+    }
+
+} // namespace slam
@@ -9,17 +9,26 @@
 #include <fstream>
 #include <tuple>
 #include <algorithm>
+#include <future>
+#include <memory>
+#include <vector>
 
 #ifdef GLOG_AVAILABLE
 #include <glog/logging.h>
 #endif
 
 #include "slam/utils_g2o.h"
+#include "slam/timestep_pack.h"
+#include "slam/timestep_source.h"
 #include "slam/slam.h"
+#include "slam/multi_hypothesis_slam.h"
+#include "slam/async_slam.h"
 #include "slam/types.h"
 #include "data_association/ml/MaximumLikelihood.h"
 #include "data_association/gt/KnownDataAssociation.h"
+#include "data_association/jcbb/JCBB.h"
 #include "config/config.h"
+#include "utils/profiler.h"
 
 using gtsam::symbol_shorthand::L; // gtsam/slam/dataset.cpp
 using namespace std;
@@ -73,17 +82,24 @@ int main(int argc, char **argv)
     slam::OptimizationMethod optimization_method = conf.optimization_method;
     gtsam::Marginals::Factorization marginals_factorization = conf.marginals_factorization;
 
-    vector<boost::shared_ptr<PoseToPointFactor<Pose2, Point2>>> measFactors2d;
-    vector<boost::shared_ptr<PoseToPointFactor<Pose3, Point3>>> measFactors3d;
-
-    vector<boost::shared_ptr<BetweenFactor<Pose2>>> odomFactors2d;
-    vector<boost::shared_ptr<BetweenFactor<Pose3>>> odomFactors3d;
-
-    // reading file and creating factor graph
-    NonlinearFactorGraph::shared_ptr graph;
-    Values::shared_ptr initial;
-    boost::tie(graph, initial) = readG2owithLmks(g2oFile, is3D, "none");
-    auto [odomFactorIdx, measFactorIdx] = findFactors(odomFactors2d, odomFactors3d, measFactors2d, measFactors3d, graph);
+    // With the dataset cache, timesteps are streamed from the timestep pack rather than the whole dataset held, and
+    // the odometry graph and initial estimates are all that is read whole, for writing results
+    std::unique_ptr<slam::G2oInput<Pose2, Point2>> input2d;
+    std::unique_ptr<slam::G2oInput<Pose3, Point3>> input3d;
+    NonlinearFactorGraph odometry_graph;
+    Values initial;
+    if (is3D)
+    {
+        input3d = std::make_unique<slam::G2oInput<Pose3, Point3>>(g2oFile, conf.dataset_cache);
+        odometry_graph = input3d->odometryGraph();
+        initial = input3d->initialEstimates();
+    }
+    else
+    {
+        input2d = std::make_unique<slam::G2oInput<Pose2, Point2>>(g2oFile, conf.dataset_cache);
+        odometry_graph = input2d->odometryGraph();
+        initial = input2d->initialEstimates();
+    }
 #ifdef LOGGING
     double avg_time = 0.0;
 #endif
@@ -98,6 +114,7 @@ int main(int argc, char **argv)
 
     std::cout << "Using association method " << conf.association_method << "\n";
     std::cout << "Using optimization method " << conf.optimization_method << "\n";
+    std::cout << "Using optimization policy " << conf.optimization_policy.policy << "\n";
     std::cout << "Using marginals factorization " << (conf.marginals_factorization == gtsam::Marginals::CHOLESKY ? "Cholesky" : "QR") << "\n";
 
     try
@@ -107,123 +124,274 @@ int main(int argc, char **argv)
             double sigmas = sqrt(da::chi2inv(ic_prob, 3));
             gtsam::Vector pose_prior_noise = (gtsam::Vector(6) << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4).finished();
             pose_prior_noise = pose_prior_noise.array().sqrt().matrix(); // Calc sigmas from variances
-            vector<slam::Timestep3D> timesteps = convert_into_timesteps(odomFactors3d, measFactors3d);
-            slam::SLAM3D slam_sys{};
+            // Timesteps are read as they are processed, rather than all of them up front
+            std::unique_ptr<slam::TimestepSource<Pose3, Point3>> timesteps = input3d->timesteps();
             std::shared_ptr<da::DataAssociation<slam::Measurement3D>> data_asso;
 
             switch (association_method)
             {
             case da::AssociationMethod::MaximumLikelihood:
             {
-                data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold);
+                data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
                 break;
             }
             case da::AssociationMethod::KnownDataAssociation:
             {
-                std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                    measFactors3d,
-                    timesteps);
+                std::map<uint64_t, gtsam::Key> meas_lmk_assos = input3d->measurementLandmarkAssociations();
                 data_asso = std::make_shared<da::gt::KnownDataAssociation3D>(meas_lmk_assos);
                 break;
             }
+            case da::AssociationMethod::JCBB:
+            {
+                data_asso = std::make_shared<da::jcbb::JCBB3D>(ic_prob, conf.jc_prob, range_threshold, conf.jcbb_max_nodes, conf.jcbb_time_budget);
+                break;
+            }
             }
 
-            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization);
-            int tot_timesteps = timesteps.size();
-            for (const auto &timestep : timesteps)
+            auto write_results = [&](const auto &slam_sys)
+            {
+                writeG2o(odometry_graph, slam_sys.currentEstimates(), output_file);
+                ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
+                slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
+                os.close();
+            };
+
+            // Same loop for single and multi-hypothesis SLAM, from the timestep after resume_after
+            auto run = [&](auto &slam_sys, int resume_after, auto &&after_timestep)
             {
-                start_t = std::chrono::high_resolution_clock::now();
-                slam_sys.processTimestep(timestep);
-                end_t = std::chrono::high_resolution_clock::now();
-                double duration = chrono::duration_cast<chrono::nanoseconds>(end_t - start_t).count() * 1e-9;
+                int tot_timesteps = timesteps->size();
+                while (auto next_timestep = timesteps->next())
+                {
+                    const auto &timestep = *next_timestep;
+                    if (timestep.step <= resume_after)
+                    {
+                        continue;
+                    }
+                    start_t = std::chrono::high_resolution_clock::now();
+                    slam_sys.processTimestep(timestep);
+                    end_t = std::chrono::high_resolution_clock::now();
+                    double duration = chrono::duration_cast<chrono::nanoseconds>(end_t - start_t).count() * 1e-9;
 #ifdef LOGGING
-                avg_time = (timestep.step * avg_time + duration) / (timestep.step + 1.0);
-                cout << "Duration: " << duration << " seconds\n"
-                     << "Average time one iteration: " << avg_time << " seconds\n";
+                    avg_time = (timestep.step * avg_time + duration) / (timestep.step + 1.0);
+                    cout << "Duration: " << duration << " seconds\n"
+                         << "Average time one iteration: " << avg_time << " seconds\n";
 #endif
 #ifdef HEARTBEAT
-                cout << "Processed timestep " << timestep.step << ", " << double(timestep.step + 1) / tot_timesteps * 100.0 << "\% complete\n";
+                    cout << "Processed timestep " << timestep.step << ", " << double(timestep.step + 1) / tot_timesteps * 100.0 << "\% complete\n";
 #endif
-                total_time += duration;
+                    total_time += duration;
+                    after_timestep(timestep);
+                }
+                // Only needed once done, copying the estimates every timestep is quadratic in the length of the run
                 final_error = slam_sys.error();
                 estimates = slam_sys.currentEstimates();
+            };
+
+            if (conf.async_pipeline)
+            {
+                slam::AsyncSLAM3D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, conf.association_policy, conf.max_staleness, optimization_method, marginals_factorization, conf.smoother_lag);
+                std::vector<std::future<slam::AsyncSLAM3D::TimestepResult>> results;
+                while (auto timestep = timesteps->next())
+                {
+                    results.push_back(slam_sys.processTimestep(*timestep));
+                }
+                for (auto &result : results)
+                {
+                    result.get();
+                }
+                slam::AsyncSLAM3D::Stats stats = slam_sys.stats();
+                std::cout << "Pipelined " << stats.timesteps << " timesteps in " << stats.wall_time << " seconds, "
+                          << stats.throughput() << " timesteps per second\n"
+                          << "Association busy " << stats.association_time << " s, optimization busy " << stats.optimization_time
+                          << " s, overlapping " << stats.overlap() << " s\n"
+                          << "Latency mean " << stats.mean_latency << " s, max " << stats.max_latency << " s\n";
+                total_time = stats.wall_time;
+                final_error = slam_sys.error();
+                estimates = slam_sys.currentEstimates();
+                write_results(slam_sys);
+            }
+            else if (conf.num_branches > 1)
+            {
+                slam::MultiHypothesisSLAM3D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, conf.num_branches, conf.hypotheses_per_branch, conf.branch_score, sigmas * sigmas, optimization_method, marginals_factorization);
+                run(slam_sys, -1, [](const auto &) {});
+                write_results(slam_sys);
+            }
+            else
+            {
+                slam::SLAM3D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization, conf.smoother_lag);
+                slam_sys.setOptimizationPolicy(conf.optimization_policy);
+                int resume_after = -1;
+                if (conf.resume_from_checkpoint && !conf.checkpoint_file.empty())
+                {
+                    slam_sys.loadCheckpoint(conf.checkpoint_file);
+                    resume_after = slam_sys.latestStep();
+                    std::cout << "Resuming from " << conf.checkpoint_file << " after timestep " << resume_after << "\n";
+                }
+                run(slam_sys, resume_after, [&](const auto &timestep)
+                    {
+                        if (!conf.checkpoint_file.empty() && conf.checkpoint_every > 0 && (timestep.step + 1) % conf.checkpoint_every == 0)
+                        {
+                            slam_sys.saveCheckpoint(conf.checkpoint_file);
+                        }
+                    });
+                // The last timesteps may not have been optimized yet
+                slam_sys.optimizePending();
+                std::cout << "Optimized " << slam_sys.numOptimizations() << " times for " << timesteps->size() << " timesteps\n";
+                final_error = slam_sys.error();
+                estimates = slam_sys.currentEstimates();
+                write_results(slam_sys);
             }
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, slam_sys.currentEstimates(), output_file);
-            ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
-            slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
-            os.close();
         }
         else
         {
             double sigmas = sqrt(da::chi2inv(ic_prob, 2));
             gtsam::Vector pose_prior_noise = Vector3(1e-6, 1e-6, 1e-8);
             pose_prior_noise = pose_prior_noise.array().sqrt().matrix(); // Calc sigmas from variances
-            vector<slam::Timestep2D> timesteps = convert_into_timesteps(odomFactors2d, measFactors2d);
-            slam::SLAM2D slam_sys{};
+            // Timesteps are read as they are processed, rather than all of them up front
+            std::unique_ptr<slam::TimestepSource<Pose2, Point2>> timesteps = input2d->timesteps();
             std::shared_ptr<da::DataAssociation<slam::Measurement2D>> data_asso;
 
             switch (association_method)
             {
             case da::AssociationMethod::MaximumLikelihood:
             {
-                data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold);
+                data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
                 break;
             }
             case da::AssociationMethod::KnownDataAssociation:
             {
-                std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                    measFactors2d,
-                    timesteps);
+                std::map<uint64_t, gtsam::Key> meas_lmk_assos = input2d->measurementLandmarkAssociations();
                 data_asso = std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos);
                 break;
             }
+            case da::AssociationMethod::JCBB:
+            {
+                data_asso = std::make_shared<da::jcbb::JCBB2D>(ic_prob, conf.jc_prob, range_threshold, conf.jcbb_max_nodes, conf.jcbb_time_budget);
+                break;
+            }
             }
 
-            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization);
-            int tot_timesteps = timesteps.size();
-            for (const auto &timestep : timesteps)
+            auto write_results = [&](const auto &slam_sys)
+            {
+                writeG2o(odometry_graph, slam_sys.currentEstimates(), output_file);
+                ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
+                slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
+                os.close();
+            };
+
+            // Same loop for single and multi-hypothesis SLAM, from the timestep after resume_after
+            auto run = [&](auto &slam_sys, int resume_after, auto &&after_timestep)
             {
-                start_t = std::chrono::high_resolution_clock::now();
-                slam_sys.processTimestep(timestep);
-                end_t = std::chrono::high_resolution_clock::now();
-                double duration = chrono::duration_cast<chrono::nanoseconds>(end_t - start_t).count() * 1e-9;
+                int tot_timesteps = timesteps->size();
+                while (auto next_timestep = timesteps->next())
+                {
+                    const auto &timestep = *next_timestep;
+                    if (timestep.step <= resume_after)
+                    {
+                        continue;
+                    }
+                    start_t = std::chrono::high_resolution_clock::now();
+                    slam_sys.processTimestep(timestep);
+                    end_t = std::chrono::high_resolution_clock::now();
+                    double duration = chrono::duration_cast<chrono::nanoseconds>(end_t - start_t).count() * 1e-9;
 #ifdef LOGGING
-                avg_time = (timestep.step * avg_time + duration) / (timestep.step + 1.0);
-                cout << "Duration: " << duration << " seconds\n"
-                     << "Average time one iteration: " << avg_time << " seconds\n";
+                    avg_time = (timestep.step * avg_time + duration) / (timestep.step + 1.0);
+                    cout << "Duration: " << duration << " seconds\n"
+                         << "Average time one iteration: " << avg_time << " seconds\n";
 #endif
 #ifdef HEARTBEAT
-                cout << "Processed timestep " << timestep.step << ", " << double(timestep.step + 1) / tot_timesteps * 100.0 << "\% complete\n";
+                    cout << "Processed timestep " << timestep.step << ", " << double(timestep.step + 1) / tot_timesteps * 100.0 << "\% complete\n";
 #endif
-                total_time += duration;
+                    total_time += duration;
+                    after_timestep(timestep);
+                }
+                // Only needed once done, copying the estimates every timestep is quadratic in the length of the run
+                final_error = slam_sys.error();
+                estimates = slam_sys.currentEstimates();
+            };
+
+            if (conf.async_pipeline)
+            {
+                slam::AsyncSLAM2D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, conf.association_policy, conf.max_staleness, optimization_method, marginals_factorization, conf.smoother_lag);
+                std::vector<std::future<slam::AsyncSLAM2D::TimestepResult>> results;
+                while (auto timestep = timesteps->next())
+                {
+                    results.push_back(slam_sys.processTimestep(*timestep));
+                }
+                for (auto &result : results)
+                {
+                    result.get();
+                }
+                slam::AsyncSLAM2D::Stats stats = slam_sys.stats();
+                std::cout << "Pipelined " << stats.timesteps << " timesteps in " << stats.wall_time << " seconds, "
+                          << stats.throughput() << " timesteps per second\n"
+                          << "Association busy " << stats.association_time << " s, optimization busy " << stats.optimization_time
+                          << " s, overlapping " << stats.overlap() << " s\n"
+                          << "Latency mean " << stats.mean_latency << " s, max " << stats.max_latency << " s\n";
+                total_time = stats.wall_time;
+                final_error = slam_sys.error();
+                estimates = slam_sys.currentEstimates();
+                write_results(slam_sys);
+            }
+            else if (conf.num_branches > 1)
+            {
+                slam::MultiHypothesisSLAM2D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, conf.num_branches, conf.hypotheses_per_branch, conf.branch_score, sigmas * sigmas, optimization_method, marginals_factorization);
+                run(slam_sys, -1, [](const auto &) {});
+                write_results(slam_sys);
+            }
+            else
+            {
+                slam::SLAM2D slam_sys{};
+                slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization, conf.smoother_lag);
+                slam_sys.setOptimizationPolicy(conf.optimization_policy);
+                int resume_after = -1;
+                if (conf.resume_from_checkpoint && !conf.checkpoint_file.empty())
+                {
+                    slam_sys.loadCheckpoint(conf.checkpoint_file);
+                    resume_after = slam_sys.latestStep();
+                    std::cout << "Resuming from " << conf.checkpoint_file << " after timestep " << resume_after << "\n";
+                }
+                run(slam_sys, resume_after, [&](const auto &timestep)
+                    {
+                        if (!conf.checkpoint_file.empty() && conf.checkpoint_every > 0 && (timestep.step + 1) % conf.checkpoint_every == 0)
+                        {
+                            slam_sys.saveCheckpoint(conf.checkpoint_file);
+                        }
+                    });
+                // The last timesteps may not have been optimized yet
+                slam_sys.optimizePending();
+                std::cout << "Optimized " << slam_sys.numOptimizations() << " times for " << timesteps->size() << " timesteps\n";
                 final_error = slam_sys.error();
                 estimates = slam_sys.currentEstimates();
+                write_results(slam_sys);
             }
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, slam_sys.currentEstimates(), output_file);
-            ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
-            slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
-            os.close();
         }
     }
     catch (gtsam::IndeterminantLinearSystemException &indetErr)
     { // when run in terminal: tbb::captured_exception
         std::cout << "Optimization failed" << std::endl;
         std::cout << indetErr.what() << std::endl;
+        string other_msg = "None";
+        if (const auto *with_graph = dynamic_cast<const slam::IndeterminantLinearSystemExceptionWithGraphValues *>(&indetErr))
+        {
+            other_msg = with_graph->when + " at timestep " + std::to_string(with_graph->step);
+            std::cout << other_msg << "\n";
+            if (argc > 5)
+            {
+                // Replay offline with slam::loadCrashDump
+                with_graph->dump(output_file + ".crash");
+            }
+        }
         if (argc > 5)
         {
-            string other_msg = "None";
             saveException(output_file, std::string("ExceptionML.txt"), indetErr.what(), other_msg);
         }
-        NonlinearFactorGraph::shared_ptr graphNoKernel;
-        Values::shared_ptr initial2;
-        boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-        estimates = *initial2;
+        estimates = initial;
         caught_exception = true;
     }
     if (argc < 5)
@@ -239,10 +407,7 @@ int main(int argc, char **argv)
         if (!caught_exception)
         {
             std::cout << "Writing results to file: " << output_file << std::endl;
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, estimates,
+            writeG2o(odometry_graph, estimates,
                      output_file); // can save pose, ldmk, odom not ldmk measurements
             saveGraphErrors(output_file, std::string("maximum_likelihood"), vector<double>{final_error});
             saveVector(output_file, std::string("errorsGraph.txt"), vector<double>{final_error});
@@ -250,4 +415,12 @@ int main(int argc, char **argv)
             std::cout << "done! " << std::endl;
         }
     }
+
+#ifdef PROFILING
+    utils::profiler::printSummary(std::cout);
+    if (!output_file.empty())
+    {
+        utils::profiler::writeChromeTrace(output_file + ".trace.json");
+    }
+#endif
 }
\ No newline at end of file
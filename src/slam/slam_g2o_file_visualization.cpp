@@ -9,6 +9,7 @@
 #include <fstream>
 #include <tuple>
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <sstream>
 
@@ -18,15 +19,19 @@
 
 // #include "slam/slam_g2o_file.h"
 #include "slam/utils_g2o.h"
+#include "slam/timestep_pack.h"
+#include "slam/timestep_source.h"
 #include "slam/slam.h"
 #include "slam/types.h"
 #include "data_association/ml/MaximumLikelihood.h"
 #include "data_association/gt/KnownDataAssociation.h"
+#include "data_association/jcbb/JCBB.h"
 #include "data_association/DataAssociation.h"
 #include "visualization/visualization.h"
 #include "imgui.h"
 #include "implot.h"
 #include "config/config.h"
+#include "utils/profiler.h"
 
 using namespace std;
 using namespace gtsam;
@@ -160,17 +165,26 @@ int main(int argc, char **argv)
         std::cout << "output_file: " << output_file << std::endl;
     }
 
-    vector<boost::shared_ptr<PoseToPointFactor<Pose2, Point2>>> measFactors2d;
-    vector<boost::shared_ptr<PoseToPointFactor<Pose3, Point3>>> measFactors3d;
-
-    vector<boost::shared_ptr<BetweenFactor<Pose2>>> odomFactors2d;
-    vector<boost::shared_ptr<BetweenFactor<Pose3>>> odomFactors3d;
+    config::Config conf("/home/mrg/prog/C++/da-slam/config/config.yaml");
 
-    // reading file and creating factor graph
-    NonlinearFactorGraph::shared_ptr graph;
-    Values::shared_ptr initial;
-    boost::tie(graph, initial) = readG2owithLmks(g2oFile, is3D, "none");
-    auto [odomFactorIdx, measFactorIdx] = findFactors(odomFactors2d, odomFactors3d, measFactors2d, measFactors3d, graph);
+    // With the dataset cache, timesteps are streamed from the timestep pack rather than the whole dataset held, and
+    // the odometry graph and initial estimates are all that is read whole, for writing results
+    std::unique_ptr<slam::G2oInput<Pose2, Point2>> input2d;
+    std::unique_ptr<slam::G2oInput<Pose3, Point3>> input3d;
+    NonlinearFactorGraph odometry_graph;
+    Values initial;
+    if (is3D)
+    {
+        input3d = std::make_unique<slam::G2oInput<Pose3, Point3>>(g2oFile, conf.dataset_cache);
+        odometry_graph = input3d->odometryGraph();
+        initial = input3d->initialEstimates();
+    }
+    else
+    {
+        input2d = std::make_unique<slam::G2oInput<Pose2, Point2>>(g2oFile, conf.dataset_cache);
+        odometry_graph = input2d->odometryGraph();
+        initial = input2d->initialEstimates();
+    }
 #ifdef LOGGING
     double avg_time = 0.0;
 #endif
@@ -196,8 +210,6 @@ int main(int argc, char **argv)
     bool early_stop = false;
     bool next_timestep = true;
 
-    config::Config conf("/home/mrg/prog/C++/da-slam/config/config.yaml");
-
     bool enable_stepping = conf.enable_stepping;
     bool draw_factor_graph = conf.draw_factor_graph;
     bool enable_step_limit = conf.enable_step_limit;
@@ -240,7 +252,8 @@ int main(int argc, char **argv)
             double sigmas = sqrt(da::chi2inv(ic_prob, 3));
             gtsam::Vector pose_prior_noise = (gtsam::Vector(6) << 1e-6, 1e-6, 1e-6, 1e-4, 1e-4, 1e-4).finished();
             pose_prior_noise = pose_prior_noise.array().sqrt().matrix(); // Calc sigmas from variances
-            vector<slam::Timestep3D> timesteps = convert_into_timesteps(odomFactors3d, measFactors3d);
+            // Timesteps are read as they are processed, rather than all of them up front
+            std::unique_ptr<slam::TimestepSource<Pose3, Point3>> timesteps = input3d->timesteps();
             slam::SLAM3D slam_sys{};
 
             std::shared_ptr<da::DataAssociation<slam::Measurement<gtsam::Point3>>> data_asso;
@@ -248,10 +261,8 @@ int main(int argc, char **argv)
             slam::SLAM3D slam_sys_gt{};
             if (with_ground_truth)
             {
-                data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold);
-                std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                    measFactors3d,
-                    timesteps);
+                data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
+                std::map<uint64_t, gtsam::Key> meas_lmk_assos = input3d->measurementLandmarkAssociations();
                 data_asso_gt = std::make_shared<da::gt::KnownDataAssociation3D>(meas_lmk_assos);
                 slam_sys_gt.initialize(pose_prior_noise, data_asso_gt);
             }
@@ -261,27 +272,34 @@ int main(int argc, char **argv)
                 {
                 case da::AssociationMethod::MaximumLikelihood:
                 {
-                    data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold);
+                    data_asso = std::make_shared<da::ml::MaximumLikelihood3D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
                     break;
                 }
                 case da::AssociationMethod::KnownDataAssociation:
                 {
-                    std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                        measFactors3d,
-                        timesteps);
+                    std::map<uint64_t, gtsam::Key> meas_lmk_assos = input3d->measurementLandmarkAssociations();
                     data_asso = std::make_shared<da::gt::KnownDataAssociation3D>(meas_lmk_assos);
                     break;
                 }
+                case da::AssociationMethod::JCBB:
+                {
+                    data_asso = std::make_shared<da::jcbb::JCBB3D>(ic_prob, conf.jc_prob, range_threshold, conf.jcbb_max_nodes, conf.jcbb_time_budget);
+                    break;
+                }
                 }
             }
 
-            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization);
+            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization, conf.smoother_lag);
+            slam_sys.setOptimizationPolicy(conf.optimization_policy);
 
-            int tot_timesteps = timesteps.size();
+            int tot_timesteps = timesteps->size();
+            // The timestep processed last, whose measurements the hypothesis is drawn with
+            slam::Timestep3D latest_timestep;
 
             int step = 0;
             while (viz::running() && step < tot_timesteps)
             {
+                PROFILE_ZONE("viz::frame");
                 viz::new_frame();
 
                 ImGui::Begin("Config");
@@ -375,7 +393,8 @@ int main(int argc, char **argv)
 
                 if (next_timestep && (!enable_step_limit || step < step_to_increment_to) && (!draw_association_hypothesis || proceed_to_next_asso_timestep || !(stop_at_association_timestep && did_association)))
                 {
-                    const slam::Timestep3D &timestep = timesteps[step];
+                    latest_timestep = *timesteps->next();
+                    const slam::Timestep3D &timestep = latest_timestep;
 
                     start_t = std::chrono::high_resolution_clock::now();
 
@@ -488,7 +507,7 @@ int main(int argc, char **argv)
                                 // const da::hypothesis::Hypothesis &hypothesis,
                                 hypo,
                                 // const slam::Measurements<gtsam::Point2> &measurements,
-                                timesteps[step - 1].measurements,
+                                latest_timestep.measurements,
                                 // const gtsam::NonlinearFactorGraph &graph,
                                 slam_sys.hypothesisGraph(),
                                 // const gtsam::Values &estimates,
@@ -509,10 +528,7 @@ int main(int argc, char **argv)
 
                 viz::render();
             }
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, slam_sys.currentEstimates(), output_file);
+            writeG2o(odometry_graph, slam_sys.currentEstimates(), output_file);
             ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
             slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
             os.close();
@@ -522,7 +538,8 @@ int main(int argc, char **argv)
             double sigmas = sqrt(da::chi2inv(ic_prob, 2));
             gtsam::Vector pose_prior_noise = Vector3(1e-6, 1e-6, 1e-8);
             pose_prior_noise = pose_prior_noise.array().sqrt().matrix(); // Calc sigmas from variances
-            vector<slam::Timestep2D> timesteps = convert_into_timesteps(odomFactors2d, measFactors2d);
+            // Timesteps are read as they are processed, rather than all of them up front
+            std::unique_ptr<slam::TimestepSource<Pose2, Point2>> timesteps = input2d->timesteps();
             slam::SLAM2D slam_sys{};
             slam::SLAM2D slam_sys_gt{};
 
@@ -530,10 +547,8 @@ int main(int argc, char **argv)
 
             if (with_ground_truth)
             {
-                data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold);
-                std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                    measFactors2d,
-                    timesteps);
+                data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
+                std::map<uint64_t, gtsam::Key> meas_lmk_assos = input2d->measurementLandmarkAssociations();
                 data_asso_gt = std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos);
                 slam_sys_gt.initialize(pose_prior_noise, data_asso_gt);
             }
@@ -543,27 +558,34 @@ int main(int argc, char **argv)
                 {
                 case da::AssociationMethod::MaximumLikelihood:
                 {
-                    data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold);
+                    data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas, range_threshold, conf.num_threads, conf.assignment_solver);
                     break;
                 }
                 case da::AssociationMethod::KnownDataAssociation:
                 {
-                    std::map<uint64_t, gtsam::Key> meas_lmk_assos = measurement_landmarks_associations(
-                        measFactors2d,
-                        timesteps);
+                    std::map<uint64_t, gtsam::Key> meas_lmk_assos = input2d->measurementLandmarkAssociations();
                     data_asso = std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos);
                     break;
                 }
+                case da::AssociationMethod::JCBB:
+                {
+                    data_asso = std::make_shared<da::jcbb::JCBB2D>(ic_prob, conf.jc_prob, range_threshold, conf.jcbb_max_nodes, conf.jcbb_time_budget);
+                    break;
+                }
                 }
             }
 
-            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization);
+            slam_sys.initialize(pose_prior_noise, data_asso, optimization_method, marginals_factorization, conf.smoother_lag);
+            slam_sys.setOptimizationPolicy(conf.optimization_policy);
 
-            int tot_timesteps = timesteps.size();
+            int tot_timesteps = timesteps->size();
+            // The timestep processed last, whose measurements the hypothesis is drawn with
+            slam::Timestep2D latest_timestep;
 
             int step = 0;
             while (viz::running() && step < tot_timesteps)
             {
+                PROFILE_ZONE("viz::frame");
                 viz::new_frame();
 
                 ImGui::Begin("Config");
@@ -657,7 +679,8 @@ int main(int argc, char **argv)
 
                 if (next_timestep && (!enable_step_limit || step < step_to_increment_to) && (!draw_association_hypothesis || proceed_to_next_asso_timestep || !(stop_at_association_timestep && did_association)))
                 {
-                    const slam::Timestep2D &timestep = timesteps[step];
+                    latest_timestep = *timesteps->next();
+                    const slam::Timestep2D &timestep = latest_timestep;
 
                     start_t = std::chrono::high_resolution_clock::now();
 
@@ -770,7 +793,7 @@ int main(int argc, char **argv)
                                 // const da::hypothesis::Hypothesis &hypothesis,
                                 hypo,
                                 // const slam::Measurements<gtsam::Point2> &measurements,
-                                timesteps[step - 1].measurements,
+                                latest_timestep.measurements,
                                 // const gtsam::NonlinearFactorGraph &graph,
                                 slam_sys.hypothesisGraph(),
                                 // const gtsam::Values &estimates,
@@ -791,10 +814,7 @@ int main(int argc, char **argv)
 
                 viz::render();
             }
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, slam_sys.currentEstimates(), output_file);
+            writeG2o(odometry_graph, slam_sys.currentEstimates(), output_file);
             ofstream os("/home/odinase/prog/C++/da-slam/graph.txt");
             slam_sys.getGraph().saveGraph(os, slam_sys.currentEstimates());
             os.close();
@@ -805,10 +825,15 @@ int main(int argc, char **argv)
         std::cout << "Optimization failed" << std::endl;
         std::cout << indetErr.what() << std::endl;
         std::cout << "Error occured when:\n"
-                  << indetErr.when << "\n";
+                  << indetErr.when << ", at timestep " << indetErr.step << "\n";
+        if (argc > 5)
+        {
+            std::cout << "Writing graph and estimates to " << output_file << ".crash\n";
+            indetErr.dump(output_file + ".crash");
+        }
 
-        const gtsam::NonlinearFactorGraph &graph = indetErr.graph;
-        const gtsam::Values &values = indetErr.values;
+        const gtsam::NonlinearFactorGraph &graph = *indetErr.graph;
+        const gtsam::Values &values = *indetErr.values;
 
         if (connected_graph(graph, values))
         {
@@ -879,10 +904,7 @@ int main(int argc, char **argv)
             string other_msg = "None";
             saveException(output_file, std::string("ExceptionML.txt"), indetErr.what(), other_msg);
         }
-        NonlinearFactorGraph::shared_ptr graphNoKernel;
-        Values::shared_ptr initial2;
-        boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-        estimates = *initial2;
+        estimates = initial;
         caught_exception = true;
     }
     if (argc < 5)
@@ -898,10 +920,7 @@ int main(int argc, char **argv)
         if (!caught_exception)
         {
             std::cout << "Writing results to file: " << output_file << std::endl;
-            NonlinearFactorGraph::shared_ptr graphNoKernel;
-            Values::shared_ptr initial2;
-            boost::tie(graphNoKernel, initial2) = readG2o(g2oFile, is3D);
-            writeG2o(*graphNoKernel, estimates,
+            writeG2o(odometry_graph, estimates,
                      output_file); // can save pose, ldmk, odom not ldmk measurements
             saveGraphErrors(output_file, std::string("maximum_likelihood"), vector<double>{final_error});
             saveVector(output_file, std::string("errorsGraph.txt"), vector<double>{final_error});
@@ -910,5 +929,13 @@ int main(int argc, char **argv)
         }
     }
 
+#ifdef PROFILING
+    utils::profiler::printSummary(std::cout);
+    if (!output_file.empty())
+    {
+        utils::profiler::writeChromeTrace(output_file + ".trace.json");
+    }
+#endif
+
     viz::shutdown();
 }
\ No newline at end of file
@@ -0,0 +1,327 @@
+#include "utils/profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+namespace utils
+{
+  namespace profiler
+  {
+    namespace
+    {
+      // Log-linear buckets of nanoseconds: exact below 8, then 8 per power of two, up to 2^51 ns (26 days)
+      constexpr int SUB_BUCKETS = 8;
+      constexpr int MAX_OCTAVE = 50;
+      constexpr size_t BUCKETS = SUB_BUCKETS * (MAX_OCTAVE - 1);
+
+      size_t bucket(uint64_t ns)
+      {
+        if (ns < SUB_BUCKETS)
+        {
+          return ns;
+        }
+        const int octave = std::min(63 - __builtin_clzll(ns), MAX_OCTAVE);
+        const uint64_t sub = std::min<uint64_t>((ns >> (octave - 3)) & (SUB_BUCKETS - 1), SUB_BUCKETS - 1);
+        return SUB_BUCKETS * (octave - 2) + sub;
+      }
+
+      // Largest duration in bucket i
+      uint64_t bucketUpperBound(size_t i)
+      {
+        if (i < SUB_BUCKETS)
+        {
+          return i;
+        }
+        const int octave = i / SUB_BUCKETS + 2;
+        const uint64_t sub = i % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << (octave - 3)) - 1;
+      }
+
+      // Only ever written by the thread owning it, so plain loads and stores suffice, atomic only so others may read
+      struct Histogram
+      {
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets;
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total;
+        std::atomic<uint64_t> max;
+
+        void add(uint64_t ns)
+        {
+          auto increment = [](std::atomic<uint64_t> &a, uint64_t by)
+          { a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed); };
+          increment(buckets[bucket(ns)], 1);
+          increment(count, 1);
+          increment(total, ns);
+          if (ns > max.load(std::memory_order_relaxed))
+          {
+            max.store(ns, std::memory_order_relaxed);
+          }
+        }
+
+        void clear()
+        {
+          for (auto &b : buckets)
+          {
+            b.store(0, std::memory_order_relaxed);
+          }
+          count.store(0, std::memory_order_relaxed);
+          total.store(0, std::memory_order_relaxed);
+          max.store(0, std::memory_order_relaxed);
+        }
+      };
+
+      struct Event
+      {
+        uint32_t zone;
+        uint64_t begin; // Nanoseconds since the profiler started
+        uint64_t duration;
+      };
+
+      struct ThreadLog
+      {
+        uint32_t thread;
+        std::unique_ptr<Event[]> ring{new Event[RING_CAPACITY]};
+        // Events ever written, the latest RING_CAPACITY of which are in ring
+        std::atomic<uint64_t> written{0};
+        // Allocated by the owning thread on the first zone of each id
+        std::array<std::atomic<Histogram *>, MAX_ZONES> histograms{};
+
+        ~ThreadLog()
+        {
+          for (auto &h : histograms)
+          {
+            delete h.load();
+          }
+        }
+      };
+
+      // Zone names and thread logs, which outlive their threads so their zones can still be reported
+      struct Registry
+      {
+        std::mutex mutex;
+        std::vector<std::string> zones;
+        std::vector<std::unique_ptr<ThreadLog>> threads;
+        const Clock::time_point epoch = Clock::now();
+      };
+
+      Registry &registry()
+      {
+        static Registry r;
+        return r;
+      }
+
+      ThreadLog &threadLog()
+      {
+        thread_local ThreadLog *log = nullptr;
+        if (!log)
+        {
+          Registry &r = registry();
+          std::lock_guard<std::mutex> lock(r.mutex);
+          r.threads.push_back(std::make_unique<ThreadLog>());
+          log = r.threads.back().get();
+          log->thread = r.threads.size() - 1;
+        }
+        return *log;
+      }
+
+      uint64_t nanoseconds(Clock::duration d)
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+      }
+
+      double milliseconds(uint64_t ns)
+      {
+        return ns * 1e-6;
+      }
+
+      std::string escape(const std::string &s)
+      {
+        std::string escaped;
+        for (char c : s)
+        {
+          if (c == '"' || c == '\\')
+          {
+            escaped += '\\';
+          }
+          escaped += c;
+        }
+        return escaped;
+      }
+    } // namespace
+
+    uint32_t registerZone(const char *name)
+    {
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      auto it = std::find(r.zones.begin(), r.zones.end(), name);
+      if (it != r.zones.end())
+      {
+        return it - r.zones.begin();
+      }
+      if (r.zones.size() == MAX_ZONES)
+      {
+        throw std::runtime_error("More than " + std::to_string(MAX_ZONES) + " profiler zones, at " + name);
+      }
+      r.zones.push_back(name);
+      return r.zones.size() - 1;
+    }
+
+    void record(uint32_t zone, Clock::time_point begin, Clock::time_point end)
+    {
+      ThreadLog &log = threadLog();
+      const uint64_t duration = nanoseconds(end - begin);
+
+      Histogram *h = log.histograms[zone].load(std::memory_order_relaxed);
+      if (!h)
+      {
+        h = new Histogram();
+        log.histograms[zone].store(h, std::memory_order_release);
+      }
+      h->add(duration);
+
+      const uint64_t written = log.written.load(std::memory_order_relaxed);
+      log.ring[written % RING_CAPACITY] = {zone, nanoseconds(begin - registry().epoch), duration};
+      log.written.store(written + 1, std::memory_order_release);
+    }
+
+    std::vector<ZoneStats> summary()
+    {
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+
+      std::vector<ZoneStats> stats;
+      std::vector<uint64_t> buckets(BUCKETS);
+      for (size_t zone = 0; zone < r.zones.size(); zone++)
+      {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        uint64_t count = 0;
+        uint64_t total = 0;
+        uint64_t max = 0;
+        for (const auto &log : r.threads)
+        {
+          const Histogram *h = log->histograms[zone].load(std::memory_order_acquire);
+          if (!h)
+          {
+            continue;
+          }
+          for (size_t i = 0; i < BUCKETS; i++)
+          {
+            buckets[i] += h->buckets[i].load(std::memory_order_relaxed);
+          }
+          count += h->count.load(std::memory_order_relaxed);
+          total += h->total.load(std::memory_order_relaxed);
+          max = std::max(max, h->max.load(std::memory_order_relaxed));
+        }
+        if (count == 0)
+        {
+          continue;
+        }
+
+        auto percentile = [&](double p)
+        {
+          const uint64_t rank = std::max<uint64_t>(1, p * count + 0.5);
+          uint64_t seen = 0;
+          for (size_t i = 0; i < BUCKETS; i++)
+          {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+              return std::min(bucketUpperBound(i), max);
+            }
+          }
+          return max;
+        };
+        stats.push_back({r.zones[zone], count, milliseconds(total), milliseconds(percentile(0.5)), milliseconds(percentile(0.99)), milliseconds(max)});
+      }
+      std::sort(stats.begin(), stats.end(), [](const ZoneStats &lhs, const ZoneStats &rhs)
+                { return lhs.name < rhs.name; });
+      return stats;
+    }
+
+    void printSummary(std::ostream &os)
+    {
+      std::vector<ZoneStats> stats = summary();
+      size_t width = 4;
+      for (const ZoneStats &s : stats)
+      {
+        width = std::max(width, s.name.size());
+      }
+      os << std::left << std::setw(width) << "Zone" << std::right << std::setw(10) << "count" << std::setw(14) << "total [ms]"
+         << std::setw(12) << "p50 [ms]" << std::setw(12) << "p99 [ms]" << std::setw(12) << "max [ms]" << "\n";
+      for (const ZoneStats &s : stats)
+      {
+        os << std::left << std::setw(width) << s.name << std::right << std::setw(10) << s.count << std::fixed << std::setprecision(3)
+           << std::setw(14) << s.total << std::setw(12) << s.p50 << std::setw(12) << s.p99 << std::setw(12) << s.max << "\n";
+      }
+      os << std::defaultfloat;
+    }
+
+    void writeChromeTrace(const std::string &filename)
+    {
+      std::ofstream os(filename);
+      if (!os)
+      {
+        throw std::runtime_error("Could not open " + filename + " for writing");
+      }
+
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+
+      // Complete events, with timestamps and durations in microseconds
+      os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+      bool first = true;
+      std::vector<Event> events;
+      for (const auto &log : r.threads)
+      {
+        const uint64_t written = log->written.load(std::memory_order_acquire);
+        const uint64_t oldest = written > RING_CAPACITY ? written - RING_CAPACITY : 0;
+        events.clear();
+        for (uint64_t i = oldest; i < written; i++)
+        {
+          events.push_back(log->ring[i % RING_CAPACITY]);
+        }
+        // The thread may have gone on writing while copying, over the oldest of them, and be writing over one more
+        const uint64_t written_after = log->written.load(std::memory_order_acquire) + 1;
+        const uint64_t overwritten = written_after > RING_CAPACITY ? std::min(written_after - RING_CAPACITY, written) : 0;
+        const size_t skip = overwritten > oldest ? overwritten - oldest : 0;
+
+        for (size_t i = skip; i < events.size(); i++)
+        {
+          const Event &e = events[i];
+          os << (first ? "" : ",") << "\n{\"name\":\"" << escape(r.zones[e.zone]) << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << log->thread
+             << ",\"ts\":" << std::fixed << std::setprecision(3) << e.begin * 1e-3 << ",\"dur\":" << e.duration * 1e-3 << "}";
+          first = false;
+        }
+      }
+      os << "\n]}\n";
+      if (!os)
+      {
+        throw std::runtime_error("Could not write " + filename);
+      }
+    }
+
+    void reset()
+    {
+      Registry &r = registry();
+      std::lock_guard<std::mutex> lock(r.mutex);
+      for (const auto &log : r.threads)
+      {
+        for (auto &h : log->histograms)
+        {
+          if (Histogram *histogram = h.load(std::memory_order_acquire))
+          {
+            histogram->clear();
+          }
+        }
+        log->written.store(0, std::memory_order_release);
+      }
+    }
+
+  } // namespace profiler
+} // namespace utils
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "data_association/Clustering.h"
+#include "data_association/SparseAssignment.h"
+
+/*
+ * Checks that solving the clusters of an assignment problem independently gives the same cost as solving it whole,
+ * on random problems with a few candidate landmarks per measurement, as after gating in MaximumLikelihood.
+ */
+
+int main(int argc, char **argv)
+{
+    const double unassigned_cost = 10.0;
+
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<double> uniform_cost(0.0, 15.0);
+    std::uniform_int_distribution<int> uniform_size(1, 100);
+    std::uniform_int_distribution<int> num_candidates(0, 3);
+
+    int failures = 0;
+    for (int problem = 0; problem < 500; problem++)
+    {
+        int num_meas = uniform_size(rng);
+        int num_lmks = uniform_size(rng);
+        std::uniform_int_distribution<int> uniform_lmk(0, num_lmks - 1);
+
+        std::vector<da::SparseCostMatrix::Entry> entries;
+        for (int m = 0; m < num_meas; m++)
+        {
+            std::vector<int> candidates;
+            for (int k = num_candidates(rng); k > 0; k--)
+            {
+                candidates.push_back(uniform_lmk(rng));
+            }
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+            for (int l : candidates)
+            {
+                entries.push_back({m, l, uniform_cost(rng)});
+            }
+        }
+        da::SparseCostMatrix costs(num_meas, num_lmks, entries);
+
+        std::vector<int> clustered(num_meas, -2);
+        int num_assigned_rows = 0;
+        for (const da::AssignmentCluster &cluster : da::cluster_assignment(costs))
+        {
+            std::vector<int> local = da::is_trivial(cluster) ? da::trivial_assignment(cluster, unassigned_cost)
+                                                             : da::sparse_assignment(cluster.costs, unassigned_cost);
+            for (int r = 0; r < cluster.rows.size(); r++)
+            {
+                clustered[cluster.rows[r]] = local[r] == -1 ? -1 : cluster.cols[local[r]];
+                num_assigned_rows++;
+            }
+        }
+
+        // Every row in exactly one cluster, and no landmark used twice
+        bool valid = num_assigned_rows == num_meas;
+        std::vector<bool> used(num_lmks, false);
+        for (int m = 0; m < num_meas; m++)
+        {
+            int l = clustered[m];
+            valid = valid && l >= -1;
+            if (l >= 0)
+            {
+                valid = valid && !used[l];
+                used[l] = true;
+            }
+        }
+
+        double clustered_cost = valid ? da::assignment_cost(costs, clustered, unassigned_cost) : 0.0;
+        double global_cost = da::assignment_cost(costs, da::sparse_assignment(costs, unassigned_cost), unassigned_cost);
+
+        if (!valid || std::abs(clustered_cost - global_cost) > 1e-9)
+        {
+            std::cout << "Problem " << problem << " (" << num_meas << " x " << num_lmks << "): "
+                      << (valid ? "" : "invalid assignment, ")
+                      << "clustered cost " << clustered_cost << ", global cost " << global_cost << "\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -258,7 +258,10 @@ int main(int argc, char **argv)
     marginals = gtsam::Marginals(isam_graph, curr_estimates);
     joint_marginals = marginals.jointMarginalCovariance(graph_keys);
 
-    da::hypothesis::Hypothesis h = ml.associate(curr_estimates, marginals, measurements);
+    slam::CovarianceRecovery covariance_recovery;
+    covariance_recovery.update(isam, 0);
+
+    da::hypothesis::Hypothesis h = ml.associate(curr_estimates, slam::KeyRegistry<gtsam::Point2>::fromValues(curr_estimates), covariance_recovery, measurements);
     const auto &assos = h.associations();
 
     while (viz::running() && !next_timestep)
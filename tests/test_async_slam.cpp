@@ -0,0 +1,232 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/Marginals.h>
+#include <gtsam/slam/BetweenFactor.h>
+
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "data_association/ml/MaximumLikelihood.h"
+#include "slam/async_slam.h"
+#include "slam/covariance_recovery.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+
+using gtsam::symbol_shorthand::L;
+
+/*
+ * Runs the same small 2D scene through SLAM and the pipelined AsyncSLAM. Waiting for the latest estimate should give
+ * exactly the hypotheses of SLAM. Associating against stale estimates should still finish every timestep in order,
+ * never against an estimate older than allowed, and associate reobserved landmarks from before the stale window.
+ * Both should hold with batch and incremental back ends. Poses dead-reckoned past an estimate should get the same
+ * covariances as factorizing the graph with their odometry added.
+ */
+
+int main(int argc, char **argv)
+{
+    const std::vector<gtsam::Point2> landmarks = {
+        {5.0, 1.0}, {6.0, -2.0}, {3.0, 4.0}, {8.0, 0.5}, {4.0, -3.0}, {7.0, 3.0}};
+    const gtsam::Pose2 odom(0.5, 0.0, 0.05);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    std::vector<slam::Timestep2D> timesteps;
+    gtsam::Pose2 x;
+    for (int step = 0; step < 20; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        // Every landmark is seen at the first pose, later only some of them
+        for (size_t l = 0; l < landmarks.size(); l++)
+        {
+            if (step == 0 || (l + step) % 3 != 0)
+            {
+                timestep.measurements.push_back({x.transformTo(landmarks[l]), l, meas_noise});
+            }
+        }
+        timesteps.push_back(timestep);
+    }
+
+    const double sigmas = std::sqrt(da::chi2inv(0.99, 2));
+    const gtsam::Vector3 pose_prior_noise(1e-3, 1e-3, 1e-4);
+
+    int failures = 0;
+
+    for (slam::OptimizationMethod method : {slam::OptimizationMethod::GaussNewton, slam::OptimizationMethod::ISAM2})
+    {
+        slam::SLAM2D sync_slam;
+        sync_slam.initialize(pose_prior_noise, std::make_shared<da::ml::MaximumLikelihood2D>(sigmas), method);
+        std::vector<da::hypothesis::Hypothesis> expected;
+        for (const auto &timestep : timesteps)
+        {
+            sync_slam.processTimestep(timestep);
+            expected.push_back(sync_slam.latestHypothesis());
+        }
+
+        for (slam::AssociationPolicy policy : {slam::AssociationPolicy::WaitForLatest, slam::AssociationPolicy::LatestAvailable})
+        {
+            const size_t max_staleness = 2;
+            slam::AsyncSLAM2D async_slam(2);
+            async_slam.initialize(pose_prior_noise, std::make_shared<da::ml::MaximumLikelihood2D>(sigmas), policy, max_staleness, method);
+            std::stringstream ss;
+            ss << method << ", " << policy;
+            const std::string name = ss.str();
+
+            // The landmarks must be mapped before anything is associated against a stale estimate
+            std::vector<std::future<slam::AsyncSLAM2D::TimestepResult>> futures;
+            futures.push_back(async_slam.processTimestep(timesteps[0]));
+            futures[0].wait();
+            for (size_t i = 1; i < timesteps.size(); i++)
+            {
+                futures.push_back(async_slam.processTimestep(timesteps[i]));
+            }
+
+            // Maps read while the back end is still running only ever move forward, and always hold whole timesteps
+            uint64_t last_version = 0;
+            while (futures.back().wait_for(std::chrono::milliseconds(0)) != std::future_status::ready)
+            {
+                std::shared_ptr<const slam::MapSnapshot<gtsam::Pose2, gtsam::Point2>> map = async_slam.mapSnapshot();
+                if (map->version < last_version || map->trajectory.size() > timesteps.size() || map->landmarks.size() != landmarks.size())
+                {
+                    std::cout << name << ": map version " << map->version << " after " << last_version << " has "
+                              << map->trajectory.size() << " poses and " << map->landmarks.size() << " landmarks\n";
+                    failures++;
+                    break;
+                }
+                last_version = map->version;
+            }
+
+            for (size_t i = 0; i < futures.size(); i++)
+            {
+                slam::AsyncSLAM2D::TimestepResult result = futures[i].get();
+                const auto &timestep = timesteps[i];
+
+                size_t oldest = policy == slam::AssociationPolicy::WaitForLatest ? i : (i > max_staleness ? i - max_staleness : 0);
+                if (result.step != timestep.step || result.associated_against < oldest || result.associated_against > i)
+                {
+                    std::cout << name << ": timestep " << i << " came back as " << result.step << ", associated against "
+                              << result.associated_against << " timesteps\n";
+                    failures++;
+                }
+
+                for (const auto &a : result.hypothesis.associations())
+                {
+                    bool ok;
+                    if (policy == slam::AssociationPolicy::WaitForLatest)
+                    {
+                        ok = false;
+                        for (const auto &e : expected[i].associations())
+                        {
+                            if (e->measurement == a->measurement)
+                            {
+                                ok = a->associated() == e->associated() && (!a->associated() || *a->landmark == *e->landmark);
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // Only landmarks from the first timestep exist, and they are in every estimate after it
+                        ok = i == 0 ? !a->associated() : (a->associated() && *a->landmark == L(timestep.measurements[a->measurement].idx));
+                    }
+                    if (!ok)
+                    {
+                        std::cout << name << ": timestep " << i << ", measurement " << a->measurement << " associated differently\n";
+                        failures++;
+                    }
+                }
+            }
+
+            std::shared_ptr<const slam::MapSnapshot<gtsam::Pose2, gtsam::Point2>> map = async_slam.mapSnapshot();
+            const gtsam::Values &estimates = async_slam.currentEstimates();
+            bool map_matches = map->trajectory.size() == timesteps.size() && map->landmarks.size() == landmarks.size();
+            for (size_t i = 0; map_matches && i < map->trajectory.size(); i++)
+            {
+                map_matches = map->trajectory[i].equals(estimates.at<gtsam::Pose2>(slam::X(i)));
+            }
+            for (size_t j = 0; map_matches && j < map->landmarks.size(); j++)
+            {
+                map_matches = map->landmarks[j].isApprox(estimates.at<gtsam::Point2>(L(j)));
+            }
+            if (!map_matches)
+            {
+                std::cout << name << ": final map does not match the estimates\n";
+                failures++;
+            }
+
+            slam::AsyncSLAM2D::Stats stats = async_slam.stats();
+            std::cout << name << ": " << stats.throughput() << " timesteps per second, overlap " << stats.overlap()
+                      << " s, mean latency " << stats.mean_latency << " s\n";
+            if (stats.timesteps != timesteps.size() || std::abs(async_slam.error() - sync_slam.error()) > 1e-6)
+            {
+                std::cout << name << ": " << stats.timesteps << " timesteps done, error " << async_slam.error()
+                          << " against " << sync_slam.error() << "\n";
+                failures++;
+            }
+        }
+    }
+
+    // Two poses past the estimate of the synchronous run, against the graph factorized with their odometry
+    {
+        slam::SLAM2D sync_slam;
+        sync_slam.initialize(pose_prior_noise, std::make_shared<da::ml::MaximumLikelihood2D>(sigmas));
+        for (const auto &timestep : timesteps)
+        {
+            sync_slam.processTimestep(timestep);
+        }
+        const gtsam::Key x = sync_slam.latestPoseKey();
+        const gtsam::Key x1 = slam::X(gtsam::Symbol(x).index() + 1);
+        const gtsam::Key x2 = slam::X(gtsam::Symbol(x).index() + 2);
+
+        gtsam::NonlinearFactorGraph graph = sync_slam.getGraph();
+        gtsam::Values estimates = sync_slam.currentEstimates();
+        graph.add(gtsam::BetweenFactor<gtsam::Pose2>(x, x1, odom, odom_noise));
+        graph.add(gtsam::BetweenFactor<gtsam::Pose2>(x1, x2, odom, odom_noise));
+        estimates.insert(x1, estimates.at<gtsam::Pose2>(x) * odom);
+        estimates.insert(x2, estimates.at<gtsam::Pose2>(x1) * odom);
+        gtsam::Marginals batch(graph, estimates);
+
+        slam::CovarianceRecovery predicted;
+        predicted.update(sync_slam.getGraph(), sync_slam.currentEstimates(), 0);
+        gtsam::Matrix H;
+        sync_slam.currentEstimates().at<gtsam::Pose2>(x).compose(odom, H);
+        predicted.addPrediction(x1, x, H, odom_noise->covariance());
+        estimates.at<gtsam::Pose2>(x1).compose(odom, H);
+        predicted.addPrediction(x2, x1, H, odom_noise->covariance());
+
+        gtsam::KeyVector keys{x, x1, x2, L(0), L(3)};
+        gtsam::Matrix expected_joint = gtsam::Matrix::Zero(3 * 3 + 2 * 2, 3 * 3 + 2 * 2);
+        {
+            gtsam::JointMarginal joint = batch.jointMarginalCovariance(keys);
+            std::vector<int> offsets{0, 3, 6, 9, 11};
+            for (size_t a = 0; a < keys.size(); a++)
+            {
+                for (size_t b = 0; b < keys.size(); b++)
+                {
+                    gtsam::Matrix block = joint(keys[a], keys[b]);
+                    expected_joint.block(offsets[a], offsets[b], block.rows(), block.cols()) = block;
+                }
+            }
+        }
+        gtsam::Matrix joint = predicted.jointMarginalCovariance(keys);
+        if (!joint.isApprox(expected_joint, 1e-6) || !predicted.marginalCovariance(x2).isApprox(batch.marginalCovariance(x2), 1e-6))
+        {
+            std::cout << "Covariances of dead-reckoned poses differ from factorizing them\n"
+                      << joint << "\nagainst\n" << expected_joint << "\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "data_association/Auction.h"
+#include "data_association/SparseAssignment.h"
+#include "utils/thread_pool.h"
+
+/*
+ * Checks the epsilon-scaling auction against the sparse shortest augmenting path solver on random ML-shaped problems:
+ * the primal must be within the reported gap of the optimum, the gap within (num_rows + num_cols) * eps_final,
+ * and the solution must not depend on the number of threads.
+ */
+
+int main(int argc, char **argv)
+{
+    const double unassigned_cost = 10.0;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> uniform_cost(0.0, 15.0);
+    std::uniform_int_distribution<int> uniform_size(1, 200);
+    std::bernoulli_distribution feasible(0.05);
+
+    utils::ThreadPool thread_pool(4);
+    da::AuctionParams params;
+
+    int failures = 0;
+    for (int problem = 0; problem < 200; problem++)
+    {
+        int num_meas = uniform_size(rng);
+        int num_lmks = uniform_size(rng);
+
+        std::vector<da::SparseCostMatrix::Entry> entries;
+        for (int m = 0; m < num_meas; m++)
+        {
+            for (int l = 0; l < num_lmks; l++)
+            {
+                if (feasible(rng))
+                {
+                    entries.push_back({m, l, uniform_cost(rng)});
+                }
+            }
+        }
+        da::SparseCostMatrix costs(num_meas, num_lmks, entries);
+
+        double optimal = da::assignment_cost(costs, da::sparse_assignment(costs, unassigned_cost), unassigned_cost);
+        da::AuctionResult serial = da::auction(costs, unassigned_cost, params);
+        da::AuctionResult parallel = da::auction(costs, unassigned_cost, params, &thread_pool);
+
+        bool ok = serial.converged;
+        ok = ok && std::abs(serial.primal - da::assignment_cost(costs, serial.assignment, unassigned_cost)) < 1e-9;
+        ok = ok && serial.primal >= optimal - 1e-9 && serial.primal - optimal <= serial.gap + 1e-9;
+        ok = ok && serial.dual <= optimal + 1e-9;
+        ok = ok && serial.gap <= (num_meas + num_lmks) * params.eps_final + 1e-9;
+        ok = ok && serial.assignment == parallel.assignment;
+
+        if (!ok)
+        {
+            std::cout << "Problem " << problem << " (" << num_meas << " x " << num_lmks << "): optimal " << optimal
+                      << ", auction primal " << serial.primal << ", dual " << serial.dual << ", gap " << serial.gap
+                      << ", converged " << serial.converged
+                      << ", same as parallel " << (serial.assignment == parallel.assignment) << "\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
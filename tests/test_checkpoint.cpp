@@ -0,0 +1,402 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/LinearContainerFactor.h>
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "data_association/gt/KnownDataAssociation.h"
+#include "slam/checkpoint.h"
+#include "slam/crash_dump.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+
+using gtsam::symbol_shorthand::L;
+
+/*
+ * Runs SLAM through a short scene in one go, and again stopping halfway to save a checkpoint, which a fresh SLAM
+ * loads and carries on from. Both runs should have the same estimates after every step, exactly for batch Gauss-Newton
+ * and close to for iSAM2, which rebuilds its Bayes tree on load. Corrupt and mismatched checkpoints should be refused,
+ * with std::runtime_error even where a corrupt count would otherwise size an allocation.
+ * Crash dumps use the same encoding, and should give back the graph and estimates of the exception they came from.
+ * SLAM should keep its own graph and estimates when it throws, so it can still be inspected and checkpointed, and share
+ * them with the exception, which should still hold them as thrown after SLAM carries on.
+ * The graph of a fixed lag smoother has the marginals of what left its window but no empty slots, and should dump
+ * with an empty slot added too.
+ * Constrained noise should keep its mu, and robust noise should be refused rather than written as what it wraps.
+ */
+
+const std::string CHECKPOINT_FILE = "test_checkpoint.bin";
+
+std::vector<slam::Timestep2D> makeTimesteps(std::map<uint64_t, gtsam::Key> &meas_lmk_assos)
+{
+    const gtsam::Pose2 odom(1.0, 0.0, 0.1);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    // Landmarks on a circle around the path, each seen from the poses nearby, with a small error on every measurement
+    std::vector<slam::Timestep2D> timesteps;
+    gtsam::Pose2 x;
+    uint64_t meas_id = 0;
+    for (int step = 0; step < 20; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        for (int l = step - 2; l <= step + 2; l++)
+        {
+            if (l >= 0)
+            {
+                gtsam::Point2 lmk(5.0 * std::cos(0.1 * l), 5.0 * std::sin(0.1 * l));
+                gtsam::Point2 error(0.01 * ((meas_id % 3) - 1.0), 0.01 * ((meas_id % 5) - 2.0));
+                meas_lmk_assos[meas_id] = L(l);
+                timestep.measurements.push_back({x.transformTo(lmk) + error, meas_id++, meas_noise});
+            }
+        }
+        timesteps.push_back(timestep);
+    }
+    return timesteps;
+}
+
+// Fails every association, as covariance recovery does on an indeterminant system
+class IndeterminantAssociation : public da::DataAssociation<slam::Measurement2D>
+{
+public:
+    da::hypothesis::Hypothesis associate(const gtsam::Values &estimates, const slam::KeyRegistry<gtsam::Point2> &registry,
+                                         const slam::CovarianceRecovery &marginals, const gtsam::FastVector<slam::Measurement2D> &measurements) override
+    {
+        throw gtsam::IndeterminantLinearSystemException(registry.latestPose());
+    }
+};
+
+void initialize(slam::SLAM2D &slam_sys, slam::OptimizationMethod method, const std::map<uint64_t, gtsam::Key> &meas_lmk_assos)
+{
+    slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos),
+                        method, gtsam::Marginals::CHOLESKY);
+}
+
+int main(int argc, char **argv)
+{
+    std::map<uint64_t, gtsam::Key> meas_lmk_assos;
+    const std::vector<slam::Timestep2D> timesteps = makeTimesteps(meas_lmk_assos);
+    const int stop_after = 9;
+
+    int failures = 0;
+    for (slam::OptimizationMethod method : {slam::OptimizationMethod::GaussNewton, slam::OptimizationMethod::ISAM2})
+    {
+        std::stringstream name;
+        name << method;
+        // The rebuilt Bayes tree solves exactly, the uninterrupted one up to the wildfire threshold of iSAM2
+        const double tol = method == slam::OptimizationMethod::GaussNewton ? 1e-9 : 1e-3;
+
+        slam::SLAM2D uninterrupted;
+        initialize(uninterrupted, method, meas_lmk_assos);
+        std::vector<gtsam::Values> uninterrupted_estimates;
+        for (const auto &timestep : timesteps)
+        {
+            uninterrupted.processTimestep(timestep);
+            uninterrupted_estimates.push_back(uninterrupted.currentEstimates());
+        }
+
+        size_t checkpoint_size = 0;
+        {
+            slam::SLAM2D first_half;
+            initialize(first_half, method, meas_lmk_assos);
+            for (const auto &timestep : timesteps)
+            {
+                if (timestep.step > stop_after)
+                {
+                    break;
+                }
+                first_half.processTimestep(timestep);
+            }
+            first_half.saveCheckpoint(CHECKPOINT_FILE);
+        }
+        {
+            std::ifstream is(CHECKPOINT_FILE, std::ios::binary | std::ios::ate);
+            checkpoint_size = is.tellg();
+        }
+
+        slam::SLAM2D resumed;
+        initialize(resumed, method, meas_lmk_assos);
+        resumed.loadCheckpoint(CHECKPOINT_FILE);
+        if (resumed.latestStep() != stop_after)
+        {
+            std::cout << name.str() << ": resumed after step " << resumed.latestStep() << ", expected " << stop_after << "\n";
+            failures++;
+        }
+        if (!resumed.currentEstimates().equals(uninterrupted_estimates[stop_after], tol))
+        {
+            std::cout << name.str() << ": resumed with other estimates than were saved\n";
+            failures++;
+        }
+        // Every step after resuming, not just the last, so a drift that settles again is still caught
+        for (const auto &timestep : timesteps)
+        {
+            if (timestep.step > resumed.latestStep())
+            {
+                resumed.processTimestep(timestep);
+                if (!resumed.currentEstimates().equals(uninterrupted_estimates[timestep.step], tol))
+                {
+                    std::cout << name.str() << ": resumed run has other estimates than the uninterrupted one after step "
+                              << timestep.step << "\n";
+                    failures++;
+                }
+            }
+        }
+
+        if (resumed.getGraph().size() != uninterrupted.getGraph().size() ||
+            resumed.currentEstimates().size() != uninterrupted.currentEstimates().size())
+        {
+            std::cout << name.str() << ": resumed run has " << resumed.getGraph().size() << " factors and "
+                      << resumed.currentEstimates().size() << " variables, uninterrupted " << uninterrupted.getGraph().size()
+                      << " and " << uninterrupted.currentEstimates().size() << "\n";
+            failures++;
+        }
+        else if (!resumed.currentEstimates().equals(uninterrupted.currentEstimates(), tol))
+        {
+            std::cout << name.str() << ": resumed run ended with other estimates than the uninterrupted one\n";
+            failures++;
+        }
+
+        // Cut off halfway through the graph
+        {
+            std::ifstream is(CHECKPOINT_FILE, std::ios::binary);
+            std::vector<char> bytes(checkpoint_size / 2);
+            is.read(bytes.data(), bytes.size());
+            std::ofstream os(CHECKPOINT_FILE, std::ios::binary | std::ios::trunc);
+            os.write(bytes.data(), bytes.size());
+        }
+        try
+        {
+            slam::SLAM2D truncated;
+            initialize(truncated, method, meas_lmk_assos);
+            truncated.loadCheckpoint(CHECKPOINT_FILE);
+            std::cout << name.str() << ": truncated checkpoint was loaded\n";
+            failures++;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+
+    // A corrupt factor count, far more than the file could hold, must not be used to size the graph
+    {
+        slam::CheckpointWriter writer;
+        writer.write<uint64_t>(uint64_t(1) << 60);
+        writer.save(CHECKPOINT_FILE);
+        try
+        {
+            slam::CheckpointReader(CHECKPOINT_FILE).readGraph();
+            std::cout << "Graph with a corrupt factor count was read\n";
+            failures++;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+
+    // Saved by batch optimization, can not be resumed by iSAM2
+    {
+        slam::SLAM2D batch;
+        initialize(batch, slam::OptimizationMethod::GaussNewton, meas_lmk_assos);
+        batch.processTimestep(timesteps[0]);
+        batch.saveCheckpoint(CHECKPOINT_FILE);
+        try
+        {
+            slam::SLAM2D incremental;
+            initialize(incremental, slam::OptimizationMethod::ISAM2, meas_lmk_assos);
+            incremental.loadCheckpoint(CHECKPOINT_FILE);
+            std::cout << "Checkpoint of another optimization method was loaded\n";
+            failures++;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+
+    {
+        slam::SLAM2D slam_sys;
+        initialize(slam_sys, slam::OptimizationMethod::GaussNewton, meas_lmk_assos);
+        for (int step = 0; step <= stop_after; step++)
+        {
+            slam_sys.processTimestep(timesteps[step]);
+        }
+        const gtsam::Key nearby = L(3);
+        slam::IndeterminantLinearSystemExceptionWithGraphValues err(
+            gtsam::IndeterminantLinearSystemException(nearby),
+            std::make_shared<const gtsam::NonlinearFactorGraph>(slam_sys.getGraph()),
+            std::make_shared<const gtsam::Values>(slam_sys.currentEstimates()), stop_after, "Error when computing marginals!");
+
+        // Thrown by value, the copy should share the graph rather than own another one
+        slam::IndeterminantLinearSystemExceptionWithGraphValues copy = err;
+        if (copy.graph != err.graph || copy.values != err.values)
+        {
+            std::cout << "Copying the exception copied the graph\n";
+            failures++;
+        }
+
+        copy.dump(CHECKPOINT_FILE);
+        slam::CrashDump dump = slam::loadCrashDump(CHECKPOINT_FILE);
+        if (dump.step != stop_after || dump.nearby_variable != nearby || dump.when != err.when)
+        {
+            std::cout << "Crash dump is from step " << dump.step << " near " << gtsam::Symbol(dump.nearby_variable)
+                      << " when \"" << dump.when << "\"\n";
+            failures++;
+        }
+        if (dump.graph.size() != err.graph->size() || !dump.values.equals(*err.values, 1e-12) ||
+            std::abs(dump.graph.error(dump.values) - err.graph->error(*err.values)) > 1e-9)
+        {
+            std::cout << "Crash dump has other factors or values than the exception\n";
+            failures++;
+        }
+    }
+
+    {
+        slam::SLAM2D slam_sys;
+        slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos),
+                            slam::OptimizationMethod::FixedLag, gtsam::Marginals::CHOLESKY, 3.0);
+        for (const auto &timestep : timesteps)
+        {
+            slam_sys.processTimestep(timestep);
+        }
+        size_t empty = 0;
+        size_t marginals = 0;
+        for (const auto &factor : slam_sys.getGraph())
+        {
+            empty += !factor;
+            marginals += static_cast<bool>(boost::dynamic_pointer_cast<gtsam::LinearContainerFactor>(factor));
+        }
+        if (empty != 0 || marginals == 0)
+        {
+            std::cout << "Fixed lag graph has " << empty << " empty slots and " << marginals << " marginal factors, expected no empty slots and some marginals\n";
+            failures++;
+        }
+
+        // The smoother's own graph has an empty slot for every factor it marginalized out, so dumps may have them
+        auto graph = std::make_shared<gtsam::NonlinearFactorGraph>(slam_sys.getGraph());
+        graph->resize(graph->size() + 1);
+        empty = 1;
+        slam::IndeterminantLinearSystemExceptionWithGraphValues err(
+            gtsam::IndeterminantLinearSystemException(slam_sys.latestPoseKey()), graph,
+            std::make_shared<const gtsam::Values>(slam_sys.currentEstimates()), slam_sys.latestStep(), "Error when optimizing!");
+        if (!err.dump(CHECKPOINT_FILE))
+        {
+            std::cout << "Fixed lag crash dump could not be written\n";
+            failures++;
+        }
+        else
+        {
+            slam::CrashDump dump = slam::loadCrashDump(CHECKPOINT_FILE);
+            size_t dump_empty = 0;
+            for (size_t i = 0; i < dump.graph.size(); i++)
+            {
+                dump_empty += !dump.graph[i];
+            }
+            if (dump.graph.size() != err.graph->size() || dump_empty != empty || !dump.values.equals(*err.values, 1e-12) ||
+                std::abs(dump.graph.error(dump.values) - err.graph->error(*err.values)) > 1e-9)
+            {
+                std::cout << "Fixed lag crash dump has other factors or values than the exception\n";
+                failures++;
+            }
+        }
+
+        // Reported rather than thrown, as it is called from catch handlers
+        if (err.dump("/nonexistent/directory/crash"))
+        {
+            std::cout << "Crash dump written to a directory that does not exist\n";
+            failures++;
+        }
+    }
+
+    {
+        slam::SLAM2D slam_sys;
+        slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), std::make_shared<IndeterminantAssociation>(), slam::OptimizationMethod::GaussNewton);
+        slam::Timestep2D odometry_only = timesteps[1];
+        odometry_only.measurements.clear();
+        slam_sys.processTimestep(timesteps[0]);
+        slam_sys.processTimestep(odometry_only);
+        const size_t factors = slam_sys.getGraph().size();
+        const size_t values = slam_sys.currentEstimates().size();
+        try
+        {
+            slam_sys.processTimestep(timesteps[2]);
+            std::cout << "Failing association did not throw\n";
+            failures++;
+        }
+        catch (const slam::IndeterminantLinearSystemExceptionWithGraphValues &err)
+        {
+            // The odometry of the failed timestep was added before associating
+            if (slam_sys.getGraph().size() < factors || slam_sys.currentEstimates().size() < values ||
+                err.graph->size() != slam_sys.getGraph().size() || err.values->size() != slam_sys.currentEstimates().size() ||
+                std::abs(slam_sys.error() - err.graph->error(*err.values)) > 1e-12)
+            {
+                std::cout << "SLAM has " << slam_sys.getGraph().size() << " factors and " << slam_sys.currentEstimates().size()
+                          << " variables after throwing, the exception " << err.graph->size() << " and " << err.values->size() << "\n";
+                failures++;
+            }
+            slam_sys.saveCheckpoint(CHECKPOINT_FILE);
+
+            // Shared rather than copied when thrown, and left as they were when SLAM carries on
+            if (err.graph.get() != &slam_sys.getGraph() || err.values.get() != &slam_sys.currentEstimates())
+            {
+                std::cout << "The exception holds copies of the graph and estimates of SLAM\n";
+                failures++;
+            }
+            const size_t thrown_factors = err.graph->size();
+            const size_t thrown_values = err.values->size();
+            slam::Timestep2D next_odometry_only = timesteps[3];
+            next_odometry_only.measurements.clear();
+            slam_sys.processTimestep(next_odometry_only);
+            if (err.graph->size() != thrown_factors || err.values->size() != thrown_values ||
+                slam_sys.getGraph().size() <= thrown_factors || slam_sys.currentEstimates().size() <= thrown_values)
+            {
+                std::cout << "After carrying on, SLAM has " << slam_sys.getGraph().size() << " factors and the exception "
+                          << err.graph->size() << ", thrown with " << thrown_factors << "\n";
+                failures++;
+            }
+        }
+    }
+
+    {
+        slam::CheckpointWriter writer;
+        auto constrained = gtsam::noiseModel::Constrained::MixedSigmas(gtsam::Vector3(100.0, 100.0, 100.0), gtsam::Vector3(0.0, 0.1, 0.0));
+        writer.writeNoise(constrained);
+        writer.save(CHECKPOINT_FILE);
+        slam::CheckpointReader reader(CHECKPOINT_FILE);
+        auto read = boost::dynamic_pointer_cast<gtsam::noiseModel::Constrained>(reader.readNoise());
+        if (!read || !read->sigmas().isApprox(constrained->sigmas()) || !read->mu().isApprox(constrained->mu()))
+        {
+            std::cout << "Constrained noise did not come back constrained\n";
+            failures++;
+        }
+
+        try
+        {
+            writer.writeNoise(gtsam::noiseModel::Robust::Create(gtsam::noiseModel::mEstimator::Huber::Create(1.345),
+                                                                gtsam::noiseModel::Isotropic::Sigma(2, 0.1)));
+            std::cout << "Robust noise was written\n";
+            failures++;
+        }
+        catch (const std::runtime_error &)
+        {
+        }
+    }
+
+    std::remove(CHECKPOINT_FILE.c_str());
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam_unstable/slam/PoseToPointFactor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+#include "data_association/DataAssociation.h"
+#include "data_association/Hypothesis.h"
+#include "slam/types.h"
+#include "test_utils.h"
+
+using gtsam::symbol_shorthand::L;
+using gtsam::symbol_shorthand::X;
+
+/*
+ * The fixed size CompatibilityKernel should give the innovation, innovation covariance, NIS and log|S| that the
+ * dynamically sized individual_compatability gives, with the Jacobians and innovation from gtsam::PoseToPointFactor,
+ * for random poses, landmarks, measurements, noise and joint covariances in 2D and 3D.
+ */
+
+// Joint covariance of one pose and one landmark, indexable as joint_marginals(i, j) like gtsam::JointMarginal
+struct JointMarginal
+{
+    gtsam::Key x_key;
+    int pose_dim;
+    gtsam::Matrix P;
+
+    gtsam::Matrix operator()(gtsam::Key i, gtsam::Key j) const
+    {
+        const int ri = i == x_key ? 0 : pose_dim;
+        const int rj = j == x_key ? 0 : pose_dim;
+        const int ni = i == x_key ? pose_dim : P.rows() - pose_dim;
+        const int nj = j == x_key ? pose_dim : P.rows() - pose_dim;
+        return P.block(ri, rj, ni, nj);
+    }
+};
+
+template <class POSE, class POINT>
+int compareKernel(const std::string &name)
+{
+    using Kernel = da::CompatibilityKernel<POSE, POINT>;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> u(-5.0, 5.0);
+    std::uniform_real_distribution<double> sigma(0.01, 1.0);
+    const double tol = 1e-9;
+
+    int failures = 0;
+    for (int trial = 0; trial < 500; trial++)
+    {
+        const POSE x = randomPose(rng, static_cast<POSE *>(nullptr));
+        POINT l;
+        POINT z;
+        gtsam::Vector sigmas(Kernel::PointDim);
+        for (int i = 0; i < Kernel::PointDim; i++)
+        {
+            l(i) = u(rng);
+            z(i) = u(rng);
+            sigmas(i) = sigma(rng);
+        }
+        const gtsam::SharedNoiseModel noise = gtsam::noiseModel::Diagonal::Sigmas(sigmas);
+
+        // Random, positive definite, and in some trials badly conditioned
+        gtsam::Matrix A(Kernel::JointDim, Kernel::JointDim);
+        for (int r = 0; r < A.rows(); r++)
+        {
+            for (int c = 0; c < A.cols(); c++)
+            {
+                A(r, c) = 0.3 * u(rng);
+            }
+        }
+        const double ridge = trial % 10 == 0 ? 1e-8 : 1e-2;
+        const JointMarginal marginal{X(0), Kernel::PoseDim, A * A.transpose() + ridge * gtsam::Matrix::Identity(A.rows(), A.cols())};
+
+        // Dynamic, with the Jacobians of the factor the measurement becomes
+        gtsam::Matrix Hx, Hl;
+        const gtsam::Vector error = gtsam::PoseToPointFactor<POSE, POINT>(X(0), L(0), z, noise).evaluateError(x, l, Hx, Hl);
+        gtsam::FastVector<slam::Measurement<POINT>> measurements{{z, 0, noise}};
+        const da::hypothesis::Association a(0, L(0), Hx, Hl, error);
+        double log_norm_factor = 0.0;
+        Eigen::MatrixXd S(Kernel::PointDim, Kernel::PointDim);
+        const double nis = da::individual_compatability(a, X(0), marginal, measurements, std::ref(log_norm_factor),
+                                                        Eigen::Ref<Eigen::MatrixXd>(S));
+
+        // Fixed size
+        typename Kernel::JacobianPose kHx;
+        typename Kernel::JacobianPoint kHl;
+        const typename Kernel::Innovation innov = Kernel::innovation(x, l, z, kHx, kHl);
+        const typename Kernel::JointCovariance P = Kernel::jointCovariance(marginal, X(0), L(0));
+        typename Kernel::Covariance kS = Kernel::innovationCovariance(kHx, kHl, P, Kernel::noiseCovariance(noise));
+        const typename Kernel::Covariance kS_unfactorized = kS;
+        double log_det = 0.0;
+        const double knis = Kernel::nis(kS, innov, &log_det);
+
+        if (relativeDifference(innov, error) > tol || relativeDifference(kHx, Hx) > tol || relativeDifference(kHl, Hl) > tol)
+        {
+            std::cout << name << ", trial " << trial << ": innovation or Jacobians differ from PoseToPointFactor\n";
+            failures++;
+        }
+        if (relativeDifference(P, marginal.P) > tol || relativeDifference(kS_unfactorized, S) > tol)
+        {
+            std::cout << name << ", trial " << trial << ": joint or innovation covariance differs, off by "
+                      << relativeDifference(kS_unfactorized, S) << "\n";
+            failures++;
+        }
+        if (std::abs(knis - nis) > 1e-7 * std::max(1.0, std::abs(nis)) ||
+            std::abs(log_det - log_norm_factor) > 1e-9 * std::max(1.0, std::abs(log_norm_factor)))
+        {
+            std::cout << name << ", trial " << trial << ": NIS " << knis << " and log|S| " << log_det << ", dynamically "
+                      << nis << " and " << log_norm_factor << "\n";
+            failures++;
+        }
+    }
+
+    // Not positive definite, the kernel gives infinity rather than a number from a failed factorization
+    typename Kernel::Covariance S = -Kernel::Covariance::Identity();
+    double log_det = 0.0;
+    if (!std::isinf(Kernel::nis(S, Kernel::Innovation::Ones(), &log_det)) || !std::isinf(log_det))
+    {
+        std::cout << name << ": NIS of an indefinite innovation covariance is not infinite\n";
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = compareKernel<gtsam::Pose2, gtsam::Point2>("2D") + compareKernel<gtsam::Pose3, gtsam::Point3>("3D");
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include "data_association/ml/MaximumLikelihood.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+
+/*
+ * Drives past a row of landmarks with fixed-lag smoothing, seeing each for a few timesteps only. After every timestep
+ * the smoother should hold no variable older than the lag, the window estimates and registry should be those of the
+ * smoother, and the graph should have no empty slots, while the current estimates keep every variable ever added.
+ * Data association should only ever gate against landmarks in the window: at the end the first landmark is measured
+ * again, exactly where it is, and must make a new landmark rather than be associated with the marginalized one.
+ */
+
+int main(int argc, char **argv)
+{
+    const double lag = 4.0;
+    const double range = 3.0;
+    std::vector<gtsam::Point2> landmarks;
+    for (int i = 0; i < 11; i++)
+    {
+        landmarks.push_back({1.5 * i, i % 2 == 0 ? 2.0 : -2.0});
+    }
+    const gtsam::Pose2 odom(0.5, 0.0, 0.0);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    std::vector<slam::Timestep2D> timesteps;
+    gtsam::Pose2 x;
+    uint64_t idx = 0;
+    for (int step = 0; step < 30; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        for (const auto &l : landmarks)
+        {
+            if ((l - x.translation()).norm() < range)
+            {
+                timestep.measurements.push_back({x.transformTo(l), idx++, meas_noise});
+            }
+        }
+        timesteps.push_back(timestep);
+    }
+    // Back where the first landmark was seen from, long after it left the window
+    slam::Timestep2D revisit;
+    revisit.step = timesteps.size();
+    revisit.odom = {odom, odom_noise};
+    revisit.measurements.push_back({(x * odom).transformTo(landmarks[0]), idx++, meas_noise});
+    timesteps.push_back(revisit);
+
+    slam::SLAM2D slam_sys;
+    slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), std::make_shared<da::ml::MaximumLikelihood2D>(std::sqrt(da::chi2inv(0.99, 2))),
+                        slam::OptimizationMethod::FixedLag, gtsam::Marginals::CHOLESKY, lag);
+
+    int failures = 0;
+    for (const auto &timestep : timesteps)
+    {
+        const gtsam::KeyVector before = slam_sys.registry().landmarks();
+        const std::set<gtsam::Key> window_landmarks(before.begin(), before.end());
+        slam_sys.processTimestep(timestep);
+
+        for (const auto &a : slam_sys.latestHypothesis().associations())
+        {
+            if (a->associated() && !window_landmarks.count(*a->landmark))
+            {
+                std::cout << "Timestep " << timestep.step << ": measurement " << a->measurement << " associated with "
+                          << gtsam::Symbol(*a->landmark) << ", which is not in the window\n";
+                failures++;
+            }
+        }
+        const gtsam::Values &window = slam_sys.bayesTree()->getLinearizationPoint();
+        size_t poses = 0;
+        for (const gtsam::Key key : window.keys())
+        {
+            if (gtsam::Symbol(key).chr() == 'x')
+            {
+                poses++;
+                if (gtsam::symbolIndex(key) + lag < timestep.step)
+                {
+                    std::cout << "Timestep " << timestep.step << ": " << gtsam::Symbol(key) << " is older than the lag\n";
+                    failures++;
+                }
+            }
+        }
+        if (poses > lag + 1)
+        {
+            std::cout << "Timestep " << timestep.step << ": " << poses << " poses in the window, more than the lag of " << lag << "\n";
+            failures++;
+        }
+
+        size_t window_landmark_count = window.size() - poses;
+        if (slam_sys.activeEstimates().size() != window.size() || slam_sys.registry().numLandmarks() != window_landmark_count)
+        {
+            std::cout << "Timestep " << timestep.step << ": " << slam_sys.activeEstimates().size() << " window estimates and "
+                      << slam_sys.registry().numLandmarks() << " landmarks registered, the smoother has " << window.size()
+                      << " variables and " << window_landmark_count << " landmarks\n";
+            failures++;
+        }
+        for (size_t i = 0; i <= timestep.step; i++)
+        {
+            if (!slam_sys.currentEstimates().exists(gtsam::symbol_shorthand::X(i)))
+            {
+                std::cout << "Timestep " << timestep.step << ": current estimates lost " << gtsam::Symbol(gtsam::symbol_shorthand::X(i))
+                          << ", marginalized out of the window\n";
+                failures++;
+            }
+        }
+        for (const auto &factor : slam_sys.getGraph())
+        {
+            if (!factor)
+            {
+                std::cout << "Timestep " << timestep.step << ": empty slot in the graph\n";
+                failures++;
+                break;
+            }
+        }
+    }
+
+    size_t landmarks_made = 0;
+    for (const gtsam::Key key : slam_sys.currentEstimates().keys())
+    {
+        landmarks_made += gtsam::Symbol(key).chr() == 'l';
+    }
+    if (landmarks_made <= slam_sys.registry().numLandmarks())
+    {
+        std::cout << "No landmark ever left the window\n";
+        failures++;
+    }
+    const auto &revisit_associations = slam_sys.latestHypothesis().associations();
+    if (revisit_associations.size() != 1 || revisit_associations[0]->associated())
+    {
+        std::cout << "The first landmark, long marginalized, was measured again and associated\n";
+        failures++;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "data_association/DataAssociation.h"
+#include "data_association/InnovationEngine.h"
+#include "test_utils.h"
+
+using gtsam::symbol_shorthand::L;
+
+/*
+ * InnovationEngine should give every pair of a batch the innovation, innovation covariance, NIS and log|S| that
+ * CompatibilityKernel gives the pair on its own, in 2D and 3D. Batches are of sizes around the vector width, empty and
+ * reused after reset(), with covariances taken from one random joint covariance of the pose and all landmarks so
+ * every pair is consistent with the shared pose covariance. A pair whose S is not positive definite should get
+ * infinite NIS from both, and a pair should get the same result wherever in the batch it is.
+ */
+
+// Infinite exactly when expected is, which is when S is not positive definite
+bool close(double actual, double expected, double tol)
+{
+    if (std::isinf(expected) || std::isinf(actual))
+    {
+        return std::isinf(actual) && std::isinf(expected);
+    }
+    return std::abs(actual - expected) <= tol * std::max(1.0, std::abs(expected));
+}
+
+template <class POSE, class POINT>
+int testEngine(const std::string &name)
+{
+    using Engine = da::InnovationEngine<POSE, POINT>;
+    using Kernel = da::CompatibilityKernel<POSE, POINT>;
+    const int pose_dim = Engine::PoseDim;
+    const int point_dim = Engine::PointDim;
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::uniform_real_distribution<double> coordinate(-10.0, 10.0);
+    std::uniform_real_distribution<double> variance(1e-4, 0.5);
+
+    int failures = 0;
+    Engine engine;
+    for (size_t n : {0, 1, 3, 4, 7, 8, 9, 33})
+    {
+        const POSE x = randomPose(rng, static_cast<POSE *>(nullptr));
+        gtsam::Matrix A(pose_dim + n * point_dim, pose_dim + n * point_dim);
+        for (int r = 0; r < A.rows(); r++)
+        {
+            for (int c = 0; c < A.cols(); c++)
+            {
+                A(r, c) = 0.2 * u(rng);
+            }
+        }
+        const gtsam::Matrix P = A * A.transpose() + 1e-3 * gtsam::Matrix::Identity(A.rows(), A.cols());
+        const typename Engine::PoseCovariance Pxx = P.topLeftCorner(pose_dim, pose_dim);
+
+        std::vector<POINT> z(n), l(n);
+        std::vector<typename Engine::PointVector> noise_variance(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (int k = 0; k < point_dim; k++)
+            {
+                l[i](k) = coordinate(rng);
+                noise_variance[i](k) = variance(rng);
+            }
+            z[i] = x.transformTo(l[i]) + POINT::Constant(0.1 * u(rng));
+        }
+        // Far too negative a noise variance, so S is not positive definite, in the middle of the batch
+        if (n == 9)
+        {
+            noise_variance[4] = Engine::PointVector::Constant(-100.0);
+        }
+
+        engine.reset(x, Pxx);
+        engine.reserve(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            engine.add(i, L(i), z[i], noise_variance[i], l[i], P.block(0, pose_dim + i * point_dim, pose_dim, point_dim),
+                       P.block(pose_dim + i * point_dim, pose_dim + i * point_dim, point_dim, point_dim));
+        }
+        engine.evaluate();
+        if (engine.size() != n || static_cast<size_t>(engine.nis().size()) != n)
+        {
+            std::cout << name << ": batch of " << n << " has " << engine.size() << " pairs and " << engine.nis().size() << " results\n";
+            failures++;
+            continue;
+        }
+
+        for (size_t i = 0; i < n; i++)
+        {
+            typename Kernel::JointCovariance Pjoint;
+            const int l_offset = pose_dim + i * point_dim;
+            Pjoint.topLeftCorner(pose_dim, pose_dim) = Pxx;
+            Pjoint.topRightCorner(pose_dim, point_dim) = P.block(0, l_offset, pose_dim, point_dim);
+            Pjoint.bottomLeftCorner(point_dim, pose_dim) = P.block(l_offset, 0, point_dim, pose_dim);
+            Pjoint.bottomRightCorner(point_dim, point_dim) = P.block(l_offset, l_offset, point_dim, point_dim);
+
+            typename Kernel::JacobianPose Hx;
+            typename Kernel::JacobianPoint Hl;
+            const typename Kernel::Innovation innov = Kernel::innovation(x, l[i], z[i], Hx, Hl);
+            typename Kernel::Covariance S = Kernel::innovationCovariance(Hx, Hl, Pjoint, noise_variance[i].asDiagonal());
+            const typename Kernel::Covariance S_unfactorized = S;
+            double log_det = 0.0;
+            const double nis = Kernel::nis(S, innov, &log_det);
+
+            if (engine.measurement(i) != static_cast<int>(i) || engine.landmark(i) != L(i))
+            {
+                std::cout << name << ", batch of " << n << ": pair " << i << " is of another measurement or landmark\n";
+                failures++;
+            }
+            if (relativeDifference(engine.innovation(i), innov) > 1e-9 || relativeDifference(engine.innovationCovariance(i), S_unfactorized) > 1e-9)
+            {
+                std::cout << name << ", batch of " << n << ": pair " << i << " has another innovation or innovation covariance\n";
+                failures++;
+            }
+            if (!close(engine.nis(i), nis, 1e-7) || !close(engine.logDet(i), log_det, 1e-9))
+            {
+                std::cout << name << ", batch of " << n << ": pair " << i << " has NIS " << engine.nis(i) << " and log|S| "
+                          << engine.logDet(i) << ", on its own " << nis << " and " << log_det << "\n";
+                failures++;
+            }
+        }
+
+        // The last pair, in the scalar tail of the batch for most sizes, alone in a batch of its own
+        if (n > 1)
+        {
+            const size_t last = n - 1;
+            const double batched_nis = engine.nis(last);
+            const double batched_log_det = engine.logDet(last);
+            engine.reset(x, Pxx);
+            engine.add(last, L(last), z[last], noise_variance[last], l[last],
+                       P.block(0, pose_dim + last * point_dim, pose_dim, point_dim),
+                       P.block(pose_dim + last * point_dim, pose_dim + last * point_dim, point_dim, point_dim));
+            engine.evaluate();
+            if (!close(engine.nis(0), batched_nis, 1e-12) || !close(engine.logDet(0), batched_log_det, 1e-12))
+            {
+                std::cout << name << ", batch of " << n << ": the last pair gets NIS " << engine.nis(0) << " alone and "
+                          << batched_nis << " in the batch\n";
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = testEngine<gtsam::Pose2, gtsam::Point2>("2D") + testEngine<gtsam::Pose3, gtsam::Point3>("3D");
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/Marginals.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "data_association/gt/KnownDataAssociation.h"
+#include "slam/covariance_recovery.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+#include "test_utils.h"
+
+/*
+ * Runs a small scene with noisy odometry and measurements through SLAM with Gauss-Newton and with iSAM2, in 2D and
+ * 3D, associating by ground truth so both build the same graph. Both should converge to the same estimates. The
+ * covariances CovarianceRecovery gives, from the graph for Gauss-Newton and from the Bayes tree for iSAM2, should
+ * be those gtsam::Marginals computes from the same graph at the same linearization point, marginal and joint alike.
+ */
+
+gtsam::Vector posePriorNoise(gtsam::Pose2 *) { return gtsam::Vector3(1e-3, 1e-3, 1e-4); }
+gtsam::Vector posePriorNoise(gtsam::Pose3 *) { return (gtsam::Vector(6) << 1e-4, 1e-4, 1e-4, 1e-3, 1e-3, 1e-3).finished(); }
+
+// Every marginal, and the joints of the latest pose with every landmark, against Marginals of graph at values
+int compareCovariances(const std::string &name, const slam::CovarianceRecovery &recovery, const gtsam::NonlinearFactorGraph &graph,
+                       const gtsam::Values &values, gtsam::Key latest_pose)
+{
+    int failures = 0;
+    const gtsam::Marginals marginals(graph, values);
+    const double tol = 1e-6;
+    for (const gtsam::Key key : values.keys())
+    {
+        double diff = relativeDifference(recovery.marginalCovariance(key), marginals.marginalCovariance(key));
+        if (diff > tol)
+        {
+            std::cout << name << ": marginal covariance of " << gtsam::DefaultKeyFormatter(key) << " off by " << diff << "\n";
+            failures++;
+        }
+        if (gtsam::Symbol(key).chr() != 'l')
+        {
+            continue;
+        }
+        const gtsam::Matrix expected = marginals.jointMarginalCovariance({latest_pose, key}).fullMatrix();
+        diff = relativeDifference(recovery.jointCovariance(latest_pose, key), expected);
+        if (diff > tol)
+        {
+            std::cout << name << ": joint covariance of the latest pose and " << gtsam::DefaultKeyFormatter(key) << " off by " << diff << "\n";
+            failures++;
+        }
+    }
+    return failures;
+}
+
+template <class POSE, class POINT>
+int testScene(const std::string &name)
+{
+    const size_t dim = POINT::RowsAtCompileTime;
+    std::vector<POINT> landmarks;
+    for (int i = 0; i < 8; i++)
+    {
+        landmarks.push_back(makePoint(1.0 + 1.5 * i, (i % 2 == 0 ? 2.0 : -2.0) + 0.3 * i, static_cast<POINT *>(nullptr)));
+    }
+    const POSE odom = makePose(0.6, 0.0, 0.04, static_cast<POSE *>(nullptr));
+    auto odom_noise = gtsam::noiseModel::Isotropic::Sigma(POSE::dimension, 0.05);
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(dim, 0.1);
+
+    // Deterministic noise, so there is something to converge to other than the ground truth
+    std::vector<slam::Timestep<POSE, POINT>> timesteps;
+    std::map<uint64_t, gtsam::Key> meas_lmk_assos;
+    POSE x = makePose(0.0, 0.0, 0.0, static_cast<POSE *>(nullptr));
+    uint64_t idx = 0;
+    for (size_t step = 0; step < 16; step++)
+    {
+        slam::Timestep<POSE, POINT> timestep;
+        timestep.step = step;
+        if (step > 0)
+        {
+            x = x * odom;
+            const double e = 0.02 * std::sin(1.7 * step);
+            timestep.odom = {odom * makePose(e, -e, 0.5 * e, static_cast<POSE *>(nullptr)), odom_noise};
+        }
+        for (size_t l = 0; l < landmarks.size(); l++)
+        {
+            const POINT local = x.transformTo(landmarks[l]);
+            if (local.norm() > 5.0)
+            {
+                continue;
+            }
+            const double e = 0.05 * std::cos(2.3 * idx + l);
+            timestep.measurements.push_back({local + POINT::Constant(e), idx, meas_noise});
+            meas_lmk_assos[idx++] = gtsam::symbol_shorthand::L(l);
+        }
+        timesteps.push_back(timestep);
+    }
+
+    auto run = [&](slam::OptimizationMethod method)
+    {
+        auto slam_sys = std::make_unique<slam::SLAM<POSE, POINT>>();
+        slam_sys->initialize(posePriorNoise(static_cast<POSE *>(nullptr)),
+                             std::make_shared<da::gt::KnownDataAssociation<POSE, POINT>>(meas_lmk_assos), method);
+        for (const auto &timestep : timesteps)
+        {
+            slam_sys->processTimestep(timestep);
+        }
+        slam_sys->optimizePending();
+        return slam_sys;
+    };
+    auto batch = run(slam::OptimizationMethod::GaussNewton);
+    auto incremental = run(slam::OptimizationMethod::ISAM2);
+
+    int failures = 0;
+    const gtsam::Values &expected = batch->currentEstimates();
+    const gtsam::Values &estimates = incremental->currentEstimates();
+    if (estimates.size() != expected.size() || incremental->getGraph().size() != batch->getGraph().size())
+    {
+        std::cout << name << ": iSAM2 has " << estimates.size() << " variables and " << incremental->getGraph().size()
+                  << " factors, Gauss-Newton " << expected.size() << " and " << batch->getGraph().size() << "\n";
+        return 1;
+    }
+    for (const gtsam::Key key : expected.keys())
+    {
+        if (!estimates.exists(key))
+        {
+            std::cout << name << ": iSAM2 has no " << gtsam::DefaultKeyFormatter(key) << "\n";
+            failures++;
+        }
+    }
+    if (failures == 0)
+    {
+        const double max_diff = expected.localCoordinates(estimates).vector().cwiseAbs().maxCoeff();
+        if (max_diff > 1e-3)
+        {
+            std::cout << name << ": iSAM2 estimates differ from Gauss-Newton by up to " << max_diff << "\n";
+            failures++;
+        }
+    }
+    if (std::abs(incremental->error() - batch->error()) > 1e-3 * std::max(1.0, batch->error()))
+    {
+        std::cout << name << ": iSAM2 ended at error " << incremental->error() << " against " << batch->error() << "\n";
+        failures++;
+    }
+
+    const gtsam::Key latest_pose = gtsam::symbol_shorthand::X(timesteps.size() - 1);
+    slam::CovarianceRecovery from_graph;
+    from_graph.update(batch->getGraph(), batch->currentEstimates(), 0);
+    failures += compareCovariances(name + ", Gauss-Newton", from_graph, batch->getGraph(), batch->currentEstimates(), latest_pose);
+
+    // The Bayes tree holds the graph linearized at the linearization point, not at the latest estimates
+    const gtsam::ISAM2 *isam = incremental->bayesTree();
+    slam::CovarianceRecovery from_bayes_tree;
+    from_bayes_tree.update(*isam, 0);
+    failures += compareCovariances(name + ", iSAM2", from_bayes_tree, isam->getFactorsUnsafe(), isam->getLinearizationPoint(), latest_pose);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = testScene<gtsam::Pose2, gtsam::Point2>("2D") + testScene<gtsam::Pose3, gtsam::Point3>("3D");
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/GaussNewtonOptimizer.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam_unstable/slam/PoseToPointFactor.h>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "data_association/jcbb/JCBB.h"
+#include "slam/covariance_recovery.h"
+#include "slam/key_registry.h"
+#include "slam/types.h"
+
+using gtsam::symbol_shorthand::L;
+using gtsam::symbol_shorthand::X;
+
+/*
+ * Small 2D scene with a few mapped landmarks, observed again from a new pose together with a clutter measurement.
+ * JCBB should associate every landmark correctly, leave the clutter unassociated, and report the same joint NIS
+ * as computing it from the dense joint innovation covariance, also when the joint NIS reuses scratch of a larger hypothesis.
+ */
+
+// NIS of the stacked innovations of h, with S from the dense H and joint covariance of the pose and all landmarks
+double denseNis(const da::hypothesis::Hypothesis &h, gtsam::Key x_key, const slam::CovarianceRecovery &marginals,
+                const gtsam::FastVector<slam::Measurement2D> &measurements)
+{
+    gtsam::KeyVector keys = {x_key};
+    for (const auto &a : h.associations())
+    {
+        if (a->associated())
+        {
+            keys.push_back(*a->landmark);
+        }
+    }
+    const int n = keys.size() - 1;
+    gtsam::Matrix H = gtsam::Matrix::Zero(2 * n, 3 + 2 * n);
+    gtsam::Matrix R = gtsam::Matrix::Zero(2 * n, 2 * n);
+    gtsam::Vector innov(2 * n);
+    int i = 0;
+    for (const auto &a : h.associations())
+    {
+        if (a->associated())
+        {
+            H.block(2 * i, 0, 2, 3) = a->Hx;
+            H.block(2 * i, 3 + 2 * i, 2, 2) = a->Hl;
+            R.block(2 * i, 2 * i, 2, 2) = measurements[a->measurement].noise->sigmas().array().square().matrix().asDiagonal();
+            innov.segment(2 * i, 2) = a->error;
+            i++;
+        }
+    }
+    gtsam::Matrix S = H * marginals.jointMarginalCovariance(keys) * H.transpose() + R;
+    return innov.dot(S.llt().solve(innov));
+}
+
+int main(int argc, char **argv)
+{
+    const std::vector<gtsam::Point2> landmarks = {
+        {5.0, 1.0}, {6.0, -2.0}, {3.0, 4.0}, {8.0, 0.5}, {4.0, -3.0}, {7.0, 3.0}};
+    const gtsam::Pose2 x0(0.0, 0.0, 0.0);
+    const gtsam::Pose2 odom(1.0, 0.2, 0.1);
+    const gtsam::Pose2 x1 = x0 * odom;
+
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    gtsam::NonlinearFactorGraph graph;
+    gtsam::Values initial;
+    graph.addPrior(X(0), x0, gtsam::noiseModel::Isotropic::Sigma(3, 1e-3));
+    graph.add(gtsam::BetweenFactor<gtsam::Pose2>(X(0), X(1), odom, gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.1, 0.1, 0.02))));
+    initial.insert(X(0), x0);
+    initial.insert(X(1), x1);
+    for (size_t i = 0; i < landmarks.size(); i++)
+    {
+        graph.add(gtsam::PoseToPointFactor<gtsam::Pose2, gtsam::Point2>(X(0), L(i), x0.transformTo(landmarks[i]), meas_noise));
+        initial.insert(L(i), landmarks[i]);
+    }
+    gtsam::Values estimates = gtsam::GaussNewtonOptimizer(graph, initial).optimize();
+
+    slam::CovarianceRecovery marginals;
+    marginals.update(graph, estimates, 0);
+    const auto registry = slam::KeyRegistry<gtsam::Point2>::fromValues(estimates);
+
+    // Landmarks in shuffled order, then clutter far from every landmark
+    const std::vector<int> observed = {3, 0, 5, 1};
+    gtsam::FastVector<slam::Measurement2D> measurements;
+    for (int l : observed)
+    {
+        measurements.push_back({x1.transformTo(landmarks[l]), 0, meas_noise});
+    }
+    measurements.push_back({gtsam::Point2(-10.0, -10.0), 0, meas_noise});
+
+    int failures = 0;
+
+    da::jcbb::JCBB2D jcbb(0.99, 0.95);
+    da::hypothesis::Hypothesis h = jcbb.associate(estimates, registry, marginals, measurements);
+
+    for (const auto &a : h.associations())
+    {
+        bool clutter = a->measurement == static_cast<int>(observed.size());
+        bool ok = clutter ? !a->associated() : (a->associated() && *a->landmark == L(observed[a->measurement]));
+        if (!ok)
+        {
+            std::cout << "Measurement " << a->measurement << " wrongly "
+                      << (a->associated() ? "associated with " + std::to_string(gtsam::Symbol(*a->landmark).index()) : "unassociated") << "\n";
+            failures++;
+        }
+    }
+
+    double dense_nis = denseNis(h, X(1), marginals, measurements);
+    if (std::abs(dense_nis - h.get_nis()) > 1e-6 * std::max(1.0, dense_nis))
+    {
+        std::cout << "Joint NIS " << h.get_nis() << " differs from dense joint NIS " << dense_nis << "\n";
+        failures++;
+    }
+
+    // Scratch sized by the full hypothesis, then reused for one with fewer associations
+    da::JointCompatibility<gtsam::Pose2, gtsam::Point2> joint_compatibility;
+    double full_nis = joint_compatibility(h, X(1), marginals, measurements);
+    da::hypothesis::Hypothesis h_partial = da::hypothesis::Hypothesis::empty_hypothesis();
+    for (const auto &a : h.associations())
+    {
+        if (a->associated() && h_partial.num_associations() < 2)
+        {
+            h_partial.extend(a);
+        }
+    }
+    double partial_nis = joint_compatibility(h_partial, X(1), marginals, measurements);
+    double dense_partial_nis = denseNis(h_partial, X(1), marginals, measurements);
+    if (std::abs(full_nis - dense_nis) > 1e-6 * std::max(1.0, dense_nis) ||
+        std::abs(partial_nis - dense_partial_nis) > 1e-6 * std::max(1.0, dense_partial_nis))
+    {
+        std::cout << "Reused joint NIS " << full_nis << " and " << partial_nis << ", dense " << dense_nis << " and "
+                  << dense_partial_nis << "\n";
+        failures++;
+    }
+
+    // A budget of one node stops at the root, with no associations made yet
+    da::jcbb::JCBB2D jcbb_budget(0.99, 0.95, std::numeric_limits<double>::infinity(), 1);
+    da::hypothesis::Hypothesis h_budget = jcbb_budget.associate(estimates, registry, marginals, measurements);
+    if (!jcbb_budget.outOfBudget() || h_budget.num_measurements() != static_cast<int>(measurements.size()))
+    {
+        std::cout << "Node budget not respected, visited " << jcbb_budget.nodesVisited() << " nodes\n";
+        failures++;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "data_association/gt/KnownDataAssociation.h"
+#include "slam/key_registry.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+
+using gtsam::symbol_shorthand::L;
+
+/*
+ * Drives SLAM with a short fixed-lag window through a scene where new landmarks keep appearing and old ones are
+ * left behind. After every timestep the key registry should hold exactly the poses and landmarks of the active
+ * estimates, in key order, with the same landmark estimates.
+ */
+
+int check(const slam::SLAM2D &slam_sys, const std::string &name, int step)
+{
+    const gtsam::Values &estimates = slam_sys.activeEstimates();
+    const auto expected = slam::KeyRegistry<gtsam::Point2>::fromValues(estimates);
+    const slam::KeyRegistry<gtsam::Point2> &registry = slam_sys.registry();
+
+    int failures = 0;
+    if (registry.poses() != expected.poses() || registry.latestPose() != slam_sys.latestPoseKey())
+    {
+        std::cout << name << ", step " << step << ": registry has " << registry.poses().size() << " poses, estimates "
+                  << expected.poses().size() << "\n";
+        failures++;
+    }
+    if (registry.landmarks() != expected.landmarks())
+    {
+        std::cout << name << ", step " << step << ": registry has " << registry.numLandmarks() << " landmarks, estimates "
+                  << expected.numLandmarks() << "\n";
+        failures++;
+        return failures;
+    }
+    for (size_t i = 0; i < registry.numLandmarks(); i++)
+    {
+        gtsam::Key l = registry.landmarks()[i];
+        if (!registry.landmarkPoints()[i].isApprox(estimates.at<gtsam::Point2>(l)) || registry.landmarkIndex(l) != i)
+        {
+            std::cout << name << ", step " << step << ": landmark " << gtsam::Symbol(l).index() << " out of date\n";
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    const gtsam::Pose2 odom(1.0, 0.0, 0.0);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    // Landmark i sits beside the path at x = i, and is seen from the poses at most two steps away
+    const int num_steps = 15;
+    std::vector<slam::Timestep2D> timesteps;
+    std::map<uint64_t, gtsam::Key> meas_lmk_assos;
+    gtsam::Pose2 x;
+    uint64_t meas_id = 0;
+    for (int step = 0; step < num_steps; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        for (int l = step - 2; l <= step + 2; l++)
+        {
+            if (l >= 0)
+            {
+                meas_lmk_assos[meas_id] = L(l);
+                timestep.measurements.push_back({x.transformTo(gtsam::Point2(l, 2.0)), meas_id++, meas_noise});
+            }
+        }
+        timesteps.push_back(timestep);
+    }
+
+    int failures = 0;
+    for (slam::OptimizationMethod method : {slam::OptimizationMethod::GaussNewton, slam::OptimizationMethod::FixedLag})
+    {
+        std::stringstream name;
+        name << method;
+
+        slam::SLAM2D slam_sys;
+        slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), std::make_shared<da::gt::KnownDataAssociation2D>(meas_lmk_assos),
+                            method, gtsam::Marginals::CHOLESKY, 4.0);
+        failures += check(slam_sys, name.str(), -1);
+        for (const auto &timestep : timesteps)
+        {
+            slam_sys.processTimestep(timestep);
+            failures += check(slam_sys, name.str(), timestep.step);
+        }
+
+        if (method == slam::OptimizationMethod::FixedLag && slam_sys.registry().poses().size() >= static_cast<size_t>(num_steps))
+        {
+            std::cout << name.str() << ": no poses were marginalized out of the window\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+#include <gtsam/geometry/Point2.h>
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "data_association/LandmarkGrid.h"
+#include "slam/key_registry.h"
+
+using gtsam::symbol_shorthand::L;
+
+/*
+ * Every range query of the landmark grid should give exactly the landmarks a brute force loop over all of them
+ * gates, in 2D and 3D, for radii below, at and above the cell size. Besides random landmarks and queries, this covers
+ * landmarks and queries on cell boundaries, landmarks at exactly the radius, negative coordinates, queries around
+ * empty cells and far from everything, and the grid after landmarks have moved across cells or been removed.
+ * A grid can not be made with a cell size that is not positive and finite.
+ */
+
+template <class POINT>
+std::vector<gtsam::Key> bruteForce(const std::vector<std::pair<gtsam::Key, POINT>> &landmarks, const POINT &point, double radius)
+{
+    std::vector<gtsam::Key> keys;
+    for (const auto &[key, p] : landmarks)
+    {
+        if ((p - point).squaredNorm() <= radius * radius)
+        {
+            keys.push_back(key);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    return keys;
+}
+
+template <class POINT>
+int compareQuery(const std::string &name, const da::LandmarkGrid<POINT> &grid, const std::vector<std::pair<gtsam::Key, POINT>> &landmarks,
+                 const POINT &point, double radius)
+{
+    std::vector<gtsam::Key> keys;
+    grid.query(point, radius, keys);
+    std::sort(keys.begin(), keys.end());
+    const std::vector<gtsam::Key> expected = bruteForce(landmarks, point, radius);
+    if (keys != expected)
+    {
+        std::cout << name << ": query at " << point.transpose() << " with radius " << radius << " gave " << keys.size()
+                  << " landmarks, brute force " << expected.size() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+template <class POINT>
+slam::KeyRegistry<POINT> makeRegistry(const std::vector<std::pair<gtsam::Key, POINT>> &landmarks)
+{
+    slam::KeyRegistry<POINT> registry;
+    for (const auto &[key, point] : landmarks)
+    {
+        registry.addLandmark(key, point);
+    }
+    return registry;
+}
+
+template <class POINT>
+int testGrid(const std::string &name)
+{
+    const int dim = POINT::RowsAtCompileTime;
+    const double cell_size = 2.0;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> coordinate(-20.0, 20.0);
+    auto randomPoint = [&]()
+    {
+        POINT p;
+        for (int i = 0; i < dim; i++)
+        {
+            p(i) = coordinate(rng);
+        }
+        return p;
+    };
+
+    std::vector<std::pair<gtsam::Key, POINT>> landmarks;
+    for (size_t i = 0; i < 300; i++)
+    {
+        landmarks.push_back({L(i), randomPoint()});
+    }
+    // On cell boundaries, corners included, on both sides of zero
+    for (double b : {-4.0, -2.0, 0.0, 2.0, 4.0})
+    {
+        landmarks.push_back({L(landmarks.size()), POINT::Constant(b)});
+        POINT p = POINT::Zero();
+        p(0) = b;
+        landmarks.push_back({L(landmarks.size()), p});
+    }
+    // At exactly the radius of the queries at the origin along each axis, exactly representable so gated
+    for (int i = 0; i < dim; i++)
+    {
+        POINT p = POINT::Zero();
+        p(i) = -cell_size;
+        landmarks.push_back({L(landmarks.size()), p});
+    }
+
+    da::LandmarkGrid<POINT> grid(cell_size);
+    grid.update(makeRegistry(landmarks));
+
+    int failures = 0;
+    if (grid.size() != landmarks.size())
+    {
+        std::cout << name << ": grid has " << grid.size() << " landmarks, expected " << landmarks.size() << "\n";
+        failures++;
+    }
+
+    std::vector<POINT> queries;
+    for (int i = 0; i < 200; i++)
+    {
+        queries.push_back(randomPoint());
+    }
+    for (double b : {-2.0, 0.0, 2.0, 1.0, -1e-12, 1e-12})
+    {
+        queries.push_back(POINT::Constant(b));
+    }
+    // Far outside the map, where every cell is empty
+    queries.push_back(POINT::Constant(100.0));
+    queries.push_back(POINT::Constant(-100.0));
+
+    for (double radius : {0.5 * cell_size, cell_size, 2.5 * cell_size})
+    {
+        for (const POINT &q : queries)
+        {
+            failures += compareQuery(name, grid, landmarks, q, radius);
+        }
+    }
+
+    // Move every other landmark, most of them to another cell, and drop every fifth, as an optimization and a
+    // fixed-lag window would
+    std::vector<std::pair<gtsam::Key, POINT>> moved;
+    for (size_t i = 0; i < landmarks.size(); i++)
+    {
+        if (i % 5 == 4)
+        {
+            continue;
+        }
+        POINT p = landmarks[i].second;
+        if (i % 2 == 0)
+        {
+            p += POINT::Constant(0.7 * cell_size);
+        }
+        moved.push_back({landmarks[i].first, p});
+    }
+    grid.update(makeRegistry(moved));
+    if (grid.size() != moved.size())
+    {
+        std::cout << name << ": grid has " << grid.size() << " landmarks after moving and dropping, expected " << moved.size() << "\n";
+        failures++;
+    }
+    for (const POINT &q : queries)
+    {
+        failures += compareQuery(name + ", moved", grid, moved, q, cell_size);
+    }
+
+    // Emptied cells, some of them next to the query, must not leave landmarks behind
+    std::vector<std::pair<gtsam::Key, POINT>> remaining;
+    for (const auto &[key, point] : moved)
+    {
+        if (point.cwiseAbs().maxCoeff() < 3.0 * cell_size)
+        {
+            grid.erase(key);
+        }
+        else
+        {
+            remaining.push_back({key, point});
+        }
+    }
+    for (const POINT &q : queries)
+    {
+        failures += compareQuery(name + ", emptied", grid, remaining, q, cell_size);
+    }
+    failures += compareQuery(name + ", emptied", grid, remaining, POINT(POINT::Zero()), 2.0 * cell_size);
+
+    grid.update(slam::KeyRegistry<POINT>());
+    std::vector<gtsam::Key> keys;
+    grid.query(POINT::Zero(), 30.0, keys);
+    if (grid.size() != 0 || !keys.empty())
+    {
+        std::cout << name << ": " << grid.size() << " landmarks left, and " << keys.size() << " found, after syncing with no landmarks\n";
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = testGrid<gtsam::Point2>("2D") + testGrid<gtsam::Point3>("3D");
+
+    // Cells are found by dividing by the cell size, so it has to be a positive number
+    for (double cell_size : {0.0, -1.0, std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN()})
+    {
+        try
+        {
+            da::LandmarkGrid<gtsam::Point2> grid(cell_size);
+            std::cout << "Grid with cell size " << cell_size << " was made\n";
+            failures++;
+        }
+        catch (const std::invalid_argument &)
+        {
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#include <gtsam/geometry/Point2.h>
+#include <gtsam/geometry/Point3.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "slam/measurement_batch.h"
+#include "slam/types.h"
+
+/*
+ * Noise models with the same information should be interned once, however they were made and whatever the sign of
+ * their zeros, and the variances of each should agree with the model. A batch should give back the measurements it
+ * was assigned, and keep its noise table when assigned the next ones.
+ */
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    // Same information three ways, and one other
+    const gtsam::Matrix3 information = (gtsam::Matrix3() << 4.0, 1.0, 0.0, 1.0, 9.0, 0.5, 0.0, 0.5, 16.0).finished();
+    const gtsam::SharedNoiseModel a = gtsam::noiseModel::Gaussian::Information(information, true);
+    const gtsam::SharedNoiseModel b = gtsam::noiseModel::Gaussian::Information(information, true);
+    const gtsam::SharedNoiseModel c = gtsam::noiseModel::Gaussian::Information(4.0 * information, true);
+
+    slam::NoiseTable<3> table;
+    const uint32_t ia = table.intern(a);
+    if (table.intern(a) != ia || table.intern(b) != ia || table.internInformation(information) != ia)
+    {
+        std::cout << "Same information interned more than once\n";
+        failures++;
+    }
+    if (table.intern(c) == ia || table.size() != 2)
+    {
+        std::cout << table.size() << " noise models interned, expected 2\n";
+        failures++;
+    }
+
+    // The zeros negated, which compare equal to the originals but are stored differently
+    gtsam::Matrix3 negative_zeros = information;
+    negative_zeros(0, 2) = negative_zeros(2, 0) = -0.0;
+    if (table.internInformation(negative_zeros) != ia || table.size() != 2)
+    {
+        std::cout << "Information with negative zeros interned apart from the same with positive zeros\n";
+        failures++;
+    }
+
+    if (!table[ia].variances.isApprox(gtsam::Vector3(a->sigmas().array().square()), 1e-12))
+    {
+        std::cout << "Precomputed variances do not agree with the model\n";
+        failures++;
+    }
+
+    try
+    {
+        table.intern(gtsam::noiseModel::Isotropic::Sigma(2, 0.1));
+        std::cout << "Noise of another dimension was interned\n";
+        failures++;
+    }
+    catch (const std::invalid_argument &)
+    {
+    }
+
+    slam::Measurements<gtsam::Point3> measurements;
+    for (uint64_t i = 0; i < 10; i++)
+    {
+        measurements.push_back({gtsam::Point3(i, 2.0 * i, -1.0 * i), 100 + i, i % 3 == 0 ? c : (i % 2 == 0 ? a : b)});
+    }
+    slam::MeasurementBatch3D batch(measurements);
+    if (batch.size() != measurements.size() || batch.noiseTable().size() != 2)
+    {
+        std::cout << "Batch of " << batch.size() << " measurements with " << batch.noiseTable().size() << " noise models\n";
+        failures++;
+    }
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+        const slam::Measurement3D measurement = batch.measurement(i);
+        if (measurement.measurement != measurements[i].measurement || measurement.idx != measurements[i].idx ||
+            batch.coordinate(1)[i] != measurements[i].measurement.y() ||
+            !batch.noise(i).information.isApprox(boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(measurements[i].noise)->information(), 1e-9))
+        {
+            std::cout << "Measurement " << i << " differs in the batch\n";
+            failures++;
+        }
+    }
+
+    measurements.resize(3);
+    batch.assign(measurements);
+    if (batch.size() != 3 || batch.noiseTable().size() != 2 || batch.id(2) != 102)
+    {
+        std::cout << "Reassigned batch has " << batch.size() << " measurements and " << batch.noiseTable().size() << " noise models\n";
+        failures++;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
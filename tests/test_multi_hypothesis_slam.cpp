@@ -0,0 +1,140 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/slam/BetweenFactor.h>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "data_association/ml/MaximumLikelihood.h"
+#include "slam/factor_chain.h"
+#include "slam/multi_hypothesis_slam.h"
+#include "slam/types.h"
+
+using gtsam::symbol_shorthand::L;
+using gtsam::symbol_shorthand::X;
+
+/*
+ * Drives multi-hypothesis SLAM through a small 2D scene where every landmark is seen at the first pose and then
+ * reobserved, in shuffled order, from the following poses. The best branch should associate every reobservation
+ * correctly, while the branches together store far fewer factors than separate copies of each branch graph would.
+ */
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+
+    // Copies share sealed factors, and only add what they append themselves
+    {
+        auto noise = gtsam::noiseModel::Isotropic::Sigma(3, 0.1);
+        slam::FactorChain chain;
+        for (int i = 0; i < 100; i++)
+        {
+            chain.add(gtsam::BetweenFactor<gtsam::Pose2>(X(i), X(i + 1), gtsam::Pose2(1.0, 0.0, 0.0), noise));
+        }
+        chain.seal();
+        slam::FactorChain a = chain;
+        slam::FactorChain b = chain;
+        a.add(gtsam::BetweenFactor<gtsam::Pose2>(X(100), X(101), gtsam::Pose2(1.0, 0.0, 0.0), noise));
+        b.add(gtsam::BetweenFactor<gtsam::Pose2>(X(100), X(102), gtsam::Pose2(1.0, 0.0, 0.0), noise));
+
+        std::unordered_set<const void *> segments;
+        size_t stored = chain.collectSegments(segments) + a.collectSegments(segments) + b.collectSegments(segments);
+        if (stored != 102 || a.size() != 101 || b.graph().size() != 101 || b.graph().back()->keys().back() != X(102))
+        {
+            std::cout << "Factor chain stored " << stored << " factors, expected 102\n";
+            failures++;
+        }
+    }
+
+    const std::vector<gtsam::Point2> landmarks = {
+        {5.0, 1.0}, {6.0, -2.0}, {3.0, 4.0}, {8.0, 0.5}, {4.0, -3.0}, {7.0, 3.0}};
+    const gtsam::Pose2 odom(0.5, 0.0, 0.05);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    std::vector<slam::Timestep2D> timesteps;
+    gtsam::Pose2 x;
+    const int num_steps = 8;
+    for (int step = 0; step < num_steps; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        for (size_t i = 0; i < landmarks.size(); i++)
+        {
+            // Rotate the order every step, so the measurement index says nothing about the landmark
+            size_t l = (i + step) % landmarks.size();
+            timestep.measurements.push_back({x.transformTo(landmarks[l]), l, meas_noise});
+        }
+        timesteps.push_back(timestep);
+    }
+
+    const double ic_prob = 0.99;
+    const double sigmas = std::sqrt(da::chi2inv(ic_prob, 2));
+    const int max_branches = 4;
+    auto data_asso = std::make_shared<da::ml::MaximumLikelihood2D>(sigmas);
+
+    slam::MultiHypothesisSLAM2D slam_sys;
+    slam_sys.initialize(gtsam::Vector3(1e-3, 1e-3, 1e-4), data_asso, max_branches, 3, slam::BranchScore::NegativeLogLikelihood, sigmas * sigmas);
+
+    for (const auto &timestep : timesteps)
+    {
+        slam_sys.processTimestep(timestep);
+
+        if (slam_sys.branches().size() > static_cast<size_t>(max_branches))
+        {
+            std::cout << "Step " << timestep.step << " kept " << slam_sys.branches().size() << " branches\n";
+            failures++;
+        }
+
+        // The first step initializes landmark i from measurement i, later steps should reobserve them
+        for (const auto &a : slam_sys.latestHypothesis().associations())
+        {
+            gtsam::Key expected = L(timestep.measurements[a->measurement].idx);
+            bool ok = timestep.step == 0 ? !a->associated() : (a->associated() && *a->landmark == expected);
+            if (!ok)
+            {
+                std::cout << "Step " << timestep.step << ", measurement " << a->measurement << " wrongly "
+                          << (a->associated() ? "associated with " + std::to_string(gtsam::Symbol(*a->landmark).index()) : "unassociated") << "\n";
+                failures++;
+            }
+        }
+    }
+
+    if (slam_sys.branches().size() < 2)
+    {
+        std::cout << "Expected several branches, got " << slam_sys.branches().size() << "\n";
+        failures++;
+    }
+
+    size_t separate = 0;
+    for (const auto &branch : slam_sys.branches())
+    {
+        separate += branch.graph.size();
+    }
+    // The prior, the first measurements and the first odometry are in one segment shared by every branch
+    size_t shared = 1 + landmarks.size() + 1;
+    size_t stored = slam_sys.storedFactors();
+    if (stored > separate - (slam_sys.branches().size() - 1) * shared)
+    {
+        std::cout << "Stored " << stored << " factors, separate graphs would have " << separate << "\n";
+        failures++;
+    }
+
+    double error = slam_sys.error();
+    if (!(error < 1e-6))
+    {
+        std::cout << "Best branch has error " << error << " on noise free data\n";
+        failures++;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "data_association/Murty.h"
+#include "data_association/SparseAssignment.h"
+
+/*
+ * Compares the k best assignments from Murty's method with brute force enumeration of every assignment,
+ * on small random problems shaped like the ones MaximumLikelihood makes.
+ */
+
+std::vector<double> all_assignment_costs(const da::SparseCostMatrix &costs, double unassigned_cost)
+{
+    std::vector<double> all;
+    std::vector<bool> used(costs.cols(), false);
+    std::function<void(int, double)> enumerate = [&](int i, double cost)
+    {
+        if (i == costs.rows())
+        {
+            all.push_back(cost);
+            return;
+        }
+        enumerate(i + 1, cost + unassigned_cost);
+        for (int idx = costs.rowBegin(i); idx < costs.rowEnd(i); idx++)
+        {
+            int j = costs.col(idx);
+            if (!used[j])
+            {
+                used[j] = true;
+                enumerate(i + 1, cost + costs.cost(idx));
+                used[j] = false;
+            }
+        }
+    };
+    enumerate(0, 0.0);
+    std::sort(all.begin(), all.end());
+    return all;
+}
+
+int main(int argc, char **argv)
+{
+    const double unassigned_cost = 10.0;
+    const int k = 25;
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> uniform_cost(0.0, 15.0);
+    std::uniform_int_distribution<int> uniform_size(1, 6);
+    std::bernoulli_distribution feasible(0.4);
+
+    int failures = 0;
+    for (int problem = 0; problem < 300; problem++)
+    {
+        int num_meas = uniform_size(rng);
+        int num_lmks = uniform_size(rng);
+
+        std::vector<da::SparseCostMatrix::Entry> entries;
+        for (int m = 0; m < num_meas; m++)
+        {
+            for (int l = 0; l < num_lmks; l++)
+            {
+                if (feasible(rng))
+                {
+                    entries.push_back({m, l, uniform_cost(rng)});
+                }
+            }
+        }
+        da::SparseCostMatrix costs(num_meas, num_lmks, entries);
+
+        std::vector<double> expected = all_assignment_costs(costs, unassigned_cost);
+        expected.resize(std::min<size_t>(expected.size(), k));
+
+        std::vector<da::RankedAssignment> ranked = da::murty(costs, unassigned_cost, k);
+
+        // Every assignment distinct and valid, with the reported cost
+        std::set<std::vector<int>> distinct;
+        bool valid = ranked.size() == expected.size();
+        for (const da::RankedAssignment &r : ranked)
+        {
+            distinct.insert(r.assignment);
+            std::vector<bool> used(num_lmks, false);
+            double cost = 0.0;
+            for (int m = 0; m < num_meas; m++)
+            {
+                int l = r.assignment[m];
+                if (l == -1)
+                {
+                    cost += unassigned_cost;
+                    continue;
+                }
+                bool found = false;
+                for (int idx = costs.rowBegin(m); idx < costs.rowEnd(m); idx++)
+                {
+                    if (costs.col(idx) == l)
+                    {
+                        cost += costs.cost(idx);
+                        found = true;
+                    }
+                }
+                valid = valid && found && !used[l];
+                used[l] = true;
+            }
+            valid = valid && std::abs(cost - r.cost) < 1e-9;
+        }
+        valid = valid && distinct.size() == ranked.size();
+
+        for (size_t i = 0; valid && i < expected.size(); i++)
+        {
+            valid = std::abs(ranked[i].cost - expected[i]) < 1e-9;
+        }
+
+        if (!valid)
+        {
+            std::cout << "Problem " << problem << " (" << num_meas << " x " << num_lmks << "): got " << ranked.size()
+                      << " assignments, expected " << expected.size() << "\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/inference/Symbol.h>
+
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "data_association/ml/MaximumLikelihood.h"
+#include "slam/slam.h"
+#include "slam/types.h"
+
+/*
+ * Runs a small 2D scene, with measurements only every other timestep, through SLAM with each optimization policy.
+ * Optimizing only on measurement steps should associate the same and end at the same estimate as optimizing always,
+ * with roughly half the optimizations. The lazier policies should optimize less still, and reach the same estimate
+ * once the pending factors are optimized. With iSAM2 the same should hold, with the factors only pushed to the Bayes
+ * tree for covariance recovery between optimizations rather than optimized.
+ */
+
+int main(int argc, char **argv)
+{
+    const std::vector<gtsam::Point2> landmarks = {
+        {5.0, 1.0}, {6.0, -2.0}, {3.0, 4.0}, {8.0, 0.5}, {4.0, -3.0}, {7.0, 3.0}};
+    const gtsam::Pose2 odom(0.5, 0.0, 0.05);
+    auto odom_noise = gtsam::noiseModel::Diagonal::Sigmas(gtsam::Vector3(0.05, 0.05, 0.01));
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(2, 0.1);
+
+    std::vector<slam::Timestep2D> timesteps;
+    gtsam::Pose2 x;
+    for (int step = 0; step < 20; step++)
+    {
+        if (step > 0)
+        {
+            x = x * odom;
+        }
+        slam::Timestep2D timestep;
+        timestep.step = step;
+        timestep.odom = {odom, odom_noise};
+        if (step % 2 == 0)
+        {
+            for (size_t l = 0; l < landmarks.size(); l++)
+            {
+                timestep.measurements.push_back({x.transformTo(landmarks[l]), l, meas_noise});
+            }
+        }
+        timesteps.push_back(timestep);
+    }
+
+    const double sigmas = std::sqrt(da::chi2inv(0.99, 2));
+    const gtsam::Vector3 pose_prior_noise(1e-3, 1e-3, 1e-4);
+
+    auto run = [&](slam::OptimizationMethod method, const slam::OptimizationPolicyParams &params, std::vector<da::hypothesis::Hypothesis> &hypotheses)
+    {
+        auto slam_sys = std::make_unique<slam::SLAM2D>();
+        slam_sys->initialize(pose_prior_noise, std::make_shared<da::ml::MaximumLikelihood2D>(sigmas), method);
+        slam_sys->setOptimizationPolicy(params);
+        for (const auto &timestep : timesteps)
+        {
+            slam_sys->processTimestep(timestep);
+            hypotheses.push_back(slam_sys->latestHypothesis());
+        }
+        slam_sys->optimizePending();
+        return slam_sys;
+    };
+
+    int failures = 0;
+
+    slam::OptimizationPolicyParams measurement_steps;
+    measurement_steps.policy = slam::OptimizationPolicy::MeasurementSteps;
+    slam::OptimizationPolicyParams every_n;
+    every_n.policy = slam::OptimizationPolicy::EveryN;
+    every_n.every_n = 4;
+    slam::OptimizationPolicyParams keyframe;
+    keyframe.policy = slam::OptimizationPolicy::Keyframe;
+    keyframe.keyframe_distance = 1.5;
+    keyframe.keyframe_angle = 1.0;
+    slam::OptimizationPolicyParams error_increase;
+    error_increase.policy = slam::OptimizationPolicy::ErrorIncrease;
+    error_increase.error_increase = 1e-6;
+
+    // Batch optimization recovers covariances from the graph, an incremental backend from its Bayes tree
+    for (slam::OptimizationMethod method : {slam::OptimizationMethod::GaussNewton, slam::OptimizationMethod::ISAM2})
+    {
+        const double tol = method == slam::OptimizationMethod::GaussNewton ? 1e-6 : 1e-4;
+        std::vector<da::hypothesis::Hypothesis> expected;
+        auto always = run(method, slam::OptimizationPolicyParams{}, expected);
+
+        for (const slam::OptimizationPolicyParams &params : {measurement_steps, every_n, keyframe, error_increase})
+        {
+            std::vector<da::hypothesis::Hypothesis> hypotheses;
+            auto slam_sys = run(method, params, hypotheses);
+            std::stringstream ss;
+            ss << method << ", " << params.policy;
+            const std::string name = ss.str();
+
+            size_t max_optimizations = params.policy == slam::OptimizationPolicy::MeasurementSteps
+                                           ? always->numOptimizations() / 2 + 1
+                                           : always->numOptimizations() / 2;
+            std::cout << name << ": " << slam_sys->numOptimizations() << " optimizations, against "
+                      << always->numOptimizations() << " when always optimizing\n";
+            if (slam_sys->numOptimizations() > max_optimizations)
+            {
+                std::cout << name << ": expected at most " << max_optimizations << " optimizations\n";
+                failures++;
+            }
+
+            // Odometry is still pending when measurements come, and only pushed for their covariances
+            const bool incremental = method != slam::OptimizationMethod::GaussNewton;
+            if ((slam_sys->numPushes() > 0) != incremental)
+            {
+                std::cout << name << ": pushed to the Bayes tree " << slam_sys->numPushes() << " times\n";
+                failures++;
+            }
+
+            if (std::abs(slam_sys->error() - always->error()) > tol ||
+                !slam_sys->latestPose().equals(always->latestPose(), tol))
+            {
+                std::cout << name << ": ended at error " << slam_sys->error() << " against " << always->error() << "\n";
+                failures++;
+            }
+
+            // Noise free data is associated right even against estimates that are not optimized yet
+            for (size_t i = 0; i < hypotheses.size(); i++)
+            {
+                for (const auto &a : hypotheses[i].associations())
+                {
+                    bool ok = false;
+                    for (const auto &e : expected[i].associations())
+                    {
+                        if (e->measurement == a->measurement)
+                        {
+                            ok = a->associated() == e->associated() && (!a->associated() || *a->landmark == *e->landmark);
+                        }
+                    }
+                    if (!ok)
+                    {
+                        std::cout << name << ": timestep " << i << ", measurement " << a->measurement << " associated differently\n";
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
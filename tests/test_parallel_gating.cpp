@@ -0,0 +1,155 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/inference/Symbol.h>
+#include <gtsam/nonlinear/GaussNewtonOptimizer.h>
+#include <gtsam/nonlinear/NonlinearFactorGraph.h>
+#include <gtsam/slam/BetweenFactor.h>
+#include <gtsam_unstable/slam/PoseToPointFactor.h>
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "data_association/ml/MaximumLikelihood.h"
+#include "slam/covariance_recovery.h"
+#include "slam/key_registry.h"
+#include "slam/types.h"
+#include "test_utils.h"
+
+using gtsam::symbol_shorthand::L;
+using gtsam::symbol_shorthand::X;
+
+/*
+ * Gates the same measurements with MaximumLikelihood on one thread and on several, in 2D and 3D. Every thread count
+ * should give exactly the associations of the serial run, with the same cost and NIS, and so should the k best
+ * hypotheses. The thread counts split the measurements unevenly, and one exceeds the number of measurements, while
+ * there are always more landmarks than threads and landmarks close enough together to compete for measurements.
+ */
+
+bool sameHypothesis(const da::hypothesis::Hypothesis &a, const da::hypothesis::Hypothesis &b)
+{
+    if (a.associations().size() != b.associations().size() ||
+        std::abs(a.get_cost() - b.get_cost()) > 1e-9 * std::max(1.0, std::abs(a.get_cost())) ||
+        std::abs(a.get_nis() - b.get_nis()) > 1e-9 * std::max(1.0, std::abs(a.get_nis())))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < a.associations().size(); i++)
+    {
+        const auto &aa = a.associations()[i];
+        const auto &ba = b.associations()[i];
+        if (aa->measurement != ba->measurement || aa->associated() != ba->associated() ||
+            (aa->associated() && *aa->landmark != *ba->landmark))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class POSE, class POINT>
+int testThreads(const std::string &name)
+{
+    const size_t dim = POINT::RowsAtCompileTime;
+    const POSE x0 = makePose(0.0, 0.0, 0.0, static_cast<POSE *>(nullptr));
+    const POSE odom = makePose(1.0, 0.2, 0.1, static_cast<POSE *>(nullptr));
+    const POSE x1 = x0 * odom;
+
+    auto meas_noise = gtsam::noiseModel::Isotropic::Sigma(dim, 0.1);
+    auto pose_noise = gtsam::noiseModel::Isotropic::Sigma(POSE::dimension, 0.05);
+
+    // Pairs of landmarks half a metre apart, close enough to both gate the measurements of either
+    std::vector<POINT> landmarks;
+    for (int i = 0; i < 7; i++)
+    {
+        double angle = 0.9 * i;
+        POINT l = makePoint(2.0 + 5.0 * std::cos(angle), 5.0 * std::sin(angle), static_cast<POINT *>(nullptr));
+        landmarks.push_back(l);
+        landmarks.push_back(l + POINT::Constant(0.5 / std::sqrt(static_cast<double>(dim))));
+    }
+
+    gtsam::NonlinearFactorGraph graph;
+    gtsam::Values initial;
+    graph.addPrior(X(0), x0, gtsam::noiseModel::Isotropic::Sigma(POSE::dimension, 1e-3));
+    graph.add(gtsam::BetweenFactor<POSE>(X(0), X(1), odom, pose_noise));
+    initial.insert(X(0), x0);
+    initial.insert(X(1), x1);
+    for (size_t i = 0; i < landmarks.size(); i++)
+    {
+        graph.add(gtsam::PoseToPointFactor<POSE, POINT>(X(0), L(i), x0.transformTo(landmarks[i]), meas_noise));
+        initial.insert(L(i), landmarks[i]);
+    }
+    gtsam::Values estimates = gtsam::GaussNewtonOptimizer(graph, initial).optimize();
+
+    slam::CovarianceRecovery marginals;
+    marginals.update(graph, estimates, 0);
+    const auto registry = slam::KeyRegistry<POINT>::fromValues(estimates);
+
+    // 14 measurements, split unevenly over 3 and 4 threads: most landmarks, a little off, and two of clutter
+    gtsam::FastVector<slam::Measurement<POINT>> measurements;
+    for (size_t l = 0; l < landmarks.size(); l++)
+    {
+        if (l % 5 == 4)
+        {
+            continue;
+        }
+        POINT error = POINT::Constant(0.03 * ((l % 3) - 1.0));
+        measurements.push_back({x1.transformTo(landmarks[l]) + error, l, meas_noise});
+    }
+    measurements.push_back({makePoint(-20.0, -20.0, static_cast<POINT *>(nullptr)), 0, meas_noise});
+    measurements.push_back({makePoint(30.0, 0.0, static_cast<POINT *>(nullptr)), 0, meas_noise});
+
+    const double sigmas = std::sqrt(da::chi2inv(0.99, dim));
+    const int k = 4;
+
+    int failures = 0;
+    // Fewer measurements than threads as well, where some threads get none
+    for (size_t num_measurements : {measurements.size(), size_t(2)})
+    {
+        gtsam::FastVector<slam::Measurement<POINT>> meas(measurements.begin(), measurements.begin() + num_measurements);
+
+        da::ml::MaximumLikelihood<POSE, POINT> serial(sigmas, std::numeric_limits<double>::infinity(), 1);
+        const da::hypothesis::Hypothesis expected = serial.associate(estimates, registry, marginals, meas);
+        const std::vector<da::hypothesis::Hypothesis> expected_k = serial.associate_k_best(estimates, registry, marginals, meas, k);
+
+        for (int num_threads : {2, 3, 4, 16})
+        {
+            da::ml::MaximumLikelihood<POSE, POINT> parallel(sigmas, std::numeric_limits<double>::infinity(), num_threads);
+            // Twice, as the engines of each chunk are reused between calls
+            for (int call = 0; call < 2; call++)
+            {
+                da::hypothesis::Hypothesis h = parallel.associate(estimates, registry, marginals, meas);
+                if (!sameHypothesis(h, expected))
+                {
+                    std::cout << name << ": " << num_threads << " threads, " << num_measurements << " measurements, call " << call
+                              << ": hypothesis with cost " << h.get_cost() << " against " << expected.get_cost() << " serially\n";
+                    failures++;
+                }
+            }
+
+            std::vector<da::hypothesis::Hypothesis> hs = parallel.associate_k_best(estimates, registry, marginals, meas, k);
+            bool same_k = hs.size() == expected_k.size();
+            for (size_t i = 0; same_k && i < hs.size(); i++)
+            {
+                same_k = sameHypothesis(hs[i], expected_k[i]);
+            }
+            if (!same_k)
+            {
+                std::cout << name << ": " << num_threads << " threads, " << num_measurements << " measurements: "
+                          << hs.size() << " best hypotheses differ from the " << expected_k.size() << " found serially\n";
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = testThreads<gtsam::Pose2, gtsam::Point2>("2D") + testThreads<gtsam::Pose3, gtsam::Point3>("3D");
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
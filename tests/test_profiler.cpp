@@ -0,0 +1,173 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/profiler.h"
+
+/*
+ * Zones of known length should be counted once each, over all threads, with percentiles within the 1/8 resolution of
+ * the histograms. Zones of the same name share their statistics, nested zones are timed each on their own, the
+ * trace should hold every zone still in the ring buffers, and reset() should forget them all.
+ */
+
+using Clock = utils::profiler::Clock;
+
+// Busy waits rather than sleeps, so the zone takes as long as asked and not whatever the scheduler makes of it
+void spin(std::chrono::microseconds duration)
+{
+    const Clock::time_point end = Clock::now() + duration;
+    while (Clock::now() < end)
+    {
+    }
+}
+
+void spinZone(std::chrono::microseconds duration)
+{
+    PROFILE_ZONE("test::spin");
+    spin(duration);
+}
+
+void sameNameZone()
+{
+    PROFILE_ZONE("test::spin");
+    spin(std::chrono::microseconds(500));
+}
+
+void nestedZones()
+{
+    PROFILE_ZONE("test::outer");
+    spin(std::chrono::microseconds(100));
+    {
+        PROFILE_ZONE("test::inner");
+        spin(std::chrono::microseconds(100));
+    }
+}
+
+const utils::profiler::ZoneStats *find(const std::vector<utils::profiler::ZoneStats> &stats, const std::string &name)
+{
+    for (const auto &s : stats)
+    {
+        if (s.name == name)
+        {
+            return &s;
+        }
+    }
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    int failures = 0;
+    const std::string trace_file = "test_profiler.trace.json";
+
+    const int spins = 50;
+    const double spin_ms = 0.5;
+    for (int i = 0; i < spins; i++)
+    {
+        spinZone(std::chrono::microseconds(500));
+    }
+    sameNameZone();
+
+    const int threads = 4;
+    const int nested_per_thread = 200;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([]
+                             {
+                               for (int i = 0; i < nested_per_thread; i++)
+                               {
+                                 nestedZones();
+                               } });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+
+    std::vector<utils::profiler::ZoneStats> stats = utils::profiler::summary();
+    utils::profiler::printSummary(std::cout);
+
+    if (stats.size() != 3)
+    {
+        std::cout << stats.size() << " zones in the summary, expected 3\n";
+        failures++;
+    }
+
+    const utils::profiler::ZoneStats *spin_stats = find(stats, "test::spin");
+    if (!spin_stats || spin_stats->count != spins + 1)
+    {
+        std::cout << "Zone of the same name in two places not counted together\n";
+        failures++;
+    }
+    else if (spin_stats->p50 < spin_ms || spin_stats->p50 > spin_ms * 1.25 || spin_stats->p99 < spin_stats->p50 ||
+             spin_stats->max < spin_stats->p99 || spin_stats->total < (spins + 1) * spin_ms)
+    {
+        std::cout << "Spinning " << spin_ms << " ms recorded with p50 " << spin_stats->p50 << " ms, p99 " << spin_stats->p99
+                  << " ms, max " << spin_stats->max << " ms and total " << spin_stats->total << " ms\n";
+        failures++;
+    }
+
+    const utils::profiler::ZoneStats *outer = find(stats, "test::outer");
+    const utils::profiler::ZoneStats *inner = find(stats, "test::inner");
+    if (!outer || !inner || outer->count != threads * nested_per_thread || inner->count != threads * nested_per_thread)
+    {
+        std::cout << "Nested zones on " << threads << " threads not all counted\n";
+        failures++;
+    }
+    else if (outer->total < inner->total + threads * nested_per_thread * 0.1 || inner->p50 < 0.1 || inner->p50 > 0.1 * 1.25)
+    {
+        std::cout << "Outer zone took " << outer->total << " ms in total, inner zone " << inner->total << " ms with p50 " << inner->p50 << " ms\n";
+        failures++;
+    }
+
+    // Every zone fits in the ring buffers, so all of them are in the trace
+    utils::profiler::writeChromeTrace(trace_file);
+    std::ifstream trace(trace_file);
+    const std::string json((std::istreambuf_iterator<char>(trace)), std::istreambuf_iterator<char>());
+    size_t events = 0;
+    for (size_t pos = json.find("\"ph\":\"X\""); pos != std::string::npos; pos = json.find("\"ph\":\"X\"", pos + 1))
+    {
+        events++;
+    }
+    const size_t expected_events = spins + 1 + 2 * threads * nested_per_thread;
+    if (json.rfind("{\"displayTimeUnit\"", 0) != 0 || json.find("\"name\":\"test::inner\"") == std::string::npos || events != expected_events)
+    {
+        std::cout << "Trace has " << events << " events, expected " << expected_events << "\n";
+        failures++;
+    }
+    std::remove(trace_file.c_str());
+
+    try
+    {
+        utils::profiler::writeChromeTrace("/nonexistent/directory/trace.json");
+        std::cout << "Trace written to a directory that does not exist\n";
+        failures++;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    utils::profiler::reset();
+    if (!utils::profiler::summary().empty())
+    {
+        std::cout << "Zones left after reset\n";
+        failures++;
+    }
+    spinZone(std::chrono::microseconds(100));
+    stats = utils::profiler::summary();
+    if (stats.size() != 1 || stats[0].count != 1)
+    {
+        std::cout << "Zone not recorded again after reset\n";
+        failures++;
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+#include <Eigen/Core>
+
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "data_association/DataAssociation.h"
+#include "data_association/SparseAssignment.h"
+
+/*
+ * Compares the sparse assignment solver with the Hungarian method on random problems shaped like the ones
+ * MaximumLikelihood makes: few feasible entries per measurement, and a dummy column per measurement for leaving it unassigned.
+ */
+
+double solution_cost(const Eigen::MatrixXd &dense, const std::vector<int> &assignment)
+{
+    double cost = 0.0;
+    for (int m = 0; m < assignment.size(); m++)
+    {
+        cost += dense(m, assignment[m]);
+    }
+    return cost;
+}
+
+int main(int argc, char **argv)
+{
+    const double unassigned_cost = 10.0;
+    // Finite stand in for infeasible entries, as the Hungarian method can not handle infinities
+    const double infeasible_cost = 1e6;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> uniform_cost(0.0, 15.0);
+    std::uniform_int_distribution<int> uniform_size(1, 30);
+    std::bernoulli_distribution feasible(0.2);
+
+    int failures = 0;
+    for (int problem = 0; problem < 500; problem++)
+    {
+        int num_meas = uniform_size(rng);
+        int num_lmks = uniform_size(rng);
+
+        std::vector<da::SparseCostMatrix::Entry> entries;
+        Eigen::MatrixXd dense = Eigen::MatrixXd::Constant(num_meas, num_lmks + num_meas, infeasible_cost);
+        dense.rightCols(num_meas).diagonal().array() = unassigned_cost;
+
+        for (int m = 0; m < num_meas; m++)
+        {
+            for (int l = 0; l < num_lmks; l++)
+            {
+                if (feasible(rng))
+                {
+                    double c = uniform_cost(rng);
+                    entries.push_back({m, l, c});
+                    dense(m, l) = c;
+                }
+            }
+        }
+
+        da::SparseCostMatrix costs(num_meas, num_lmks, entries);
+        std::vector<int> sparse = da::sparse_assignment(costs, unassigned_cost);
+
+        // Map to the dense columns, checking that no landmark is used twice
+        std::vector<int> sparse_dense(num_meas);
+        std::vector<bool> used(num_lmks, false);
+        bool valid = true;
+        for (int m = 0; m < num_meas; m++)
+        {
+            int l = sparse[m];
+            if (l == -1)
+            {
+                sparse_dense[m] = num_lmks + m;
+                continue;
+            }
+            valid = valid && !used[l] && dense(m, l) < infeasible_cost;
+            used[l] = true;
+            sparse_dense[m] = l;
+        }
+
+        double sparse_cost = solution_cost(dense, sparse_dense);
+        double hungarian_cost = solution_cost(dense, da::hungarian(dense));
+
+        if (!valid || std::abs(sparse_cost - hungarian_cost) > 1e-9)
+        {
+            std::cout << "Problem " << problem << " (" << num_meas << " x " << num_lmks << "): "
+                      << (valid ? "" : "invalid assignment, ")
+                      << "sparse cost " << sparse_cost << ", hungarian cost " << hungarian_cost << "\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "slam/timestep_pack.h"
+#include "slam/timestep_source.h"
+#include "slam/types.h"
+#include "slam/utils_g2o.h"
+#include "test_utils.h"
+
+/*
+ * Every timestep source should give the same timesteps, in the same order, as G2oDataset::timesteps does for the
+ * dataset, and then nothing more: in memory, built from the dataset, decoded from a timestep pack, and read ahead
+ * on another thread. A pack should also give the ground truth, odometry and vertices of the dataset. Read ahead
+ * should hand on an exception of the source once the timesteps before it are taken. Packs of another source file, or
+ * with a corrupt count, should be refused with std::runtime_error.
+ */
+
+template <class POSE, class POINT>
+int compareSource(const std::string &name, slam::TimestepSource<POSE, POINT> &source, const std::vector<slam::Timestep<POSE, POINT>> &expected)
+{
+    int failures = 0;
+    if (source.size() != expected.size())
+    {
+        std::cout << name << ": " << source.size() << " timesteps, expected " << expected.size() << "\n";
+        failures++;
+    }
+    for (const auto &expected_timestep : expected)
+    {
+        std::optional<slam::Timestep<POSE, POINT>> timestep = source.next();
+        if (!timestep)
+        {
+            std::cout << name << ": ended before timestep " << expected_timestep.step << "\n";
+            return failures + 1;
+        }
+        if (timestep->step != expected_timestep.step || !timestep->odom.odom.equals(expected_timestep.odom.odom, 1e-12) ||
+            !sameNoise(timestep->odom.noise, expected_timestep.odom.noise))
+        {
+            std::cout << name << ": timestep " << timestep->step << " has other odometry than timestep " << expected_timestep.step << "\n";
+            failures++;
+        }
+        if (timestep->measurements.size() != expected_timestep.measurements.size())
+        {
+            std::cout << name << ", timestep " << timestep->step << ": " << timestep->measurements.size() << " measurements, expected "
+                      << expected_timestep.measurements.size() << "\n";
+            failures++;
+            continue;
+        }
+        for (size_t i = 0; i < timestep->measurements.size(); i++)
+        {
+            const auto &meas = timestep->measurements[i];
+            const auto &expected_meas = expected_timestep.measurements[i];
+            if (meas.idx != expected_meas.idx || meas.measurement != expected_meas.measurement || !sameNoise(meas.noise, expected_meas.noise))
+            {
+                std::cout << name << ", timestep " << timestep->step << ": measurement " << meas.idx << " differs from "
+                          << expected_meas.idx << "\n";
+                failures++;
+            }
+        }
+    }
+    if (source.next())
+    {
+        std::cout << name << ": more timesteps than expected\n";
+        failures++;
+    }
+    return failures;
+}
+
+template <class POSE, class POINT>
+int compare(const std::string &g2o_file)
+{
+    const std::string pack_file = "test_timestep_source.pack";
+    auto dataset = std::make_shared<const slam::G2oDataset<POSE, POINT>>(slam::readG2oDataset<POSE, POINT>(g2o_file));
+    const std::vector<slam::Timestep<POSE, POINT>> expected = dataset->timesteps();
+    const uint64_t hash = slam::hashFile(g2o_file);
+    slam::saveTimestepPack(pack_file, *dataset, hash);
+
+    int failures = 0;
+    {
+        slam::MemoryTimestepSource<POSE, POINT> source(expected);
+        failures += compareSource(g2o_file + ", in memory", source, expected);
+    }
+    {
+        slam::G2oTimestepSource<POSE, POINT> source(dataset);
+        failures += compareSource(g2o_file + ", from the dataset", source, expected);
+    }
+    {
+        slam::TimestepPackSource<POSE, POINT> source(pack_file, hash);
+        failures += compareSource(g2o_file + ", from the pack", source, expected);
+        if (source.measurementLandmarkAssociations() != dataset->measurementLandmarkAssociations())
+        {
+            std::cout << g2o_file << ": other ground truth landmarks in the pack\n";
+            failures++;
+        }
+        const gtsam::NonlinearFactorGraph odometry = source.odometryGraph();
+        const gtsam::Values initial = source.initialEstimates();
+        if (!initial.equals(dataset->initial) || odometry.size() != dataset->odometry.size() ||
+            std::abs(odometry.error(initial) - dataset->odometryGraph().error(dataset->initial)) > 1e-9)
+        {
+            std::cout << g2o_file << ": other odometry or initial estimates in the pack\n";
+            failures++;
+        }
+    }
+    for (size_t read_ahead : {1, 16})
+    {
+        slam::ReadAheadTimestepSource<POSE, POINT> source(std::make_unique<slam::TimestepPackSource<POSE, POINT>>(pack_file, hash), read_ahead);
+        failures += compareSource(g2o_file + ", read " + std::to_string(read_ahead) + " ahead from the pack", source, expected);
+    }
+    {
+        // Left before reading it all, the reader must stop rather than wait for room forever
+        slam::ReadAheadTimestepSource<POSE, POINT> source(std::make_unique<slam::G2oTimestepSource<POSE, POINT>>(dataset), 2);
+        source.next();
+    }
+
+    try
+    {
+        slam::TimestepPackSource<POSE, POINT> source(pack_file, hash + 1);
+        std::cout << g2o_file << ": pack of another source file was read\n";
+        failures++;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+
+    // A header fine but for a noise model count far more than the file could hold
+    {
+        slam::CheckpointWriter corrupt;
+        corrupt.write(slam::TIMESTEP_PACK_MAGIC);
+        corrupt.write(slam::TIMESTEP_PACK_FORMAT_VERSION);
+        corrupt.write<uint32_t>(POSE::dimension);
+        corrupt.write<uint32_t>(POINT::RowsAtCompileTime);
+        corrupt.write(hash);
+        corrupt.write<uint64_t>(uint64_t(1) << 60);
+        corrupt.save(pack_file);
+    }
+    try
+    {
+        slam::TimestepPackSource<POSE, POINT> source(pack_file, hash);
+        std::cout << g2o_file << ": pack with a corrupt noise model count was read\n";
+        failures++;
+    }
+    catch (const std::runtime_error &)
+    {
+    }
+    std::remove(pack_file.c_str());
+    return failures;
+}
+
+// Gives a few timesteps, then fails
+class FailingSource : public slam::TimestepSource2D
+{
+private:
+    int next_ = 0;
+
+public:
+    std::optional<slam::Timestep2D> next() override
+    {
+        if (next_ == 3)
+        {
+            throw std::runtime_error("Source failed");
+        }
+        slam::Timestep2D timestep;
+        timestep.step = next_++;
+        return timestep;
+    }
+    size_t size() const override { return 5; }
+};
+
+int main(int argc, char **argv)
+{
+    const std::string data_dir = G2O_DATA_DIR;
+
+    int failures = 0;
+    failures += compare<gtsam::Pose2, gtsam::Point2>(data_dir + "/2d/graph_type1.g2o");
+    failures += compare<gtsam::Pose3, gtsam::Point3>(data_dir + "/3d_garage/graph_gczptgyr.g2o");
+
+    slam::ReadAheadTimestepSource<gtsam::Pose2, gtsam::Point2> source(std::make_unique<FailingSource>(), 8);
+    int given = 0;
+    try
+    {
+        while (source.next())
+        {
+            given++;
+        }
+        std::cout << "Read ahead swallowed the exception of its source\n";
+        failures++;
+    }
+    catch (const std::runtime_error &)
+    {
+        if (given != 3)
+        {
+            std::cout << "Read ahead gave " << given << " timesteps before the exception, expected 3\n";
+            failures++;
+        }
+    }
+
+    std::cout << failures << " failures\n";
+    return failures == 0 ? 0 : 1;
+}
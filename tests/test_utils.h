@@ -0,0 +1,64 @@
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <gtsam/geometry/Point2.h>
+#include <gtsam/geometry/Point3.h>
+#include <gtsam/geometry/Pose2.h>
+#include <gtsam/geometry/Pose3.h>
+#include <gtsam/linear/NoiseModel.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+/*
+ * Helpers shared by the tests. Poses and points are made in 2D and 3D from the same arguments, the type picked by
+ * a null pointer tag, e.g. makePose(x, y, theta, static_cast<POSE *>(nullptr)), so scenes are written once for both.
+ */
+
+// Planar in 2D, and in 3D with a little height so the third dimension is not left out
+inline gtsam::Pose2 makePose(double x, double y, double theta, gtsam::Pose2 *) { return gtsam::Pose2(x, y, theta); }
+inline gtsam::Pose3 makePose(double x, double y, double theta, gtsam::Pose3 *)
+{
+    return gtsam::Pose3(gtsam::Rot3::Rz(theta), gtsam::Point3(x, y, 0.02 * theta));
+}
+
+inline gtsam::Point2 makePoint(double x, double y, gtsam::Point2 *) { return gtsam::Point2(x, y); }
+inline gtsam::Point3 makePoint(double x, double y, gtsam::Point3 *) { return gtsam::Point3(x, y, 0.3 * std::cos(x)); }
+
+// Uniformly random position within 5 of the origin, and heading, in 3D with roll and pitch kept small
+inline gtsam::Pose2 randomPose(std::mt19937 &rng, gtsam::Pose2 *)
+{
+    std::uniform_real_distribution<double> u(-5.0, 5.0);
+    return gtsam::Pose2(u(rng), u(rng), u(rng));
+}
+
+inline gtsam::Pose3 randomPose(std::mt19937 &rng, gtsam::Pose3 *)
+{
+    std::uniform_real_distribution<double> u(-5.0, 5.0);
+    return gtsam::Pose3::Expmap((gtsam::Vector6() << 0.3 * u(rng), 0.3 * u(rng), 0.3 * u(rng), u(rng), u(rng), u(rng)).finished());
+}
+
+// Largest difference relative to the largest entry of expected, infinite if the sizes differ
+inline double relativeDifference(const gtsam::Matrix &actual, const gtsam::Matrix &expected)
+{
+    if (actual.rows() != expected.rows() || actual.cols() != expected.cols())
+    {
+        return INFINITY;
+    }
+    return (actual - expected).cwiseAbs().maxCoeff() / std::max(expected.cwiseAbs().maxCoeff(), 1e-12);
+}
+
+// Both Gaussian with the same information, or both missing
+inline bool sameNoise(const gtsam::SharedNoiseModel &lhs, const gtsam::SharedNoiseModel &rhs)
+{
+    if (!lhs || !rhs)
+    {
+        return !lhs && !rhs;
+    }
+    auto lhs_gaussian = boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(lhs);
+    auto rhs_gaussian = boost::dynamic_pointer_cast<gtsam::noiseModel::Gaussian>(rhs);
+    return lhs_gaussian && rhs_gaussian && lhs_gaussian->information().isApprox(rhs_gaussian->information(), 1e-9);
+}
+
+#endif // TEST_UTILS_H